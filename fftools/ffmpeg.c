@@ -63,6 +63,7 @@
 #include "libavutil/time.h"
 #include "libavutil/thread.h"
 #include "libavutil/threadmessage.h"
+#include "libavutil/threadpool.h"
 #include "libavcodec/mathops.h"
 #include "libavformat/os_support.h"
 
@@ -130,11 +131,19 @@ const char *const forced_keyframes_const_names[] = {
     NULL
 };
 
-typedef struct BenchmarkTimeStamps {
-    int64_t real_usec;
-    int64_t user_usec;
-    int64_t sys_usec;
-} BenchmarkTimeStamps;
+/* a filtered frame on its way to the encoder */
+typedef struct EncodeMessage {
+    AVFrame *frame;         /* NULL when flushing the video sync code */
+    double sync_ipts;       /* frame pts in encoder time base, full precision */
+    AVRational frame_rate;  /* frame rate of the buffersink */
+    int round;              /* reap_filters() call that sent the frame */
+} EncodeMessage;
+
+/* a packet returned by an encoder thread, muxed once its round is complete */
+typedef struct EncodedPacket {
+    AVPacket pkt;
+    int round;
+} EncodedPacket;
 
 static void do_video_stats(OutputStream *ost, int frame_size);
 static BenchmarkTimeStamps get_benchmark_time_stamps(void);
@@ -142,9 +151,8 @@ static int64_t getmaxrss(void);
 static int ifilter_has_all_input_formats(FilterGraph *fg);
 
 static int run_as_daemon  = 0;
-static int nb_frames_dup = 0;
-static unsigned dup_warning = 1000;
-static int nb_frames_drop = 0;
+static atomic_int nb_frames_dup = ATOMIC_VAR_INIT(0);
+static atomic_int nb_frames_drop = ATOMIC_VAR_INIT(0);
 static int64_t decode_error_stat[2];
 static unsigned nb_output_dumped = 0;
 
@@ -152,6 +160,7 @@ static int want_sdp = 1;
 
 static BenchmarkTimeStamps current_time;
 AVIOContext *progress_avio = NULL;
+AVIOContext *stats_json_avio = NULL;
 
 static uint8_t *subtitle_out;
 
@@ -177,6 +186,13 @@ static int restore_tty;
 
 #if HAVE_THREADS
 static void free_input_threads(void);
+static void free_encoder_threads(void);
+static OutputStream *current_encoder_thread(void);
+static void wait_encoder_threads(void);
+
+/* number of reap_filters() rounds sent to the encoder threads so far, and the
+ * first round whose packets are not muxed yet */
+static int enc_round, mux_round;
 #endif
 
 /* sub2video hack:
@@ -250,9 +266,11 @@ static void sub2video_push_ref(InputStream *ist, int64_t pts)
     av_assert1(frame->data[0]);
     ist->sub2video.last_pts = frame->pts = pts;
     for (i = 0; i < ist->nb_filters; i++) {
+        int64_t start = stats_clock(ist->stats);
         ret = av_buffersrc_add_frame_flags(ist->filters[i]->filter, frame,
                                            AV_BUFFERSRC_FLAG_KEEP_REF |
                                            AV_BUFFERSRC_FLAG_PUSH);
+        stats_end(ist->stats, STATS_FILTER, start);
         if (ret != AVERROR_EOF && ret < 0)
             av_log(NULL, AV_LOG_WARNING, "Error while add the frame to buffer source(%s).\n",
                    av_err2str(ret));
@@ -537,6 +555,10 @@ static void ffmpeg_cleanup(int ret)
 {
     int i, j;
 
+#if HAVE_THREADS
+    free_encoder_threads();
+#endif
+
     if (do_benchmark) {
         int maxrss = getmaxrss() / 1024;
         av_log(NULL, AV_LOG_INFO, "bench: maxrss=%ikB\n", maxrss);
@@ -621,6 +643,7 @@ static void ffmpeg_cleanup(int ret)
         av_freep(&ost->logfile_prefix);
 
         av_freep(&ost->audio_channels_map);
+        av_freep(&ost->stats);
         ost->audio_channels_mapped = 0;
 
         av_dict_free(&ost->sws_dict);
@@ -658,6 +681,7 @@ static void ffmpeg_cleanup(int ret)
         av_freep(&ist->filters);
         av_freep(&ist->hwaccel_device);
         av_freep(&ist->dts_buffer);
+        av_freep(&ist->stats);
 
         avcodec_free_context(&ist->dec_ctx);
 
@@ -679,6 +703,7 @@ static void ffmpeg_cleanup(int ret)
 
     uninit_opts();
 
+    av_thread_pool_uninit();
     avformat_network_deinit();
 
     if (received_sigterm) {
@@ -718,29 +743,85 @@ static void update_benchmark(const char *fmt, ...)
 {
     if (do_benchmark_all) {
         BenchmarkTimeStamps t = get_benchmark_time_stamps();
+        BenchmarkTimeStamps *last = &current_time;
         va_list va;
         char buf[1024];
 
+#if HAVE_THREADS
+        /* each encoder thread measures from its own previous call */
+        OutputStream *ost = current_encoder_thread();
+        if (ost)
+            last = &ost->enc_thread_time;
+#endif
+
         if (fmt) {
             va_start(va, fmt);
             vsnprintf(buf, sizeof(buf), fmt, va);
             va_end(va);
             av_log(NULL, AV_LOG_INFO,
                    "bench: %8" PRIu64 " user %8" PRIu64 " sys %8" PRIu64 " real %s \n",
-                   t.user_usec - current_time.user_usec,
-                   t.sys_usec - current_time.sys_usec,
-                   t.real_usec - current_time.real_usec, buf);
+                   t.user_usec - last->user_usec,
+                   t.sys_usec - last->sys_usec,
+                   t.real_usec - last->real_usec, buf);
         }
-        current_time = t;
+        *last = t;
     }
 }
 
+/*
+ * The encoder thread of a stream can finish it while the main thread runs,
+ * so ost->finished of such a stream is only accessed under its lock.
+ */
+static OSTFinished output_stream_finished(OutputStream *ost)
+{
+#if HAVE_THREADS
+    if (ost->enc_thread_queue) {
+        OSTFinished finished;
+
+        pthread_mutex_lock(&ost->enc_thread_lock);
+        finished = ost->finished;
+        pthread_mutex_unlock(&ost->enc_thread_lock);
+        return finished;
+    }
+#endif
+    return ost->finished;
+}
+
+static void set_output_stream_finished(OutputStream *ost, OSTFinished finished)
+{
+#if HAVE_THREADS
+    if (ost->enc_thread_queue) {
+        pthread_mutex_lock(&ost->enc_thread_lock);
+        ost->finished |= finished;
+        pthread_mutex_unlock(&ost->enc_thread_lock);
+        return;
+    }
+#endif
+    ost->finished |= finished;
+}
+
+/* the number of frames encoded so far, for the main thread */
+static int output_stream_frame_number(OutputStream *ost)
+{
+#if HAVE_THREADS
+    if (ost->enc_thread_queue) {
+        int frame_number;
+
+        pthread_mutex_lock(&ost->enc_thread_lock);
+        frame_number = ost->enc_thread_frame_number;
+        pthread_mutex_unlock(&ost->enc_thread_lock);
+        return frame_number;
+    }
+#endif
+    return ost->frame_number;
+}
+
 static void close_all_output_streams(OutputStream *ost, OSTFinished this_stream, OSTFinished others)
 {
     int i;
     for (i = 0; i < nb_output_streams; i++) {
         OutputStream *ost2 = output_streams[i];
-        ost2->finished |= ost == ost2 ? this_stream : others;
+        set_output_stream_finished(ost2, ost == ost2 ? this_stream : others);
     }
 }
 
@@ -891,7 +972,7 @@ static void close_output_stream(OutputStream *ost)
 {
     OutputFile *of = output_files[ost->file_index];
 
-    ost->finished |= ENCODER_FINISHED;
+    set_output_stream_finished(ost, ENCODER_FINISHED);
     if (of->shortest) {
         int64_t end = av_rescale_q(ost->sync_opts - ost->first_pts, ost->enc_ctx->time_base, AV_TIME_BASE_Q);
         of->recording_time = FFMIN(of->recording_time, end);
@@ -912,8 +993,11 @@ static void close_output_stream(OutputStream *ost)
 static void output_packet(OutputFile *of, AVPacket *pkt,
                           OutputStream *ost, int eof)
 {
+    int64_t start;
     int ret = 0;
 
+    start = stats_clock(ost->stats);
+
     /* apply the output bitstream filters */
     if (ost->bsf_ctx) {
         ret = av_bsf_send_packet(ost->bsf_ctx, eof ? NULL : pkt);
@@ -927,6 +1011,8 @@ static void output_packet(OutputFile *of, AVPacket *pkt,
         write_packet(of, pkt, ost, 0);
 
 finish:
+    if (!eof)
+        stats_end(ost->stats, STATS_MUX, start);
     if (ret < 0 && ret != AVERROR_EOF) {
         av_log(NULL, AV_LOG_ERROR, "Error applying bitstream filters to an output "
                "packet for stream #%d:%d.\n", ost->file_index, ost->index);
@@ -935,6 +1021,41 @@ finish:
     }
 }
 
+/*
+ * Send a packet returned by the encoder to the output. On an encoder thread,
+ * the packet is queued and muxed by the main thread in mux_encoder_rounds(),
+ * so that the muxer sees the packets in the same order as without threads.
+ */
+static int output_encoded_packet(OutputFile *of, AVPacket *pkt,
+                                 OutputStream *ost)
+{
+#if HAVE_THREADS
+    if (ost->enc_thread_queue) {
+        EncodedPacket tmp = { .round = ost->enc_thread_round };
+        int ret;
+
+        ret = av_packet_make_refcounted(pkt);
+        if (ret < 0)
+            return ret;
+
+        pthread_mutex_lock(&ost->enc_thread_lock);
+        if (!av_fifo_space(ost->enc_thread_pkts)) {
+            ret = av_fifo_grow(ost->enc_thread_pkts, av_fifo_size(ost->enc_thread_pkts));
+            if (ret < 0) {
+                pthread_mutex_unlock(&ost->enc_thread_lock);
+                return ret;
+            }
+        }
+        av_packet_move_ref(&tmp.pkt, pkt);
+        av_fifo_generic_write(ost->enc_thread_pkts, &tmp, sizeof(tmp), NULL);
+        pthread_mutex_unlock(&ost->enc_thread_lock);
+        return 0;
+    }
+#endif
+    output_packet(of, pkt, ost, 0);
+    return 0;
+}
+
 static int check_recording_time(OutputStream *ost)
 {
     OutputFile *of = output_files[ost->file_index];
@@ -1004,6 +1125,12 @@ static int init_output_stream_wrapper(OutputStream *ost, AVFrame *frame,
     if (ost->initialized)
         return 0;
 
+#if HAVE_THREADS
+    /* initializing the stream can write the header and flush the muxing
+     * queues, mux the packets encoded so far first as without threads */
+    wait_encoder_threads();
+#endif
+
     ret = init_output_stream(ost, frame, error, sizeof(error));
     if (ret < 0) {
         av_log(NULL, AV_LOG_ERROR, "Error initializing output stream %d:%d -- %s\n",
@@ -1016,21 +1143,20 @@ static int init_output_stream_wrapper(OutputStream *ost, AVFrame *frame,
     return ret;
 }
 
-static void do_audio_out(OutputFile *of, OutputStream *ost,
-                         AVFrame *frame)
+static int do_audio_out(OutputFile *of, OutputStream *ost,
+                        AVFrame *frame)
 {
     AVCodecContext *enc = ost->enc_ctx;
     AVPacket pkt;
+    int64_t start, enc_time;
     int ret;
 
     av_init_packet(&pkt);
     pkt.data = NULL;
     pkt.size = 0;
 
-    adjust_frame_pts_to_encoder_tb(of, ost, frame);
-
     if (!check_recording_time(ost))
-        return;
+        return 0;
 
     if (frame->pts == AV_NOPTS_VALUE || audio_sync_method < 0)
         frame->pts = ost->sync_opts;
@@ -1047,17 +1173,23 @@ static void do_audio_out(OutputFile *of, OutputStream *ost,
                enc->time_base.num, enc->time_base.den);
     }
 
+    start = stats_clock(ost->stats);
     ret = avcodec_send_frame(enc, frame);
     if (ret < 0)
         goto error;
+    enc_time = stats_clock(ost->stats) - start;
+    stats_count_encoded(ost->stats, 1, 0);
 
     while (1) {
+        start = stats_clock(ost->stats);
         ret = avcodec_receive_packet(enc, &pkt);
+        enc_time += stats_clock(ost->stats) - start;
         if (ret == AVERROR(EAGAIN))
             break;
         if (ret < 0)
             goto error;
 
+        stats_count_encoded(ost->stats, 0, 1);
         update_benchmark("encode_audio %d.%d", ost->file_index, ost->index);
 
         av_packet_rescale_ts(&pkt, enc->time_base, ost->mux_timebase);
@@ -1069,13 +1201,17 @@ static void do_audio_out(OutputFile *of, OutputStream *ost,
                    av_ts2str(pkt.dts), av_ts2timestr(pkt.dts, &enc->time_base));
         }
 
-        output_packet(of, &pkt, ost, 0);
+        ret = output_encoded_packet(of, &pkt, ost);
+        if (ret < 0)
+            goto error;
     }
 
-    return;
+    if (ost->stats)
+        stats_add(ost->stats, STATS_ENCODE, enc_time);
+    return 0;
 error:
     av_log(NULL, AV_LOG_FATAL, "Audio encoding failed\n");
-    exit_program(1);
+    return ret;
 }
 
 static void do_subtitle_out(OutputFile *of,
@@ -1161,29 +1297,37 @@ static void do_subtitle_out(OutputFile *of,
     }
 }
 
-static void do_video_out(OutputFile *of,
-                         OutputStream *ost,
-                         AVFrame *next_picture)
+/**
+ * Encode a filtered video frame, duplicating or dropping it as needed by the
+ * video sync method.
+ *
+ * This does not touch the filtergraph, so that it can run on an encoder
+ * thread; sync_ipts and frame_rate are the values the caller derived from
+ * the buffersink (see prepare_filtered_frame()).
+ *
+ * @return 0 on success, a negative AVERROR if encoding failed
+ */
+static int do_video_out(OutputFile *of,
+                        OutputStream *ost,
+                        AVFrame *next_picture,
+                        double sync_ipts,
+                        AVRational frame_rate)
 {
     int ret, format_video_sync;
     AVPacket pkt;
     AVCodecContext *enc = ost->enc_ctx;
-    AVRational frame_rate;
     int nb_frames, nb0_frames, i;
+    int dup, prev_dup;
+    int64_t warning;
     double delta, delta0;
     double duration = 0;
-    double sync_ipts = AV_NOPTS_VALUE;
     int frame_size = 0;
+    int64_t start, enc_time;
     InputStream *ist = NULL;
-    AVFilterContext *filter = ost->filter->filter;
-
-    init_output_stream_wrapper(ost, next_picture, 1);
-    sync_ipts = adjust_frame_pts_to_encoder_tb(of, ost, next_picture);
 
     if (ost->source_index >= 0)
         ist = input_streams[ost->source_index];
 
-    frame_rate = av_buffersink_get_frame_rate(filter);
     if (frame_rate.num > 0 && frame_rate.den > 0)
         duration = 1/(av_q2d(frame_rate) * av_q2d(enc->time_base));
 
@@ -1287,7 +1431,7 @@ static void do_video_out(OutputFile *of,
     ost->last_nb0_frames[0] = nb0_frames;
 
     if (nb0_frames == 0 && ost->last_dropped) {
-        nb_frames_drop++;
+        atomic_fetch_add(&nb_frames_drop, 1);
         av_log(NULL, AV_LOG_VERBOSE,
                "*** dropping frame %d from stream %d at ts %"PRId64"\n",
                ost->frame_number, ost->st->index, ost->last_frame->pts);
@@ -1295,15 +1439,18 @@ static void do_video_out(OutputFile *of,
     if (nb_frames > (nb0_frames && ost->last_dropped) + (nb_frames > nb0_frames)) {
         if (nb_frames > dts_error_threshold * 30) {
             av_log(NULL, AV_LOG_ERROR, "%d frame duplication too large, skipping\n", nb_frames - 1);
-            nb_frames_drop++;
-            return;
+            atomic_fetch_add(&nb_frames_drop, 1);
+            return 0;
         }
-        nb_frames_dup += nb_frames - (nb0_frames && ost->last_dropped) - (nb_frames > nb0_frames);
+        dup = nb_frames - (nb0_frames && ost->last_dropped) - (nb_frames > nb0_frames);
+        prev_dup = atomic_fetch_add(&nb_frames_dup, dup);
         av_log(NULL, AV_LOG_VERBOSE, "*** %d dup!\n", nb_frames - 1);
-        if (nb_frames_dup > dup_warning) {
-            av_log(NULL, AV_LOG_WARNING, "More than %d frames duplicated\n", dup_warning);
-            dup_warning *= 10;
-        }
+        /* warn when crossing 1000, 10000, ... duplicated frames; the
+         * counter is shared by the encoder threads */
+        for (warning = 1000; warning < prev_dup; warning *= 10)
+            ;
+        if (prev_dup + dup > warning)
+            av_log(NULL, AV_LOG_WARNING, "More than %"PRId64" frames duplicated\n", warning);
     }
     ost->last_dropped = nb_frames == nb0_frames && next_picture;
 
@@ -1322,12 +1469,12 @@ static void do_video_out(OutputFile *of,
             in_picture = next_picture;
 
         if (!in_picture)
-            return;
+            return 0;
 
         in_picture->pts = ost->sync_opts;
 
         if (!check_recording_time(ost))
-            return;
+            return 0;
 
         in_picture->quality = enc->global_quality;
         in_picture->pict_type = 0;
@@ -1386,20 +1533,27 @@ static void do_video_out(OutputFile *of,
 
         ost->frames_encoded++;
 
+        start = stats_clock(ost->stats);
         ret = avcodec_send_frame(enc, in_picture);
         if (ret < 0)
             goto error;
+        enc_time = stats_clock(ost->stats) - start;
+        stats_count_encoded(ost->stats, 1, 0);
         // Make sure Closed Captions will not be duplicated
         av_frame_remove_side_data(in_picture, AV_FRAME_DATA_A53_CC);
 
         while (1) {
+            start = stats_clock(ost->stats);
             ret = avcodec_receive_packet(enc, &pkt);
+            enc_time += stats_clock(ost->stats) - start;
             update_benchmark("encode_video %d.%d", ost->file_index, ost->index);
             if (ret == AVERROR(EAGAIN))
                 break;
             if (ret < 0)
                 goto error;
 
+            stats_count_encoded(ost->stats, 0, 1);
+
             if (debug_ts) {
                 av_log(NULL, AV_LOG_INFO, "encoder -> type:video "
                        "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s\n",
@@ -1420,7 +1574,9 @@ static void do_video_out(OutputFile *of,
             }
 
             frame_size = pkt.size;
-            output_packet(of, &pkt, ost, 0);
+            ret = output_encoded_packet(of, &pkt, ost);
+            if (ret < 0)
+                goto error;
 
 #ifdef LATENCY_PROFILE
             if (out_number < NFRAMES) {
@@ -1433,6 +1589,8 @@ static void do_video_out(OutputFile *of,
                 fprintf(ost->logfile, "%s", enc->stats_out);
             }
         }
+        if (ost->stats)
+            stats_add(ost->stats, STATS_ENCODE, enc_time);
         ost->sync_opts++;
         /*
          * For video, number of frames in == number of packets out.
@@ -1453,10 +1611,10 @@ static void do_video_out(OutputFile *of,
     else
         av_frame_free(&ost->last_frame);
 
-    return;
+    return 0;
 error:
     av_log(NULL, AV_LOG_FATAL, "Video encoding failed\n");
-    exit_program(1);
+    return ret;
 }
 
 static double psnr(double d)
@@ -1521,12 +1679,187 @@ static void finish_output_stream(OutputStream *ost)
 }
 
 /**
- * Get and encode new output from any of the filtergraphs, without causing
- * activity.
+ * Do the filtergraph dependent part of encoding a filtered frame: initialize
+ * the encoder and rescale the frame timestamps to the encoder time base.
+ * This must run on the thread driving the filtergraphs.
  *
- * @return  0 for success, <0 for severe errors
+ * @param frame the filtered frame, or NULL to flush the video sync code
  */
-static int reap_filters(int flush)
+static void prepare_filtered_frame(OutputFile *of, OutputStream *ost,
+                                   AVFrame *frame, EncodeMessage *msg)
+{
+    AVFilterContext *filter = ost->filter->filter;
+
+    msg->frame      = frame;
+    msg->sync_ipts  = AV_NOPTS_VALUE;
+    msg->frame_rate = (AVRational){ 0, 1 };
+
+    if (av_buffersink_get_type(filter) == AVMEDIA_TYPE_VIDEO) {
+        init_output_stream_wrapper(ost, frame, 1);
+        msg->sync_ipts  = adjust_frame_pts_to_encoder_tb(of, ost, frame);
+        msg->frame_rate = av_buffersink_get_frame_rate(filter);
+    } else if (frame) {
+        adjust_frame_pts_to_encoder_tb(of, ost, frame);
+    }
+}
+
+static int encode_filtered_frame(OutputFile *of, OutputStream *ost,
+                                 EncodeMessage *msg)
+{
+    AVCodecContext *enc = ost->enc_ctx;
+    AVFrame *frame = msg->frame;
+
+    switch (enc->codec_type) {
+    case AVMEDIA_TYPE_VIDEO:
+        if (frame && !ost->frame_aspect_ratio.num)
+            enc->sample_aspect_ratio = frame->sample_aspect_ratio;
+
+        return do_video_out(of, ost, frame, msg->sync_ipts, msg->frame_rate);
+    case AVMEDIA_TYPE_AUDIO:
+        if (!(enc->codec->capabilities & AV_CODEC_CAP_PARAM_CHANGE) &&
+            enc->channels != frame->channels) {
+            av_log(NULL, AV_LOG_ERROR,
+                   "Audio filter graph output is not normalized and encoder does not support parameter changes\n");
+            return 0;
+        }
+        return do_audio_out(of, ost, frame);
+    default:
+        av_assert0(0);
+    }
+    return 0;
+}
+
+#if HAVE_THREADS
+static void *encoder_thread(void *arg)
+{
+    OutputStream *ost = arg;
+    OutputFile    *of = output_files[ost->file_index];
+    EncodeMessage msg;
+
+    while (av_thread_message_queue_recv(ost->enc_thread_queue, &msg, 0) >= 0) {
+        int ret = 0, skip;
+
+        pthread_mutex_lock(&ost->enc_thread_lock);
+        ost->enc_thread_round = msg.round;
+        pthread_cond_signal(&ost->enc_thread_cond);
+        /* the stream may have been finished by a frame sent earlier, after
+         * the main thread checked it */
+        skip = ost->enc_thread_ret || (msg.frame && ost->finished);
+        pthread_mutex_unlock(&ost->enc_thread_lock);
+
+        if (!skip)
+            ret = encode_filtered_frame(of, ost, &msg);
+        av_frame_free(&msg.frame);
+
+        pthread_mutex_lock(&ost->enc_thread_lock);
+        if (ret < 0 && !ost->enc_thread_ret)
+            ost->enc_thread_ret = ret;
+        ost->enc_thread_frame_number = ost->frame_number;
+        ost->enc_thread_pending--;
+        pthread_cond_signal(&ost->enc_thread_cond);
+        pthread_mutex_unlock(&ost->enc_thread_lock);
+    }
+
+    return NULL;
+}
+
+/**
+ * Mux the packets the encoder threads returned for the frames sent by the
+ * reap_filters() rounds before end, waiting for the threads to encode them.
+ * The packets are muxed round after round and stream after stream within a
+ * round. This is the order in which they are muxed when the streams are
+ * encoded one after the other on the main thread, so the output does not
+ * depend on the thread timing. Exit if one of the threads failed to encode a
+ * frame.
+ */
+static void mux_encoder_rounds(int end)
+{
+    int i, ret;
+
+    for (; mux_round < end; mux_round++) {
+        for (i = 0; i < nb_output_streams; i++) {
+            OutputStream *ost = output_streams[i];
+            EncodedPacket tmp;
+
+            if (!ost || !ost->enc_thread_queue)
+                continue;
+
+            /* the frames of a stream are encoded in the order of their
+             * rounds, so the round is done once the thread has started on a
+             * later one */
+            pthread_mutex_lock(&ost->enc_thread_lock);
+            while (ost->enc_thread_pending && ost->enc_thread_round <= mux_round)
+                pthread_cond_wait(&ost->enc_thread_cond, &ost->enc_thread_lock);
+            ret = ost->enc_thread_ret;
+
+            while (av_fifo_size(ost->enc_thread_pkts) >= sizeof(tmp)) {
+                av_fifo_generic_peek(ost->enc_thread_pkts, &tmp, sizeof(tmp), NULL);
+                if (tmp.round > mux_round)
+                    break;
+                av_fifo_drain(ost->enc_thread_pkts, sizeof(tmp));
+                pthread_mutex_unlock(&ost->enc_thread_lock);
+                output_packet(output_files[ost->file_index], &tmp.pkt, ost, 0);
+                pthread_mutex_lock(&ost->enc_thread_lock);
+            }
+            pthread_mutex_unlock(&ost->enc_thread_lock);
+
+            if (ret < 0)
+                exit_program(1);
+        }
+    }
+}
+
+/**
+ * Wait until the encoder threads have encoded all the frames sent to them
+ * and mux the packets they returned.
+ */
+static void wait_encoder_threads(void)
+{
+    mux_encoder_rounds(++enc_round);
+}
+#endif
+
+/**
+ * Encode the frame prepared by prepare_filtered_frame(), or hand it over to
+ * the encoder thread of the stream if there is one. The frame data is
+ * consumed in both cases.
+ */
+static int send_filtered_frame(OutputFile *of, OutputStream *ost,
+                               EncodeMessage *msg)
+{
+#if HAVE_THREADS
+    if (ost->enc_thread_queue) {
+        AVFrame *frame = msg->frame;
+        int ret;
+
+        if (frame) {
+            if (!(msg->frame = av_frame_alloc()))
+                return AVERROR(ENOMEM);
+            av_frame_move_ref(msg->frame, frame);
+        }
+
+        msg->round = enc_round;
+        pthread_mutex_lock(&ost->enc_thread_lock);
+        ost->enc_thread_pending++;
+        pthread_mutex_unlock(&ost->enc_thread_lock);
+
+        ret = av_thread_message_queue_send(ost->enc_thread_queue, msg, 0);
+        if (ret < 0) {
+            av_frame_free(&msg->frame);
+            pthread_mutex_lock(&ost->enc_thread_lock);
+            ost->enc_thread_pending--;
+            pthread_mutex_unlock(&ost->enc_thread_lock);
+            return ret;
+        }
+        return 0;
+    }
+#endif
+    if (encode_filtered_frame(of, ost, msg) < 0)
+        exit_program(1);
+    return 0;
+}
+
+static int reap_filtered_frames(int flush)
 {
     AVFrame *filtered_frame = NULL;
     int i;
@@ -1536,8 +1869,7 @@ static int reap_filters(int flush)
         OutputStream *ost = output_streams[i];
         OutputFile    *of = output_files[ost->file_index];
         AVFilterContext *filter;
-        AVCodecContext *enc = ost->enc_ctx;
-        int ret = 0;
+        int finished, ret = 0;
 
         if (!ost->filter || !ost->filter->graph->graph)
             continue;
@@ -1559,8 +1891,11 @@ static int reap_filters(int flush)
             return AVERROR(ENOMEM);
         }
         filtered_frame = ost->filtered_frame;
+        finished = output_stream_finished(ost);
 
         while (1) {
+            EncodeMessage msg;
+
             ret = av_buffersink_get_frame_flags(filter, filtered_frame,
                                                AV_BUFFERSINK_FLAG_NO_REQUEST);
             if (ret < 0) {
@@ -1568,44 +1903,67 @@ static int reap_filters(int flush)
                     av_log(NULL, AV_LOG_WARNING,
                            "Error in av_buffersink_get_frame_flags(): %s\n", av_err2str(ret));
                 } else if (flush && ret == AVERROR_EOF) {
-                    if (av_buffersink_get_type(filter) == AVMEDIA_TYPE_VIDEO)
-                        do_video_out(of, ost, NULL);
+                    if (av_buffersink_get_type(filter) == AVMEDIA_TYPE_VIDEO) {
+                        prepare_filtered_frame(of, ost, NULL, &msg);
+                        ret = send_filtered_frame(of, ost, &msg);
+                        if (ret < 0)
+                            return ret;
+                    }
                 }
                 break;
             }
-            if (ost->finished) {
+#if HAVE_THREADS
+            /* the encoder thread may still be encoding the previous
+             * frames, it checks ost->finished itself */
+            if (!ost->enc_thread_queue)
+#endif
+                finished = ost->finished;
+            if (finished) {
                 av_frame_unref(filtered_frame);
                 continue;
             }
 
-            switch (av_buffersink_get_type(filter)) {
-            case AVMEDIA_TYPE_VIDEO:
-                if (!ost->frame_aspect_ratio.num)
-                    enc->sample_aspect_ratio = filtered_frame->sample_aspect_ratio;
-
-                do_video_out(of, ost, filtered_frame);
-                break;
-            case AVMEDIA_TYPE_AUDIO:
-                if (!(enc->codec->capabilities & AV_CODEC_CAP_PARAM_CHANGE) &&
-                    enc->channels != filtered_frame->channels) {
-                    av_log(NULL, AV_LOG_ERROR,
-                           "Audio filter graph output is not normalized and encoder does not support parameter changes\n");
-                    break;
-                }
-                do_audio_out(of, ost, filtered_frame);
-                break;
-            default:
+            if (av_buffersink_get_type(filter) != AVMEDIA_TYPE_VIDEO &&
+                av_buffersink_get_type(filter) != AVMEDIA_TYPE_AUDIO) {
                 // TODO support subtitle filters
                 av_assert0(0);
             }
 
+            prepare_filtered_frame(of, ost, filtered_frame, &msg);
+            ret = send_filtered_frame(of, ost, &msg);
             av_frame_unref(filtered_frame);
+            if (ret < 0)
+                return ret;
         }
     }
 
     return 0;
 }
 
+/**
+ * Get and encode new output from any of the filtergraphs, without causing
+ * activity.
+ *
+ * With -output_thread_queue_size, the frames are encoded by the threads of
+ * their output streams while the main thread goes on decoding and filtering.
+ * This only muxes the packets of the previous calls, except when flushing,
+ * which waits for all the frames to be encoded.
+ *
+ * @return  0 for success, <0 for severe errors
+ */
+static int reap_filters(int flush)
+{
+    int ret = reap_filtered_frames(flush);
+
+#if HAVE_THREADS
+    if (flush)
+        wait_encoder_threads();
+    else
+        mux_encoder_rounds(enc_round++);
+#endif
+    return ret;
+}
+
 static void print_final_stats(int64_t total_size)
 {
     uint64_t video_size = 0, audio_size = 0, extra_size = 0, other_size = 0;
@@ -1731,6 +2089,7 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     int64_t total_size;
     AVCodecContext *enc;
     int frame_number, vid, i;
+    int frames_dup, frames_drop;
     double bitrate;
     double speed;
     int64_t pts = INT64_MIN + 1;
@@ -1742,7 +2101,7 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     int ret;
     float t;
 
-    if (!print_stats && !is_last_report && !progress_avio)
+    if (!print_stats && !is_last_report && !progress_avio && !stats_json_avio)
         return;
 
     if (!is_last_report) {
@@ -1782,7 +2141,7 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
         if (!vid && enc->codec_type == AVMEDIA_TYPE_VIDEO) {
             float fps;
 
-            frame_number = ost->frame_number;
+            frame_number = output_stream_frame_number(ost);
             fps = t > 1 ? frame_number / t : 0;
             av_bprintf(&buf, "frame=%5d fps=%3.*f q=%3.1f ",
                      frame_number, fps < 9.95, fps, q);
@@ -1851,7 +2210,7 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
         }
 
         if (is_last_report)
-            nb_frames_drop += ost->last_dropped;
+            atomic_fetch_add(&nb_frames_drop, ost->last_dropped);
     }
 
     secs = FFABS(pts) / AV_TIME_BASE;
@@ -1895,10 +2254,12 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
                    hours_sign, hours, mins, secs, us);
     }
 
-    if (nb_frames_dup || nb_frames_drop)
-        av_bprintf(&buf, " dup=%d drop=%d", nb_frames_dup, nb_frames_drop);
-    av_bprintf(&buf_script, "dup_frames=%d\n", nb_frames_dup);
-    av_bprintf(&buf_script, "drop_frames=%d\n", nb_frames_drop);
+    frames_dup  = atomic_load(&nb_frames_dup);
+    frames_drop = atomic_load(&nb_frames_drop);
+    if (frames_dup || frames_drop)
+        av_bprintf(&buf, " dup=%d drop=%d", frames_dup, frames_drop);
+    av_bprintf(&buf_script, "dup_frames=%d\n", frames_dup);
+    av_bprintf(&buf_script, "drop_frames=%d\n", frames_drop);
 
     if (speed < 0) {
         av_bprintf(&buf, " speed=N/A");
@@ -1933,6 +2294,8 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
         }
     }
 
+    stats_report(is_last_report, timer_start, cur_time);
+
     first_report = 0;
 
     if (is_last_report)
@@ -2045,6 +2408,7 @@ static void flush_encoders(void)
                 output_packet(of, &pkt, ost, 1);
                 break;
             }
+            stats_count_encoded(ost->stats, 0, 1);
             if (ost->finished & MUXER_FINISHED) {
                 av_packet_unref(&pkt);
                 continue;
@@ -2209,6 +2573,8 @@ static int ifilter_has_all_input_formats(FilterGraph *fg)
 static int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame)
 {
     FilterGraph *fg = ifilter->graph;
+    StreamStats *stats = ifilter->ist->stats;
+    int64_t start;
     int need_reinit, ret, i;
 
     /* determine if the parameters for this input changed */
@@ -2273,7 +2639,10 @@ static int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame)
         }
     }
 
+    /* the push runs the filters up to the sinks */
+    start = stats_clock(stats);
     ret = av_buffersrc_add_frame_flags(ifilter->filter, frame, AV_BUFFERSRC_FLAG_PUSH);
+    stats_end(stats, STATS_FILTER, start);
     if (ret < 0) {
         if (ret != AVERROR_EOF)
             av_log(NULL, AV_LOG_ERROR, "Error while filtering: %s\n", av_err2str(ret));
@@ -2364,6 +2733,7 @@ static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output,
 {
     AVFrame *decoded_frame;
     AVCodecContext *avctx = ist->dec_ctx;
+    int64_t start;
     int ret, err = 0;
     AVRational decoded_frame_tb;
 
@@ -2374,7 +2744,9 @@ static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output,
     decoded_frame = ist->decoded_frame;
 
     update_benchmark(NULL);
+    start = stats_clock(ist->stats);
     ret = decode(avctx, decoded_frame, got_output, pkt);
+    stats_end(ist->stats, STATS_DECODE, start);
     update_benchmark("decode_audio %d.%d", ist->file_index, ist->st->index);
     if (ret < 0)
         *decode_failed = 1;
@@ -2428,6 +2800,7 @@ static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output, int64_
     int i, ret = 0, err = 0;
     int64_t best_effort_timestamp;
     int64_t dts = AV_NOPTS_VALUE;
+    int64_t start;
     AVPacket avpkt;
 
     // With fate-indeo3-2, we're getting 0-sized packets before EOF for some
@@ -2459,7 +2832,9 @@ static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output, int64_
     }
 
     update_benchmark(NULL);
+    start = stats_clock(ist->stats);
     ret = decode(ist->dec_ctx, decoded_frame, got_output, pkt ? &avpkt : NULL);
+    stats_end(ist->stats, STATS_DECODE, start);
     update_benchmark("decode_video %d.%d", ist->file_index, ist->st->index);
     if (ret < 0)
         *decode_failed = 1;
@@ -3945,10 +4320,10 @@ static int need_output(void)
         OutputFile *of       = output_files[ost->file_index];
         AVFormatContext *os  = output_files[ost->file_index]->ctx;
 
-        if (ost->finished ||
+        if (output_stream_finished(ost) ||
             (os->pb && avio_tell(os->pb) >= of->limit_filesize))
             continue;
-        if (ost->frame_number >= ost->max_frames) {
+        if (output_stream_frame_number(ost) >= ost->max_frames) {
             int j;
             for (j = 0; j < of->ctx->nb_streams; j++)
                 close_output_stream(output_streams[of->ost_index + j]);
@@ -3980,12 +4355,13 @@ static OutputStream *choose_output(void)
         if (ost->st->cur_dts == AV_NOPTS_VALUE)
             av_log(NULL, AV_LOG_DEBUG,
                 "cur_dts is invalid st:%d (%d) [init:%d i_done:%d finish:%d] (this is harmless if it occurs once at the start per stream)\n",
-                ost->st->index, ost->st->id, ost->initialized, ost->inputs_done, ost->finished);
+                ost->st->index, ost->st->id, ost->initialized, ost->inputs_done,
+                output_stream_finished(ost));
 
         if (!ost->initialized && !ost->inputs_done)
             return ost;
 
-        if (!ost->finished && opts < opts_min) {
+        if (!output_stream_finished(ost) && opts < opts_min) {
             opts_min = opts;
             ost_min  = ost->unavailable ? NULL : ost;
         }
@@ -4118,6 +4494,19 @@ static int check_keyboard_interaction(int64_t cur_time)
     return 0;
 }
 
+/* all the streams of a file have stats or none has */
+static int64_t demux_stats_start(InputFile *f)
+{
+    return f->nb_streams ? stats_clock(input_streams[f->ist_index]->stats) : 0;
+}
+
+static void demux_stats_end(InputFile *f, const AVPacket *pkt, int64_t start)
+{
+    if (pkt->stream_index < f->nb_streams)
+        stats_end(input_streams[f->ist_index + pkt->stream_index]->stats,
+                  STATS_DEMUX, start);
+}
+
 #if HAVE_THREADS
 static void *input_thread(void *arg)
 {
@@ -4126,8 +4515,11 @@ static void *input_thread(void *arg)
     int ret = 0;
 
     while (1) {
+        int64_t start = demux_stats_start(f);
         AVPacket pkt;
         ret = av_read_frame(f->ctx, &pkt);
+        if (ret >= 0)
+            demux_stats_end(f, &pkt, start);
 
         if (ret == AVERROR(EAGAIN)) {
             av_usleep(10000);
@@ -4229,10 +4621,141 @@ static int get_input_packet_mt(InputFile *f, AVPacket *pkt)
                                         f->non_blocking ?
                                         AV_THREAD_MESSAGE_NONBLOCK : 0);
 }
+
+/**
+ * @return the output stream encoded by the calling thread, or NULL when
+ *         called from the main thread
+ */
+static OutputStream *current_encoder_thread(void)
+{
+    int i;
+
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+        if (ost && atomic_load(&ost->enc_thread_started) &&
+            pthread_equal(ost->enc_thread, pthread_self()))
+            return ost;
+    }
+    return NULL;
+}
+
+/**
+ * Stop the encoder thread of a stream.
+ *
+ * @param abort if 0, wait for all the queued frames to be encoded,
+ *              otherwise drop them
+ */
+static void free_encoder_thread(OutputStream *ost, int abort)
+{
+    EncodeMessage msg;
+    EncodedPacket tmp;
+
+    if (!ost || !ost->enc_thread_queue)
+        return;
+    av_thread_message_queue_set_err_recv(ost->enc_thread_queue, AVERROR_EOF);
+    if (abort) {
+        while (av_thread_message_queue_recv(ost->enc_thread_queue, &msg,
+                                            AV_THREAD_MESSAGE_NONBLOCK) >= 0)
+            av_frame_free(&msg.frame);
+    }
+
+    pthread_join(ost->enc_thread, NULL);
+    while (av_thread_message_queue_recv(ost->enc_thread_queue, &msg,
+                                        AV_THREAD_MESSAGE_NONBLOCK) >= 0)
+        av_frame_free(&msg.frame);
+    av_thread_message_queue_free(&ost->enc_thread_queue);
+
+    while (av_fifo_size(ost->enc_thread_pkts) >= sizeof(tmp)) {
+        av_fifo_generic_read(ost->enc_thread_pkts, &tmp, sizeof(tmp), NULL);
+        av_packet_unref(&tmp.pkt);
+    }
+    av_fifo_freep(&ost->enc_thread_pkts);
+    pthread_cond_destroy(&ost->enc_thread_cond);
+    pthread_mutex_destroy(&ost->enc_thread_lock);
+}
+
+static void finish_encoder_threads(void)
+{
+    int i;
+
+    wait_encoder_threads();
+    for (i = 0; i < nb_output_streams; i++)
+        free_encoder_thread(output_streams[i], 0);
+}
+
+static void free_encoder_threads(void)
+{
+    int i;
+
+    for (i = 0; i < nb_output_streams; i++)
+        free_encoder_thread(output_streams[i], 1);
+}
+
+/*
+ * Where an output file ends depends on the relative progress of its streams
+ * with -shortest, -fs and -frames, and -vstats reads the muxer statistics
+ * right after each frame is encoded, so such files are encoded on the main
+ * thread to keep the output identical.
+ */
+static int output_file_can_use_threads(OutputFile *of)
+{
+    int i;
+
+    if (of->shortest || of->limit_filesize != UINT64_MAX || vstats_filename)
+        return 0;
+    for (i = 0; i < of->ctx->nb_streams; i++)
+        if (output_streams[of->ost_index + i]->max_frames != INT64_MAX)
+            return 0;
+    return 1;
+}
+
+static int init_encoder_threads(void)
+{
+    int i, ret;
+
+    if (output_thread_queue_size <= 0)
+        return 0;
+
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+
+        if (!ost->encoding_needed || !ost->filter ||
+            !output_file_can_use_threads(output_files[ost->file_index]))
+            continue;
+
+        ost->enc_thread_pkts = av_fifo_alloc(8 * sizeof(EncodedPacket));
+        if (!ost->enc_thread_pkts)
+            return AVERROR(ENOMEM);
+        ret = av_thread_message_queue_alloc(&ost->enc_thread_queue,
+                                            output_thread_queue_size,
+                                            sizeof(EncodeMessage));
+        if (ret < 0) {
+            av_fifo_freep(&ost->enc_thread_pkts);
+            return ret;
+        }
+        pthread_mutex_init(&ost->enc_thread_lock, NULL);
+        pthread_cond_init(&ost->enc_thread_cond, NULL);
+
+        if ((ret = pthread_create(&ost->enc_thread, NULL, encoder_thread, ost))) {
+            av_log(NULL, AV_LOG_ERROR, "pthread_create failed: %s. Try to increase `ulimit -v` or decrease `ulimit -s`.\n", strerror(ret));
+            av_thread_message_queue_free(&ost->enc_thread_queue);
+            av_fifo_freep(&ost->enc_thread_pkts);
+            pthread_cond_destroy(&ost->enc_thread_cond);
+            pthread_mutex_destroy(&ost->enc_thread_lock);
+            return AVERROR(ret);
+        }
+        atomic_store(&ost->enc_thread_started, 1);
+    }
+
+    return 0;
+}
 #endif
 
 static int get_input_packet(InputFile *f, AVPacket *pkt)
 {
+    int64_t start;
+    int ret;
+
     if (f->rate_emu) {
         int i;
         for (i = 0; i < f->nb_streams; i++) {
@@ -4248,7 +4771,11 @@ static int get_input_packet(InputFile *f, AVPacket *pkt)
     if (f->thread_queue_size)
         return get_input_packet_mt(f, pkt);
 #endif
-    return av_read_frame(f->ctx, pkt);
+    start = demux_stats_start(f);
+    ret = av_read_frame(f->ctx, pkt);
+    if (ret >= 0)
+        demux_stats_end(f, pkt, start);
+    return ret;
 }
 
 static int got_eagain(void)
@@ -4639,19 +5166,25 @@ discard_packet:
 /**
  * Perform a step of transcoding for the specified filter graph.
  *
+ * @param[in]  ost       output stream the step is performed for, the time
+ *                       spent running the filters is accounted to it
  * @param[in]  graph     filter graph to consider
  * @param[out] best_ist  input stream where a frame would allow to continue
  * @return  0 for success, <0 for error
  */
-static int transcode_from_filter(FilterGraph *graph, InputStream **best_ist)
+static int transcode_from_filter(OutputStream *ost, FilterGraph *graph,
+                                 InputStream **best_ist)
 {
     int i, ret;
     int nb_requests, nb_requests_max = 0;
     InputFilter *ifilter;
     InputStream *ist;
+    int64_t start;
 
     *best_ist = NULL;
+    start = stats_clock(ost->stats);
     ret = avfilter_graph_request_oldest(graph->graph);
+    stats_end(ost->stats, STATS_FILTER, start);
     if (ret >= 0)
         return reap_filters(0);
 
@@ -4741,7 +5274,7 @@ static int transcode_step(void)
         if (av_buffersink_get_type(ost->filter->filter) == AVMEDIA_TYPE_AUDIO)
             init_output_stream_wrapper(ost, NULL, 1);
 
-        if ((ret = transcode_from_filter(ost->filter->graph, &ist)) < 0)
+        if ((ret = transcode_from_filter(ost, ost->filter->graph, &ist)) < 0)
             return ret;
         if (!ist)
             return 0;
@@ -4791,6 +5324,8 @@ static int transcode(void)
     ret = transcode_init();
     if (ret < 0)
         goto fail;
+    if ((ret = stats_init()) < 0)
+        goto fail;
 
     if (stdin_interaction) {
         av_log(NULL, AV_LOG_INFO, "Press [q] to stop, [?] for help\n");
@@ -4801,6 +5336,8 @@ static int transcode(void)
 #if HAVE_THREADS
     if ((ret = init_input_threads()) < 0)
         goto fail;
+    if ((ret = init_encoder_threads()) < 0)
+        goto fail;
 #endif
 
     while (!received_sigterm) {
@@ -4837,6 +5374,9 @@ static int transcode(void)
             process_input_packet(ist, NULL, 0);
         }
     }
+#if HAVE_THREADS
+    finish_encoder_threads();
+#endif
     flush_encoders();
 
     term_exit();
@@ -4897,6 +5437,7 @@ static int transcode(void)
  fail:
 #if HAVE_THREADS
     free_input_threads();
+    free_encoder_threads();
 #endif
 
     if (output_streams) {
@@ -5047,6 +5588,15 @@ int main(int argc, char **argv)
                "bench: utime=%0.3fs stime=%0.3fs rtime=%0.3fs\n",
                utime / 1000000.0, stime / 1000000.0, rtime / 1000000.0);
     }
+    if (do_benchmark) {
+        AVThreadPoolStats stats;
+        if (av_thread_pool_get_stats(&stats) >= 0)
+            av_log(NULL, AV_LOG_INFO,
+                   "bench: thread_pool threads=%d batches=%"PRIu64" jobs=%"PRIu64" "
+                   "steals=%"PRIu64" max_queue_depth=%d\n",
+                   stats.nb_threads, stats.nb_batches, stats.nb_jobs,
+                   stats.nb_steals, stats.max_queue_depth);
+    }
     av_log(NULL, AV_LOG_DEBUG, "%"PRIu64" frames successfully decoded, %"PRIu64" decoding errors\n",
            decode_error_stat[0], decode_error_stat[1]);
     if ((decode_error_stat[0] + decode_error_stat[1]) * max_error_rate < decode_error_stat[1])
@@ -21,6 +21,7 @@
 
 #include "config.h"
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <signal.h>
@@ -43,6 +44,7 @@
 #include "libavutil/rational.h"
 #include "libavutil/thread.h"
 #include "libavutil/threadmessage.h"
+#include "libavutil/time.h"
 
 #include "libswresample/swresample.h"
 
@@ -261,6 +263,39 @@ typedef struct InputFilter {
     int eof;
 } InputFilter;
 
+enum StatsStage {
+    STATS_DEMUX,
+    STATS_DECODE,
+    STATS_FILTER,
+    STATS_ENCODE,
+    STATS_MUX,
+    STATS_NB_STAGES,
+};
+
+/* latencies below 16us get one bucket each, then 8 buckets per power of two */
+#define STATS_HIST_SIZE (16 + 36 * 8)
+
+typedef struct StageStats {
+    /* updated only by the thread running the stage */
+    atomic_uint_least64_t count;
+    atomic_uint_least64_t time;             /* total time spent in the stage, in us */
+    atomic_uint_least64_t max;
+    atomic_uint_least64_t hist[STATS_HIST_SIZE];
+
+    /* values at the previous report, only used by the reporting thread */
+    uint64_t last_count;
+    uint64_t last_hist[STATS_HIST_SIZE];
+} StageStats;
+
+/* per-stream statistics written with -stats_json */
+typedef struct StreamStats {
+    StageStats stage[STATS_NB_STAGES];
+
+    /* frames sent to the encoder and packets received from it */
+    atomic_uint_least64_t enc_frames;
+    atomic_uint_least64_t enc_packets;
+} StreamStats;
+
 typedef struct OutputFilter {
     AVFilterContext     *filter;
     struct OutputStream *ost;
@@ -394,6 +429,8 @@ typedef struct InputStream {
     int nb_dts_buffer;
 
     int got_output;
+
+    StreamStats *stats;     /* NULL unless -stats_json is used */
 } InputStream;
 
 typedef struct InputFile {
@@ -441,6 +478,12 @@ enum forced_keyframes_const {
 
 extern const char *const forced_keyframes_const_names[];
 
+typedef struct BenchmarkTimeStamps {
+    int64_t real_usec;
+    int64_t user_usec;
+    int64_t sys_usec;
+} BenchmarkTimeStamps;
+
 typedef enum {
     ENCODER_FINISHED = 1,
     MUXER_FINISHED = 2,
@@ -566,6 +609,23 @@ typedef struct OutputStream {
 
     /* frame encode sum of squared error values */
     int64_t error[4];
+
+#if HAVE_THREADS
+    AVThreadMessageQueue *enc_thread_queue;
+    pthread_t enc_thread;       /* thread encoding this stream */
+    atomic_int enc_thread_started; /* enc_thread is valid */
+    pthread_mutex_t enc_thread_lock;
+    pthread_cond_t enc_thread_cond;
+    int enc_thread_pending;     /* frames sent to the thread and not encoded yet */
+    int enc_thread_ret;         /* first encoding error */
+    int enc_thread_round;       /* round of the frame the thread is encoding */
+    int enc_thread_frame_number; /* frame_number, for the main thread */
+    /* encoded packets waiting to be muxed by the main thread */
+    AVFifoBuffer *enc_thread_pkts;
+    BenchmarkTimeStamps enc_thread_time; /* -benchmark_all reference */
+#endif
+
+    StreamStats *stats;     /* NULL unless -stats_json is used */
 } OutputStream;
 
 typedef struct OutputFile {
@@ -622,11 +682,13 @@ extern int qp_hist;
 extern int stdin_interaction;
 extern int frame_bits_per_raw_sample;
 extern AVIOContext *progress_avio;
+extern AVIOContext *stats_json_avio;
 extern float max_error_rate;
 extern char *videotoolbox_pixfmt;
 
 extern int filter_nbthreads;
 extern int filter_complex_nbthreads;
+extern int output_thread_queue_size;
 extern int vstats_version;
 extern int auto_conversion_filters;
 
@@ -675,4 +737,31 @@ int hw_device_setup_for_filter(FilterGraph *fg);
 
 int hwaccel_decode_init(AVCodecContext *avctx);
 
+int stats_init(void);
+void stats_add(StreamStats *stats, enum StatsStage stage, int64_t time);
+void stats_report(int is_last_report, int64_t timer_start, int64_t cur_time);
+
+/**
+ * Get the current time for timing a stage, or 0 if stats is NULL, so that
+ * the timing costs nothing when -stats_json is not used.
+ */
+static inline int64_t stats_clock(StreamStats *stats)
+{
+    return stats ? av_gettime_relative() : 0;
+}
+
+static inline void stats_end(StreamStats *stats, enum StatsStage stage, int64_t start)
+{
+    if (stats)
+        stats_add(stats, stage, av_gettime_relative() - start);
+}
+
+static inline void stats_count_encoded(StreamStats *stats, int frames, int packets)
+{
+    if (stats) {
+        atomic_fetch_add_explicit(&stats->enc_frames,  frames,  memory_order_relaxed);
+        atomic_fetch_add_explicit(&stats->enc_packets, packets, memory_order_relaxed);
+    }
+}
+
 #endif /* FFTOOLS_FFMPEG_H */
@@ -0,0 +1,260 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Per-stream, per-stage statistics written as one JSON object per line
+ * with -stats_json.
+ *
+ * Every stage of a stream is timed by a single thread, which updates its
+ * counters with relaxed atomics; the main thread reads them when writing a
+ * report. The latency percentiles are computed from a log-linear histogram
+ * with a resolution of about 6%, over the time since the previous report,
+ * or over the whole run for the final report.
+ */
+
+#include "libavutil/bprint.h"
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+
+#include "ffmpeg.h"
+
+static const char *const stage_names[STATS_NB_STAGES] = {
+    [STATS_DEMUX]  = "demux",
+    [STATS_DECODE] = "decode",
+    [STATS_FILTER] = "filter",
+    [STATS_ENCODE] = "encode",
+    [STATS_MUX]    = "mux",
+};
+
+static int64_t last_report_time = -1;
+
+static int hist_index(uint64_t t)
+{
+    int l;
+
+    if (t < 16)
+        return t;
+    t = FFMIN(t, (UINT64_C(1) << 40) - 1);
+    l = t >> 32 ? 32 + av_log2(t >> 32) : av_log2(t);
+    return 16 + (l - 4) * 8 + ((t >> (l - 3)) & 7);
+}
+
+/* center of the range of latencies counted in a bucket */
+static uint64_t hist_value(int i)
+{
+    int l;
+
+    if (i < 16)
+        return i;
+    l = (i - 16) / 8 + 4;
+    return ((uint64_t)(8 + (i - 16) % 8) << (l - 3)) + (UINT64_C(1) << (l - 4));
+}
+
+void stats_add(StreamStats *stats, enum StatsStage stage, int64_t time)
+{
+    StageStats *s = &stats->stage[stage];
+    uint64_t t = FFMAX(time, 0);
+
+    atomic_fetch_add_explicit(&s->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->time, t, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->hist[hist_index(t)], 1, memory_order_relaxed);
+    if (t > atomic_load_explicit(&s->max, memory_order_relaxed))
+        atomic_store_explicit(&s->max, t, memory_order_relaxed);
+}
+
+int stats_init(void)
+{
+    int i;
+
+    if (!stats_json_avio)
+        return 0;
+
+    for (i = 0; i < nb_input_streams; i++)
+        if (!(input_streams[i]->stats = av_mallocz(sizeof(StreamStats))))
+            return AVERROR(ENOMEM);
+    for (i = 0; i < nb_output_streams; i++)
+        if (!(output_streams[i]->stats = av_mallocz(sizeof(StreamStats))))
+            return AVERROR(ENOMEM);
+
+    return 0;
+}
+
+static void print_stage(AVBPrint *bp, StageStats *s, const char *name,
+                        double interval, int since_start)
+{
+    static const int percentiles[] = { 50, 95, 99 };
+    uint64_t hist[STATS_HIST_SIZE];
+    uint64_t count = atomic_load_explicit(&s->count, memory_order_relaxed);
+    uint64_t time  = atomic_load_explicit(&s->time,  memory_order_relaxed);
+    uint64_t max   = atomic_load_explicit(&s->max,   memory_order_relaxed);
+    uint64_t nb = 0, sum = 0;
+    int i, j = 0;
+
+    for (i = 0; i < STATS_HIST_SIZE; i++) {
+        uint64_t v = atomic_load_explicit(&s->hist[i], memory_order_relaxed);
+        hist[i] = since_start ? v : v - s->last_hist[i];
+        s->last_hist[i] = v;
+        nb += hist[i];
+    }
+
+    av_bprintf(bp, "\"%s\":{\"count\":%"PRIu64",\"rate\":%.2f,\"time_us\":%"PRIu64,
+               name, count,
+               interval > 0 ? (count - (since_start ? 0 : s->last_count)) / interval : 0.0,
+               time);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(percentiles); i++) {
+        uint64_t target = (nb * percentiles[i] + 99) / 100;
+
+        while (j < STATS_HIST_SIZE - 1 && sum + hist[j] < target)
+            sum += hist[j++];
+        av_bprintf(bp, ",\"p%d_us\":%"PRIu64, percentiles[i],
+                   nb ? FFMIN(hist_value(j), max) : 0);
+    }
+    av_bprintf(bp, ",\"max_us\":%"PRIu64"}", max);
+
+    s->last_count = count;
+}
+
+static void print_stages(AVBPrint *bp, StreamStats *stats,
+                         enum StatsStage first, enum StatsStage last,
+                         double interval, int since_start)
+{
+    enum StatsStage stage;
+
+    av_bprintf(bp, "\"stages\":{");
+    for (stage = first; stage <= last; stage++) {
+        if (stage != first)
+            av_bprint_chars(bp, ',', 1);
+        print_stage(bp, &stats->stage[stage], stage_names[stage],
+                    interval, since_start);
+    }
+    av_bprint_chars(bp, '}', 1);
+}
+
+static const char *stream_type_string(enum AVMediaType type)
+{
+    const char *str = av_get_media_type_string(type);
+    return str ? str : "unknown";
+}
+
+static int thread_queue_depth(AVThreadMessageQueue *queue)
+{
+    return queue ? FFMAX(av_thread_message_queue_nb_elems(queue), 0) : 0;
+}
+
+static void print_inputs(AVBPrint *bp, double interval, int since_start)
+{
+    int i, j;
+
+    av_bprintf(bp, "\"inputs\":[");
+    for (i = 0; i < nb_input_files; i++) {
+        InputFile *f = input_files[i];
+        int depth = 0;
+
+#if HAVE_THREADS
+        depth = thread_queue_depth(f->in_thread_queue);
+#endif
+        av_bprintf(bp, "%s{\"file\":%d,\"queue_depth\":%d,\"streams\":[",
+                   i ? "," : "", i, depth);
+        for (j = 0; j < f->nb_streams; j++) {
+            InputStream *ist = input_streams[f->ist_index + j];
+
+            av_bprintf(bp, "%s{\"index\":%d,\"type\":\"%s\",", j ? "," : "",
+                       j, stream_type_string(ist->st->codecpar->codec_type));
+            print_stages(bp, ist->stats, STATS_DEMUX, STATS_FILTER,
+                         interval, since_start);
+            av_bprint_chars(bp, '}', 1);
+        }
+        av_bprintf(bp, "]}");
+    }
+    av_bprint_chars(bp, ']', 1);
+}
+
+static void print_outputs(AVBPrint *bp, double interval, int since_start)
+{
+    int i, j = 0;
+
+    av_bprintf(bp, "\"outputs\":[");
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+        StreamStats *stats = ost->stats;
+        int64_t in_encoder;
+        int depth = 0;
+
+        if (!i || ost->file_index != output_streams[i - 1]->file_index) {
+            if (i)
+                av_bprintf(bp, "]},");
+            av_bprintf(bp, "{\"file\":%d,\"streams\":[", ost->file_index);
+            j = 0;
+        }
+
+#if HAVE_THREADS
+        depth = thread_queue_depth(ost->enc_thread_queue);
+#endif
+        in_encoder = atomic_load_explicit(&stats->enc_frames,  memory_order_relaxed) -
+                     atomic_load_explicit(&stats->enc_packets, memory_order_relaxed);
+
+        av_bprintf(bp, "%s{\"index\":%d,\"type\":\"%s\",\"queue_depth\":%d,"
+                   "\"frames_in_flight\":%"PRId64",", j++ ? "," : "", ost->index,
+                   stream_type_string(ost->st->codecpar->codec_type), depth,
+                   depth + FFMAX(in_encoder, 0));
+        print_stages(bp, stats, STATS_FILTER, STATS_MUX, interval, since_start);
+        av_bprint_chars(bp, '}', 1);
+    }
+    if (nb_output_streams)
+        av_bprintf(bp, "]}");
+    av_bprint_chars(bp, ']', 1);
+}
+
+void stats_report(int is_last_report, int64_t timer_start, int64_t cur_time)
+{
+    AVBPrint bp;
+    double interval;
+    int ret;
+
+    if (!stats_json_avio)
+        return;
+
+    if (last_report_time < 0 || is_last_report)
+        last_report_time = timer_start;
+    interval = (cur_time - last_report_time) / 1000000.0;
+    last_report_time = cur_time;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&bp, "{\"time\":%.6f,\"final\":%s,\"interval\":%.6f,",
+               (cur_time - timer_start) / 1000000.0,
+               is_last_report ? "true" : "false", interval);
+    print_inputs(&bp, interval, is_last_report);
+    av_bprint_chars(&bp, ',', 1);
+    print_outputs(&bp, interval, is_last_report);
+    av_bprintf(&bp, "}\n");
+
+    if (av_bprint_is_complete(&bp)) {
+        avio_write(stats_json_avio, bp.str, bp.len);
+        avio_flush(stats_json_avio);
+    }
+    av_bprint_finalize(&bp, NULL);
+
+    if (is_last_report) {
+        if ((ret = avio_closep(&stats_json_avio)) < 0)
+            av_log(NULL, AV_LOG_ERROR,
+                   "Error closing stats_json output, loss of information possible: %s\n",
+                   av_err2str(ret));
+    }
+}
@@ -335,6 +335,26 @@ static int find_next_start_code(const uint8_t *buf, const uint8_t *next_avc)
         return next_avc - buf;
 
     while (buf + i + 3 < next_avc) {
+#if HAVE_FAST_UNALIGNED
+        /* a start code can only begin at a zero byte, skip words without one */
+#if HAVE_FAST_64BIT
+        if (next_avc - buf - i >= 11 &&
+            !((~AV_RN64(buf + i) &
+               (AV_RN64(buf + i) - 0x0101010101010101ULL)) &
+              0x8080808080808080ULL)) {
+            i += 8;
+            continue;
+        }
+#else
+        if (next_avc - buf - i >= 7 &&
+            !((~AV_RN32(buf + i) &
+               (AV_RN32(buf + i) - 0x01010101U)) &
+              0x80808080U)) {
+            i += 4;
+            continue;
+        }
+#endif /* HAVE_FAST_64BIT */
+#endif /* HAVE_FAST_UNALIGNED */
         if (buf[i] == 0 && buf[i + 1] == 0 && buf[i + 2] == 1)
             break;
         i++;
@@ -476,10 +496,24 @@ int ff_h2645_packet_split(H2645Packet *pkt, const uint8_t *buf, int length,
         }
         nal = &pkt->nals[pkt->nb_nals];
 
-        consumed = ff_h2645_extract_rbsp(bc.buffer, extract_length, &pkt->rbsp, nal, small_padding);
+        consumed = ff_h2645_extract_rbsp(bc.buffer, extract_length, &pkt->rbsp, nal, 1);
         if (consumed < 0)
             return consumed;
 
+        /* A NAL without escapes is used in place as long as the rest of the
+         * packet provides the padding the caller asked for, otherwise it
+         * still has to be copied. */
+        if (nal->data == nal->raw_data &&
+            bytestream2_get_bytes_left(&bc) - consumed < padding) {
+            uint8_t *dst = &pkt->rbsp.rbsp_buffer[pkt->rbsp.rbsp_buffer_size];
+
+            memcpy(dst, nal->data, nal->size);
+            memset(dst + nal->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+            nal->data        =
+            nal->rbsp_buffer = dst;
+            pkt->rbsp.rbsp_buffer_size += nal->raw_size;
+        }
+
         if (is_nalff && (extract_length != consumed) && extract_length)
             av_log(logctx, AV_LOG_DEBUG,
                    "NALFF: Consumed only %d bytes instead of %d\n",
@@ -97,7 +97,8 @@ int ff_h2645_extract_rbsp(const uint8_t *src, int length, H2645RBSP *rbsp,
  *
  * If data == raw_data holds true for a NAL unit of the returned pkt, then
  * said NAL unit does not contain any emulation_prevention_three_byte and
- * the data is contained in the input buffer pointed to by buf.
+ * the data is contained in the input buffer pointed to by buf. Unless
+ * small_padding is set, at least MAX_MBPAIR_SIZE bytes of buf follow it.
  * Otherwise, the unescaped data is part of the rbsp_buffer described by the
  * packet's H2645RBSP.
  *
@@ -76,6 +76,7 @@ typedef struct HapContext {
     int tex_rat2;             /* Compression ratio of the second texture */
     const uint8_t *tex_data; /* Compressed texture */
     uint8_t *tex_buf;        /* Buffer for compressed texture */
+    uint8_t *tex_out;        /* Output of the texture compression (encoder only) */
     size_t tex_size;         /* Size of the compressed texture */
 
     size_t max_snappy;       /* Maximum compressed size for snappy buffer */
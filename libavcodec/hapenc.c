@@ -52,21 +52,46 @@ enum HapHeaderLength {
     HAP_HDR_LONG = 8,
 };
 
+static int compress_texture_thread(AVCodecContext *avctx, void *arg,
+                                   int slice, int thread_nb)
+{
+    HapContext *ctx = avctx->priv_data;
+    const AVFrame *f = arg;
+    int w_block = avctx->width  / TEXTURE_BLOCK_W;
+    int h_block = avctx->height / TEXTURE_BLOCK_H;
+    int x, y;
+    int start_slice, end_slice;
+    int base_blocks_per_slice = h_block / ctx->slice_count;
+    int remainder_blocks = h_block % ctx->slice_count;
+
+    /* Spread the remaining block rows evenly between the first slices,
+     * as the decoder does */
+    start_slice = slice * base_blocks_per_slice;
+    start_slice += FFMIN(slice, remainder_blocks);
+
+    end_slice = start_slice + base_blocks_per_slice;
+    if (slice < remainder_blocks)
+        end_slice++;
+
+    for (y = start_slice; y < end_slice; y++) {
+        const uint8_t *p = f->data[0] + y * f->linesize[0] * TEXTURE_BLOCK_H;
+        uint8_t *out     = ctx->tex_out + y * w_block * ctx->tex_rat;
+        for (x = 0; x < w_block; x++)
+            out += ctx->tex_fun(out, f->linesize[0], p + x * 4 * 4);
+    }
+
+    return 0;
+}
+
 static int compress_texture(AVCodecContext *avctx, uint8_t *out, int out_length, const AVFrame *f)
 {
     HapContext *ctx = avctx->priv_data;
-    int i, j;
 
     if (ctx->tex_size > out_length)
         return AVERROR_BUFFER_TOO_SMALL;
 
-    for (j = 0; j < avctx->height; j += 4) {
-        for (i = 0; i < avctx->width; i += 4) {
-            uint8_t *p = f->data[0] + i * 4 + j * f->linesize[0];
-            const int step = ctx->tex_fun(out, f->linesize[0], p);
-            out += step;
-        }
-    }
+    ctx->tex_out = out;
+    avctx->execute2(avctx, compress_texture_thread, (void *)f, NULL, ctx->slice_count);
 
     return 0;
 }
@@ -89,48 +114,66 @@ static void hap_write_section_header(PutByteContext *pbc,
     }
 }
 
+static int compress_chunks_thread(AVCodecContext *avctx, void *arg,
+                                  int chunk_nb, int thread_nb)
+{
+    HapContext *ctx = avctx->priv_data;
+    HapChunk *chunk = &ctx->chunks[chunk_nb];
+    uint8_t *dst = arg;
+    uint8_t *chunk_src, *chunk_dst;
+    int ret;
+
+    /* Every chunk is compressed into its own area of the packet buffer,
+     * the chunks are packed together once they are all done. */
+    chunk->uncompressed_size = ctx->tex_size / ctx->chunk_count;
+    chunk->uncompressed_offset = chunk_nb * chunk->uncompressed_size;
+    chunk->compressed_offset = chunk_nb * ctx->max_snappy;
+    chunk->compressed_size = ctx->max_snappy;
+    chunk_src = ctx->tex_buf + chunk->uncompressed_offset;
+    chunk_dst = dst + chunk->compressed_offset;
+
+    /* Compress with snappy too, write directly on packet buffer. */
+    ret = snappy_compress(chunk_src, chunk->uncompressed_size,
+                          chunk_dst, &chunk->compressed_size);
+    if (ret != SNAPPY_OK) {
+        av_log(avctx, AV_LOG_ERROR, "Snappy compress error.\n");
+        return AVERROR_BUG;
+    }
+
+    /* If there is no gain from snappy, just use the raw texture. */
+    if (chunk->compressed_size >= chunk->uncompressed_size) {
+        av_log(avctx, AV_LOG_VERBOSE,
+               "Snappy buffer bigger than uncompressed (%"SIZE_SPECIFIER" >= %"SIZE_SPECIFIER" bytes).\n",
+               chunk->compressed_size, chunk->uncompressed_size);
+        memcpy(chunk_dst, chunk_src, chunk->uncompressed_size);
+        chunk->compressor = HAP_COMP_NONE;
+        chunk->compressed_size = chunk->uncompressed_size;
+    } else {
+        chunk->compressor = HAP_COMP_SNAPPY;
+    }
+
+    return 0;
+}
+
 static int hap_compress_frame(AVCodecContext *avctx, uint8_t *dst)
 {
     HapContext *ctx = avctx->priv_data;
     int i, final_size = 0;
 
+    avctx->execute2(avctx, compress_chunks_thread, dst,
+                    ctx->chunk_results, ctx->chunk_count);
+
     for (i = 0; i < ctx->chunk_count; i++) {
         HapChunk *chunk = &ctx->chunks[i];
-        uint8_t *chunk_src, *chunk_dst;
-        int ret;
-
-        if (i == 0) {
-            chunk->compressed_offset = 0;
-        } else {
-            chunk->compressed_offset = ctx->chunks[i-1].compressed_offset
-                                       + ctx->chunks[i-1].compressed_size;
-        }
-        chunk->uncompressed_size = ctx->tex_size / ctx->chunk_count;
-        chunk->uncompressed_offset = i * chunk->uncompressed_size;
-        chunk->compressed_size = ctx->max_snappy;
-        chunk_src = ctx->tex_buf + chunk->uncompressed_offset;
-        chunk_dst = dst + chunk->compressed_offset;
-
-        /* Compress with snappy too, write directly on packet buffer. */
-        ret = snappy_compress(chunk_src, chunk->uncompressed_size,
-                              chunk_dst, &chunk->compressed_size);
-        if (ret != SNAPPY_OK) {
-            av_log(avctx, AV_LOG_ERROR, "Snappy compress error.\n");
-            return AVERROR_BUG;
-        }
 
-        /* If there is no gain from snappy, just use the raw texture. */
-        if (chunk->compressed_size >= chunk->uncompressed_size) {
-            av_log(avctx, AV_LOG_VERBOSE,
-                   "Snappy buffer bigger than uncompressed (%"SIZE_SPECIFIER" >= %"SIZE_SPECIFIER" bytes).\n",
-                   chunk->compressed_size, chunk->uncompressed_size);
-            memcpy(chunk_dst, chunk_src, chunk->uncompressed_size);
-            chunk->compressor = HAP_COMP_NONE;
-            chunk->compressed_size = chunk->uncompressed_size;
-        } else {
-            chunk->compressor = HAP_COMP_SNAPPY;
-        }
+        if (ctx->chunk_results[i] < 0)
+            return ctx->chunk_results[i];
 
+        if (chunk->compressed_offset != final_size) {
+            memmove(dst + final_size, dst + chunk->compressed_offset,
+                    chunk->compressed_size);
+            chunk->compressed_offset = final_size;
+        }
         final_size += chunk->compressed_size;
     }
 
@@ -259,18 +302,21 @@ static av_cold int hap_init(AVCodecContext *avctx)
         ratio = 8;
         avctx->codec_tag = MKTAG('H', 'a', 'p', '1');
         avctx->bits_per_coded_sample = 24;
+        ctx->tex_rat = 8;
         ctx->tex_fun = ctx->dxtc.dxt1_block;
         break;
     case HAP_FMT_RGBADXT5:
         ratio = 4;
         avctx->codec_tag = MKTAG('H', 'a', 'p', '5');
         avctx->bits_per_coded_sample = 32;
+        ctx->tex_rat = 16;
         ctx->tex_fun = ctx->dxtc.dxt5_block;
         break;
     case HAP_FMT_YCOCGDXT5:
         ratio = 4;
         avctx->codec_tag = MKTAG('H', 'a', 'p', 'Y');
         avctx->bits_per_coded_sample = 24;
+        ctx->tex_rat = 16;
         ctx->tex_fun = ctx->dxtc.dxt5ys_block;
         break;
     default:
@@ -316,6 +362,9 @@ static av_cold int hap_init(AVCodecContext *avctx)
     if (ret != 0)
         return ret;
 
+    ctx->slice_count = av_clip(avctx->thread_count, 1,
+                               avctx->height / TEXTURE_BLOCK_H);
+
     return 0;
 }
 
@@ -359,6 +408,7 @@ AVCodec ff_hap_encoder = {
     .init           = hap_init,
     .encode2        = hap_encode,
     .close          = hap_close,
+    .capabilities   = AV_CODEC_CAP_SLICE_THREADS,
     .pix_fmts       = (const enum AVPixelFormat[]) {
         AV_PIX_FMT_RGBA, AV_PIX_FMT_NONE,
     },
@@ -30,6 +30,7 @@
 #include "h2645_parse.h"
 #include "internal.h"
 #include "parser.h"
+#include "startcode.h"
 
 #define START_CODE 0x000001 ///< start_code_prefix_one_3bytes
 
@@ -268,6 +269,19 @@ static int hevc_find_frame_end(AVCodecParserContext *s, const uint8_t *buf,
     for (i = 0; i < buf_size; i++) {
         int nut;
 
+        /* A start code needs two zero bytes, so as long as none of the last
+         * four bytes is zero jump to the next zero byte, only keeping the
+         * skipped bytes that end up in state64. */
+        if (!((~(uint32_t)pc->state64 & ((uint32_t)pc->state64 - 0x01010101U)) &
+              0x80808080U)) {
+            int next = FFMIN(i + ff_startcode_find_candidate_c(buf + i, buf_size - i),
+                             buf_size);
+            for (i = FFMAX(i, next - 8); i < next; i++)
+                pc->state64 = (pc->state64 << 8) | buf[i];
+            if (i >= buf_size)
+                break;
+        }
+
         pc->state64 = (pc->state64 << 8) | buf[i];
 
         if (((pc->state64 >> 3 * 8) & 0xFFFFFF) != START_CODE)
@@ -917,8 +917,10 @@ static int hls_slice_header(HEVCContext *s)
                 sh->entry_point_offset[i] = val + 1; // +1; // +1 to get the size
             }
             if (s->threads_number > 1 && (s->ps.pps->num_tile_rows > 1 || s->ps.pps->num_tile_columns > 1)) {
-                s->enable_parallel_tiles = 0; // TODO: you can enable tiles in parallel here
-                s->threads_number = 1;
+                // tiles combined with wavefronts are still decoded serially
+                s->enable_parallel_tiles = !s->ps.pps->entropy_coding_sync_enabled_flag;
+                if (!s->enable_parallel_tiles)
+                    s->threads_number = 1;
             } else
                 s->enable_parallel_tiles = 0;
         } else
@@ -2429,13 +2431,18 @@ static void hls_decode_neighbour(HEVCContext *s, int x_ctb, int y_ctb,
 
     lc->boundary_flags = 0;
     if (s->ps.pps->tiles_enabled_flag) {
+        /* with parallel tiles the neighbouring tile may still be decoding;
+         * the boundary strengths of tile edges are computed afterwards */
+        int parallel_left, parallel_up;
         if (x_ctb > 0 && s->ps.pps->tile_id[ctb_addr_ts] != s->ps.pps->tile_id[s->ps.pps->ctb_addr_rs_to_ts[ctb_addr_rs - 1]])
             lc->boundary_flags |= BOUNDARY_LEFT_TILE;
-        if (x_ctb > 0 && s->tab_slice_address[ctb_addr_rs] != s->tab_slice_address[ctb_addr_rs - 1])
+        parallel_left = s->enable_parallel_tiles && (lc->boundary_flags & BOUNDARY_LEFT_TILE);
+        if (x_ctb > 0 && !parallel_left && s->tab_slice_address[ctb_addr_rs] != s->tab_slice_address[ctb_addr_rs - 1])
             lc->boundary_flags |= BOUNDARY_LEFT_SLICE;
         if (y_ctb > 0 && s->ps.pps->tile_id[ctb_addr_ts] != s->ps.pps->tile_id[s->ps.pps->ctb_addr_rs_to_ts[ctb_addr_rs - s->ps.sps->ctb_width]])
             lc->boundary_flags |= BOUNDARY_UPPER_TILE;
-        if (y_ctb > 0 && s->tab_slice_address[ctb_addr_rs] != s->tab_slice_address[ctb_addr_rs - s->ps.sps->ctb_width])
+        parallel_up = s->enable_parallel_tiles && (lc->boundary_flags & BOUNDARY_UPPER_TILE);
+        if (y_ctb > 0 && !parallel_up && s->tab_slice_address[ctb_addr_rs] != s->tab_slice_address[ctb_addr_rs - s->ps.sps->ctb_width])
             lc->boundary_flags |= BOUNDARY_UPPER_SLICE;
     } else {
         if (ctb_addr_in_slice <= 0)
@@ -2562,6 +2569,11 @@ static int hls_decode_entry_wpp(AVCodecContext *avctxt, void *input_ctb_row, int
         if (ret < 0)
             goto error;
         hls_sao_param(s, x_ctb >> s->ps.sps->log2_ctb_size, y_ctb >> s->ps.sps->log2_ctb_size);
+
+        s->deblock[ctb_addr_rs].beta_offset = s->sh.beta_offset;
+        s->deblock[ctb_addr_rs].tc_offset   = s->sh.tc_offset;
+        s->filter_slice_edges[ctb_addr_rs]  = s->sh.slice_loop_filter_across_slices_enabled_flag;
+
         more_data = hls_coding_quadtree(s, x_ctb, y_ctb, s->ps.sps->log2_ctb_size, 0);
 
         if (more_data < 0) {
@@ -2603,6 +2615,173 @@ error:
     return ret;
 }
 
+typedef struct HEVCTileJob {
+    int tile;   ///< index of the tile decoded by the job
+    int thread; ///< slice thread the job was run on
+} HEVCTileJob;
+
+static int hls_decode_entry_tile(AVCodecContext *avctxt, void *input_jobs, int job, int self_id)
+{
+    HEVCContext *s1  = avctxt->priv_data, *s;
+    HEVCLocalContext *lc;
+    const HEVCPPS *pps;
+    HEVCTileJob *jobs = input_jobs;
+    int tile        = jobs[job].tile;
+    int more_data   = 1;
+    int ctb_addr_rs, ctb_addr_ts;
+    int ret;
+
+    s   = s1->sList[self_id];
+    lc  = s->HEVClc;
+    pps = s->ps.pps;
+    jobs[job].thread = self_id;
+
+    if (job) {
+        int tile_x = tile % pps->num_tile_columns;
+        int tile_y = tile / pps->num_tile_columns;
+
+        ctb_addr_rs = pps->row_bd[tile_y] * s->ps.sps->ctb_width + pps->col_bd[tile_x];
+        ctb_addr_ts = pps->ctb_addr_rs_to_ts[ctb_addr_rs];
+        ret = init_get_bits8(&lc->gb, s->data + s->sh.offset[job - 1], s->sh.size[job - 1]);
+        if (ret < 0)
+            goto error;
+    } else {
+        ctb_addr_rs = s->sh.slice_ctb_addr_rs;
+        ctb_addr_ts = pps->ctb_addr_rs_to_ts[ctb_addr_rs];
+    }
+
+    while (more_data && ctb_addr_ts < s->ps.sps->ctb_size &&
+           pps->tile_id[ctb_addr_ts] == tile) {
+        int x_ctb, y_ctb;
+
+        ctb_addr_rs = pps->ctb_addr_ts_to_rs[ctb_addr_ts];
+        x_ctb = (ctb_addr_rs % s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+        y_ctb = (ctb_addr_rs / s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+        hls_decode_neighbour(s, x_ctb, y_ctb, ctb_addr_ts);
+
+        ret = ff_hevc_cabac_init(s, ctb_addr_ts, 0);
+        if (ret < 0)
+            goto error;
+
+        hls_sao_param(s, x_ctb >> s->ps.sps->log2_ctb_size, y_ctb >> s->ps.sps->log2_ctb_size);
+
+        s->deblock[ctb_addr_rs].beta_offset = s->sh.beta_offset;
+        s->deblock[ctb_addr_rs].tc_offset   = s->sh.tc_offset;
+        s->filter_slice_edges[ctb_addr_rs]  = s->sh.slice_loop_filter_across_slices_enabled_flag;
+
+        more_data = hls_coding_quadtree(s, x_ctb, y_ctb, s->ps.sps->log2_ctb_size, 0);
+        if (more_data < 0) {
+            ret = more_data;
+            goto error;
+        }
+
+        ctb_addr_ts++;
+    }
+
+    // every tile but the last one of the slice segment must end with its tile
+    if (more_data != (job < s->sh.num_entry_point_offsets) &&
+        ctb_addr_ts < s->ps.sps->ctb_size) {
+        av_log(s->avctx, AV_LOG_ERROR, "Tile %d does not match the entry points.\n", tile);
+        return AVERROR_INVALIDDATA;
+    }
+
+    return ctb_addr_ts;
+error:
+    s->tab_slice_address[ctb_addr_rs] = -1;
+    return ret;
+}
+
+/**
+ * Decode the tiles of a slice segment in parallel, one job per entry point,
+ * then run the in-loop filters on the decoded CTBs in tile scan order, as
+ * hls_decode_entry() does. SAO reads samples that the deblocking of later
+ * CTBs still modifies, so any other order changes the output.
+ */
+static int hls_slice_data_tiles(HEVCContext *s, int *ret)
+{
+    const HEVCPPS *pps = s->ps.pps;
+    HEVCTileJob *jobs;
+    int ctb_size    = 1 << s->ps.sps->log2_ctb_size;
+    int nb_jobs     = s->sh.num_entry_point_offsets + 1;
+    int start_ts    = pps->ctb_addr_rs_to_ts[s->sh.slice_ctb_addr_rs];
+    int first_tile  = pps->tile_id[start_ts];
+    int end_ts, ctb_addr_ts;
+    int i, res;
+
+    if (!start_ts && s->sh.dependent_slice_segment_flag) {
+        av_log(s->avctx, AV_LOG_ERROR, "Impossible initial tile.\n");
+        return AVERROR_INVALIDDATA;
+    }
+
+    if (s->sh.dependent_slice_segment_flag) {
+        int prev_rs = pps->ctb_addr_ts_to_rs[start_ts - 1];
+        if (s->tab_slice_address[prev_rs] != s->sh.slice_addr) {
+            av_log(s->avctx, AV_LOG_ERROR, "Previous slice segment missing\n");
+            return AVERROR_INVALIDDATA;
+        }
+    }
+
+    if (first_tile + nb_jobs > pps->num_tile_columns * pps->num_tile_rows) {
+        av_log(s->avctx, AV_LOG_ERROR, "Tile entry points are wrong (%d %d)\n",
+               first_tile, s->sh.num_entry_point_offsets);
+        return AVERROR_INVALIDDATA;
+    }
+
+    jobs = av_malloc_array(nb_jobs, sizeof(*jobs));
+    if (!jobs)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < nb_jobs; i++) {
+        jobs[i].tile   = first_tile + i;
+        jobs[i].thread = 0;
+        ret[i]         = 0;
+    }
+
+    // the first tile continues from the slice header on whichever thread runs it
+    for (i = 1; i < s->threads_number; i++)
+        memcpy(s->HEVClcList[i], s->HEVClc, offsetof(HEVCLocalContext, edge_emu_buffer));
+
+    s->avctx->execute2(s->avctx, hls_decode_entry_tile, jobs, ret, nb_jobs);
+
+    for (i = 0; i < nb_jobs; i++) {
+        if (ret[i] < 0) {
+            res = ret[i];
+            goto end;
+        }
+    }
+    end_ts = ret[nb_jobs - 1];
+
+    // a following dependent slice segment continues from the last tile
+    if (jobs[nb_jobs - 1].thread)
+        memcpy(s->HEVClc, s->HEVClcList[jobs[nb_jobs - 1].thread],
+               offsetof(HEVCLocalContext, edge_emu_buffer));
+
+    for (ctb_addr_ts = start_ts; ctb_addr_ts < end_ts; ctb_addr_ts++) {
+        int ctb_addr_rs = pps->ctb_addr_ts_to_rs[ctb_addr_ts];
+        int x_ctb       = (ctb_addr_rs % s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+        int y_ctb       = (ctb_addr_rs / s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+
+        ff_hevc_deblocking_boundary_strengths_tile(s, x_ctb, y_ctb);
+    }
+
+    for (ctb_addr_ts = start_ts; ctb_addr_ts < end_ts; ctb_addr_ts++) {
+        int ctb_addr_rs = pps->ctb_addr_ts_to_rs[ctb_addr_ts];
+        int x_ctb       = (ctb_addr_rs % s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+        int y_ctb       = (ctb_addr_rs / s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+
+        ff_hevc_hls_filters(s, x_ctb, y_ctb, ctb_size);
+    }
+
+    if (end_ts >= s->ps.sps->ctb_size)
+        ff_hevc_hls_filter(s, (s->ps.sps->ctb_width  - 1) * ctb_size,
+                              (s->ps.sps->ctb_height - 1) * ctb_size, ctb_size);
+
+    res = end_ts;
+end:
+    av_free(jobs);
+    return res;
+}
+
 static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
 {
     const uint8_t *data = nal->data;
@@ -2620,7 +2799,8 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
         return AVERROR(ENOMEM);
     }
 
-    if (s->sh.slice_ctb_addr_rs + s->sh.num_entry_point_offsets * s->ps.sps->ctb_width >= s->ps.sps->ctb_width * s->ps.sps->ctb_height) {
+    if (!s->enable_parallel_tiles &&
+        s->sh.slice_ctb_addr_rs + s->sh.num_entry_point_offsets * s->ps.sps->ctb_width >= s->ps.sps->ctb_width * s->ps.sps->ctb_height) {
         av_log(s->avctx, AV_LOG_ERROR, "WPP ctb addresses are wrong (%d %d %d %d)\n",
             s->sh.slice_ctb_addr_rs, s->sh.num_entry_point_offsets,
             s->ps.sps->ctb_width, s->ps.sps->ctb_height
@@ -2696,11 +2876,15 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
         ret[i] = 0;
     }
 
-    if (s->ps.pps->entropy_coding_sync_enabled_flag)
-        s->avctx->execute2(s->avctx, hls_decode_entry_wpp, arg, ret, s->sh.num_entry_point_offsets + 1);
+    if (s->enable_parallel_tiles) {
+        res = hls_slice_data_tiles(s, ret);
+    } else {
+        if (s->ps.pps->entropy_coding_sync_enabled_flag)
+            s->avctx->execute2(s->avctx, hls_decode_entry_wpp, arg, ret, s->sh.num_entry_point_offsets + 1);
 
-    for (i = 0; i <= s->sh.num_entry_point_offsets; i++)
-        res += ret[i];
+        for (i = 0; i <= s->sh.num_entry_point_offsets; i++)
+            res += ret[i];
+    }
 error:
     av_free(ret);
     av_free(arg);
@@ -554,6 +554,7 @@ typedef struct HEVCContext {
     uint16_t seq_decode;
     uint16_t seq_output;
 
+    /* tiles of the current slice segment are decoded by separate jobs */
     int enable_parallel_tiles;
     atomic_int wpp_err;
 
@@ -675,6 +676,12 @@ void ff_hevc_set_qPy(HEVCContext *s, int xBase, int yBase,
                      int log2_cb_size);
 void ff_hevc_deblocking_boundary_strengths(HEVCContext *s, int x0, int y0,
                                            int log2_trafo_size);
+/**
+ * Compute the boundary strengths of the CTB edges at (x0, y0) that border
+ * another tile. ff_hevc_deblocking_boundary_strengths() leaves them out while
+ * the tiles of a slice segment are decoded in parallel.
+ */
+void ff_hevc_deblocking_boundary_strengths_tile(HEVCContext *s, int x0, int y0);
 int ff_hevc_cu_qp_delta_sign_flag(HEVCContext *s);
 int ff_hevc_cu_qp_delta_abs(HEVCContext *s);
 int ff_hevc_cu_chroma_qp_offset_flag(HEVCContext *s);
@@ -143,6 +143,13 @@ av_cold int ff_mjpeg_decode_init(AVCodecContext *avctx)
     avctx->colorspace = AVCOL_SPC_BT470BG;
     s->hwaccel_pix_fmt = s->hwaccel_sw_pix_fmt = AV_PIX_FMT_NONE;
 
+    if (avctx->active_thread_type & FF_THREAD_SLICE && avctx->thread_count > 1) {
+        s->slice_ctx = av_calloc(avctx->thread_count, sizeof(*s->slice_ctx));
+        s->slice_ret = av_calloc(avctx->thread_count, sizeof(*s->slice_ret));
+        if (!s->slice_ctx || !s->slice_ret)
+            return AVERROR(ENOMEM);
+    }
+
     if ((ret = init_default_huffman_tables(s)) < 0)
         return ret;
 
@@ -1411,12 +1418,15 @@ static void shift_output(MJpegDecodeContext *s, uint8_t *ptr, int linesize)
     }
 }
 
-static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
-                             int Al, const uint8_t *mb_bitmask,
-                             int mb_bitmask_size,
-                             const AVFrame *reference)
+/* Decode the MCUs from mcu_start to mcu_end (exclusive) in raster order. */
+static int mjpeg_decode_scan_mcus(MJpegDecodeContext *s, int nb_components,
+                                  int Ah, int Al, const uint8_t *mb_bitmask,
+                                  const AVFrame *reference,
+                                  int mcu_start, int mcu_end)
 {
     int i, mb_x, mb_y, chroma_h_shift, chroma_v_shift, chroma_width, chroma_height;
+    int start_x = mcu_start % s->mb_width;
+    int start_y = mcu_start / s->mb_width;
     uint8_t *data[MAX_COMPONENTS];
     const uint8_t *reference_data[MAX_COMPONENTS];
     int linesize[MAX_COMPONENTS];
@@ -1424,15 +1434,10 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
     int bytes_per_pixel = 1 + (s->bits > 8);
 
     if (mb_bitmask) {
-        if (mb_bitmask_size != (s->mb_width * s->mb_height + 7)>>3) {
-            av_log(s->avctx, AV_LOG_ERROR, "mb_bitmask_size mismatches\n");
-            return AVERROR_INVALIDDATA;
-        }
         init_get_bits(&mb_bitmask_gb, mb_bitmask, s->mb_width * s->mb_height);
+        skip_bits_long(&mb_bitmask_gb, mcu_start);
     }
 
-    s->restart_count = 0;
-
     av_pix_fmt_get_chroma_sub_sample(s->avctx->pix_fmt, &chroma_h_shift,
                                      &chroma_v_shift);
     chroma_width  = AV_CEIL_RSHIFT(s->width,  chroma_h_shift);
@@ -1443,13 +1448,15 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
         data[c] = s->picture_ptr->data[c];
         reference_data[c] = reference ? reference->data[c] : NULL;
         linesize[c] = s->linesize[c];
-        s->coefs_finished[c] |= 1;
     }
 
-    for (mb_y = 0; mb_y < s->mb_height; mb_y++) {
-        for (mb_x = 0; mb_x < s->mb_width; mb_x++) {
+    for (mb_y = start_y; mb_y < s->mb_height; mb_y++) {
+        for (mb_x = mb_y == start_y ? start_x : 0; mb_x < s->mb_width; mb_x++) {
             const int copy_mb = mb_bitmask && !get_bits1(&mb_bitmask_gb);
 
+            if (mb_y * s->mb_width + mb_x >= mcu_end)
+                return 0;
+
             if (s->restart_interval && !s->restart_count)
                 s->restart_count = s->restart_interval;
 
@@ -1532,6 +1539,135 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
     return 0;
 }
 
+typedef struct MJpegScanSlices {
+    int nb_components;
+    const uint8_t *mb_bitmask;
+    const AVFrame *reference;
+    const int *rst_offsets;   ///< start of the restart intervals after the first one
+    int nb_intervals;
+    int intervals_per_job;
+    int nb_jobs;
+    int end;                  ///< bit position after the last restart interval
+} MJpegScanSlices;
+
+static int decode_scan_slice(AVCodecContext *avctx, void *arg,
+                             int jobnr, int threadnr)
+{
+    MJpegDecodeContext *s  = avctx->priv_data;
+    MJpegDecodeContext *t  = &s->slice_ctx[threadnr];
+    MJpegScanSlices *sl    = arg;
+    int first_interval     = jobnr * sl->intervals_per_job;
+    int last_interval      = FFMIN(first_interval + sl->intervals_per_job,
+                                   sl->nb_intervals);
+    int i, ret;
+
+    t->gb = s->gb;
+    if (first_interval)
+        skip_bits_long(&t->gb, sl->rst_offsets[first_interval - 1] * 8 -
+                               get_bits_count(&s->gb));
+    for (i = 0; i < sl->nb_components; i++)
+        t->last_dc[i] = (4 << s->bits);
+    t->restart_count = 0;
+
+    ret = mjpeg_decode_scan_mcus(t, sl->nb_components, 0, 0,
+                                 sl->mb_bitmask, sl->reference,
+                                 first_interval * s->restart_interval,
+                                 FFMIN(last_interval * s->restart_interval,
+                                       s->mb_width * s->mb_height));
+    if (ret < 0)
+        return ret;
+    if (jobnr == sl->nb_jobs - 1)
+        sl->end = get_bits_count(&t->gb);
+    /* handle_rstn() only resets the DC predictors when it finds the RSTn
+     * marker where the interval ends, as the next job assumed */
+    else if (get_bits_count(&t->gb) != sl->rst_offsets[last_interval - 1] * 8)
+        return 1;
+    return 0;
+}
+
+/**
+ * Decode the restart intervals of a sequential scan in parallel.
+ * @return 0 on success, 1 if the scan must be decoded serially or
+ *         a negative error code
+ */
+static int mjpeg_decode_scan_slices(MJpegDecodeContext *s, int nb_components,
+                                    const uint8_t *mb_bitmask,
+                                    const AVFrame *reference)
+{
+    AVCodecContext *avctx = s->avctx;
+    MJpegScanSlices sl = { 0 };
+    int64_t nb_mcus   = (int64_t)s->mb_width * s->mb_height;
+    int pos           = get_bits_count(&s->gb) >> 3;
+    int i, first;
+
+    if (!s->slice_ctx || s->progressive || !s->restart_interval ||
+        s->restart_interval >= nb_mcus || s->gb.buffer != s->buffer)
+        return 1;
+
+    /* Every restart interval must be terminated by its RSTn marker, otherwise
+     * the intervals cannot be located without decoding them. */
+    sl.nb_intervals = (nb_mcus + s->restart_interval - 1) / s->restart_interval;
+    for (first = 0; first < s->nb_rst_offsets; first++)
+        if (s->rst_offsets[first] > pos)
+            break;
+    if (s->nb_rst_offsets - first < sl.nb_intervals - 1)
+        return 1;
+    for (i = 0; i < sl.nb_intervals - 1; i++)
+        if (s->buffer[s->rst_offsets[first + i] - 1] != RST0 + (i & 7))
+            return 1;
+
+    sl.nb_components     = nb_components;
+    sl.mb_bitmask        = mb_bitmask;
+    sl.reference         = reference;
+    sl.rst_offsets       = s->rst_offsets + first;
+    sl.nb_jobs           = FFMIN(sl.nb_intervals, avctx->thread_count);
+    sl.intervals_per_job = (sl.nb_intervals + sl.nb_jobs - 1) / sl.nb_jobs;
+    sl.nb_jobs           = (sl.nb_intervals + sl.intervals_per_job - 1) / sl.intervals_per_job;
+
+    for (i = 0; i < avctx->thread_count; i++)
+        memcpy(&s->slice_ctx[i], s, sizeof(*s));
+
+    avctx->execute2(avctx, decode_scan_slice, &sl, s->slice_ret, sl.nb_jobs);
+
+    /* An interval not ending at its marker continues into the next one
+     * without a reset when decoded serially; the jobs after it decoded
+     * their MCUs from the wrong state, so start again serially. */
+    for (i = 0; i < sl.nb_jobs; i++) {
+        if (s->slice_ret[i] > 0)
+            return 1;
+        if (s->slice_ret[i] < 0)
+            return s->slice_ret[i];
+    }
+
+    skip_bits_long(&s->gb, sl.end - get_bits_count(&s->gb));
+    return 0;
+}
+
+static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
+                             int Al, const uint8_t *mb_bitmask,
+                             int mb_bitmask_size,
+                             const AVFrame *reference)
+{
+    int i, ret;
+
+    if (mb_bitmask && mb_bitmask_size != (s->mb_width * s->mb_height + 7)>>3) {
+        av_log(s->avctx, AV_LOG_ERROR, "mb_bitmask_size mismatches\n");
+        return AVERROR_INVALIDDATA;
+    }
+
+    s->restart_count = 0;
+
+    for (i = 0; i < nb_components; i++)
+        s->coefs_finished[s->comp_index[i]] |= 1;
+
+    ret = mjpeg_decode_scan_slices(s, nb_components, mb_bitmask, reference);
+    if (ret <= 0)
+        return ret;
+
+    return mjpeg_decode_scan_mcus(s, nb_components, Ah, Al, mb_bitmask,
+                                  reference, 0, s->mb_width * s->mb_height);
+}
+
 static int mjpeg_decode_scan_progressive_ac(MJpegDecodeContext *s, int ss,
                                             int se, int Ah, int Al)
 {
@@ -2209,6 +2345,8 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
         const uint8_t *ptr = src;
         uint8_t *dst = s->buffer;
 
+        s->nb_rst_offsets = 0;
+
         #define copy_data_segment(skip) do {       \
             ptrdiff_t length = (ptr - src) - (skip);  \
             if (length > 0) {                         \
@@ -2246,6 +2384,14 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
                         copy_data_segment(1);
                         if (x)
                             break;
+                    } else if (s->slice_ctx) {
+                        /* the marker itself is copied with the next segment */
+                        int *offsets = av_fast_realloc(s->rst_offsets, &s->rst_offsets_size,
+                                                       (s->nb_rst_offsets + 1) * sizeof(*offsets));
+                        if (!offsets)
+                            return AVERROR(ENOMEM);
+                        s->rst_offsets = offsets;
+                        s->rst_offsets[s->nb_rst_offsets++] = dst - s->buffer + ptr - src;
                     }
                 }
             }
@@ -2898,6 +3044,9 @@ av_cold int ff_mjpeg_decode_end(AVCodecContext *avctx)
     av_frame_free(&s->smv_frame);
 
     av_freep(&s->buffer);
+    av_freep(&s->rst_offsets);
+    av_freep(&s->slice_ctx);
+    av_freep(&s->slice_ret);
     av_freep(&s->stereo3d);
     av_freep(&s->ljpeg_buffer);
     s->ljpeg_buffer_size = 0;
@@ -2954,7 +3103,7 @@ AVCodec ff_mjpeg_decoder = {
     .close          = ff_mjpeg_decode_end,
     .receive_frame  = ff_mjpeg_receive_frame,
     .flush          = decode_flush,
-    .capabilities   = AV_CODEC_CAP_DR1,
+    .capabilities   = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_SLICE_THREADS,
     .max_lowres     = 3,
     .priv_class     = &mjpegdec_class,
     .profiles       = NULL_IF_CONFIG_SMALL(ff_mjpeg_profiles),
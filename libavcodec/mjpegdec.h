@@ -117,6 +117,12 @@ typedef struct MJpegDecodeContext {
 
     int restart_interval;
     int restart_count;
+    int *rst_offsets;                ///< byte offsets of the data following each RSTn of the unescaped scan
+    unsigned int rst_offsets_size;
+    int nb_rst_offsets;
+
+    struct MJpegDecodeContext *slice_ctx; ///< per thread decoding state for slice threading
+    int *slice_ret;
 
     int buggy_avid;
     int cs_itu601;
@@ -0,0 +1,347 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * scale the input to several output sizes in one pass
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/internal.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/parseutils.h"
+#include "libavutil/pixdesc.h"
+#include "libswscale/swscale.h"
+
+#include "avfilter.h"
+#include "filters.h"
+#include "formats.h"
+#include "internal.h"
+#include "scale_eval.h"
+#include "video.h"
+
+typedef struct ScaleLadderContext {
+    const AVClass *class;
+    char *sizes_str;
+    char *flags_str;
+    double cascade;
+
+    int flags;
+    int nb_sizes;
+    int *w, *h;                 ///< requested sizes, negative to keep the aspect
+
+    struct SwsLadder *ladder;
+    int ladder_w, ladder_h;
+    enum AVPixelFormat ladder_format;
+
+    int *out_w, *out_h;
+    uint8_t *(*dst)[4];
+    int (*dst_stride)[4];
+} ScaleLadderContext;
+
+static int config_output(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    ScaleLadderContext *s = ctx->priv;
+    AVFilterLink *inlink = ctx->inputs[0];
+    int idx = FF_OUTLINK_IDX(outlink);
+    int w = s->w[idx], h = s->h[idx];
+
+    if (!w)
+        w = inlink->w;
+    if (!h)
+        h = inlink->h;
+    ff_scale_adjust_dimensions(inlink, &w, &h, 0, 1);
+
+    if (w <= 0 || h <= 0 || w > INT_MAX / 2 || h > INT_MAX / 2) {
+        av_log(ctx, AV_LOG_ERROR, "Invalid size %dx%d for output%d\n", w, h, idx);
+        return AVERROR(EINVAL);
+    }
+
+    outlink->w = s->out_w[idx] = w;
+    outlink->h = s->out_h[idx] = h;
+    if (inlink->sample_aspect_ratio.num)
+        outlink->sample_aspect_ratio = av_mul_q((AVRational){ h * inlink->w, w * inlink->h },
+                                                inlink->sample_aspect_ratio);
+    else
+        outlink->sample_aspect_ratio = inlink->sample_aspect_ratio;
+
+    /* the ladder is set up once all the sizes are known */
+    sws_free_ladder(&s->ladder);
+
+    av_log(ctx, AV_LOG_VERBOSE, "w:%d h:%d fmt:%s -> output%d w:%d h:%d fmt:%s\n",
+           inlink->w, inlink->h, av_get_pix_fmt_name(inlink->format), idx,
+           w, h, av_get_pix_fmt_name(outlink->format));
+    return 0;
+}
+
+static int parse_size(AVFilterContext *ctx, const char *str, int *w, int *h)
+{
+    char tail;
+
+    if (sscanf(str, "%dx%d%c", w, h, &tail) == 2 && *w >= -16 && *h >= -16 &&
+        !(*w < 0 && *h < 0))
+        return 0;
+    if (av_parse_video_size(w, h, str) >= 0)
+        return 0;
+
+    av_log(ctx, AV_LOG_ERROR, "Invalid size '%s'\n", str);
+    return AVERROR(EINVAL);
+}
+
+static av_cold int init(AVFilterContext *ctx)
+{
+    ScaleLadderContext *s = ctx->priv;
+    const AVClass *class = sws_get_class();
+    const AVOption *o;
+    char *sizes, *p, *saveptr = NULL;
+    int i, ret;
+
+    if (!s->sizes_str || !*s->sizes_str) {
+        av_log(ctx, AV_LOG_ERROR, "No output sizes specified\n");
+        return AVERROR(EINVAL);
+    }
+
+    o = av_opt_find(&class, "sws_flags", NULL, 0, AV_OPT_SEARCH_FAKE_OBJ);
+    if ((ret = av_opt_eval_flags(&class, o, s->flags_str, &s->flags)) < 0)
+        return ret;
+
+    sizes = av_strdup(s->sizes_str);
+    if (!sizes)
+        return AVERROR(ENOMEM);
+
+    for (p = sizes; (p = av_strtok(p, "|", &saveptr)); p = NULL) {
+        AVFilterPad pad = { 0 };
+        int w, h;
+
+        if ((ret = parse_size(ctx, p, &w, &h)) < 0)
+            goto end;
+        if ((ret = av_reallocp_array(&s->w, s->nb_sizes + 1, sizeof(*s->w))) < 0 ||
+            (ret = av_reallocp_array(&s->h, s->nb_sizes + 1, sizeof(*s->h))) < 0)
+            goto end;
+        s->w[s->nb_sizes] = w;
+        s->h[s->nb_sizes] = h;
+
+        pad.type = AVMEDIA_TYPE_VIDEO;
+        pad.name = av_asprintf("output%d", s->nb_sizes);
+        if (!pad.name) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        pad.config_props = config_output;
+        if ((ret = ff_insert_outpad(ctx, s->nb_sizes, &pad)) < 0) {
+            av_freep(&pad.name);
+            goto end;
+        }
+        s->nb_sizes++;
+    }
+
+    s->out_w      = av_calloc(s->nb_sizes, sizeof(*s->out_w));
+    s->out_h      = av_calloc(s->nb_sizes, sizeof(*s->out_h));
+    s->dst        = av_calloc(s->nb_sizes, sizeof(*s->dst));
+    s->dst_stride = av_calloc(s->nb_sizes, sizeof(*s->dst_stride));
+    if (!s->out_w || !s->out_h || !s->dst || !s->dst_stride)
+        ret = AVERROR(ENOMEM);
+
+    for (i = 0; i < s->nb_sizes; i++)
+        av_log(ctx, AV_LOG_VERBOSE, "output%d: %dx%d\n", i, s->w[i], s->h[i]);
+
+end:
+    av_free(sizes);
+    return ret;
+}
+
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    ScaleLadderContext *s = ctx->priv;
+    int i;
+
+    sws_free_ladder(&s->ladder);
+    for (i = 0; i < ctx->nb_outputs; i++)
+        av_freep(&ctx->output_pads[i].name);
+    av_freep(&s->w);
+    av_freep(&s->h);
+    av_freep(&s->out_w);
+    av_freep(&s->out_h);
+    av_freep(&s->dst);
+    av_freep(&s->dst_stride);
+}
+
+static int query_formats(AVFilterContext *ctx)
+{
+    const AVPixFmtDescriptor *desc = NULL;
+    AVFilterFormats *in = NULL, *out = NULL;
+    int i, ret;
+
+    while ((desc = av_pix_fmt_desc_next(desc))) {
+        enum AVPixelFormat pix_fmt = av_pix_fmt_desc_get_id(desc);
+
+        if (sws_isSupportedInput(pix_fmt) &&
+            (ret = ff_add_format(&in, pix_fmt)) < 0)
+            return ret;
+        if (sws_isSupportedOutput(pix_fmt) &&
+            (ret = ff_add_format(&out, pix_fmt)) < 0)
+            return ret;
+    }
+
+    if ((ret = ff_formats_ref(in, &ctx->inputs[0]->outcfg.formats)) < 0)
+        return ret;
+    /* all the outputs share the list, so that they get the same format */
+    for (i = 0; i < ctx->nb_outputs; i++)
+        if ((ret = ff_formats_ref(out, &ctx->outputs[i]->incfg.formats)) < 0)
+            return ret;
+
+    return 0;
+}
+
+static int init_ladder(AVFilterContext *ctx, const AVFrame *in)
+{
+    ScaleLadderContext *s = ctx->priv;
+    enum AVPixelFormat out_format = ctx->outputs[0]->format;
+    int i;
+
+    sws_free_ladder(&s->ladder);
+    s->ladder = sws_alloc_ladder(in->width, in->height, in->format,
+                                 s->nb_sizes, s->out_w, s->out_h, out_format,
+                                 s->flags, NULL, s->cascade);
+    if (!s->ladder)
+        return AVERROR(EINVAL);
+    s->ladder_w      = in->width;
+    s->ladder_h      = in->height;
+    s->ladder_format = in->format;
+
+    for (i = 0; i < s->nb_sizes; i++) {
+        int src = sws_ladder_get_source(s->ladder, i);
+        if (src < 0)
+            av_log(ctx, AV_LOG_VERBOSE, "output%d: scaled from the input\n", i);
+        else
+            av_log(ctx, AV_LOG_VERBOSE, "output%d: scaled from output%d\n", i, src);
+    }
+    return 0;
+}
+
+static int filter_frame(AVFilterLink *inlink, AVFrame *in)
+{
+    AVFilterContext *ctx = inlink->dst;
+    ScaleLadderContext *s = ctx->priv;
+    AVFrame **out;
+    int i, ret = 0;
+
+    if (!s->ladder || in->width != s->ladder_w || in->height != s->ladder_h ||
+        in->format != s->ladder_format) {
+        if ((ret = init_ladder(ctx, in)) < 0) {
+            av_frame_free(&in);
+            return ret;
+        }
+    }
+
+    out = av_calloc(s->nb_sizes, sizeof(*out));
+    if (!out) {
+        av_frame_free(&in);
+        return AVERROR(ENOMEM);
+    }
+
+    /* closed outputs are still needed as intermediates */
+    for (i = 0; i < s->nb_sizes; i++) {
+        AVFilterLink *outlink = ctx->outputs[i];
+
+        out[i] = ff_get_video_buffer(outlink, outlink->w, outlink->h);
+        if (!out[i]) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        if ((ret = av_frame_copy_props(out[i], in)) < 0)
+            goto end;
+        out[i]->width  = outlink->w;
+        out[i]->height = outlink->h;
+        av_reduce(&out[i]->sample_aspect_ratio.num, &out[i]->sample_aspect_ratio.den,
+                  (int64_t)in->sample_aspect_ratio.num * outlink->h * in->width,
+                  (int64_t)in->sample_aspect_ratio.den * outlink->w * in->height,
+                  INT_MAX);
+        memcpy(s->dst[i], out[i]->data, sizeof(s->dst[i]));
+        memcpy(s->dst_stride[i], out[i]->linesize, sizeof(s->dst_stride[i]));
+    }
+
+    ret = sws_scale_ladder(s->ladder, (const uint8_t *const *)in->data, in->linesize,
+                           s->dst, s->dst_stride);
+    if (ret < 0)
+        goto end;
+
+    ret = AVERROR_EOF;
+    for (i = 0; i < s->nb_sizes; i++) {
+        int err;
+
+        if (ff_outlink_get_status(ctx->outputs[i])) {
+            av_frame_free(&out[i]);
+            continue;
+        }
+        err = ff_filter_frame(ctx->outputs[i], out[i]);
+        out[i] = NULL;
+        if (err < 0) {
+            ret = err;
+            goto end;
+        }
+        ret = 0;
+    }
+
+end:
+    for (i = 0; i < s->nb_sizes; i++)
+        av_frame_free(&out[i]);
+    av_free(out);
+    av_frame_free(&in);
+    return ret;
+}
+
+#define OFFSET(x) offsetof(ScaleLadderContext, x)
+#define FLAGS AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_FILTERING_PARAM
+
+static const AVOption scale_ladder_options[] = {
+    { "sizes",   "set the output sizes separated by '|'", OFFSET(sizes_str), AV_OPT_TYPE_STRING, { .str = NULL },        .flags = FLAGS },
+    { "flags",   "set libswscale flags",                  OFFSET(flags_str), AV_OPT_TYPE_STRING, { .str = "bilinear" }, .flags = FLAGS },
+    { "cascade", "set the minimum size ratio for scaling an output from a larger one, 0 to scale all of them from the input",
+                                                          OFFSET(cascade),   AV_OPT_TYPE_DOUBLE, { .dbl = 1.5 }, 0, 16, FLAGS },
+    { NULL }
+};
+
+AVFILTER_DEFINE_CLASS(scale_ladder);
+
+static const AVFilterPad scale_ladder_inputs[] = {
+    {
+        .name         = "default",
+        .type         = AVMEDIA_TYPE_VIDEO,
+        .filter_frame = filter_frame,
+    },
+    { NULL }
+};
+
+AVFilter ff_vf_scale_ladder = {
+    .name          = "scale_ladder",
+    .description   = NULL_IF_CONFIG_SMALL("Scale the input video to several sizes in one pass."),
+    .priv_size     = sizeof(ScaleLadderContext),
+    .priv_class    = &scale_ladder_class,
+    .init          = init,
+    .uninit        = uninit,
+    .query_formats = query_formats,
+    .inputs        = scale_ladder_inputs,
+    .outputs       = NULL,
+    .flags         = AVFILTER_FLAG_DYNAMIC_OUTPUTS,
+};
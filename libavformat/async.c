@@ -34,6 +34,7 @@
 #include "libavutil/log.h"
 #include "libavutil/opt.h"
 #include "libavutil/thread.h"
+#include "http.h"
 #include "url.h"
 #include <stdint.h>
 
@@ -41,9 +42,11 @@
 #include <unistd.h>
 #endif
 
-#define BUFFER_CAPACITY         (4 * 1024 * 1024)
 #define READ_BACK_CAPACITY      (4 * 1024 * 1024)
 #define SHORT_SEEK_THRESHOLD    (256 * 1024)
+#define MAX_CONNECTIONS         16
+#define RANGE_READ_SIZE         (64 * 1024)
+#define RANGE_RETRIES           3
 
 typedef struct RingBuffer
 {
@@ -53,6 +56,13 @@ typedef struct RingBuffer
     int           read_pos;
 } RingBuffer;
 
+typedef struct RangeWorker {
+    URLContext     *parent;
+    URLContext     *inner;
+    uint8_t        *buf;
+    pthread_t       thread;
+} RangeWorker;
+
 typedef struct Context {
     AVClass        *class;
     URLContext     *inner;
@@ -78,6 +88,21 @@ typedef struct Context {
 
     int             abort_request;
     AVIOInterruptCB interrupt_callback;
+
+    /* parallel range requests, see range_worker_task() */
+    char           *url;
+    AVDictionary   *inner_options;
+    int             is_http;
+    RangeWorker    *workers;
+    int             nb_workers;
+    int64_t         fetch_pos;      ///< start of the next range to request
+    int64_t         write_pos;      ///< position of the end of the ring data
+    unsigned        generation;     ///< incremented by every seek resetting the ring
+
+    /* options */
+    int             buffer_size;
+    int             connections;
+    int             chunk_size;
 } Context;
 
 static int ring_init(RingBuffer *ring, unsigned int capacity, int read_back_capacity)
@@ -173,6 +198,221 @@ static int wrapped_url_read(void *src, void *dst, int size)
     return ret;
 }
 
+/*
+ * With several connections, the workers request consecutive ranges of
+ * chunk_size bytes, each on its own connection, and append them to the ring
+ * buffer in order. The ranges requested are at most buffer_size bytes ahead
+ * of the read position. A seek outside of the buffered data resets the ring
+ * and increments the generation, making the workers drop the ranges they
+ * are fetching.
+ */
+
+static int range_request(RangeWorker *w, int64_t start, int64_t end)
+{
+    URLContext      *h  = w->parent;
+    Context         *c  = h->priv_data;
+    AVIOInterruptCB  cb = {.callback = async_check_interrupt, .opaque = h};
+    AVDictionary    *opts = NULL;
+    int64_t          pos;
+    int              ret;
+
+#if CONFIG_HTTP_PROTOCOL
+    if (w->inner && c->is_http) {
+        uint8_t *location = NULL;
+
+        /* reuse the connection if the server keeps it alive */
+        av_dict_set_int(&opts, "offset",     start, 0);
+        av_dict_set_int(&opts, "end_offset", end,   0);
+        ret = av_opt_get(w->inner->priv_data, "location", 0, &location);
+        if (ret >= 0)
+            ret = ff_http_do_new_request2(w->inner, location, &opts);
+        av_free(location);
+        av_dict_free(&opts);
+        if (ret < 0)
+            ffurl_closep(&w->inner);
+    }
+#endif
+
+    if (!w->inner) {
+        av_dict_copy(&opts, c->inner_options, 0);
+        if (c->is_http) {
+            av_dict_set_int(&opts, "offset",            start, 0);
+            av_dict_set_int(&opts, "end_offset",        end,   0);
+            av_dict_set_int(&opts, "multiple_requests", 1,     0);
+        }
+        ret = ffurl_open_whitelist(&w->inner, c->url, AVIO_FLAG_READ, &cb, &opts,
+                                   h->protocol_whitelist, h->protocol_blacklist, h);
+        av_dict_free(&opts);
+        if (ret < 0)
+            return ret;
+    }
+
+    /* also checks that the server honoured the range */
+    pos = ffurl_seek(w->inner, start, SEEK_SET);
+    if (pos != start) {
+        av_log(h, AV_LOG_ERROR, "Failed to request the range at %"PRId64"\n", start);
+        ffurl_closep(&w->inner);
+        return pos < 0 ? pos : AVERROR(EIO);
+    }
+    return 0;
+}
+
+static int range_fetch(RangeWorker *w, int64_t start, int size, unsigned generation,
+                       int *nb_read)
+{
+    URLContext *h   = w->parent;
+    Context    *c   = h->priv_data;
+    int         len = 0, retries = 0;
+    int         ret = range_request(w, start, start + size);
+
+    while (ret >= 0 && len < size) {
+        ret = ffurl_read(w->inner, w->buf + len, FFMIN(size - len, RANGE_READ_SIZE));
+        if (ret == AVERROR_EXIT)
+            break;
+        if (ret <= 0) {
+            /* the connection failed or was closed by the server before the
+             * end of the range: request the rest on a new one */
+            ffurl_closep(&w->inner);
+            if (retries++ == RANGE_RETRIES) {
+                av_log(h, AV_LOG_ERROR, "The range at %"PRId64" ended at %"PRId64"\n",
+                       start, start + len);
+                ret = ret < 0 && ret != AVERROR_EOF ? ret : AVERROR(EIO);
+                break;
+            }
+            av_log(h, AV_LOG_WARNING, "The range at %"PRId64" ended at %"PRId64", retrying\n",
+                   start, start + len);
+            ret = range_request(w, start + len, start + size);
+            continue;
+        }
+        len += ret;
+
+        pthread_mutex_lock(&c->mutex);
+        if (generation != c->generation || c->abort_request)
+            ret = AVERROR_EXIT;
+        pthread_mutex_unlock(&c->mutex);
+    }
+
+    /* a partially read response cannot be followed by another request */
+    if (len < size)
+        ffurl_closep(&w->inner);
+
+    *nb_read = len;
+    return FFMIN(ret, 0);
+}
+
+static void *range_worker_task(void *arg)
+{
+    RangeWorker  *w    = arg;
+    URLContext   *h    = w->parent;
+    Context      *c    = h->priv_data;
+    RingBuffer   *ring = &c->ring;
+
+    pthread_mutex_lock(&c->mutex);
+    while (!async_check_interrupt(h)) {
+        int64_t  start      = c->fetch_pos;
+        unsigned generation = c->generation;
+        int      size, len, ret;
+
+        if (c->io_eof_reached || start >= c->logical_size ||
+            start + FFMIN(c->chunk_size, c->logical_size - start) >
+            c->logical_pos + c->buffer_size) {
+            pthread_cond_wait(&c->cond_wakeup_background, &c->mutex);
+            continue;
+        }
+        size = FFMIN(c->chunk_size, c->logical_size - start);
+        c->fetch_pos += size;
+        pthread_mutex_unlock(&c->mutex);
+
+        ret = range_fetch(w, start, size, generation, &len);
+
+        pthread_mutex_lock(&c->mutex);
+        while (generation == c->generation && !c->abort_request &&
+               (c->write_pos != start || ring_space(ring) < len))
+            pthread_cond_wait(&c->cond_wakeup_background, &c->mutex);
+        if (generation != c->generation || c->abort_request)
+            continue;
+
+        ring_generic_write(ring, w->buf, len, NULL);
+        c->write_pos += len;
+        if (ret < 0 || len < size) {
+            /* the ranges after this one are never appended */
+            c->io_eof_reached = 1;
+            c->io_error       = ret < 0 ? ret : AVERROR(EIO);
+        } else if (c->write_pos >= c->logical_size) {
+            c->io_eof_reached = 1;
+        }
+        pthread_cond_broadcast(&c->cond_wakeup_background);
+        pthread_cond_signal(&c->cond_wakeup_main);
+    }
+
+    c->io_eof_reached = 1;
+    c->io_error       = AVERROR_EXIT;
+    pthread_cond_signal(&c->cond_wakeup_main);
+    pthread_mutex_unlock(&c->mutex);
+
+    return NULL;
+}
+
+static void range_workers_stop(URLContext *h)
+{
+    Context *c = h->priv_data;
+    int      i, ret;
+
+    pthread_mutex_lock(&c->mutex);
+    c->abort_request = 1;
+    pthread_cond_broadcast(&c->cond_wakeup_background);
+    pthread_mutex_unlock(&c->mutex);
+
+    for (i = 0; i < c->nb_workers; i++) {
+        ret = pthread_join(c->workers[i].thread, NULL);
+        if (ret != 0)
+            av_log(h, AV_LOG_ERROR, "pthread_join(): %s\n", av_err2str(ret));
+    }
+    for (i = 0; i < c->connections; i++) {
+        ffurl_closep(&c->workers[i].inner);
+        av_freep(&c->workers[i].buf);
+    }
+    av_freep(&c->workers);
+    c->nb_workers = 0;
+}
+
+static int range_workers_start(URLContext *h)
+{
+    Context *c = h->priv_data;
+    int      i, ret;
+
+    c->workers = av_mallocz_array(c->connections, sizeof(*c->workers));
+    if (!c->workers)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < c->connections; i++) {
+        c->workers[i].parent = h;
+        c->workers[i].buf    = av_malloc(c->chunk_size);
+        if (!c->workers[i].buf) {
+            range_workers_stop(h);
+            return AVERROR(ENOMEM);
+        }
+    }
+    /* the first worker continues with the connection opened to get the
+     * size, unless it is an HTTP one requesting everything up to the end */
+    if (!c->is_http)
+        c->workers[0].inner = c->inner;
+    else
+        ffurl_closep(&c->inner);
+    c->inner = NULL;
+
+    for (i = 0; i < c->connections; i++) {
+        ret = pthread_create(&c->workers[i].thread, NULL, range_worker_task, &c->workers[i]);
+        if (ret) {
+            ret = AVERROR(ret);
+            av_log(h, AV_LOG_ERROR, "pthread_create failed : %s\n", av_err2str(ret));
+            range_workers_stop(h);
+            return ret;
+        }
+        c->nb_workers++;
+    }
+    return 0;
+}
+
 static void *async_buffer_task(void *arg)
 {
     URLContext   *h    = arg;
@@ -245,10 +485,20 @@ static int async_open(URLContext *h, const char *arg, int flags, AVDictionary **
 
     av_strstart(arg, "async:", &arg);
 
-    ret = ring_init(&c->ring, BUFFER_CAPACITY, READ_BACK_CAPACITY);
+    if (c->connections > 1)
+        c->buffer_size = FFMAX(c->buffer_size, c->connections * c->chunk_size);
+    ret = ring_init(&c->ring, c->buffer_size, READ_BACK_CAPACITY);
     if (ret < 0)
         goto fifo_fail;
 
+    if (c->connections > 1) {
+        c->url = av_strdup(arg);
+        if (!c->url || (options && av_dict_copy(&c->inner_options, *options, 0) < 0)) {
+            ret = AVERROR(ENOMEM);
+            goto url_fail;
+        }
+    }
+
     /* wrap interrupt callback */
     c->interrupt_callback = h->interrupt_callback;
     ret = ffurl_open_whitelist(&c->inner, arg, flags, &interrupt_callback, options, h->protocol_whitelist, h->protocol_blacklist, h);
@@ -260,6 +510,13 @@ static int async_open(URLContext *h, const char *arg, int flags, AVDictionary **
     c->logical_size = ffurl_size(c->inner);
     h->is_streamed  = c->inner->is_streamed;
 
+    if (c->connections > 1 && (h->is_streamed || c->logical_size <= 0)) {
+        av_log(h, AV_LOG_VERBOSE, "Size unknown or not seekable, using a single connection\n");
+        c->connections = 1;
+    }
+    c->is_http = !strcmp(c->inner->prot->name, "http") ||
+                 !strcmp(c->inner->prot->name, "https");
+
     ret = pthread_mutex_init(&c->mutex, NULL);
     if (ret != 0) {
         ret = AVERROR(ret);
@@ -281,6 +538,13 @@ static int async_open(URLContext *h, const char *arg, int flags, AVDictionary **
         goto cond_wakeup_background_fail;
     }
 
+    if (c->connections > 1) {
+        ret = range_workers_start(h);
+        if (ret < 0)
+            goto thread_fail;
+        return 0;
+    }
+
     ret = pthread_create(&c->async_buffer_thread, NULL, async_buffer_task, h);
     if (ret) {
         ret = AVERROR(ret);
@@ -299,6 +563,8 @@ cond_wakeup_main_fail:
 mutex_fail:
     ffurl_closep(&c->inner);
 url_fail:
+    av_freep(&c->url);
+    av_dict_free(&c->inner_options);
     ring_destroy(&c->ring);
 fifo_fail:
     return ret;
@@ -309,19 +575,25 @@ static int async_close(URLContext *h)
     Context *c = h->priv_data;
     int      ret;
 
-    pthread_mutex_lock(&c->mutex);
-    c->abort_request = 1;
-    pthread_cond_signal(&c->cond_wakeup_background);
-    pthread_mutex_unlock(&c->mutex);
+    if (c->workers) {
+        range_workers_stop(h);
+    } else {
+        pthread_mutex_lock(&c->mutex);
+        c->abort_request = 1;
+        pthread_cond_signal(&c->cond_wakeup_background);
+        pthread_mutex_unlock(&c->mutex);
 
-    ret = pthread_join(c->async_buffer_thread, NULL);
-    if (ret != 0)
-        av_log(h, AV_LOG_ERROR, "pthread_join(): %s\n", av_err2str(ret));
+        ret = pthread_join(c->async_buffer_thread, NULL);
+        if (ret != 0)
+            av_log(h, AV_LOG_ERROR, "pthread_join(): %s\n", av_err2str(ret));
+    }
 
     pthread_cond_destroy(&c->cond_wakeup_background);
     pthread_cond_destroy(&c->cond_wakeup_main);
     pthread_mutex_destroy(&c->mutex);
     ffurl_closep(&c->inner);
+    av_freep(&c->url);
+    av_dict_free(&c->inner_options);
     ring_destroy(&c->ring);
 
     return 0;
@@ -364,11 +636,11 @@ static int async_read_internal(URLContext *h, void *dest, int size, int read_com
             }
             break;
         }
-        pthread_cond_signal(&c->cond_wakeup_background);
+        pthread_cond_broadcast(&c->cond_wakeup_background);
         pthread_cond_wait(&c->cond_wakeup_main, &c->mutex);
     }
 
-    pthread_cond_signal(&c->cond_wakeup_background);
+    pthread_cond_broadcast(&c->cond_wakeup_background);
     pthread_mutex_unlock(&c->mutex);
 
     return ret;
@@ -389,6 +661,7 @@ static int64_t async_seek(URLContext *h, int64_t pos, int whence)
     RingBuffer   *ring = &c->ring;
     int64_t       ret;
     int64_t       new_logical_pos;
+    int64_t       short_seek = SHORT_SEEK_THRESHOLD;
     int fifo_size;
     int fifo_size_of_read_back;
 
@@ -407,13 +680,19 @@ static int64_t async_seek(URLContext *h, int64_t pos, int whence)
     if (new_logical_pos < 0)
         return AVERROR(EINVAL);
 
+    pthread_mutex_lock(&c->mutex);
     fifo_size = ring_size(ring);
     fifo_size_of_read_back = ring_size_of_read_back(ring);
+    /* wait for the ranges being fetched rather than requesting them again */
+    if (c->workers)
+        short_seek = FFMAX(short_seek, c->fetch_pos - c->logical_pos - fifo_size);
+    pthread_mutex_unlock(&c->mutex);
+
     if (new_logical_pos == c->logical_pos) {
         /* current position */
         return c->logical_pos;
     } else if ((new_logical_pos >= (c->logical_pos - fifo_size_of_read_back)) &&
-               (new_logical_pos < (c->logical_pos + fifo_size + SHORT_SEEK_THRESHOLD))) {
+               (new_logical_pos < (c->logical_pos + fifo_size + short_seek))) {
         int pos_delta = (int)(new_logical_pos - c->logical_pos);
         /* fast seek */
         av_log(h, AV_LOG_TRACE, "async_seek: fask_seek %"PRId64" from %d dist:%d/%d\n",
@@ -425,8 +704,10 @@ static int64_t async_seek(URLContext *h, int64_t pos, int whence)
             async_read_internal(h, NULL, pos_delta, 1, fifo_do_not_copy_func);
         } else {
             // fast seek backwards
+            pthread_mutex_lock(&c->mutex);
             ring_drain(ring, pos_delta);
             c->logical_pos = new_logical_pos;
+            pthread_mutex_unlock(&c->mutex);
         }
 
         return c->logical_pos;
@@ -440,6 +721,19 @@ static int64_t async_seek(URLContext *h, int64_t pos, int whence)
 
     pthread_mutex_lock(&c->mutex);
 
+    if (c->workers) {
+        ring_reset(ring);
+        c->generation++;
+        c->logical_pos    = new_logical_pos;
+        c->fetch_pos      = new_logical_pos;
+        c->write_pos      = new_logical_pos;
+        c->io_eof_reached = new_logical_pos >= c->logical_size;
+        c->io_error       = 0;
+        pthread_cond_broadcast(&c->cond_wakeup_background);
+        pthread_mutex_unlock(&c->mutex);
+        return new_logical_pos;
+    }
+
     c->seek_request   = 1;
     c->seek_pos       = new_logical_pos;
     c->seek_whence    = SEEK_SET;
@@ -470,6 +764,9 @@ static int64_t async_seek(URLContext *h, int64_t pos, int whence)
 #define D AV_OPT_FLAG_DECODING_PARAM
 
 static const AVOption options[] = {
+    { "buffer_size", "Size of the read-ahead buffer", OFFSET(buffer_size), AV_OPT_TYPE_INT, { .i64 = 4 * 1024 * 1024 }, 65536, INT_MAX / 2, D },
+    { "connections", "Number of connections requesting ranges in parallel", OFFSET(connections), AV_OPT_TYPE_INT, { .i64 = 1 }, 1, MAX_CONNECTIONS, D },
+    { "chunk_size", "Size of the ranges requested with several connections", OFFSET(chunk_size), AV_OPT_TYPE_INT, { .i64 = 1024 * 1024 }, 4096, 64 * 1024 * 1024, D },
     {NULL},
 };
 
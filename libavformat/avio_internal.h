@@ -53,6 +53,19 @@ int ffio_init_context(AVIOContext *s,
  */
 int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsigned char **data);
 
+/**
+ * Read size bytes from AVIOContext as a reference to the memory mapping of
+ * the underlying protocol, without copying them.
+ * @param s IO context
+ * @param buf set to a new read-only reference to the size bytes read,
+ *    followed by padding zero bytes
+ * @param size number of bytes requested
+ * @param padding number of zero bytes after the data
+ * @return size on success, AVERROR(ENOSYS) if the data is not mapped or
+ *    another negative error code, in which case nothing is read
+ */
+int ffio_read_mapped(AVIOContext *s, AVBufferRef **buf, int size, int padding);
+
 void ffio_fill(AVIOContext *s, int b, int count);
 
 static av_always_inline void ffio_wfourcc(AVIOContext *pb, const uint8_t *s)
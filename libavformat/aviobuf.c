@@ -705,6 +705,38 @@ int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsig
     }
 }
 
+int ffio_read_mapped(AVIOContext *s, AVBufferRef **buf, int size, int padding)
+{
+    URLContext *h = ffio_geturlcontext(s);
+    int64_t pos = avio_tell(s);
+    int avail = s->buf_end - s->buf_ptr;
+    int ret;
+
+    if (!h || s->write_flag || s->update_checksum || size <= 0 ||
+        size > INT_MAX - padding || pos < 0)
+        return AVERROR(ENOSYS);
+
+    ret = ffurl_get_mapping(h, buf, pos, size, padding);
+    if (ret < 0)
+        return ret;
+
+    if (avail >= size) {
+        s->buf_ptr += size;
+    } else {
+        /* skip the buffered data and the rest of the mapped bytes */
+        int64_t res = s->seek(s->opaque, pos + size, SEEK_SET);
+        if (res < 0) {
+            av_buffer_unref(buf);
+            return res;
+        }
+        s->bytes_read += size - avail;
+        s->buf_end = s->buf_ptr = s->buf_ptr_max = s->buffer;
+        s->pos = pos + size;
+        s->eof_reached = 0;
+    }
+    return size;
+}
+
 int avio_read_partial(AVIOContext *s, unsigned char *buf, int size)
 {
     int len;
@@ -23,7 +23,6 @@
 
 /**
  * @TODO
- *      support keeping files
  *      support filling with a background thread
  */
 
@@ -31,8 +30,11 @@
 #include "libavutil/avstring.h"
 #include "libavutil/internal.h"
 #include "libavutil/opt.h"
+#include "libavutil/random_seed.h"
+#include "libavutil/sha.h"
 #include "libavutil/tree.h"
 #include "avformat.h"
+#include "internal.h"
 #include <fcntl.h>
 #if HAVE_IO_H
 #include <io.h>
@@ -40,11 +42,19 @@
 #if HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#if HAVE_DIRENT_H
+#include <dirent.h>
+#include <utime.h>
+#endif
 #include <sys/stat.h>
 #include <stdlib.h>
+#include <time.h>
 #include "os_support.h"
 #include "url.h"
 
+/* temporary files older than this were left by a process which died */
+#define STALE_TMP_AGE 3600
+
 typedef struct CacheEntry {
     int64_t logical_pos;
     int64_t physical_pos;
@@ -64,13 +74,201 @@ typedef struct Context {
     URLContext *inner;
     int64_t cache_hit, cache_miss;
     int read_ahead_limit;
+
+    /* persistent cache directory, see block_path() */
+    char *cache_dir;
+    int block_size;
+    int64_t max_size;
+    char key[33];
+    uint8_t *block;             ///< block being read from the inner protocol
+    int64_t block_index;
+    int block_fill;
+    int block_done;             ///< the block is full or ends at EOF
+    int block_fd;               ///< stored block being read
+    int64_t block_fd_index;
+    int block_fd_size;
+    int64_t dir_size;
+
+    int64_t hit_bytes, miss_bytes;
 } Context;
 
+typedef struct CacheFile {
+    char *path;
+    int64_t mtime;
+    int64_t size;
+} CacheFile;
+
 static int cmp(const void *key, const void *node)
 {
     return FFDIFFSIGN(*(const int64_t *)key, ((const CacheEntry *) node)->logical_pos);
 }
 
+/*
+ * With cache_dir, the data is stored in blocks of block_size bytes, one file
+ * per block named after a hash of the URL and of the validator of the
+ * resource (see get_validator()), the block size and the block index. A
+ * block shorter than block_size, possibly empty, ends the resource.
+ * Blocks are written to a temporary file renamed once complete, so
+ * processes sharing the directory only ever see complete blocks. The
+ * modification time of a block is updated whenever it is read, and the
+ * least recently used blocks are deleted when the directory grows beyond
+ * max_size.
+ */
+
+static char *block_path(Context *c, int64_t index)
+{
+    return av_asprintf("%s/%s_%d_%"PRId64, c->cache_dir, c->key,
+                       c->block_size, index);
+}
+
+static int cmp_mtime(const void *a, const void *b)
+{
+    return FFDIFFSIGN(((const CacheFile *)a)->mtime, ((const CacheFile *)b)->mtime);
+}
+
+/**
+ * Compute the size of the cache directory and, if it exceeds max_size,
+ * delete the least recently used blocks down to 90% of max_size.
+ *
+ * dir_size is then only updated with the blocks stored by this process, and
+ * the directory is scanned again once it exceeds max_size. It is not set
+ * above 90% of max_size, so that the directory is not scanned for every
+ * block when the blocks cannot be deleted, e.g. because of their
+ * permissions.
+ */
+static void trim_dir(URLContext *h)
+{
+#if HAVE_DIRENT_H
+    Context *c = h->priv_data;
+    CacheFile *files = NULL;
+    int i, nb_files = 0, nb_evicted = 0;
+    int64_t total = 0, now = time(NULL);
+    struct dirent *entry;
+    DIR *dir = opendir(c->cache_dir);
+
+    if (!dir)
+        return;
+    while ((entry = readdir(dir))) {
+        const char *name = entry->d_name;
+        CacheFile *file;
+        struct stat st;
+        char *path;
+
+        if (strspn(name, "0123456789abcdef") != 32 || name[32] != '_')
+            continue;
+        path = av_append_path_component(c->cache_dir, name);
+        if (!path)
+            break;
+        if (stat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
+            av_free(path);
+            continue;
+        }
+        if (strstr(name, ".tmp")) {
+            if (now - st.st_mtime > STALE_TMP_AGE)
+                unlink(path);
+            av_free(path);
+            continue;
+        }
+        file = av_dynarray2_add((void **)&files, &nb_files, sizeof(*files), NULL);
+        if (!file) {
+            av_free(path);
+            break;
+        }
+        file->path  = path;
+        file->mtime = st.st_mtime;
+        file->size  = st.st_size;
+        total      += st.st_size;
+    }
+    closedir(dir);
+
+    if (c->max_size && total > c->max_size) {
+        int64_t target = c->max_size / 10 * 9;
+
+        qsort(files, nb_files, sizeof(*files), cmp_mtime);
+        for (i = 0; i < nb_files && total > target; i++) {
+            /* another process may have deleted it already */
+            if (unlink(files[i].path) < 0 && errno != ENOENT)
+                continue;
+            total -= files[i].size;
+            nb_evicted++;
+        }
+        av_log(h, AV_LOG_VERBOSE, "Evicted %d blocks from %s\n",
+               nb_evicted, c->cache_dir);
+        total = FFMIN(total, target);
+    }
+    for (i = 0; i < nb_files; i++)
+        av_free(files[i].path);
+    av_free(files);
+    c->dir_size = total;
+#endif
+}
+
+/**
+ * Get a string which changes with the content of the resource, made of its
+ * size and of the validators exported by the inner protocol, if any.
+ */
+static char *get_validator(Context *c, int64_t size)
+{
+    uint8_t *etag = NULL, *last_modified = NULL;
+    char *validator;
+
+    av_opt_get(c->inner, "etag", AV_OPT_SEARCH_CHILDREN, &etag);
+    av_opt_get(c->inner, "last_modified", AV_OPT_SEARCH_CHILDREN, &last_modified);
+    validator = av_asprintf("%"PRId64"\n%s\n%s", size,
+                            etag ? (char *)etag : "",
+                            last_modified ? (char *)last_modified : "");
+    av_free(etag);
+    av_free(last_modified);
+    return validator;
+}
+
+static int dir_open(URLContext *h, const char *url)
+{
+    Context *c = h->priv_data;
+    struct AVSHA *sha;
+    uint8_t digest[32];
+    char *validator;
+    int64_t size;
+    int ret;
+
+    c->fd          = -1;
+    c->block_index = -1;
+
+    if (mkdir(c->cache_dir, 0777) < 0 && errno != EEXIST) {
+        ret = AVERROR(errno);
+        av_log(h, AV_LOG_ERROR, "Could not create %s\n", c->cache_dir);
+        return ret;
+    }
+
+    size = ffurl_seek(c->inner, 0, AVSEEK_SIZE);
+    if (size >= 0) {
+        c->end         = size;
+        c->is_true_eof = 1;
+    }
+
+    sha       = av_sha_alloc();
+    validator = get_validator(c, size);
+    c->block  = av_malloc(c->block_size);
+    if (!sha || !validator || !c->block) {
+        av_free(sha);
+        av_free(validator);
+        return AVERROR(ENOMEM);
+    }
+    av_sha_init(sha, 256);
+    av_sha_update(sha, url, strlen(url) + 1);
+    av_sha_update(sha, validator, strlen(validator));
+    av_sha_final(sha, digest);
+    av_free(sha);
+    av_free(validator);
+    ff_data_to_hex(c->key, digest, 16, 1);
+    c->key[32] = 0;
+
+    if (c->max_size)
+        trim_dir(h);
+
+    return 0;
+}
+
 static int cache_open(URLContext *h, const char *arg, int flags, AVDictionary **options)
 {
     int ret;
@@ -79,21 +277,34 @@ static int cache_open(URLContext *h, const char *arg, int flags, AVDictionary **
 
     av_strstart(arg, "cache:", &arg);
 
-    c->fd = avpriv_tempfile("ffcache", &buffername, 0, h);
-    if (c->fd < 0){
-        av_log(h, AV_LOG_ERROR, "Failed to create tempfile\n");
-        return c->fd;
-    }
+    c->block_fd = -1;
+    if (!c->cache_dir) {
+        c->fd = avpriv_tempfile("ffcache", &buffername, 0, h);
+        if (c->fd < 0){
+            av_log(h, AV_LOG_ERROR, "Failed to create tempfile\n");
+            return c->fd;
+        }
+
+        ret = unlink(buffername);
 
-    ret = unlink(buffername);
+        if (ret >= 0)
+            av_freep(&buffername);
+        else
+            c->filename = buffername;
+    }
 
-    if (ret >= 0)
-        av_freep(&buffername);
-    else
-        c->filename = buffername;
+    ret = ffurl_open_whitelist(&c->inner, arg, flags, &h->interrupt_callback,
+                               options, h->protocol_whitelist, h->protocol_blacklist, h);
+    if (ret < 0 || !c->cache_dir)
+        return ret;
 
-    return ffurl_open_whitelist(&c->inner, arg, flags, &h->interrupt_callback,
-                                options, h->protocol_whitelist, h->protocol_blacklist, h);
+    /* the blocks are keyed by the validator of the opened resource */
+    ret = dir_open(h, arg);
+    if (ret < 0) {
+        ffurl_closep(&c->inner);
+        av_freep(&c->block);
+    }
+    return ret;
 }
 
 static int add_entry(URLContext *h, const unsigned char *buf, int size)
@@ -159,7 +370,7 @@ fail:
     return ret;
 }
 
-static int cache_read(URLContext *h, unsigned char *buf, int size)
+static int file_read(URLContext *h, unsigned char *buf, int size)
 {
     Context *c= h->priv_data;
     CacheEntry *entry, *next[2] = {NULL, NULL};
@@ -190,6 +401,7 @@ static int cache_read(URLContext *h, unsigned char *buf, int size)
                 c->cache_pos += r;
                 c->logical_pos += r;
                 c->cache_hit ++;
+                c->hit_bytes += r;
                 return r;
             }
         }
@@ -216,6 +428,7 @@ static int cache_read(URLContext *h, unsigned char *buf, int size)
     c->inner_pos += r;
 
     c->cache_miss ++;
+    c->miss_bytes += r;
 
     add_entry(h, buf, r);
     c->logical_pos += r;
@@ -224,11 +437,216 @@ static int cache_read(URLContext *h, unsigned char *buf, int size)
     return r;
 }
 
+static int open_block(URLContext *h, int64_t index)
+{
+    Context *c = h->priv_data;
+    int access = O_RDONLY;
+    struct stat st;
+    char *path;
+    int fd;
+
+    if (c->block_fd >= 0 && c->block_fd_index == index)
+        return c->block_fd_size;
+
+    path = block_path(c, index);
+    if (!path)
+        return AVERROR(ENOMEM);
+#ifdef O_BINARY
+    access |= O_BINARY;
+#endif
+    fd = avpriv_open(path, access);
+    if (fd >= 0 && (fstat(fd, &st) < 0 || st.st_size > c->block_size)) {
+        close(fd);
+        fd = -1;
+    }
+#if HAVE_DIRENT_H
+    if (fd >= 0)
+        utime(path, NULL);
+#endif
+    av_free(path);
+    if (fd < 0)
+        return AVERROR(ENOENT);
+
+    if (c->block_fd >= 0)
+        close(c->block_fd);
+    c->block_fd       = fd;
+    c->block_fd_index = index;
+    c->block_fd_size  = st.st_size;
+    return c->block_fd_size;
+}
+
+static void store_block(URLContext *h)
+{
+    Context *c = h->priv_data;
+    int access = O_WRONLY | O_CREAT | O_EXCL;
+    char *path = block_path(c, c->block_index);
+    char *tmp  = path ? av_asprintf("%s.%08x.tmp", path, av_get_random_seed()) : NULL;
+    int fd = -1, ret = -1, written = 0;
+
+#ifdef O_BINARY
+    access |= O_BINARY;
+#endif
+    if (tmp)
+        fd = avpriv_open(tmp, access, 0666);
+    if (fd >= 0) {
+        while (written < c->block_fill) {
+            ret = write(fd, c->block + written, c->block_fill - written);
+            if (ret <= 0)
+                break;
+            written += ret;
+        }
+        ret = written == c->block_fill ? 0 : -1;
+        if (close(fd) < 0)
+            ret = -1;
+        if (!ret)
+            ret = rename(tmp, path);
+        if (ret < 0)
+            unlink(tmp);
+    }
+
+    if (ret < 0) {
+        av_log(h, AV_LOG_WARNING, "Could not store block %"PRId64" in %s\n",
+               c->block_index, c->cache_dir);
+    } else {
+        c->dir_size += c->block_fill;
+        if (c->max_size && c->dir_size > c->max_size)
+            trim_dir(h);
+    }
+    av_free(tmp);
+    av_free(path);
+}
+
+static int read_stored_block(URLContext *h, unsigned char *buf, int size,
+                             int64_t index, int offset)
+{
+    Context *c = h->priv_data;
+    int64_t r = open_block(h, index);
+
+    if (r < 0)
+        return r;
+    if (offset >= r) {
+        c->is_true_eof = 1;
+        c->end = FFMAX(c->end, index * c->block_size + r);
+        return AVERROR_EOF;
+    }
+
+    r = lseek(c->block_fd, offset, SEEK_SET);
+    if (r >= 0)
+        r = read(c->block_fd, buf, FFMIN(size, c->block_fd_size - offset));
+    if (r <= 0)
+        return AVERROR(ENOENT);
+
+    c->logical_pos += r;
+    c->end = FFMAX(c->end, c->logical_pos);
+    c->cache_hit ++;
+    c->hit_bytes += r;
+    return r;
+}
+
+static int dir_read(URLContext *h, unsigned char *buf, int size)
+{
+    Context *c = h->priv_data;
+    int64_t index = c->logical_pos / c->block_size;
+    int offset    = c->logical_pos % c->block_size;
+    int64_t r;
+
+    if (c->is_true_eof && c->logical_pos >= c->end)
+        return AVERROR_EOF;
+
+    if (index != c->block_index || offset >= c->block_fill) {
+        r = read_stored_block(h, buf, size, index, offset);
+        if (r != AVERROR(ENOENT))
+            return r;
+
+        // Cache miss, read the block from its start
+        if (index != c->block_index) {
+            c->block_index = index;
+            c->block_fill  = 0;
+            c->block_done  = 0;
+        }
+        while (offset >= c->block_fill && !c->block_done) {
+            int64_t pos = index * c->block_size + c->block_fill;
+
+            if (c->inner_pos != pos) {
+                r = ffurl_seek(c->inner, pos, SEEK_SET);
+                if (r < 0) {
+                    av_log(h, AV_LOG_ERROR, "Failed to perform internal seek\n");
+                    return r;
+                }
+                c->inner_pos = r;
+            }
+
+            r = ffurl_read(c->inner, c->block + c->block_fill,
+                           c->block_size - c->block_fill);
+            if (r == AVERROR_EOF || !r) {
+                c->is_true_eof = 1;
+                c->end = FFMAX(c->end, pos);
+                c->block_done = 1;
+            } else if (r < 0) {
+                return r;
+            } else {
+                c->inner_pos  += r;
+                c->block_fill += r;
+                c->miss_bytes += r;
+                c->block_done  = c->block_fill == c->block_size ||
+                                 c->is_true_eof && pos + r >= c->end;
+            }
+            if (c->block_done)
+                store_block(h);
+        }
+        if (offset >= c->block_fill)
+            return AVERROR_EOF;
+        c->cache_miss ++;
+    }
+
+    r = FFMIN(size, c->block_fill - offset);
+    memcpy(buf, c->block + offset, r);
+    c->logical_pos += r;
+    c->end = FFMAX(c->end, c->logical_pos);
+    return r;
+}
+
+static int cache_read(URLContext *h, unsigned char *buf, int size)
+{
+    Context *c = h->priv_data;
+
+    if (c->cache_dir)
+        return dir_read(h, buf, size);
+    return file_read(h, buf, size);
+}
+
+/* The inner protocol is only repositioned by dir_read(), when a block is
+ * missing from the cache. */
+static int64_t dir_seek(URLContext *h, int64_t pos, int whence)
+{
+    Context *c = h->priv_data;
+
+    if (whence == AVSEEK_SIZE || whence == SEEK_END) {
+        if (!c->is_true_eof)
+            return AVERROR(ENOSYS);
+        if (whence == AVSEEK_SIZE)
+            return c->end;
+        pos += c->end;
+    } else if (whence == SEEK_CUR) {
+        pos += c->logical_pos;
+    } else if (whence != SEEK_SET) {
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0)
+        return AVERROR(EINVAL);
+    c->logical_pos = pos;
+    return pos;
+}
+
 static int64_t cache_seek(URLContext *h, int64_t pos, int whence)
 {
     Context *c= h->priv_data;
     int64_t ret;
 
+    /* without a seekable source, seeks forwards still read ahead */
+    if (c->cache_dir && !c->inner->is_streamed)
+        return dir_seek(h, pos, whence);
+
     if (whence == AVSEEK_SIZE) {
         pos= ffurl_seek(c->inner, pos, whence);
         if(pos <= 0){
@@ -283,6 +701,7 @@ resolve_eof:
 
     if (ret >= 0) {
         c->logical_pos = ret;
+        c->inner_pos = ret;
         c->end = FFMAX(c->end, ret);
     }
 
@@ -300,10 +719,15 @@ static int cache_close(URLContext *h)
     Context *c= h->priv_data;
     int ret;
 
-    av_log(h, AV_LOG_INFO, "Statistics, cache hits:%"PRId64" cache misses:%"PRId64"\n",
-           c->cache_hit, c->cache_miss);
+    av_log(h, AV_LOG_INFO, "Statistics, cache hits:%"PRId64" cache misses:%"PRId64
+           ", bytes read from the cache:%"PRId64" from the source:%"PRId64"\n",
+           c->cache_hit, c->cache_miss, c->hit_bytes, c->miss_bytes);
 
-    close(c->fd);
+    if (c->fd >= 0)
+        close(c->fd);
+    if (c->block_fd >= 0)
+        close(c->block_fd);
+    av_freep(&c->block);
     if (c->filename) {
         ret = unlink(c->filename);
         if (ret < 0)
@@ -319,9 +743,15 @@ static int cache_close(URLContext *h)
 
 #define OFFSET(x) offsetof(Context, x)
 #define D AV_OPT_FLAG_DECODING_PARAM
+#define E AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY
 
 static const AVOption options[] = {
     { "read_ahead_limit", "Amount in bytes that may be read ahead when seeking isn't supported, -1 for unlimited", OFFSET(read_ahead_limit), AV_OPT_TYPE_INT, { .i64 = 65536 }, -1, INT_MAX, D },
+    { "cache_dir", "Directory keeping the cached data, possibly shared with other processes", OFFSET(cache_dir), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, D },
+    { "cache_block_size", "Size of the blocks stored in cache_dir", OFFSET(block_size), AV_OPT_TYPE_INT, { .i64 = 1 << 20 }, 4096, 1 << 28, D },
+    { "cache_max_size", "Size in bytes above which the least recently used blocks are deleted from cache_dir, 0 for unlimited", OFFSET(max_size), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, D },
+    { "cache_hit_bytes", "Number of bytes read from the cache", OFFSET(hit_bytes), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, E },
+    { "cache_miss_bytes", "Number of bytes read from the source", OFFSET(miss_bytes), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, E },
     {NULL},
 };
 
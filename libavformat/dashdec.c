@@ -20,17 +20,23 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 #include <libxml/parser.h>
+#include "libavutil/avassert.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "libavutil/parseutils.h"
 #include "internal.h"
 #include "avio_internal.h"
 #include "dash.h"
+#include "http.h"
+#include "prefetchqueue.h"
+#include "url.h"
 
 #define INITIAL_BUFFER_SIZE 32768
 #define MAX_BPRINT_READ_SIZE (UINT_MAX - 1)
 #define DEFAULT_MANIFEST_SIZE 8 * 1024
+#define MAX_IDLE_CONNECTIONS 16
 
 struct fragment {
     int64_t url_offset;
@@ -78,6 +84,8 @@ struct representation {
     char *url_template;
     AVIOContext pb;
     AVIOContext *input;
+    int input_read_done;
+    FFPrefetch *cur_prefetch; /* download the fragment is read from */
     AVFormatContext *parent;
     AVFormatContext *ctx;
     int stream_index;
@@ -157,6 +165,21 @@ typedef struct DASHContext {
     int is_init_section_common_audio;
     int is_init_section_common_subtitle;
 
+    int http_persistent;
+    /* idle HTTP connections, reused by the next request to the same origin */
+    AVMutex conn_lock;
+    AVIOContext *idle_conns[MAX_IDLE_CONNECTIONS];
+    int nb_idle_conns;
+
+    int prefetch_segments;
+    int64_t prefetch_max_size;
+    FFPrefetchQueue *prefetch;
+
+    /* exported statistics */
+    int64_t segment_stalls;
+    int64_t segment_stall_time;
+    int64_t prefetch_bytes;
+    int64_t prefetch_throughput;
 } DASHContext;
 
 static int ishttp(char *url)
@@ -397,13 +420,100 @@ static void free_subtitle_list(DASHContext *c)
     c->n_subtitles = 0;
 }
 
+static int same_origin(const char *url1, const char *url2)
+{
+    char proto1[10], proto2[10], host1[1024], host2[1024];
+    int port1, port2;
+
+    av_url_split(proto1, sizeof(proto1), NULL, 0, host1, sizeof(host1),
+                 &port1, NULL, 0, url1);
+    av_url_split(proto2, sizeof(proto2), NULL, 0, host2, sizeof(host2),
+                 &port2, NULL, 0, url2);
+    return !strcmp(proto1, proto2) && !strcmp(host1, host2) && port1 == port2;
+}
+
+/* Take an idle connection to the origin of url, if there is one. */
+static AVIOContext *take_connection(DASHContext *c, const char *url)
+{
+    AVIOContext *pb = NULL;
+    int i;
+
+    ff_mutex_lock(&c->conn_lock);
+    for (i = 0; i < c->nb_idle_conns && !pb; i++) {
+        char *location = NULL;
+
+        if (av_opt_get(c->idle_conns[i], "location", AV_OPT_SEARCH_CHILDREN,
+                       (uint8_t **)&location) < 0)
+            continue;
+        if (same_origin(location, url)) {
+            pb = c->idle_conns[i];
+            c->idle_conns[i] = c->idle_conns[--c->nb_idle_conns];
+        }
+        av_free(location);
+    }
+    ff_mutex_unlock(&c->conn_lock);
+
+    return pb;
+}
+
+/* Close *pb, or keep it for a later request if it is an HTTP connection
+ * whose response was read entirely. */
+static void release_connection(AVFormatContext *s, AVIOContext **pb, int read_done)
+{
+    DASHContext *c = s->priv_data;
+    URLContext *uc = *pb ? ffio_geturlcontext(*pb) : NULL;
+
+    if (read_done && c->http_persistent && uc && uc->prot &&
+        av_strstart(uc->prot->name, "http", NULL)) {
+        ff_mutex_lock(&c->conn_lock);
+        if (c->nb_idle_conns < MAX_IDLE_CONNECTIONS) {
+            c->idle_conns[c->nb_idle_conns++] = *pb;
+            *pb = NULL;
+        }
+        ff_mutex_unlock(&c->conn_lock);
+    }
+    ff_format_io_close(s, pb);
+}
+
+static void close_idle_connections(AVFormatContext *s)
+{
+    DASHContext *c = s->priv_data;
+    int i;
+
+    for (i = 0; i < c->nb_idle_conns; i++)
+        ff_format_io_close(s, &c->idle_conns[i]);
+    c->nb_idle_conns = 0;
+}
+
+static int open_url_keepalive(AVFormatContext *s, AVIOContext **pb,
+                              const char *url, AVDictionary **options)
+{
+#if !CONFIG_HTTP_PROTOCOL
+    return AVERROR_PROTOCOL_NOT_FOUND;
+#else
+    int ret;
+    URLContext *uc = ffio_geturlcontext(*pb);
+    av_assert0(uc);
+    (*pb)->eof_reached = 0;
+    ret = ff_http_do_new_request2(uc, url, options);
+    if (ret < 0) {
+        ff_format_io_close(s, pb);
+    }
+    return ret;
+#endif
+}
+
+/* Open url, on a kept-alive connection if possible. The prefetch workers
+ * pass their own interrupt callback in int_cb and keep their connection in
+ * *pb, apart from the pool of idle connections. */
 static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
-                    AVDictionary **opts, AVDictionary *opts2, int *is_http)
+                    AVDictionary **opts, AVDictionary *opts2, int *is_http,
+                    const AVIOInterruptCB *int_cb)
 {
     DASHContext *c = s->priv_data;
     AVDictionary *tmp = NULL;
     const char *proto_name = NULL;
-    int ret;
+    int persistent, ret;
 
     if (av_strstart(url, "crypto", NULL)) {
         if (url[6] == '+' || url[6] == ':')
@@ -437,10 +547,35 @@ static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
     else if (strcmp(proto_name, "file") || !strncmp(url, "file,", 5))
         return AVERROR_INVALIDDATA;
 
-    av_freep(pb);
     av_dict_copy(&tmp, *opts, 0);
     av_dict_copy(&tmp, opts2, 0);
-    ret = avio_open2(pb, url, AVIO_FLAG_READ, c->interrupt_callback, &tmp);
+
+    persistent = c->http_persistent && av_strstart(proto_name, "http", NULL);
+    if (persistent)
+        av_dict_set(&tmp, "multiple_requests", "1", 0);
+    if (!int_cb) {
+        av_freep(pb);
+        int_cb = c->interrupt_callback;
+        if (persistent)
+            *pb = take_connection(c, url);
+    } else if (!persistent) {
+        avio_closep(pb);
+    }
+    if (*pb) {
+        ret = open_url_keepalive(s, pb, url, &tmp);
+        if (ret == AVERROR_EXIT) {
+            av_dict_free(&tmp);
+            return ret;
+        } else if (ret < 0) {
+            if (ret != AVERROR_EOF)
+                av_log(s, AV_LOG_WARNING,
+                       "keepalive request failed for '%s' with error: '%s' when opening url, retrying with new connection\n",
+                       url, av_err2str(ret));
+            ret = avio_open2(pb, url, AVIO_FLAG_READ, int_cb, &tmp);
+        }
+    } else {
+        ret = avio_open2(pb, url, AVIO_FLAG_READ, int_cb, &tmp);
+    }
     if (ret >= 0) {
         // update cookies on http response with setcookies.
         char *new_cookies = NULL;
@@ -1573,29 +1708,68 @@ finish:
     return ret;
 }
 
+static struct fragment *copy_fragment(const struct fragment *src)
+{
+    struct fragment *seg = av_mallocz(sizeof(struct fragment));
+
+    if (!seg)
+        return NULL;
+    seg->url = av_strdup(src->url);
+    if (!seg->url) {
+        av_free(seg);
+        return NULL;
+    }
+    seg->size = src->size;
+    seg->url_offset = src->url_offset;
+    return seg;
+}
+
+static struct fragment *get_template_fragment(struct representation *pls, int64_t seq_no)
+{
+    DASHContext *c = pls->parent->priv_data;
+    struct fragment *seg;
+    char *tmpfilename;
+
+    if (!pls->url_template) {
+        av_log(pls->parent, AV_LOG_ERROR, "Cannot get fragment, missing template URL\n");
+        return NULL;
+    }
+    seg = av_mallocz(sizeof(struct fragment));
+    if (!seg) {
+        return NULL;
+    }
+    tmpfilename = av_mallocz(c->max_url_size);
+    if (!tmpfilename) {
+        av_free(seg);
+        return NULL;
+    }
+    ff_dash_fill_tmpl_params(tmpfilename, c->max_url_size, pls->url_template, 0, seq_no, 0, get_segment_start_time_based_on_timeline(pls, seq_no));
+    seg->url = av_strireplace(pls->url_template, pls->url_template, tmpfilename);
+    if (!seg->url) {
+        av_log(pls->parent, AV_LOG_WARNING, "Unable to resolve template url '%s', try to use origin template\n", pls->url_template);
+        seg->url = av_strdup(pls->url_template);
+        if (!seg->url) {
+            av_log(pls->parent, AV_LOG_ERROR, "Cannot resolve template url '%s'\n", pls->url_template);
+            av_free(tmpfilename);
+            av_free(seg);
+            return NULL;
+        }
+    }
+    av_free(tmpfilename);
+    seg->size = -1;
+
+    return seg;
+}
+
 static struct fragment *get_current_fragment(struct representation *pls)
 {
     int64_t min_seq_no = 0;
     int64_t max_seq_no = 0;
-    struct fragment *seg = NULL;
-    struct fragment *seg_ptr = NULL;
     DASHContext *c = pls->parent->priv_data;
 
     while (( !ff_check_interrupt(c->interrupt_callback)&& pls->n_fragments > 0)) {
         if (pls->cur_seq_no < pls->n_fragments) {
-            seg_ptr = pls->fragments[pls->cur_seq_no];
-            seg = av_mallocz(sizeof(struct fragment));
-            if (!seg) {
-                return NULL;
-            }
-            seg->url = av_strdup(seg_ptr->url);
-            if (!seg->url) {
-                av_free(seg);
-                return NULL;
-            }
-            seg->size = seg_ptr->size;
-            seg->url_offset = seg_ptr->url_offset;
-            return seg;
+            return copy_fragment(pls->fragments[pls->cur_seq_no]);
         } else if (c->is_live) {
             refresh_manifest(pls->parent);
         } else {
@@ -1615,57 +1789,149 @@ static struct fragment *get_current_fragment(struct representation *pls)
         } else if (pls->cur_seq_no > max_seq_no) {
             av_log(pls->parent, AV_LOG_VERBOSE, "new fragment: min[%"PRId64"] max[%"PRId64"]\n", min_seq_no, max_seq_no);
         }
-        seg = av_mallocz(sizeof(struct fragment));
-        if (!seg) {
-            return NULL;
-        }
+        return get_template_fragment(pls, pls->cur_seq_no);
     } else if (pls->cur_seq_no <= pls->last_seq_no) {
-        seg = av_mallocz(sizeof(struct fragment));
-        if (!seg) {
-            return NULL;
-        }
+        return get_template_fragment(pls, pls->cur_seq_no);
     }
-    if (seg) {
-        char *tmpfilename;
-        if (!pls->url_template) {
-            av_log(pls->parent, AV_LOG_ERROR, "Cannot get fragment, missing template URL\n");
-            av_free(seg);
-            return NULL;
-        }
-        tmpfilename = av_mallocz(c->max_url_size);
-        if (!tmpfilename) {
-            av_free(seg);
-            return NULL;
-        }
-        ff_dash_fill_tmpl_params(tmpfilename, c->max_url_size, pls->url_template, 0, pls->cur_seq_no, 0, get_segment_start_time_based_on_timeline(pls, pls->cur_seq_no));
-        seg->url = av_strireplace(pls->url_template, pls->url_template, tmpfilename);
-        if (!seg->url) {
-            av_log(pls->parent, AV_LOG_WARNING, "Unable to resolve template url '%s', try to use origin template\n", pls->url_template);
-            seg->url = av_strdup(pls->url_template);
-            if (!seg->url) {
-                av_log(pls->parent, AV_LOG_ERROR, "Cannot resolve template url '%s'\n", pls->url_template);
-                av_free(tmpfilename);
-                av_free(seg);
-                return NULL;
-            }
-        }
-        av_free(tmpfilename);
-        seg->size = -1;
+
+    return NULL;
+}
+
+/*
+ * Prefetching: when prefetch_segments is set, the next fragments of the
+ * active representations are downloaded by a prefetch queue, while the
+ * demuxer reads the fragments from there.
+ */
+
+static int prefetch_open(void *opaque, FFPrefetch *p, AVIOContext **pb,
+                         const AVIOInterruptCB *int_cb)
+{
+    AVFormatContext *s = opaque;
+    DASHContext *c = s->priv_data;
+    AVDictionary *opts = NULL;
+    int is_http = 0, ret;
+
+    if (p->size >= 0) {
+        av_dict_set_int(&opts, "offset", p->url_offset, 0);
+        av_dict_set_int(&opts, "end_offset", p->url_offset + p->size, 0);
     }
+    ret = open_url(s, pb, p->url, &p->avio_opts, opts, &is_http, int_cb);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+    /* the worker keeps its connection: one opened with its interrupt
+     * callback must not outlive it in the pool of idle connections */
+    return is_http && c->http_persistent;
+}
 
-    return seg;
+static void prefetch_close(void *opaque, AVIOContext **pb, int reusable)
+{
+    avio_closep(pb);
+}
+
+/* Drop all the downloads of a representation. */
+static void prefetch_cancel(DASHContext *c, struct representation *rep)
+{
+    ff_prefetch_queue_cancel(c->prefetch, rep);
+    rep->cur_prefetch = NULL;
+}
+
+/* Queue the downloads of the next prefetch_segments fragments of rep which
+ * are already available, starting with the current one. */
+static void prefetch_schedule(AVFormatContext *s, struct representation *rep)
+{
+    DASHContext *c = s->priv_data;
+    int nb_reps = c->n_videos + c->n_audios + c->n_subtitles;
+    int64_t seq_no, max_seq_no;
+    char *url;
+
+    /* a single fragment is read with seeks by the inner demuxer */
+    if (!c->prefetch || rep->n_fragments == 1)
+        return;
+    url = av_malloc(c->max_url_size);
+    if (!url)
+        return;
+
+    if (rep->n_fragments)
+        max_seq_no = rep->n_fragments - 1;
+    else
+        max_seq_no = c->is_live ? calc_max_seg_no(rep, c) : rep->last_seq_no;
+
+    ff_prefetch_queue_start(c->prefetch, c->prefetch_segments * nb_reps);
+    ff_prefetch_queue_release_before(c->prefetch, rep, rep->cur_seq_no,
+                                     rep->cur_prefetch);
+
+    for (seq_no = FFMAX(rep->cur_seq_no, 0);
+         seq_no < rep->cur_seq_no + c->prefetch_segments && seq_no <= max_seq_no;
+         seq_no++) {
+        struct fragment *seg;
+        int ret;
+
+        if (ff_prefetch_queue_has(c->prefetch, rep, seq_no))
+            continue;
+        if (seq_no > rep->cur_seq_no && ff_prefetch_queue_full(c->prefetch))
+            break;
+        seg = rep->n_fragments ? copy_fragment(rep->fragments[seq_no]) :
+                                 get_template_fragment(rep, seq_no);
+        if (!seg)
+            break;
+        ff_make_absolute_url(url, c->max_url_size, c->base_url, seg->url);
+        ret = ff_prefetch_queue_add(c->prefetch, rep, seq_no, url,
+                                    seg->url_offset, seg->size, c->avio_opts);
+        free_fragment(&seg);
+        if (ret < 0)
+            break;
+    }
+    av_free(url);
+}
+
+/*
+ * Get the download of a fragment, waiting for its first data.
+ * Return NULL if there is none or if it failed without data.
+ */
+static FFPrefetch *prefetch_take(DASHContext *c, struct representation *rep,
+                                 int64_t seq_no)
+{
+    FFPrefetchStats stats;
+    int64_t stall_time;
+    FFPrefetch *p = ff_prefetch_queue_take(c->prefetch, rep, seq_no, &stall_time);
+
+    if (stall_time >= 0) {
+        c->segment_stalls++;
+        c->segment_stall_time += stall_time;
+    }
+    ff_prefetch_queue_get_stats(c->prefetch, &stats);
+    c->prefetch_bytes      = stats.downloaded;
+    c->prefetch_throughput = stats.throughput;
+
+    return p;
+}
+
+/* Stop reading the current fragment of pls, keeping the connection for
+ * the next request if the fragment was read entirely. */
+static void close_input(struct representation *pls)
+{
+    DASHContext *c = pls->parent->priv_data;
+
+    ff_prefetch_queue_release(c->prefetch, &pls->cur_prefetch);
+    release_connection(pls->parent, &pls->input, pls->input_read_done);
+    pls->input_read_done = 0;
 }
 
 static int read_from_url(struct representation *pls, struct fragment *seg,
                          uint8_t *buf, int buf_size)
 {
+    DASHContext *c = pls->parent->priv_data;
     int ret;
 
     /* limit read if the fragment was only a part of a file */
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, pls->cur_seg_size - pls->cur_seg_offset);
 
-    ret = avio_read(pls->input, buf, buf_size);
+    if (pls->cur_prefetch)
+        ret = ff_prefetch_queue_read(c->prefetch, pls->cur_prefetch, buf, buf_size);
+    else
+        ret = avio_read(pls->input, buf, buf_size);
     if (ret > 0)
         pls->cur_seg_offset += ret;
 
@@ -1694,7 +1960,7 @@ static int open_input(DASHContext *c, struct representation *pls, struct fragmen
     ff_make_absolute_url(url, c->max_url_size, c->base_url, seg->url);
     av_log(pls->parent, AV_LOG_VERBOSE, "DASH request for url '%s', offset %"PRId64"\n",
            url, seg->url_offset);
-    ret = open_url(pls->parent, &pls->input, url, &c->avio_opts, opts, NULL);
+    ret = open_url(pls->parent, &pls->input, url, &c->avio_opts, opts, NULL, NULL);
 
 cleanup:
     av_free(url);
@@ -1710,6 +1976,7 @@ static int update_init_section(struct representation *pls)
     DASHContext *c = pls->parent->priv_data;
     int64_t sec_size;
     int64_t urlsize;
+    int known_size = 1;
     int ret;
 
     if (!pls->init_section || pls->init_sec_buf)
@@ -1726,8 +1993,10 @@ static int update_init_section(struct representation *pls)
         sec_size = pls->init_section->size;
     else if ((urlsize = avio_size(pls->input)) >= 0)
         sec_size = urlsize;
-    else
+    else {
         sec_size = max_init_section_size;
+        known_size = 0;
+    }
 
     av_log(pls->parent, AV_LOG_DEBUG,
            "Downloading an initialization section of size %"PRId64"\n",
@@ -1739,7 +2008,9 @@ static int update_init_section(struct representation *pls)
 
     ret = read_from_url(pls, pls->init_section, pls->init_sec_buf,
                         pls->init_sec_buf_size);
-    ff_format_io_close(pls->parent, &pls->input);
+    pls->input_read_done = ret >= 0 &&
+                           (avio_feof(pls->input) || (known_size && ret == sec_size));
+    close_input(pls);
 
     if (ret < 0)
         return ret;
@@ -1753,7 +2024,7 @@ static int update_init_section(struct representation *pls)
 static int64_t seek_data(void *opaque, int64_t offset, int whence)
 {
     struct representation *v = opaque;
-    if (v->n_fragments && !v->init_sec_data_len) {
+    if (v->n_fragments && !v->init_sec_data_len && v->input) {
         return avio_seek(v->input, offset, whence);
     }
 
@@ -1767,7 +2038,7 @@ static int read_data(void *opaque, uint8_t *buf, int buf_size)
     DASHContext *c = v->parent->priv_data;
 
 restart:
-    if (!v->input) {
+    if (!v->input && !v->cur_prefetch) {
         free_fragment(&v->cur_seg);
         v->cur_seg = get_current_fragment(v);
         if (!v->cur_seg) {
@@ -1780,7 +2051,15 @@ restart:
         if (ret)
             goto end;
 
-        ret = open_input(c, v, v->cur_seg);
+        prefetch_schedule(v->parent, v);
+        v->cur_prefetch = prefetch_take(c, v, v->cur_seq_no);
+        if (v->cur_prefetch) {
+            v->cur_seg_offset = 0;
+            v->cur_seg_size   = v->cur_seg->size;
+            ret = 0;
+        } else {
+            ret = open_input(c, v, v->cur_seg);
+        }
         if (ret < 0) {
             if (ff_check_interrupt(c->interrupt_callback)) {
                 ret = AVERROR_EXIT;
@@ -1812,6 +2091,8 @@ restart:
     ret = read_from_url(v, v->cur_seg, buf, buf_size);
     if (ret > 0)
         goto end;
+    if (!ret || ret == AVERROR_EOF)
+        v->input_read_done = 1;
 
     if (c->is_live || v->cur_seq_no < v->last_seq_no) {
         if (!v->is_restart_needed)
@@ -2041,9 +2322,24 @@ static int dash_read_header(AVFormatContext *s)
 
     c->interrupt_callback = &s->interrupt_callback;
 
+    if ((ret = ff_mutex_init(&c->conn_lock, NULL))) {
+        av_log(s, AV_LOG_ERROR, "ff_mutex_init failed : %s\n", av_err2str(AVERROR(ret)));
+        return AVERROR(ret);
+    }
+
     if ((ret = save_avio_options(s)) < 0)
         goto fail;
 
+    if (c->prefetch_segments &&
+        (ret = ff_prefetch_queue_alloc(&c->prefetch, s, c->prefetch_max_size,
+                                       &s->interrupt_callback,
+                                       prefetch_open, prefetch_close, s)) < 0) {
+        if (ret != AVERROR(ENOSYS))
+            goto fail;
+        av_log(s, AV_LOG_WARNING, "Fragment prefetching requires threads, disabling it\n");
+        c->prefetch_segments = 0;
+    }
+
     if ((ret = parse_manifest(s, s->url, s->pb)) < 0)
         goto fail;
 
@@ -2181,7 +2477,8 @@ static void recheck_discard_flags(AVFormatContext *s, struct representation **p,
             av_log(s, AV_LOG_INFO, "Now receiving stream_index %d\n", pls->stream_index);
         } else if (!needed && pls->ctx) {
             close_demux_for_component(pls);
-            ff_format_io_close(pls->parent, &pls->input);
+            prefetch_cancel(s->priv_data, pls);
+            close_input(pls);
             av_log(s, AV_LOG_INFO, "No longer receiving stream_index %d\n", pls->stream_index);
         }
     }
@@ -2242,7 +2539,7 @@ static int dash_read_packet(AVFormatContext *s, AVPacket *pkt)
         if (cur->is_restart_needed) {
             cur->cur_seg_offset = 0;
             cur->init_sec_buf_read_offset = 0;
-            ff_format_io_close(cur->parent, &cur->input);
+            close_input(cur);
             ret = reopen_demux_for_component(s, cur);
             cur->is_restart_needed = 0;
         }
@@ -2253,9 +2550,12 @@ static int dash_read_packet(AVFormatContext *s, AVPacket *pkt)
 static int dash_close(AVFormatContext *s)
 {
     DASHContext *c = s->priv_data;
+    ff_prefetch_queue_free(&c->prefetch);
     free_audio_list(c);
     free_video_list(c);
     free_subtitle_list(c);
+    close_idle_connections(s);
+    ff_mutex_destroy(&c->conn_lock);
     av_dict_free(&c->avio_opts);
     av_freep(&c->base_url);
     return 0;
@@ -2281,7 +2581,8 @@ static int dash_seek(AVFormatContext *s, struct representation *pls, int64_t see
         return av_seek_frame(pls->ctx, -1, seek_pos_msec * 1000, flags);
     }
 
-    ff_format_io_close(pls->parent, &pls->input);
+    prefetch_cancel(s->priv_data, pls);
+    close_input(pls);
 
     // find the nearest fragment
     if (pls->n_timelines > 0 && pls->fragment_timescale > 0) {
@@ -2379,6 +2680,20 @@ static const AVOption dash_options[] = {
         OFFSET(allowed_extensions), AV_OPT_TYPE_STRING,
         {.str = "aac,m4a,m4s,m4v,mov,mp4,webm,ts"},
         INT_MIN, INT_MAX, FLAGS},
+    {"http_persistent", "Use persistent HTTP connections",
+        OFFSET(http_persistent), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, FLAGS },
+    {"prefetch_segments", "Number of fragments of each representation to download ahead in background threads, 0 = disable",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, FLAGS},
+    {"prefetch_max_size", "Maximum memory used by the downloads ahead",
+        OFFSET(prefetch_max_size), AV_OPT_TYPE_INT64, {.i64 = 64 * 1024 * 1024}, 0, INT64_MAX, FLAGS},
+    {"segment_stalls", "Number of times the demuxer waited for a prefetched fragment",
+        OFFSET(segment_stalls), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, FLAGS | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
+    {"segment_stall_time", "Time the demuxer waited for prefetched fragments, in microseconds",
+        OFFSET(segment_stall_time), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, FLAGS | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
+    {"prefetch_bytes", "Number of bytes downloaded ahead",
+        OFFSET(prefetch_bytes), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, FLAGS | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
+    {"prefetch_throughput", "Average download rate of the downloads ahead, in bytes per second",
+        OFFSET(prefetch_throughput), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, FLAGS | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
     {NULL}
 };
 
@@ -47,6 +47,7 @@
 #include "internal.h"
 #include "isom.h"
 #include "os_support.h"
+#include "uploadqueue.h"
 #include "url.h"
 #include "vpcc.h"
 #include "dash.h"
@@ -199,6 +200,18 @@ typedef struct DASHContext {
     AVRational min_playback_rate;
     AVRational max_playback_rate;
     int64_t update_period;
+    int upload_connections;
+    int upload_queue_size;
+    int upload_retries;
+    FFUploadQueue *upload_queue;
+
+    /* exported statistics */
+    int64_t upload_queue_depth;
+    int64_t upload_max_queue_depth;
+    int64_t upload_latency;
+    int64_t upload_max_latency;
+    int64_t upload_retry_count;
+    int64_t upload_failures;
 } DASHContext;
 
 static struct codec_string {
@@ -228,6 +241,13 @@ static int dashenc_io_open(AVFormatContext *s, AVIOContext **pb, char *filename,
     DASHContext *c = s->priv_data;
     int http_base_proto = filename ? ff_is_http_proto(filename) : 0;
     int err = AVERROR_MUXER_NOT_FOUND;
+    if (c->upload_queue && http_base_proto) {
+        /* report the uploads which failed in the background */
+        if ((err = ff_upload_queue_get_error(c->upload_queue)) < 0)
+            return err;
+        return ff_upload_queue_open(c->upload_queue, pb, filename,
+                                    av_match_ext(filename, "mpd,m3u8") ? FF_UPLOAD_ORDERED : 0);
+    }
     if (!*pb || !http_base_proto || !c->http_persistent) {
         err = s->io_open(s, pb, filename, AVIO_FLAG_WRITE, options);
 #if CONFIG_HTTP_PROTOCOL
@@ -249,7 +269,12 @@ static void dashenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filenam
     if (!*pb)
         return;
 
-    if (!http_base_proto || !c->http_persistent) {
+    if (c->upload_queue && ff_upload_queue_owns(c->upload_queue, *pb)) {
+        int ret = ff_upload_queue_submit(c->upload_queue, pb);
+        if (ret < 0)
+            av_log(s, AV_LOG_ERROR, "Cannot queue the upload of %s: %s\n",
+                   filename, av_err2str(ret));
+    } else if (!http_base_proto || !c->http_persistent) {
         ff_format_io_close(s, pb);
 #if CONFIG_HTTP_PROTOCOL
     } else {
@@ -635,6 +660,8 @@ static void dash_free(AVFormatContext *s)
             else
                 avio_close(os->ctx->pb);
         }
+        if (c->upload_queue)
+            ff_upload_queue_discard(c->upload_queue, &os->out);
         ff_format_io_close(s, &os->out);
         avformat_free_context(os->ctx);
         avcodec_free_context(&os->parser_avctx);
@@ -648,6 +675,11 @@ static void dash_free(AVFormatContext *s)
     }
     av_freep(&c->streams);
 
+    if (c->upload_queue) {
+        ff_upload_queue_discard(c->upload_queue, &c->mpd_out);
+        ff_upload_queue_discard(c->upload_queue, &c->m3u8_out);
+        ff_upload_queue_free(&c->upload_queue);
+    }
     ff_format_io_close(s, &c->mpd_out);
     ff_format_io_close(s, &c->m3u8_out);
 }
@@ -1406,6 +1438,28 @@ static int dash_init(AVFormatContext *s)
         c->target_latency = 0;
     }
 
+    if (c->upload_connections > 0) {
+        if (c->single_file || c->streaming) {
+            av_log(s, AV_LOG_WARNING, "upload_connections is not supported with "
+                   "single_file or streaming, uploading synchronously\n");
+        } else if (!ff_format_io_is_default(s)) {
+            av_log(s, AV_LOG_WARNING, "upload_connections bypasses the custom "
+                   "io_open callback, uploading synchronously\n");
+        } else {
+            AVDictionary *opts = NULL;
+            set_http_options(&opts, c);
+            ret = ff_upload_queue_alloc(&c->upload_queue, s, c->upload_connections,
+                                        c->upload_queue_size, c->upload_retries,
+                                        c->http_persistent, opts);
+            av_dict_free(&opts);
+            if (ret == AVERROR(ENOSYS))
+                av_log(s, AV_LOG_WARNING, "upload_connections requires threads, "
+                       "uploading synchronously\n");
+            else if (ret < 0)
+                return ret;
+        }
+    }
+
     if (c->global_sidx && !c->single_file) {
         av_log(s, AV_LOG_WARNING, "Global SIDX option will be ignored as single_file is not enabled\n");
         c->global_sidx = 0;
@@ -1574,7 +1628,7 @@ static int dash_init(AVFormatContext *s)
         if (!c->single_file) {
             if ((ret = avio_open_dyn_buf(&ctx->pb)) < 0)
                 return ret;
-            ret = s->io_open(s, &os->out, filename, AVIO_FLAG_WRITE, &opts);
+            ret = dashenc_io_open(s, &os->out, filename, &opts);
         } else {
             ctx->url = av_strdup(filename);
             ret = avio_open2(&ctx->pb, filename, AVIO_FLAG_WRITE, NULL, &opts);
@@ -1839,7 +1893,11 @@ static void dashenc_delete_file(AVFormatContext *s, char *filename) {
     DASHContext *c = s->priv_data;
     int http_base_proto = ff_is_http_proto(filename);
 
-    if (http_base_proto) {
+    if (http_base_proto && c->upload_queue) {
+        int ret = ff_upload_queue_delete(c->upload_queue, filename);
+        if (ret < 0)
+            av_log(s, AV_LOG_ERROR, "failed to delete %s: %s\n", filename, av_err2str(ret));
+    } else if (http_base_proto) {
         AVIOContext *out = NULL;
         AVDictionary *http_opts = NULL;
 
@@ -2052,6 +2110,21 @@ static int dash_parse_prft(DASHContext *c, AVPacket *pkt)
     return 0;
 }
 
+static void update_upload_stats(DASHContext *c)
+{
+    FFUploadStats stats;
+
+    if (!c->upload_queue)
+        return;
+    ff_upload_queue_get_stats(c->upload_queue, &stats);
+    c->upload_queue_depth     = stats.queue_depth;
+    c->upload_max_queue_depth = stats.max_queue_depth;
+    c->upload_latency         = stats.latency;
+    c->upload_max_latency     = stats.max_latency;
+    c->upload_retry_count     = stats.retries;
+    c->upload_failures        = stats.failures;
+}
+
 static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
 {
     DASHContext *c = s->priv_data;
@@ -2173,6 +2246,7 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
 
         if ((ret = dash_flush(s, 0, pkt->stream_index)) < 0)
             return ret;
+        update_upload_stats(c);
     }
 
     if (!os->packets_written) {
@@ -2309,6 +2383,13 @@ static int dash_write_trailer(AVFormatContext *s)
         }
     }
 
+    if (c->upload_queue) {
+        int ret = ff_upload_queue_flush(c->upload_queue);
+        update_upload_stats(c);
+        if (ret < 0 && !c->ignore_io_errors)
+            return ret;
+    }
+
     return 0;
 }
 
@@ -2384,6 +2465,21 @@ static const AVOption options[] = {
     { "min_playback_rate", "Set desired minimum playback rate", OFFSET(min_playback_rate), AV_OPT_TYPE_RATIONAL, { .dbl = 1.0 }, 0.5, 1.5, E },
     { "max_playback_rate", "Set desired maximum playback rate", OFFSET(max_playback_rate), AV_OPT_TYPE_RATIONAL, { .dbl = 1.0 }, 0.5, 1.5, E },
     { "update_period", "Set the mpd update interval", OFFSET(update_period), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, E},
+    { "upload_connections", "upload HTTP files in the background over this many connections", OFFSET(upload_connections), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 16, E },
+    { "upload_queue_size", "set the maximum number of files waiting for upload", OFFSET(upload_queue_size), AV_OPT_TYPE_INT, {.i64 = 16}, 1, INT_MAX, E },
+    { "upload_retries", "set the number of retries of a failed upload", OFFSET(upload_retries), AV_OPT_TYPE_INT, {.i64 = 3}, 0, 10, E },
+    { "upload_queue_depth", "Number of uploads queued or in progress",
+        OFFSET(upload_queue_depth), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, E | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "upload_max_queue_depth", "Maximum number of uploads queued or in progress",
+        OFFSET(upload_max_queue_depth), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, E | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "upload_latency", "Mean time from the end of a file to the end of its upload in microseconds",
+        OFFSET(upload_latency), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, E | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "upload_max_latency", "Maximum time from the end of a file to the end of its upload in microseconds",
+        OFFSET(upload_max_latency), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, E | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "upload_retry_count", "Number of uploads retried",
+        OFFSET(upload_retry_count), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, E | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "upload_failures", "Number of uploads given up after all retries",
+        OFFSET(upload_failures), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, E | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     { NULL },
 };
 
@@ -30,6 +30,9 @@
 #if HAVE_IO_H
 #include <io.h>
 #endif
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #if HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -37,6 +40,9 @@
 #include <stdlib.h>
 #include "os_support.h"
 #include "url.h"
+#if HAVE_IO_URING
+#include "uring.h"
+#endif
 
 /* Some systems may not have S_ISFIFO */
 #ifndef S_ISFIFO
@@ -67,6 +73,18 @@
 
 /* standard file protocol */
 
+#if HAVE_IO_URING
+#define URING_BLOCK_SIZE 262144
+
+typedef struct FileBlock {
+    uint8_t *data;
+    int64_t pos;
+    int size;
+    int result;     ///< bytes transferred or negative errno of the request
+    int pending;
+} FileBlock;
+#endif
+
 typedef struct FileContext {
     const AVClass *class;
     int fd;
@@ -74,6 +92,22 @@ typedef struct FileContext {
     int blocksize;
     int follow;
     int seekable;
+    int use_mmap;
+    int64_t page_size;      ///< nonzero if packets can be mapped
+    int use_io_uring;
+    int queue_depth;
+    int fsync;
+#if HAVE_IO_URING
+    FFURing *ring;
+    FileBlock *blocks;      ///< queue_depth blocks, used as a circular queue
+    int first;              ///< oldest queued block
+    int nb_queued;          ///< blocks in flight or completed, in file order
+    int window;             ///< number of blocks to read ahead
+    int fill;               ///< bytes in the block being filled for writing
+    int64_t pos;            ///< position of the next read or write
+    int64_t next_pos;       ///< position of the next block to read ahead
+    int error;              ///< write error reported by the next call
+#endif
 #if HAVE_DIRENT_H
     DIR *dir;
 #endif
@@ -84,6 +118,10 @@ static const AVOption file_options[] = {
     { "blocksize", "set I/O operation maximum block size", offsetof(FileContext, blocksize), AV_OPT_TYPE_INT, { .i64 = INT_MAX }, 1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM },
     { "follow", "Follow a file as it is being written", offsetof(FileContext, follow), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { "seekable", "Sets if the file is seekable", offsetof(FileContext, seekable), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "mmap", "Map regular files in memory so that demuxers can reference packets without copying them", offsetof(FileContext, use_mmap), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+    { "io_uring", "Use io_uring for asynchronous read-ahead and write-behind", offsetof(FileContext, use_io_uring), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "queue_depth", "set the maximum number of io_uring requests in flight", offsetof(FileContext, queue_depth), AV_OPT_TYPE_INT, { .i64 = 8 }, 1, 64, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "fsync", "synchronize written data to storage on close (-1 = only with io_uring)", offsetof(FileContext, fsync), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 1, AV_OPT_FLAG_ENCODING_PARAM },
     { NULL }
 };
 
@@ -106,10 +144,191 @@ static const AVClass pipe_class = {
     .version    = LIBAVUTIL_VERSION_INT,
 };
 
+#if HAVE_IO_URING
+static int uring_wait(FileContext *c, FileBlock *b)
+{
+    while (b->pending) {
+        struct io_uring_cqe cqe;
+        int ret = ff_uring_get_cqe(c->ring, &cqe, 1);
+        if (ret < 0)
+            return ret;
+        c->blocks[cqe.user_data].result  = cqe.res;
+        c->blocks[cqe.user_data].pending = 0;
+    }
+    return 0;
+}
+
+static int uring_submit(FileContext *c, FileBlock *b, int opcode)
+{
+    struct io_uring_sqe *sqe = ff_uring_get_sqe(c->ring);
+    int ret;
+
+    if (!sqe)
+        return AVERROR(EAGAIN);
+    sqe->opcode    = opcode;
+    sqe->fd        = c->fd;
+    sqe->off       = b->pos;
+    sqe->addr      = (uintptr_t)b->data;
+    sqe->len       = b->size;
+    sqe->user_data = b - c->blocks;
+    ret = ff_uring_submit(c->ring);
+    if (ret <= 0)
+        return ret < 0 ? ret : AVERROR(EIO);
+    b->pending = 1;
+    return 0;
+}
+
+/**
+ * Wait for the oldest block and remove it from the queue. Written blocks
+ * are retired in file order, so that errors are reported in that order.
+ */
+static int uring_retire(URLContext *h)
+{
+    FileContext *c = h->priv_data;
+    FileBlock *b = &c->blocks[c->first];
+    int ret = uring_wait(c, b);
+    int done;
+
+    c->first = (c->first + 1) % c->queue_depth;
+    c->nb_queued--;
+    if (ret < 0 || !(h->flags & AVIO_FLAG_WRITE))
+        return ret;
+    if (b->result < 0)
+        return AVERROR(-b->result);
+    /* complete short writes synchronously */
+    for (done = b->result; done < b->size; done += ret) {
+        ret = pwrite(c->fd, b->data + done, b->size - done, b->pos + done);
+        if (ret < 0)
+            return AVERROR(errno);
+    }
+    return 0;
+}
+
+static int uring_drain(URLContext *h)
+{
+    FileContext *c = h->priv_data;
+    int ret = 0;
+
+    while (c->nb_queued) {
+        int err = uring_retire(h);
+        if (err < 0 && ret >= 0)
+            ret = err;
+    }
+    return ret;
+}
+
+static int uring_read(URLContext *h, unsigned char *buf, int size)
+{
+    FileContext *c = h->priv_data;
+    FileBlock *b;
+    int ret;
+
+    /* skip the blocks before the read position, start over after a
+     * backward seek or a seek beyond the read-ahead */
+    while (c->nb_queued) {
+        b = &c->blocks[c->first];
+        if (c->pos >= b->pos && c->pos < b->pos + b->size)
+            break;
+        if (c->pos < b->pos || c->pos >= c->next_pos) {
+            if ((ret = uring_drain(h)) < 0)
+                return ret;
+            c->window = 1;
+            break;
+        }
+        if ((ret = uring_retire(h)) < 0)
+            return ret;
+    }
+
+    if (!c->nb_queued)
+        c->next_pos = c->pos;
+    while (c->nb_queued < c->window) {
+        b = &c->blocks[(c->first + c->nb_queued) % c->queue_depth];
+        b->pos  = c->next_pos;
+        b->size = URING_BLOCK_SIZE;
+        if ((ret = uring_submit(c, b, IORING_OP_READ)) < 0)
+            return ret;
+        c->next_pos += b->size;
+        c->nb_queued++;
+    }
+
+    b = &c->blocks[c->first];
+    if ((ret = uring_wait(c, b)) < 0)
+        return ret;
+    if (b->result <= c->pos - b->pos) {
+        if (b->result < 0)
+            ret = AVERROR(-b->result);
+        else
+            ret = c->follow ? AVERROR(EAGAIN) : AVERROR_EOF;
+        /* read again from the same position on the next call */
+        uring_drain(h);
+        return ret;
+    }
+
+    size = FFMIN3(size, c->blocksize, b->result - (c->pos - b->pos));
+    memcpy(buf, b->data + c->pos - b->pos, size);
+    c->pos += size;
+    if (c->pos == b->pos + b->result) {
+        uring_retire(h);
+        /* sequential access, read further ahead */
+        if (b->result == b->size)
+            c->window = FFMIN(2 * c->window, c->queue_depth);
+    }
+    return size;
+}
+
+static int uring_flush(FileContext *c)
+{
+    FileBlock *b = &c->blocks[(c->first + c->nb_queued) % c->queue_depth];
+    int ret;
+
+    if (!c->fill)
+        return 0;
+    b->size = c->fill;
+    c->fill = 0;
+    if ((ret = uring_submit(c, b, IORING_OP_WRITE)) < 0)
+        return ret;
+    c->nb_queued++;
+    return 0;
+}
+
+static int uring_write(URLContext *h, const unsigned char *buf, int size)
+{
+    FileContext *c = h->priv_data;
+    int written = 0, ret;
+
+    if (c->error)
+        return c->error;
+    size = FFMIN(size, c->blocksize);
+    while (written < size) {
+        FileBlock *b;
+        int len;
+
+        if (!c->fill && c->nb_queued == c->queue_depth &&
+            (ret = uring_retire(h)) < 0)
+            return c->error = ret;
+        b = &c->blocks[(c->first + c->nb_queued) % c->queue_depth];
+        if (!c->fill)
+            b->pos = c->pos;
+        len = FFMIN(size - written, URING_BLOCK_SIZE - c->fill);
+        memcpy(b->data + c->fill, buf + written, len);
+        c->fill += len;
+        c->pos  += len;
+        written += len;
+        if (c->fill == URING_BLOCK_SIZE && (ret = uring_flush(c)) < 0)
+            return c->error = ret;
+    }
+    return written;
+}
+#endif
+
 static int file_read(URLContext *h, unsigned char *buf, int size)
 {
     FileContext *c = h->priv_data;
     int ret;
+#if HAVE_IO_URING
+    if (c->ring)
+        return uring_read(h, buf, size);
+#endif
     size = FFMIN(size, c->blocksize);
     ret = read(c->fd, buf, size);
     if (ret == 0 && c->follow)
@@ -123,6 +342,10 @@ static int file_write(URLContext *h, const unsigned char *buf, int size)
 {
     FileContext *c = h->priv_data;
     int ret;
+#if HAVE_IO_URING
+    if (c->ring)
+        return uring_write(h, buf, size);
+#endif
     size = FFMIN(size, c->blocksize);
     ret = write(c->fd, buf, size);
     return (ret == -1) ? AVERROR(errno) : ret;
@@ -205,6 +428,177 @@ static int file_move(URLContext *h_src, URLContext *h_dst)
 
 #if CONFIG_FILE_PROTOCOL
 
+#if HAVE_MMAP
+/* packets smaller than this are cheaper to copy than to map */
+#define MIN_MAPPED_SIZE 65536
+
+typedef struct FileMapping {
+    uint8_t *data;
+    size_t size;
+} FileMapping;
+
+static void file_unmap(void *opaque, uint8_t *data)
+{
+    FileMapping *m = opaque;
+
+    munmap(m->data, m->size);
+    av_free(m);
+}
+
+/*
+ * Each reference gets its own private mapping, so that its padding can be
+ * cleared: this only copies the pages holding the padding, while the other
+ * pages are shared with the page cache. The mapping stays valid after the
+ * file is closed.
+ */
+static int file_get_mapping(URLContext *h, AVBufferRef **buf, int64_t pos,
+                            int size, int padding)
+{
+    FileContext *c = h->priv_data;
+    FileMapping *m;
+    struct stat st;
+    int64_t start;
+
+    if (!c->page_size || size < MIN_MAPPED_SIZE)
+        return AVERROR(ENOSYS);
+    /* bytes past the end of the file cannot be accessed, and accessing the
+     * mapping of a file truncated afterwards raises SIGBUS */
+    if (pos < 0 || fstat(c->fd, &st) < 0 || pos > st.st_size - size - padding)
+        return AVERROR(ENOSYS);
+
+    m = av_mallocz(sizeof(*m));
+    if (!m)
+        return AVERROR(ENOMEM);
+    start   = pos & ~(c->page_size - 1);
+    m->size = pos - start + size + padding;
+    m->data = mmap(NULL, m->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, c->fd, start);
+    if (m->data == MAP_FAILED) {
+        int ret = AVERROR(errno);
+        av_free(m);
+        return ret;
+    }
+    memset(m->data + m->size - padding, 0, padding);
+    mprotect(m->data, m->size, PROT_READ);
+
+    *buf = av_buffer_create(m->data + pos - start, size + padding, file_unmap,
+                            m, AV_BUFFER_FLAG_READONLY);
+    if (!*buf) {
+        file_unmap(m, NULL);
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+#endif
+
+#if HAVE_IO_URING
+static void uring_free(FileContext *c)
+{
+    int i;
+
+    if (c->ring)
+        ff_uring_free(c->ring);
+    av_freep(&c->ring);
+    for (i = 0; c->blocks && i < c->queue_depth; i++)
+        av_free(c->blocks[i].data);
+    av_freep(&c->blocks);
+}
+
+static int uring_open(URLContext *h)
+{
+    FileContext *c = h->priv_data;
+    int i, ret;
+
+    c->blocks = av_mallocz_array(c->queue_depth, sizeof(*c->blocks));
+    if (!c->blocks)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < c->queue_depth; i++) {
+        c->blocks[i].data = av_malloc(URING_BLOCK_SIZE);
+        if (!c->blocks[i].data) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+    }
+    c->ring = av_malloc(sizeof(*c->ring));
+    if (!c->ring) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    ret = ff_uring_init(c->ring, c->queue_depth);
+    if (ret < 0) {
+        av_freep(&c->ring);
+        goto fail;
+    }
+    /* IORING_OP_READ and IORING_OP_WRITE came with this feature */
+    if (!(c->ring->features & IORING_FEAT_RW_CUR_POS)) {
+        ret = AVERROR(ENOSYS);
+        goto fail;
+    }
+    c->window = 1;
+    return 0;
+
+fail:
+    uring_free(c);
+    return ret;
+}
+
+/* blocks in flight all end before the write position */
+static int64_t uring_size(URLContext *h)
+{
+    FileContext *c = h->priv_data;
+    struct stat st;
+
+    if (fstat(c->fd, &st) < 0)
+        return AVERROR(errno);
+    return h->flags & AVIO_FLAG_WRITE ? FFMAX(st.st_size, c->pos) : st.st_size;
+}
+
+static int64_t uring_seek(URLContext *h, int64_t pos, int whence)
+{
+    FileContext *c = h->priv_data;
+    int64_t size;
+    int ret;
+
+    switch (whence) {
+    case AVSEEK_SIZE:
+        return uring_size(h);
+    case SEEK_CUR:
+        pos += c->pos;
+        break;
+    case SEEK_END:
+        if ((size = uring_size(h)) < 0)
+            return size;
+        pos += size;
+        break;
+    }
+    if (pos < 0)
+        return AVERROR(EINVAL);
+
+    /* later writes may overlap the ones in flight */
+    if (pos != c->pos && h->flags & AVIO_FLAG_WRITE) {
+        if (c->error)
+            return c->error;
+        if ((ret = uring_flush(c)) < 0 || (ret = uring_drain(h)) < 0)
+            return c->error = ret;
+    }
+    c->pos = pos;
+    return pos;
+}
+
+static int uring_close(URLContext *h)
+{
+    FileContext *c = h->priv_data;
+    int ret = c->error, err;
+
+    if (!ret && h->flags & AVIO_FLAG_WRITE)
+        ret = uring_flush(c);
+    err = uring_drain(h);
+    if (err < 0 && !ret && h->flags & AVIO_FLAG_WRITE)
+        ret = err;
+    uring_free(c);
+    return ret;
+}
+#endif
+
 static int file_open(URLContext *h, const char *filename, int flags)
 {
     FileContext *c = h->priv_data;
@@ -243,6 +637,25 @@ static int file_open(URLContext *h, const char *filename, int flags)
     if (c->seekable >= 0)
         h->is_streamed = !c->seekable;
 
+#if HAVE_MMAP
+    if (c->use_mmap && !(flags & AVIO_FLAG_WRITE) && !c->follow &&
+        !fstat(fd, &st) && S_ISREG(st.st_mode))
+        c->page_size = FFMAX(sysconf(_SC_PAGESIZE), 0);
+#endif
+
+#if HAVE_IO_URING
+    if (c->use_io_uring && !h->is_streamed &&
+        !(flags & AVIO_FLAG_WRITE && flags & AVIO_FLAG_READ) &&
+        !fstat(fd, &st) && S_ISREG(st.st_mode)) {
+        int ret = uring_open(h);
+        if (ret < 0)
+            av_log(h, AV_LOG_VERBOSE, "Cannot use io_uring, falling back to "
+                   "blocking I/O: %s\n", av_err2str(ret));
+        else if (c->fsync < 0)
+            c->fsync = !!(flags & AVIO_FLAG_WRITE);
+    }
+#endif
+
     return 0;
 }
 
@@ -252,6 +665,11 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
     FileContext *c = h->priv_data;
     int64_t ret;
 
+#if HAVE_IO_URING
+    if (c->ring)
+        return uring_seek(h, pos, whence);
+#endif
+
     if (whence == AVSEEK_SIZE) {
         struct stat st;
         ret = fstat(c->fd, &st);
@@ -266,7 +684,19 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
 static int file_close(URLContext *h)
 {
     FileContext *c = h->priv_data;
-    return close(c->fd);
+    int ret = 0;
+
+#if HAVE_IO_URING
+    if (c->ring)
+        ret = uring_close(h);
+#endif
+#if HAVE_FSYNC
+    if (c->fsync > 0 && h->flags & AVIO_FLAG_WRITE && fsync(c->fd) < 0 && !ret)
+        ret = AVERROR(errno);
+#endif
+    if (close(c->fd) < 0 && !ret)
+        ret = AVERROR(errno);
+    return ret;
 }
 
 static int file_open_dir(URLContext *h)
@@ -361,6 +791,9 @@ const URLProtocol ff_file_protocol = {
     .url_seek            = file_seek,
     .url_close           = file_close,
     .url_get_file_handle = file_get_handle,
+#if HAVE_MMAP
+    .url_get_mapping     = file_get_mapping,
+#endif
     .url_check           = file_check,
     .url_delete          = file_delete,
     .url_move            = file_move,
@@ -29,6 +29,7 @@
 #include "libavformat/http.h"
 #include "libavutil/avstring.h"
 #include "libavutil/avassert.h"
+#include "libavutil/bprint.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
@@ -38,6 +39,7 @@
 #include "internal.h"
 #include "avio_internal.h"
 #include "id3v2.h"
+#include "prefetchqueue.h"
 
 #define INITIAL_BUFFER_SIZE 32768
 
@@ -98,6 +100,7 @@ struct playlist {
     int input_read_done;
     AVIOContext *input_next;
     int input_next_requested;
+    FFPrefetch *cur_prefetch; /* download the segment is read from */
     AVFormatContext *parent;
     int index;
     AVFormatContext *ctx;
@@ -213,6 +216,16 @@ typedef struct HLSContext {
     int http_multiple;
     int http_seekable;
     AVIOContext *playlist_pb;
+
+    int prefetch_segments;
+    int64_t prefetch_max_size;
+    FFPrefetchQueue *prefetch;
+
+    /* exported statistics */
+    int64_t segment_stalls;
+    int64_t segment_stall_time;
+    int64_t prefetch_bytes;
+    int64_t prefetch_throughput;
 } HLSContext;
 
 static void free_segment_dynarray(struct segment **segments, int n_segments)
@@ -598,26 +611,36 @@ static int ensure_playlist(HLSContext *c, struct playlist **pls, const char *url
     return 0;
 }
 
-static int open_url_keepalive(AVFormatContext *s, AVIOContext **pb,
-                              const char *url, AVDictionary **options)
+/* Send a new request on the kept-alive connection *pb; the caller closes
+ * it on failure. */
+static int open_url_keepalive(AVIOContext **pb, const char *url,
+                              AVDictionary **options)
 {
 #if !CONFIG_HTTP_PROTOCOL
     return AVERROR_PROTOCOL_NOT_FOUND;
 #else
-    int ret;
     URLContext *uc = ffio_geturlcontext(*pb);
     av_assert0(uc);
     (*pb)->eof_reached = 0;
-    ret = ff_http_do_new_request2(uc, url, options);
-    if (ret < 0) {
-        ff_format_io_close(s, pb);
-    }
-    return ret;
+    return ff_http_do_new_request2(uc, url, options);
 #endif
 }
 
+/* Open url with io_open, or with the protocol layer directly when int_cb is
+ * set: the prefetch workers download with their own interrupt callback, which
+ * is why prefetching is only enabled with the default io_open. */
+static int open_url_io(AVFormatContext *s, AVIOContext **pb, const char *url,
+                       AVDictionary **opts, const AVIOInterruptCB *int_cb)
+{
+    if (int_cb)
+        return ffio_open_whitelist(pb, url, AVIO_FLAG_READ, int_cb, opts,
+                                   s->protocol_whitelist, s->protocol_blacklist);
+    return s->io_open(s, pb, url, AVIO_FLAG_READ, opts);
+}
+
 static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
-                    AVDictionary **opts, AVDictionary *opts2, int *is_http_out)
+                    AVDictionary **opts, AVDictionary *opts2, int *is_http_out,
+                    const AVIOInterruptCB *int_cb)
 {
     HLSContext *c = s->priv_data;
     AVDictionary *tmp = NULL;
@@ -668,7 +691,13 @@ static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
     av_dict_copy(&tmp, opts2, 0);
 
     if (is_http && c->http_persistent && *pb) {
-        ret = open_url_keepalive(c->ctx, pb, url, &tmp);
+        ret = open_url_keepalive(pb, url, &tmp);
+        if (ret < 0) {
+            if (int_cb)
+                avio_closep(pb);
+            else
+                ff_format_io_close(c->ctx, pb);
+        }
         if (ret == AVERROR_EXIT) {
             av_dict_free(&tmp);
             return ret;
@@ -677,10 +706,10 @@ static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
                 av_log(s, AV_LOG_WARNING,
                     "keepalive request failed for '%s' with error: '%s' when opening url, retrying with new connection\n",
                     url, av_err2str(ret));
-            ret = s->io_open(s, pb, url, AVIO_FLAG_READ, &tmp);
+            ret = open_url_io(s, pb, url, &tmp, int_cb);
         }
     } else {
-        ret = s->io_open(s, pb, url, AVIO_FLAG_READ, &tmp);
+        ret = open_url_io(s, pb, url, &tmp, int_cb);
     }
     if (ret >= 0) {
         // update cookies on http response with setcookies.
@@ -726,7 +755,9 @@ static int parse_playlist(HLSContext *c, const char *url,
 
     if (is_http && !in && c->http_persistent && c->playlist_pb) {
         in = c->playlist_pb;
-        ret = open_url_keepalive(c->ctx, &c->playlist_pb, url, NULL);
+        ret = open_url_keepalive(&c->playlist_pb, url, NULL);
+        if (ret < 0)
+            ff_format_io_close(c->ctx, &c->playlist_pb);
         if (ret == AVERROR_EXIT) {
             return ret;
         } else if (ret < 0) {
@@ -1005,16 +1036,239 @@ static struct segment *next_segment(struct playlist *pls)
     return pls->segments[n];
 }
 
+/*
+ * Prefetching: when prefetch_segments is set, the next segments of the
+ * active playlists and the reloads of live playlists are downloaded by a
+ * prefetch queue, while the demuxer reads the segments from there.
+ */
+
+/* Check if two lines of Set-Cookie values are equal, or set the same cookie. */
+static int cookie_match(const char *a, int a_len, const char *b, int b_len,
+                        int by_name)
+{
+    if (by_name) {
+        a_len = strcspn(a, "=\n");
+        b_len = strcspn(b, "=\n");
+    }
+    return a_len == b_len && !memcmp(a, b, a_len);
+}
+
+/* Append the lines of cookies which do not match a line of remove, as the
+ * newline delimited Set-Cookie values of the http cookies option. */
+static void cookies_without(AVBPrint *bp, const char *cookies, const char *remove,
+                            int by_name)
+{
+    while (cookies && *cookies) {
+        int len = strcspn(cookies, "\n");
+        const char *r = remove;
+        int found = 0;
+
+        while (r && *r && !found) {
+            int r_len = strcspn(r, "\n");
+            found = cookie_match(cookies, len, r, r_len, by_name);
+            r += r_len + !!r[r_len];
+        }
+        if (!found && len)
+            av_bprintf(bp, "%.*s\n", len, cookies);
+        cookies += len + !!cookies[len];
+    }
+}
+
+/* Set the cookies option of opts to the cookies of bp, or remove it if
+ * there are none. */
+static int set_cookies(AVDictionary **opts, AVBPrint *bp)
+{
+    char *cookies;
+    int ret;
+
+    if (!bp->len) {
+        av_bprint_finalize(bp, NULL);
+        return av_dict_set(opts, "cookies", NULL, 0);
+    }
+    if ((ret = av_bprint_finalize(bp, &cookies)) < 0)
+        return ret;
+    return av_dict_set(opts, "cookies", cookies, AV_DICT_DONT_STRDUP_VAL);
+}
+
+/*
+ * The segments are queued with the cookies known at that time, so the
+ * downloads only report the cookies the server set, which the demuxer then
+ * merges into its own ones when it takes the download.
+ */
+static int keep_new_cookies(AVDictionary **opts, const char *sent)
+{
+    AVDictionaryEntry *e = av_dict_get(*opts, "cookies", NULL, 0);
+    AVBPrint bp;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    cookies_without(&bp, e ? e->value : NULL, sent, 0);
+    return set_cookies(opts, &bp);
+}
+
+static int add_cookies(AVDictionary **opts, const char *cookies)
+{
+    AVDictionaryEntry *e = av_dict_get(*opts, "cookies", NULL, 0);
+    AVBPrint bp;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    cookies_without(&bp, e ? e->value : NULL, cookies, 1);
+    av_bprintf(&bp, "%s", cookies);
+    return set_cookies(opts, &bp);
+}
+
+static int prefetch_open(void *opaque, FFPrefetch *p, AVIOContext **pb,
+                         const AVIOInterruptCB *int_cb)
+{
+    HLSContext *c = opaque;
+    AVDictionary *opts = NULL;
+    AVDictionaryEntry *e;
+    char *sent_cookies = NULL;
+    int is_http = 0, ret;
+
+    if (p->seq_no < 0) {
+        char *location = NULL;
+
+        av_dict_copy(&opts, p->avio_opts, 0);
+        ret = open_url_io(c->ctx, pb, p->url, &opts, int_cb);
+        av_dict_free(&opts);
+        if (ret >= 0 &&
+            av_opt_get(*pb, "location", AV_OPT_SEARCH_CHILDREN, (uint8_t **)&location) >= 0)
+            p->location = location;
+        return FFMIN(ret, 0);
+    }
+
+    if (c->http_persistent)
+        av_dict_set(&opts, "multiple_requests", "1", 0);
+    if (p->size >= 0) {
+        av_dict_set_int(&opts, "offset", p->url_offset, 0);
+        av_dict_set_int(&opts, "end_offset", p->url_offset + p->size, 0);
+    }
+    /* a kept-alive connection can only be reused by an HTTP request */
+    if (*pb && !av_strstart(p->url, "http", NULL))
+        avio_closep(pb);
+
+    if ((e = av_dict_get(p->avio_opts, "cookies", NULL, 0)) &&
+        !(sent_cookies = av_strdup(e->value))) {
+        av_dict_free(&opts);
+        return AVERROR(ENOMEM);
+    }
+
+    ret = open_url(c->ctx, pb, p->url, &p->avio_opts, opts, &is_http, int_cb);
+    av_dict_free(&opts);
+    if (ret >= 0)
+        ret = keep_new_cookies(&p->avio_opts, sent_cookies);
+    av_free(sent_cookies);
+    if (ret < 0) {
+        avio_closep(pb);
+        return ret;
+    }
+
+    if (!is_http && p->url_offset) {
+        int64_t seekret = avio_seek(*pb, p->url_offset, SEEK_SET);
+        if (seekret < 0) {
+            avio_closep(pb);
+            return seekret;
+        }
+    }
+    return is_http && c->http_persistent;
+}
+
+static void prefetch_close(void *opaque, AVIOContext **pb, int reusable)
+{
+    avio_closep(pb);
+}
+
+/* Drop all the downloads of a playlist. */
+static void prefetch_cancel(HLSContext *c, struct playlist *pls)
+{
+    ff_prefetch_queue_cancel(c->prefetch, pls);
+    pls->cur_prefetch = NULL;
+}
+
+/* Queue the downloads of the next prefetch_segments segments of pls,
+ * starting with the current one. */
+static void prefetch_schedule(HLSContext *c, struct playlist *pls)
+{
+    int64_t seq_no;
+    int i, nb_needed = 0;
+
+    if (!c->prefetch)
+        return;
+
+    for (i = 0; i < c->n_playlists; i++)
+        nb_needed += c->playlists[i]->needed;
+    ff_prefetch_queue_start(c->prefetch, c->prefetch_segments * nb_needed);
+
+    ff_prefetch_queue_release_before(c->prefetch, pls, pls->cur_seq_no,
+                                     pls->cur_prefetch);
+
+    for (seq_no = FFMAX(pls->cur_seq_no, pls->start_seq_no);
+         seq_no < pls->cur_seq_no + c->prefetch_segments &&
+         seq_no < pls->start_seq_no + pls->n_segments; seq_no++) {
+        struct segment *seg = pls->segments[seq_no - pls->start_seq_no];
+
+        /* encrypted segments are opened by the demuxer */
+        if (seg->key_type != KEY_NONE)
+            break;
+        if (ff_prefetch_queue_has(c->prefetch, pls, seq_no))
+            continue;
+        if (seq_no > pls->cur_seq_no && ff_prefetch_queue_full(c->prefetch))
+            break;
+        if (ff_prefetch_queue_add(c->prefetch, pls, seq_no, seg->url,
+                                  seg->url_offset, seg->size, c->avio_opts) < 0)
+            break;
+    }
+}
+
+/* Queue a reload of pls, if none is pending. */
+static void prefetch_schedule_reload(HLSContext *c, struct playlist *pls)
+{
+    if (c->prefetch && !ff_prefetch_queue_has(c->prefetch, pls, -1))
+        ff_prefetch_queue_add(c->prefetch, pls, -1, pls->url, 0, -1, c->avio_opts);
+}
+
+/*
+ * Get the download of a segment, or of the reload of pls if seq_no is -1.
+ * Return NULL if there is none or if it failed without data.
+ */
+static FFPrefetch *prefetch_take(HLSContext *c, struct playlist *pls,
+                                 int64_t seq_no)
+{
+    FFPrefetchStats stats;
+    int64_t stall_time;
+    FFPrefetch *p = ff_prefetch_queue_take(c->prefetch, pls, seq_no, &stall_time);
+
+    if (p && seq_no >= 0) {
+        /* keep the cookies set by the server, as open_url() does */
+        AVDictionaryEntry *cookies = av_dict_get(p->avio_opts, "cookies", NULL, 0);
+        if (cookies)
+            add_cookies(&c->avio_opts, cookies->value);
+    }
+    if (stall_time >= 0) {
+        c->segment_stalls++;
+        c->segment_stall_time += stall_time;
+    }
+    ff_prefetch_queue_get_stats(c->prefetch, &stats);
+    c->prefetch_bytes      = stats.downloaded;
+    c->prefetch_throughput = stats.throughput;
+
+    return p;
+}
+
 static int read_from_url(struct playlist *pls, struct segment *seg,
                          uint8_t *buf, int buf_size)
 {
+    HLSContext *c = pls->parent->priv_data;
     int ret;
 
      /* limit read if the segment was only a part of a file */
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, seg->size - pls->cur_seg_offset);
 
-    ret = avio_read(pls->input, buf, buf_size);
+    if (pls->cur_prefetch)
+        ret = ff_prefetch_queue_read(c->prefetch, pls->cur_prefetch, buf, buf_size);
+    else
+        ret = avio_read(pls->input, buf, buf_size);
     if (ret > 0)
         pls->cur_seg_offset += ret;
 
@@ -1239,12 +1493,12 @@ static int open_input(HLSContext *c, struct playlist *pls, struct segment *seg,
            seg->url, seg->url_offset, pls->index);
 
     if (seg->key_type == KEY_NONE) {
-        ret = open_url(pls->parent, in, seg->url, &c->avio_opts, opts, &is_http);
+        ret = open_url(pls->parent, in, seg->url, &c->avio_opts, opts, &is_http, NULL);
     } else if (seg->key_type == KEY_AES_128) {
         char iv[33], key[33], url[MAX_URL_SIZE];
         if (strcmp(seg->key, pls->key_url)) {
             AVIOContext *pb = NULL;
-            if (open_url(pls->parent, &pb, seg->key, &c->avio_opts, opts, NULL) == 0) {
+            if (open_url(pls->parent, &pb, seg->key, &c->avio_opts, opts, NULL, NULL) == 0) {
                 ret = avio_read(pb, pls->key, sizeof(pls->key));
                 if (ret != sizeof(pls->key)) {
                     av_log(pls->parent, AV_LOG_ERROR, "Unable to read key file %s\n",
@@ -1268,7 +1522,7 @@ static int open_input(HLSContext *c, struct playlist *pls, struct segment *seg,
         av_dict_set(&opts, "key", key, 0);
         av_dict_set(&opts, "iv", iv, 0);
 
-        ret = open_url(pls->parent, in, url, &c->avio_opts, opts, &is_http);
+        ret = open_url(pls->parent, in, url, &c->avio_opts, opts, &is_http, NULL);
         if (ret < 0) {
             goto cleanup;
         }
@@ -1416,6 +1670,24 @@ static int playlist_needed(struct playlist *pls)
     return 0;
 }
 
+/* Reload a playlist, from its prefetched download if there is one. */
+static int reload_playlist(HLSContext *c, struct playlist *pls)
+{
+    FFPrefetch *p = prefetch_take(c, pls, -1);
+    int ret;
+
+    if (p) {
+        AVIOContext pb;
+
+        ffio_init_context(&pb, p->data, p->data_size, 0, NULL, NULL, NULL, NULL);
+        ret = parse_playlist(c, p->location ? p->location : pls->url, pls, &pb);
+        ff_prefetch_queue_release(c->prefetch, &p);
+        if (ret >= 0)
+            return ret;
+    }
+    return parse_playlist(c, pls->url, pls, NULL);
+}
+
 static int read_data(void *opaque, uint8_t *buf, int buf_size)
 {
     struct playlist *v = opaque;
@@ -1429,7 +1701,12 @@ restart:
     if (!v->needed)
         return AVERROR_EOF;
 
-    if (!v->input || (c->http_persistent && v->input_read_done)) {
+    /* Reload live playlists in the background while reading the segments. */
+    if (c->prefetch_segments && !v->finished &&
+        av_gettime_relative() - v->last_load_time >= default_reload_interval(v))
+        prefetch_schedule_reload(c, v);
+
+    if (!v->cur_prefetch && (!v->input || (c->http_persistent && v->input_read_done))) {
         int64_t reload_interval;
 
         /* Check that the playlist is still needed before opening a new
@@ -1439,6 +1716,7 @@ restart:
         if (!v->needed) {
             av_log(v->parent, AV_LOG_INFO, "No longer receiving playlist %d ('%s')\n",
                    v->index, v->url);
+            prefetch_cancel(c, v);
             return AVERROR_EOF;
         }
 
@@ -1452,7 +1730,7 @@ reload:
             return AVERROR_EOF;
         if (!v->finished &&
             av_gettime_relative() - v->last_load_time >= reload_interval) {
-            if ((ret = parse_playlist(c, v->url, v, NULL)) < 0) {
+            if ((ret = reload_playlist(c, v)) < 0) {
                 if (ret != AVERROR_EXIT)
                     av_log(v->parent, AV_LOG_WARNING, "Failed to reload playlist %d\n",
                            v->index);
@@ -1500,7 +1778,13 @@ reload:
         if (ret)
             return ret;
 
-        if (c->http_multiple == 1 && v->input_next_requested) {
+        if (c->prefetch_segments)
+            prefetch_schedule(c, v);
+
+        if ((v->cur_prefetch = prefetch_take(c, v, v->cur_seq_no))) {
+            v->cur_seg_offset = 0;
+            ret = 0;
+        } else if (c->http_multiple == 1 && v->input_next_requested) {
             FFSWAP(AVIOContext *, v->input, v->input_next);
             v->cur_seg_offset = 0;
             v->input_next_requested = 0;
@@ -1520,7 +1804,7 @@ reload:
         just_opened = 1;
     }
 
-    if (c->http_multiple == -1) {
+    if (c->http_multiple == -1 && !v->cur_prefetch) {
         uint8_t *http_version_opt = NULL;
         int r = av_opt_get(v->input, "http_version", AV_OPT_SEARCH_CHILDREN, &http_version_opt);
         if (r >= 0) {
@@ -1530,7 +1814,7 @@ reload:
     }
 
     seg = next_segment(v);
-    if (c->http_multiple == 1 && !v->input_next_requested &&
+    if (c->http_multiple == 1 && !v->input_next_requested && !c->prefetch_segments &&
         seg && seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         ret = open_input(c, v, seg, &v->input_next);
         if (ret < 0) {
@@ -1563,7 +1847,9 @@ reload:
 
         return ret;
     }
-    if (c->http_persistent &&
+    if (v->cur_prefetch) {
+        ff_prefetch_queue_release(c->prefetch, &v->cur_prefetch);
+    } else if (c->http_persistent &&
         seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         v->input_read_done = 1;
     } else {
@@ -1838,6 +2124,7 @@ static int hls_close(AVFormatContext *s)
 {
     HLSContext *c = s->priv_data;
 
+    ff_prefetch_queue_free(&c->prefetch);
     free_playlist_list(c);
     free_variant_list(c);
     free_rendition_list(c);
@@ -1869,6 +2156,21 @@ static int hls_read_header(AVFormatContext *s)
        the range header */
     av_dict_set_int(&c->avio_opts, "seekable", c->http_seekable, 0);
 
+    if (c->prefetch_segments && !ff_format_io_is_default(s)) {
+        av_log(s, AV_LOG_WARNING,
+               "Segment prefetching bypasses the custom io_open callback, disabling it\n");
+        c->prefetch_segments = 0;
+    }
+    if (c->prefetch_segments &&
+        (ret = ff_prefetch_queue_alloc(&c->prefetch, s, c->prefetch_max_size,
+                                       &s->interrupt_callback,
+                                       prefetch_open, prefetch_close, c)) < 0) {
+        if (ret != AVERROR(ENOSYS))
+            goto fail;
+        av_log(s, AV_LOG_WARNING, "Segment prefetching requires threads, disabling it\n");
+        c->prefetch_segments = 0;
+    }
+
     if ((ret = parse_playlist(c, s->url, NULL, s->pb)) < 0)
         goto fail;
 
@@ -2331,6 +2633,7 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
         pls->input_read_done = 0;
         ff_format_io_close(pls->parent, &pls->input_next);
         pls->input_next_requested = 0;
+        prefetch_cancel(c, pls);
         av_packet_unref(&pls->pkt);
         pls->pb.eof_reached = 0;
         /* Clear any buffered data */
@@ -2392,6 +2695,18 @@ static const AVOption hls_options[] = {
         OFFSET(http_multiple), AV_OPT_TYPE_BOOL, {.i64 = -1}, -1, 1, FLAGS},
     {"http_seekable", "Use HTTP partial requests, 0 = disable, 1 = enable, -1 = auto",
         OFFSET(http_seekable), AV_OPT_TYPE_BOOL, { .i64 = -1}, -1, 1, FLAGS},
+    {"prefetch_segments", "Number of segments of each playlist to download ahead in background threads, 0 = disable",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, FLAGS},
+    {"prefetch_max_size", "Maximum memory used by the downloads ahead",
+        OFFSET(prefetch_max_size), AV_OPT_TYPE_INT64, {.i64 = 64 * 1024 * 1024}, 0, INT64_MAX, FLAGS},
+    {"segment_stalls", "Number of times the demuxer waited for a prefetched segment",
+        OFFSET(segment_stalls), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, FLAGS | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
+    {"segment_stall_time", "Time the demuxer waited for prefetched segments, in microseconds",
+        OFFSET(segment_stall_time), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, FLAGS | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
+    {"prefetch_bytes", "Number of bytes downloaded ahead",
+        OFFSET(prefetch_bytes), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, FLAGS | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
+    {"prefetch_throughput", "Average download rate of the downloads ahead, in bytes per second",
+        OFFSET(prefetch_throughput), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, FLAGS | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
     {NULL}
 };
 
@@ -53,6 +53,7 @@
 #include "hlsplaylist.h"
 #include "internal.h"
 #include "os_support.h"
+#include "uploadqueue.h"
 
 typedef enum {
     HLS_START_SEQUENCE_AS_START_NUMBER = 0,
@@ -72,6 +73,12 @@ typedef enum {
 #define HLS_MICROSECOND_UNIT   1000000
 #define BUFSIZE (16 * 1024)
 #define POSTFIX_PATTERN "_%d"
+#define HLS_MAX_PARTS 64
+
+typedef struct HLSPart {
+    double duration; /* in seconds */
+    int independent;
+} HLSPart;
 
 typedef struct HLSSegment {
     char filename[MAX_URL_SIZE];
@@ -89,6 +96,9 @@ typedef struct HLSSegment {
 
     struct HLSSegment *next;
     double discont_program_date_time;
+
+    HLSPart parts[HLS_MAX_PARTS];
+    int nb_parts;
 } HLSSegment;
 
 typedef enum HLSFlags {
@@ -158,6 +168,7 @@ typedef struct VariantStream {
     char *vtt_basename;
     char *vtt_m3u8_name;
     char *m3u8_name;
+    char *delta_m3u8_name;
 
     double initial_prog_date_time;
     char current_segment_final_filename_fmt[MAX_URL_SIZE]; // when renaming segments
@@ -183,6 +194,13 @@ typedef struct VariantStream {
     const char *sgroup;   /* subtitle group name */
     const char *ccgroup;  /* closed caption group name */
     const char *varname;  /* variant name */
+
+    /* partial segments of the current segment */
+    HLSPart parts[HLS_MAX_PARTS];
+    int nb_parts;
+    double parts_duration;  // sum of the durations of the parts written
+    int part_pos;           // position of the next part in the segment buffer
+    int part_independent;   // the next part starts with a keyframe
 } VariantStream;
 
 typedef struct ClosedCaptionsStream {
@@ -253,11 +271,27 @@ typedef struct HLSContext {
     int http_persistent;
     AVIOContext *m3u8_out;
     AVIOContext *sub_m3u8_out;
+    AVIOContext *delta_m3u8_out;
     int64_t timeout;
     int ignore_io_errors;
     char *headers;
     int has_default_key; /* has DEFAULT field of var_stream_map */
     int has_video_m3u8; /* has video stream m3u8 list */
+    int64_t part_time;      ///< low latency part target duration
+    int block_reload;
+    int64_t skip_until;
+    int upload_connections;
+    int upload_queue_size;
+    int upload_retries;
+    FFUploadQueue *upload_queue;
+
+    /* exported statistics */
+    int64_t upload_queue_depth;
+    int64_t upload_max_queue_depth;
+    int64_t upload_latency;
+    int64_t upload_max_latency;
+    int64_t upload_retry_count;
+    int64_t upload_failures;
 } HLSContext;
 
 static int strftime_expand(const char *fmt, char **dest)
@@ -289,6 +323,13 @@ static int hlsenc_io_open(AVFormatContext *s, AVIOContext **pb, char *filename,
     HLSContext *hls = s->priv_data;
     int http_base_proto = filename ? ff_is_http_proto(filename) : 0;
     int err = AVERROR_MUXER_NOT_FOUND;
+    if (hls->upload_queue && http_base_proto) {
+        /* report the uploads which failed in the background */
+        if ((err = ff_upload_queue_get_error(hls->upload_queue)) < 0)
+            return err;
+        return ff_upload_queue_open(hls->upload_queue, pb, filename,
+                                    av_match_ext(filename, "m3u8") ? FF_UPLOAD_ORDERED : 0);
+    }
     if (!*pb || !http_base_proto || !hls->http_persistent) {
         err = s->io_open(s, pb, filename, AVIO_FLAG_WRITE, options);
 #if CONFIG_HTTP_PROTOCOL
@@ -311,7 +352,9 @@ static int hlsenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filename)
     int ret = 0;
     if (!*pb)
         return ret;
-    if (!http_base_proto || !hls->http_persistent || hls->key_info_file || hls->encrypt) {
+    if (hls->upload_queue && ff_upload_queue_owns(hls->upload_queue, *pb)) {
+        ret = ff_upload_queue_submit(hls->upload_queue, pb);
+    } else if (!http_base_proto || !hls->http_persistent || hls->key_info_file || hls->encrypt) {
         ff_format_io_close(s, pb);
 #if CONFIG_HTTP_PROTOCOL
     } else {
@@ -560,6 +603,24 @@ static void reflush_dynbuf(VariantStream *vs, int *range_length)
     avio_write(vs->out, vs->temp_buffer, *range_length);
 }
 
+/* seg5.m4s -> seg5.part3.m4s, a .tmp suffix of segments written to
+ * temporary files is dropped */
+static void get_part_name(char *buf, int size, HLSContext *hls,
+                          const char *segment, int index)
+{
+    int len = strlen(segment);
+    const char *ext;
+
+    if ((hls->flags & HLS_TEMP_FILE) && len > 4 && !strcmp(segment + len - 4, ".tmp"))
+        len -= 4;
+    for (ext = segment + len; ext > segment && ext[-1] != '.' && ext[-1] != '/'; ext--)
+        ;
+    if (ext == segment || ext[-1] != '.')
+        ext = segment + len + 1;
+    snprintf(buf, size, "%.*s.part%d%.*s", (int)(ext - 1 - segment), segment, index,
+             (int)(segment + len - ext + 1), ext - 1);
+}
+
 #if HAVE_DOS_PATHS
 #define SEPARATOR '\\'
 #else
@@ -569,7 +630,11 @@ static void reflush_dynbuf(VariantStream *vs, int *range_length)
 static int hls_delete_file(HLSContext *hls, AVFormatContext *avf,
                            const char *path, const char *proto)
 {
-    if (hls->method || (proto && !av_strcasecmp(proto, "http"))) {
+    if (hls->upload_queue && proto && !av_strcasecmp(proto, "http")) {
+        int ret = ff_upload_queue_delete(hls->upload_queue, path);
+        if (ret < 0)
+            return hls->ignore_io_errors ? 1 : ret;
+    } else if (hls->method || (proto && !av_strcasecmp(proto, "http"))) {
         AVDictionary *opt = NULL;
         AVIOContext  *out = NULL;
         int ret;
@@ -592,7 +657,7 @@ static int hls_delete_old_segments(AVFormatContext *s, HLSContext *hls,
 
     HLSSegment *segment, *previous_segment = NULL;
     float playlist_duration = 0.0f;
-    int ret = 0;
+    int ret = 0, i;
     int segment_cnt = 0;
     AVBPrint path;
     const char *dirname = NULL;
@@ -666,6 +731,22 @@ static int hls_delete_old_segments(AVFormatContext *s, HLSContext *hls,
         if (ret = hls_delete_file(hls, vs->avf, path.str, proto))
             goto fail;
 
+        for (i = 0; i < segment->nb_parts; i++) {
+            char part[MAX_URL_SIZE];
+
+            get_part_name(part, sizeof(part), hls, segment->filename, i);
+            av_bprint_clear(&path);
+            if (!hls->use_localtime_mkdir)
+                av_bprintf(&path, "%s%c", dirname, SEPARATOR);
+            av_bprintf(&path, "%s", part);
+            if (!av_bprint_is_complete(&path)) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
+            if (ret = hls_delete_file(hls, vs->avf, path.str, proto))
+                goto fail;
+        }
+
         if ((segment->sub_filename[0] != '\0')) {
             vtt_dirname_r = av_strdup(vs->vtt_avf->url);
             vtt_dirname = av_dirname(vtt_dirname_r);
@@ -1150,6 +1231,12 @@ static int hls_append_segment(struct AVFormatContext *s, HLSContext *hls,
     en->discont  = 0;
     en->discont_program_date_time = 0;
 
+    memcpy(en->parts, vs->parts, vs->nb_parts * sizeof(*vs->parts));
+    en->nb_parts       = vs->nb_parts;
+    vs->nb_parts       = 0;
+    vs->parts_duration = 0;
+    vs->part_pos       = 0;
+
     if (vs->discontinuity) {
         en->discont = 1;
         vs->discontinuity = 0;
@@ -1538,6 +1625,113 @@ fail:
     return ret;
 }
 
+static int hls_write_media_playlist(AVFormatContext *s, VariantStream *vs,
+                                    AVIOContext *out, int last, int target_duration,
+                                    int64_t sequence, int nb_skipped)
+{
+    HLSContext *hls = s->priv_data;
+    HLSSegment *en;
+    char *key_uri = NULL;
+    char *iv_string = NULL;
+    char part[MAX_URL_SIZE];
+    const char *name;
+    double prog_date_time = vs->initial_prog_date_time;
+    double *prog_date_time_p = (hls->flags & HLS_PROGRAM_DATE_TIME) ? &prog_date_time : NULL;
+    double remaining = vs->parts_duration;
+    int byterange_mode = (hls->flags & HLS_SINGLE_FILE) || (hls->max_seg_size > 0);
+    int init_written = 0;
+    int ret = 0, i;
+
+    vs->discontinuity_set = 0;
+    ff_hls_write_playlist_header(out, hls->version, hls->allowcache,
+                                 target_duration, sequence, hls->pl_type, hls->flags & HLS_I_FRAMES_ONLY);
+    if (hls->part_time > 0 || hls->block_reload || hls->skip_until > 0)
+        ff_hls_write_server_control(out, hls->block_reload,
+                                    3 * hls->part_time / (double)AV_TIME_BASE,
+                                    hls->skip_until / (double)AV_TIME_BASE);
+    if (hls->part_time > 0)
+        ff_hls_write_part_inf(out, hls->part_time / (double)AV_TIME_BASE);
+
+    if ((hls->flags & HLS_DISCONT_START) && sequence==hls->start_sequence && vs->discontinuity_set==0) {
+        avio_printf(out, "#EXT-X-DISCONTINUITY\n");
+        vs->discontinuity_set = 1;
+    }
+    if (vs->has_video && (hls->flags & HLS_INDEPENDENT_SEGMENTS)) {
+        avio_printf(out, "#EXT-X-INDEPENDENT-SEGMENTS\n");
+    }
+    if (nb_skipped > 0)
+        ff_hls_write_skip(out, nb_skipped);
+
+    for (en = vs->segments; en; en = en->next)
+        remaining += en->duration;
+
+    for (en = vs->segments; en; en = en->next) {
+        remaining -= en->duration;
+        if (nb_skipped > 0) {
+            nb_skipped--;
+            if (!en->discont_program_date_time)
+                prog_date_time += en->duration;
+            continue;
+        }
+
+        if ((hls->encrypt || hls->key_info_file) && (!key_uri || strcmp(en->key_uri, key_uri) ||
+                                    av_strcasecmp(en->iv_string, iv_string))) {
+            avio_printf(out, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\"", en->key_uri);
+            if (*en->iv_string)
+                avio_printf(out, ",IV=0x%s", en->iv_string);
+            avio_printf(out, "\n");
+            key_uri = en->key_uri;
+            iv_string = en->iv_string;
+        }
+
+        if ((hls->segment_type == SEGMENT_TYPE_FMP4) && !init_written) {
+            ff_hls_write_init_file(out, (hls->flags & HLS_SINGLE_FILE) ? en->filename : vs->fmp4_init_filename,
+                                   hls->flags & HLS_SINGLE_FILE, vs->init_range_length, 0);
+            init_written = 1;
+        }
+
+        /* the parts of the segments near the live edge are listed before them */
+        if (remaining < 3 * target_duration) {
+            for (i = 0; i < en->nb_parts; i++) {
+                get_part_name(part, sizeof(part), hls, en->filename, i);
+                ff_hls_write_part(out, en->parts[i].duration, hls->baseurl, part,
+                                  en->parts[i].independent);
+            }
+        }
+
+        ret = ff_hls_write_file_entry(out, en->discont, byterange_mode,
+                                      en->duration, hls->flags & HLS_ROUND_DURATIONS,
+                                      en->size, en->pos, hls->baseurl,
+                                      en->filename,
+                                      en->discont_program_date_time ? &en->discont_program_date_time : prog_date_time_p,
+                                      en->keyframe_size, en->keyframe_pos, hls->flags & HLS_I_FRAMES_ONLY);
+        if (en->discont_program_date_time)
+            en->discont_program_date_time -= en->duration;
+        if (ret < 0) {
+            av_log(s, AV_LOG_WARNING, "ff_hls_write_file_entry get error\n");
+        }
+    }
+
+    /* parts of the segment being written, and the next one to come */
+    if (hls->part_time > 0 && !last) {
+        name = hls->use_localtime_mkdir ? vs->avf->url : av_basename(vs->avf->url);
+        if (hls->segment_type == SEGMENT_TYPE_FMP4 && !init_written)
+            ff_hls_write_init_file(out, vs->fmp4_init_filename, 0, vs->init_range_length, 0);
+        for (i = 0; i < vs->nb_parts; i++) {
+            get_part_name(part, sizeof(part), hls, name, i);
+            ff_hls_write_part(out, vs->parts[i].duration, hls->baseurl, part,
+                              vs->parts[i].independent);
+        }
+        get_part_name(part, sizeof(part), hls, name, vs->nb_parts);
+        ff_hls_write_preload_hint(out, hls->baseurl, part);
+    }
+
+    if (last && (hls->flags & HLS_OMIT_ENDLIST)==0)
+        ff_hls_write_end_list(out);
+
+    return 0;
+}
+
 static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
 {
     HLSContext *hls = s->priv_data;
@@ -1546,16 +1740,13 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
     int ret = 0;
     char temp_filename[MAX_URL_SIZE];
     char temp_vtt_filename[MAX_URL_SIZE];
+    char temp_delta_filename[MAX_URL_SIZE] = "";
     int64_t sequence = FFMAX(hls->start_sequence, vs->sequence - vs->nb_entries);
     const char *proto = avio_find_protocol_name(vs->m3u8_name);
     int is_file_proto = proto && !strcmp(proto, "file");
     int use_temp_file = is_file_proto && ((hls->flags & HLS_TEMP_FILE) || !(hls->pl_type == PLAYLIST_TYPE_VOD));
     static unsigned warned_non_file;
-    char *key_uri = NULL;
-    char *iv_string = NULL;
     AVDictionary *options = NULL;
-    double prog_date_time = vs->initial_prog_date_time;
-    double *prog_date_time_p = (hls->flags & HLS_PROGRAM_DATE_TIME) ? &prog_date_time : NULL;
     int byterange_mode = (hls->flags & HLS_SINGLE_FILE) || (hls->max_seg_size > 0);
 
     hls->version = 3;
@@ -1576,6 +1767,10 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
         hls->version = 7;
     }
 
+    if (hls->skip_until > 0) {
+        hls->version = 9;
+    }
+
     if (!is_file_proto && (hls->flags & HLS_TEMP_FILE) && !warned_non_file++)
         av_log(s, AV_LOG_ERROR, "Cannot use rename on non file protocol, this may lead to races and temporary partial files\n");
 
@@ -1592,48 +1787,8 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
             target_duration = lrint(en->duration);
     }
 
-    vs->discontinuity_set = 0;
-    ff_hls_write_playlist_header(byterange_mode ? hls->m3u8_out : vs->out, hls->version, hls->allowcache,
-                                 target_duration, sequence, hls->pl_type, hls->flags & HLS_I_FRAMES_ONLY);
-
-    if ((hls->flags & HLS_DISCONT_START) && sequence==hls->start_sequence && vs->discontinuity_set==0) {
-        avio_printf(byterange_mode ? hls->m3u8_out : vs->out, "#EXT-X-DISCONTINUITY\n");
-        vs->discontinuity_set = 1;
-    }
-    if (vs->has_video && (hls->flags & HLS_INDEPENDENT_SEGMENTS)) {
-        avio_printf(byterange_mode ? hls->m3u8_out : vs->out, "#EXT-X-INDEPENDENT-SEGMENTS\n");
-    }
-    for (en = vs->segments; en; en = en->next) {
-        if ((hls->encrypt || hls->key_info_file) && (!key_uri || strcmp(en->key_uri, key_uri) ||
-                                    av_strcasecmp(en->iv_string, iv_string))) {
-            avio_printf(byterange_mode ? hls->m3u8_out : vs->out, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\"", en->key_uri);
-            if (*en->iv_string)
-                avio_printf(byterange_mode ? hls->m3u8_out : vs->out, ",IV=0x%s", en->iv_string);
-            avio_printf(byterange_mode ? hls->m3u8_out : vs->out, "\n");
-            key_uri = en->key_uri;
-            iv_string = en->iv_string;
-        }
-
-        if ((hls->segment_type == SEGMENT_TYPE_FMP4) && (en == vs->segments)) {
-            ff_hls_write_init_file(byterange_mode ? hls->m3u8_out : vs->out, (hls->flags & HLS_SINGLE_FILE) ? en->filename : vs->fmp4_init_filename,
-                                   hls->flags & HLS_SINGLE_FILE, vs->init_range_length, 0);
-        }
-
-        ret = ff_hls_write_file_entry(byterange_mode ? hls->m3u8_out : vs->out, en->discont, byterange_mode,
-                                      en->duration, hls->flags & HLS_ROUND_DURATIONS,
-                                      en->size, en->pos, hls->baseurl,
-                                      en->filename,
-                                      en->discont_program_date_time ? &en->discont_program_date_time : prog_date_time_p,
-                                      en->keyframe_size, en->keyframe_pos, hls->flags & HLS_I_FRAMES_ONLY);
-        if (en->discont_program_date_time)
-            en->discont_program_date_time -= en->duration;
-        if (ret < 0) {
-            av_log(s, AV_LOG_WARNING, "ff_hls_write_file_entry get error\n");
-        }
-    }
-
-    if (last && (hls->flags & HLS_OMIT_ENDLIST)==0)
-        ff_hls_write_end_list(byterange_mode ? hls->m3u8_out : vs->out);
+    hls_write_media_playlist(s, vs, byterange_mode ? hls->m3u8_out : vs->out,
+                             last, target_duration, sequence, 0);
 
     if (vs->vtt_m3u8_name) {
         snprintf(temp_vtt_filename, sizeof(temp_vtt_filename), use_temp_file ? "%s.tmp" : "%s", vs->vtt_m3u8_name);
@@ -1658,6 +1813,28 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
 
     }
 
+    if (vs->delta_m3u8_name) {
+        /* the segments starting before the skip boundary are skipped */
+        double remaining = vs->parts_duration;
+        int nb_skipped = 0;
+
+        for (en = vs->segments; en; en = en->next)
+            remaining += en->duration;
+        for (en = vs->segments; en && remaining > hls->skip_until / (double)AV_TIME_BASE; en = en->next) {
+            remaining -= en->duration;
+            nb_skipped++;
+        }
+
+        snprintf(temp_delta_filename, sizeof(temp_delta_filename), use_temp_file ? "%s.tmp" : "%s", vs->delta_m3u8_name);
+        if ((ret = hlsenc_io_open(s, &hls->delta_m3u8_out, temp_delta_filename, &options)) < 0) {
+            if (hls->ignore_io_errors)
+                ret = 0;
+            goto fail;
+        }
+        hls_write_media_playlist(s, vs, hls->delta_m3u8_out, last, target_duration,
+                                 sequence, nb_skipped);
+    }
+
 fail:
     av_dict_free(&options);
     ret = hlsenc_io_close(s, byterange_mode ? &hls->m3u8_out : &vs->out, temp_filename);
@@ -1665,10 +1842,13 @@ fail:
         return ret;
     }
     hlsenc_io_close(s, &hls->sub_m3u8_out, vs->vtt_m3u8_name);
+    hlsenc_io_close(s, &hls->delta_m3u8_out, vs->delta_m3u8_name);
     if (use_temp_file) {
         ff_rename(temp_filename, vs->m3u8_name, s);
         if (vs->vtt_m3u8_name)
             ff_rename(temp_vtt_filename, vs->vtt_m3u8_name, s);
+        if (*temp_delta_filename)
+            ff_rename(temp_delta_filename, vs->delta_m3u8_name, s);
     }
     if (ret >= 0 && hls->master_pl_name)
         if (create_master_playlist(s, vs) < 0)
@@ -2415,6 +2595,95 @@ static int64_t append_single_file(AVFormatContext *s, VariantStream *vs)
 
     return ret;
 }
+
+static void update_upload_stats(HLSContext *hls)
+{
+    FFUploadStats stats;
+
+    if (!hls->upload_queue)
+        return;
+    ff_upload_queue_get_stats(hls->upload_queue, &stats);
+    hls->upload_queue_depth     = stats.queue_depth;
+    hls->upload_max_queue_depth = stats.max_queue_depth;
+    hls->upload_latency         = stats.latency;
+    hls->upload_max_latency     = stats.max_latency;
+    hls->upload_retry_count     = stats.retries;
+    hls->upload_failures        = stats.failures;
+}
+
+/* the moov has just been flushed to the segment buffer */
+static int hls_write_init_file(AVFormatContext *s, VariantStream *vs)
+{
+    HLSContext *hls = s->priv_data;
+    AVFormatContext *oc = vs->avf;
+    int byterange_mode = (hls->flags & HLS_SINGLE_FILE) || (hls->max_seg_size > 0);
+    int range_length;
+
+    range_length = avio_close_dyn_buf(oc->pb, &vs->init_buffer);
+    if (range_length <= 0)
+        return AVERROR(EINVAL);
+    avio_write(vs->out, vs->init_buffer, range_length);
+    if (!hls->resend_init_file)
+        av_freep(&vs->init_buffer);
+    vs->init_range_length = range_length;
+    avio_open_dyn_buf(&oc->pb);
+    vs->packets_written = 0;
+    vs->start_pos = range_length;
+    if (!byterange_mode) {
+        hlsenc_io_close(s, &vs->out, vs->base_output_dirname);
+    }
+    return 0;
+}
+
+/**
+ * Write the data buffered since the previous part of the segment to a part
+ * file. The segment itself is still written whole once it is complete.
+ *
+ * @param elapsed time from the start of the segment to the end of the part,
+ *                in seconds
+ */
+static int hls_write_part(AVFormatContext *s, VariantStream *vs, double elapsed)
+{
+    HLSContext *hls = s->priv_data;
+    AVFormatContext *oc = vs->avf;
+    AVDictionary *options = NULL;
+    char filename[MAX_URL_SIZE];
+    uint8_t *buf;
+    int size, ret;
+
+    av_write_frame(oc, NULL); /* Flush the buffered packets into a fragment */
+    if (!vs->init_range_length) {
+        /* the first flush only wrote the moov */
+        if ((ret = hls_write_init_file(s, vs)) < 0)
+            return ret;
+        av_write_frame(oc, NULL);
+    }
+    size = avio_get_dyn_buf(oc->pb, &buf);
+    if (size <= vs->part_pos || vs->nb_parts >= HLS_MAX_PARTS)
+        return 0;
+
+    get_part_name(filename, sizeof(filename), hls, oc->url, vs->nb_parts);
+    set_http_options(s, &options, hls);
+    ret = hlsenc_io_open(s, &vs->out, filename, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        av_log(s, hls->ignore_io_errors ? AV_LOG_WARNING : AV_LOG_ERROR,
+               "Failed to open file '%s'\n", filename);
+        return hls->ignore_io_errors ? 0 : ret;
+    }
+    avio_write(vs->out, buf + vs->part_pos, size - vs->part_pos);
+    ret = hlsenc_io_close(s, &vs->out, filename);
+    if (ret < 0 && !hls->ignore_io_errors)
+        return ret;
+
+    vs->parts[vs->nb_parts].duration    = elapsed - vs->parts_duration;
+    vs->parts[vs->nb_parts].independent = vs->part_independent;
+    vs->nb_parts++;
+    vs->parts_duration = elapsed;
+    vs->part_pos       = size;
+    return 0;
+}
+
 static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
 {
     HLSContext *hls = s->priv_data;
@@ -2506,26 +2775,20 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
         int64_t new_start_pos;
         int byterange_mode = (hls->flags & HLS_SINGLE_FILE) || (hls->max_seg_size > 0);
 
+        if (hls->part_time > 0) {
+            double elapsed = (double)(pkt->pts - vs->end_pts) * st->time_base.num / st->time_base.den;
+            if ((ret = hls_write_part(s, vs, elapsed)) < 0)
+                return ret;
+            vs->part_independent = !vs->has_video || (pkt->flags & AV_PKT_FLAG_KEY);
+        }
+
         av_write_frame(oc, NULL); /* Flush any buffered data */
         new_start_pos = avio_tell(oc->pb);
         vs->size = new_start_pos - vs->start_pos;
         avio_flush(oc->pb);
-        if (hls->segment_type == SEGMENT_TYPE_FMP4) {
-            if (!vs->init_range_length) {
-                range_length = avio_close_dyn_buf(oc->pb, &vs->init_buffer);
-                if (range_length <= 0)
-                    return AVERROR(EINVAL);
-                avio_write(vs->out, vs->init_buffer, range_length);
-                if (!hls->resend_init_file)
-                    av_freep(&vs->init_buffer);
-                vs->init_range_length = range_length;
-                avio_open_dyn_buf(&oc->pb);
-                vs->packets_written = 0;
-                vs->start_pos = range_length;
-                if (!byterange_mode) {
-                    hlsenc_io_close(s, &vs->out, vs->base_output_dirname);
-                }
-            }
+        if (hls->segment_type == SEGMENT_TYPE_FMP4 && !vs->init_range_length) {
+            if ((ret = hls_write_init_file(s, vs)) < 0)
+                return ret;
         }
         if (!byterange_mode) {
             if (vs->vtt_avf) {
@@ -2622,13 +2885,18 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
         }
 
         // if we're building a VOD playlist, skip writing the manifest multiple times, and just wait until the end
-        if (hls->pl_type != PLAYLIST_TYPE_VOD) {
+        // with parts, it is written once the next segment is started, to hint at its first part
+        if (hls->pl_type != PLAYLIST_TYPE_VOD && !hls->part_time) {
             if ((ret = hls_window(s, 0, vs)) < 0) {
+                int err = ret;
+
                 av_log(s, AV_LOG_WARNING, "upload playlist failed, will retry with a new http session.\n");
                 ff_format_io_close(s, &vs->out);
-                if ((ret = hls_window(s, 0, vs)) < 0) {
+                /* the error of a background upload is only reported once,
+                 * it is returned even if the playlist is written again */
+                if ((ret = hls_window(s, 0, vs)) < 0 || hls->upload_queue) {
                     av_freep(&old_filename);
-                    return ret;
+                    return err;
                 }
             }
         }
@@ -2663,11 +2931,32 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
         }
         vs->number++;
         av_freep(&old_filename);
+        if (ret >= 0 && hls->part_time > 0 && hls->pl_type != PLAYLIST_TYPE_VOD)
+            ret = hls_window(s, 0, vs);
+        update_upload_stats(hls);
 
         if (ret < 0) {
             return ret;
         }
 
+    } else if (hls->part_time > 0 && vs->packets_written && is_ref_pkt &&
+               vs->nb_parts < HLS_MAX_PARTS - 1) {
+        double elapsed  = (double)(pkt->pts - vs->end_pts) * st->time_base.num / st->time_base.den;
+        double duration = (double)pkt->duration * st->time_base.num / st->time_base.den;
+
+        /* cut the part before it gets longer than the part target */
+        if (elapsed > vs->parts_duration &&
+            elapsed + duration - vs->parts_duration > hls->part_time / (double)AV_TIME_BASE) {
+            int nb_parts = vs->nb_parts;
+
+            if ((ret = hls_write_part(s, vs, elapsed)) < 0)
+                return ret;
+            if (vs->nb_parts > nb_parts) {
+                vs->part_independent = !vs->has_video || (pkt->flags & AV_PKT_FLAG_KEY);
+                if (hls->pl_type != PLAYLIST_TYPE_VOD && (ret = hls_window(s, 0, vs)) < 0)
+                    return ret;
+            }
+        }
     }
 
     vs->packets_written++;
@@ -2701,7 +2990,13 @@ static void hls_deinit(AVFormatContext *s)
         av_freep(&vs->fmp4_init_filename);
         av_freep(&vs->vtt_basename);
         av_freep(&vs->vtt_m3u8_name);
+        av_freep(&vs->delta_m3u8_name);
 
+        if (hls->upload_queue) {
+            ff_upload_queue_discard(hls->upload_queue, &vs->out);
+            if (vs->vtt_avf)
+                ff_upload_queue_discard(hls->upload_queue, &vs->vtt_avf->pb);
+        }
         avformat_free_context(vs->vtt_avf);
         avformat_free_context(vs->avf);
         if (hls->resend_init_file)
@@ -2712,8 +3007,15 @@ static void hls_deinit(AVFormatContext *s)
         av_freep(&vs->streams);
     }
 
+    if (hls->upload_queue) {
+        ff_upload_queue_discard(hls->upload_queue, &hls->m3u8_out);
+        ff_upload_queue_discard(hls->upload_queue, &hls->sub_m3u8_out);
+        ff_upload_queue_discard(hls->upload_queue, &hls->delta_m3u8_out);
+        ff_upload_queue_free(&hls->upload_queue);
+    }
     ff_format_io_close(s, &hls->m3u8_out);
     ff_format_io_close(s, &hls->sub_m3u8_out);
+    ff_format_io_close(s, &hls->delta_m3u8_out);
     av_freep(&hls->key_basename);
     av_freep(&hls->var_streams);
     av_freep(&hls->cc_streams);
@@ -2729,7 +3031,7 @@ static int hls_write_trailer(struct AVFormatContext *s)
     const char *proto = NULL;
     int use_temp_file = 0;
     int i;
-    int ret = 0;
+    int ret = 0, upload_err = 0;
     VariantStream *vs = NULL;
     AVDictionary *options = NULL;
     int range_length, byterange_mode;
@@ -2772,11 +3074,16 @@ static int hls_write_trailer(struct AVFormatContext *s)
                 vs->start_pos = range_length;
                 byterange_mode = (hls->flags & HLS_SINGLE_FILE) || (hls->max_seg_size > 0);
                 if (!byterange_mode) {
-                    ff_format_io_close(s, &vs->out);
                     hlsenc_io_close(s, &vs->out, vs->base_output_dirname);
+                    ff_format_io_close(s, &vs->out);
                 }
             }
         }
+        if (hls->part_time > 0) {
+            ret = hls_write_part(s, vs, vs->duration + vs->dpp);
+            if (ret < 0)
+                goto failed;
+        }
         if (!(hls->flags & HLS_SINGLE_FILE)) {
             set_http_options(s, &options, hls);
             ret = hlsenc_io_open(s, &vs->out, filename, &options);
@@ -2813,6 +3120,9 @@ static int hls_write_trailer(struct AVFormatContext *s)
             hlsenc_io_close(s, &vs->out_single_file, vs->basename);
         }
 failed:
+        /* the failed background uploads are reported by the next open */
+        if (ret < 0 && hls->upload_queue && !upload_err)
+            upload_err = ret;
         av_freep(&vs->temp_buffer);
         av_dict_free(&options);
         av_freep(&filename);
@@ -2842,6 +3152,7 @@ failed:
             if (vtt_oc->pb)
                 av_write_trailer(vtt_oc);
             vs->size = avio_tell(vs->vtt_avf->pb) - vs->start_pos;
+            hlsenc_io_close(s, &vtt_oc->pb, vtt_oc->url);
             ff_format_io_close(s, &vtt_oc->pb);
         }
         ret = hls_window(s, 1, vs);
@@ -2849,12 +3160,23 @@ failed:
             av_log(s, AV_LOG_WARNING, "upload playlist failed, will retry with a new http session.\n");
             ff_format_io_close(s, &vs->out);
             hls_window(s, 1, vs);
+            if (hls->upload_queue && !upload_err)
+                upload_err = ret;
         }
         ffio_free_dyn_buf(&oc->pb);
 
         av_free(old_filename);
     }
 
+    if (hls->upload_queue) {
+        ret = ff_upload_queue_flush(hls->upload_queue);
+        update_upload_stats(hls);
+        if (upload_err < 0)
+            ret = upload_err;
+        if (ret < 0 && !hls->ignore_io_errors)
+            return ret;
+    }
+
     return 0;
 }
 
@@ -2894,6 +3216,28 @@ static int hls_init(AVFormatContext *s)
         av_log(hls, AV_LOG_WARNING, "No HTTP method set, hls muxer defaulting to method PUT.\n");
     }
 
+    if (hls->upload_connections > 0) {
+        if ((hls->flags & HLS_SINGLE_FILE) || hls->max_seg_size > 0) {
+            av_log(s, AV_LOG_WARNING, "upload_connections is not supported with "
+                   "single_file or hls_segment_size, uploading synchronously\n");
+        } else if (!ff_format_io_is_default(s)) {
+            av_log(s, AV_LOG_WARNING, "upload_connections bypasses the custom "
+                   "io_open callback, uploading synchronously\n");
+        } else {
+            AVDictionary *options = NULL;
+            set_http_options(s, &options, hls);
+            ret = ff_upload_queue_alloc(&hls->upload_queue, s, hls->upload_connections,
+                                        hls->upload_queue_size, hls->upload_retries,
+                                        hls->http_persistent, options);
+            av_dict_free(&options);
+            if (ret == AVERROR(ENOSYS))
+                av_log(s, AV_LOG_WARNING, "upload_connections requires threads, "
+                       "uploading synchronously\n");
+            else if (ret < 0)
+                return ret;
+        }
+    }
+
     ret = validate_name(hls->nb_varstreams, s->url);
     if (ret < 0)
         return ret;
@@ -2955,6 +3299,29 @@ static int hls_init(AVFormatContext *s)
                "enabled together. Disabling 'independent_segments' flag\n");
     }
 
+    if (hls->part_time > 0) {
+        if (hls->pl_type == PLAYLIST_TYPE_VOD) {
+            av_log(s, AV_LOG_WARNING, "hls_part_time is only useful for live "
+                   "playlists, disabling partial segments\n");
+            hls->part_time = 0;
+        } else if (hls->segment_type != SEGMENT_TYPE_FMP4) {
+            av_log(s, AV_LOG_ERROR, "hls_part_time requires hls_segment_type fmp4\n");
+            return AVERROR(EINVAL);
+        } else if ((hls->flags & (HLS_SINGLE_FILE | HLS_SECOND_LEVEL_SEGMENT_SIZE |
+                                  HLS_SECOND_LEVEL_SEGMENT_DURATION)) ||
+                   hls->max_seg_size > 0) {
+            av_log(s, AV_LOG_ERROR, "hls_part_time cannot be used with single_file, "
+                   "hls_segment_size or the second_level_segment_* flags\n");
+            return AVERROR(EINVAL);
+        } else if (hls->part_time >= hls->time) {
+            av_log(s, AV_LOG_ERROR, "hls_part_time must be shorter than hls_time\n");
+            return AVERROR(EINVAL);
+        }
+    }
+    if (hls->skip_until > 0 && hls->skip_until < 6 * hls->time)
+        av_log(s, AV_LOG_WARNING, "hls_skip_until should be at least six times "
+               "hls_time, clients may refuse the delta playlists\n");
+
     for (i = 0; i < hls->nb_varstreams; i++) {
         vs = &hls->var_streams[i];
 
@@ -2967,6 +3334,7 @@ static int hls_init(AVFormatContext *s)
         vs->end_pts   = AV_NOPTS_VALUE;
         vs->current_segment_final_filename_fmt[0] = '\0';
         vs->initial_prog_date_time = initial_program_date_time;
+        vs->part_independent = 1;
 
         for (j = 0; j < vs->nb_streams; j++) {
             vs->has_video += vs->streams[j]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO;
@@ -3088,6 +3456,17 @@ static int hls_init(AVFormatContext *s)
                 *p = '.';
         }
 
+        if (hls->skip_until > 0) {
+            p = strrchr(vs->m3u8_name, '.');
+            if (p)
+                *p = '\0';
+            vs->delta_m3u8_name = av_asprintf("%s_delta.m3u8", vs->m3u8_name);
+            if (p)
+                *p = '.';
+            if (!vs->delta_m3u8_name)
+                return AVERROR(ENOMEM);
+        }
+
         if ((ret = hls_mux_init(s, vs)) < 0)
             return ret;
 
@@ -3180,6 +3559,24 @@ static const AVOption options[] = {
     {"timeout", "set timeout for socket I/O operations", OFFSET(timeout), AV_OPT_TYPE_DURATION, { .i64 = -1 }, -1, INT_MAX, .flags = E },
     {"ignore_io_errors", "Ignore IO errors for stable long-duration runs with network output", OFFSET(ignore_io_errors), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
     {"headers", "set custom HTTP headers, can override built in default headers", OFFSET(headers), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, E },
+    {"hls_part_time", "set the duration of the low-latency partial segments", OFFSET(part_time), AV_OPT_TYPE_DURATION, {.i64 = 0}, 0, INT64_MAX, E},
+    {"hls_block_reload", "advertise that the server supports blocking playlist reloads", OFFSET(block_reload), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, E},
+    {"hls_skip_until", "write delta playlists skipping the segments older than this", OFFSET(skip_until), AV_OPT_TYPE_DURATION, {.i64 = 0}, 0, INT64_MAX, E},
+    {"upload_connections", "upload HTTP files in the background over this many connections", OFFSET(upload_connections), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 16, E},
+    {"upload_queue_size", "set the maximum number of files waiting for upload", OFFSET(upload_queue_size), AV_OPT_TYPE_INT, {.i64 = 16}, 1, INT_MAX, E},
+    {"upload_retries", "set the number of retries of a failed upload", OFFSET(upload_retries), AV_OPT_TYPE_INT, {.i64 = 3}, 0, 10, E},
+    {"upload_queue_depth", "Number of uploads queued or in progress",
+        OFFSET(upload_queue_depth), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, E | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
+    {"upload_max_queue_depth", "Maximum number of uploads queued or in progress",
+        OFFSET(upload_max_queue_depth), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, E | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
+    {"upload_latency", "Mean time from the end of a file to the end of its upload in microseconds",
+        OFFSET(upload_latency), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, E | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
+    {"upload_max_latency", "Maximum time from the end of a file to the end of its upload in microseconds",
+        OFFSET(upload_max_latency), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, E | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
+    {"upload_retry_count", "Number of uploads retried",
+        OFFSET(upload_retry_count), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, E | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
+    {"upload_failures", "Number of uploads given up after all retries",
+        OFFSET(upload_failures), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, E | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY},
     { NULL },
 };
 
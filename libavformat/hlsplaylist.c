@@ -186,6 +186,60 @@ int ff_hls_write_file_entry(AVIOContext *out, int insert_discont,
     return 0;
 }
 
+void ff_hls_write_server_control(AVIOContext *out, int can_block_reload,
+                                 double part_hold_back, double can_skip_until)
+{
+    const char *sep = ":";
+
+    if (!out)
+        return;
+    /* YES is the only value defined for CAN-BLOCK-RELOAD */
+    avio_printf(out, "#EXT-X-SERVER-CONTROL");
+    if (can_block_reload) {
+        avio_printf(out, "%sCAN-BLOCK-RELOAD=YES", sep);
+        sep = ",";
+    }
+    if (can_skip_until > 0) {
+        avio_printf(out, "%sCAN-SKIP-UNTIL=%f", sep, can_skip_until);
+        sep = ",";
+    }
+    if (part_hold_back > 0)
+        avio_printf(out, "%sPART-HOLD-BACK=%f", sep, part_hold_back);
+    avio_printf(out, "\n");
+}
+
+void ff_hls_write_part_inf(AVIOContext *out, double part_target)
+{
+    if (!out)
+        return;
+    avio_printf(out, "#EXT-X-PART-INF:PART-TARGET=%f\n", part_target);
+}
+
+void ff_hls_write_skip(AVIOContext *out, int skipped_segments)
+{
+    if (!out)
+        return;
+    avio_printf(out, "#EXT-X-SKIP:SKIPPED-SEGMENTS=%d\n", skipped_segments);
+}
+
+void ff_hls_write_part(AVIOContext *out, double duration, const char *baseurl,
+                       const char *filename, int independent)
+{
+    if (!out)
+        return;
+    avio_printf(out, "#EXT-X-PART:DURATION=%f,URI=\"%s%s\"%s\n", duration,
+                baseurl ? baseurl : "", filename, independent ? ",INDEPENDENT=YES" : "");
+}
+
+void ff_hls_write_preload_hint(AVIOContext *out, const char *baseurl,
+                               const char *filename)
+{
+    if (!out)
+        return;
+    avio_printf(out, "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"%s%s\"\n",
+                baseurl ? baseurl : "", filename);
+}
+
 void ff_hls_write_end_list(AVIOContext *out)
 {
     if (!out)
@@ -60,6 +60,14 @@ int ff_hls_write_file_entry(AVIOContext *out, int insert_discont,
                             const char *filename, double *prog_date_time,
                             int64_t video_keyframe_size, int64_t video_keyframe_pos,
                             int iframe_mode);
+void ff_hls_write_server_control(AVIOContext *out, int can_block_reload,
+                                 double part_hold_back, double can_skip_until);
+void ff_hls_write_part_inf(AVIOContext *out, double part_target);
+void ff_hls_write_skip(AVIOContext *out, int skipped_segments);
+void ff_hls_write_part(AVIOContext *out, double duration, const char *baseurl,
+                       const char *filename, int independent);
+void ff_hls_write_preload_hint(AVIOContext *out, const char *baseurl,
+                               const char *filename);
 void ff_hls_write_end_list (AVIOContext *out);
 
 #endif /* AVFORMAT_HLSPLAYLIST_H_ */
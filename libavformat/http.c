@@ -75,6 +75,8 @@ typedef struct HTTPContext {
     char *http_proxy;
     char *headers;
     char *mime_type;
+    char *etag;
+    char *last_modified;
     char *http_version;
     char *user_agent;
     char *referer;
@@ -89,6 +91,11 @@ typedef struct HTTPContext {
     int chunked_post;
     /* A flag which indicates if the end of chunked encoding has been sent. */
     int end_chunked_post;
+    /* Start of the POST reply read when shutting down, and its status code
+     * once the status line is complete. */
+    char post_reply_status[16];
+    int post_reply_status_len;
+    int post_reply_code;
     /* A flag which indicates we have finished to read POST reply. */
     int end_header;
     /* A flag which indicates if we use persistent connections. */
@@ -150,6 +157,8 @@ static const AVOption options[] = {
     { "multiple_requests", "use persistent connections", OFFSET(multiple_requests), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, D | E },
     { "post_data", "set custom HTTP post data", OFFSET(post_data), AV_OPT_TYPE_BINARY, .flags = D | E },
     { "mime_type", "export the MIME type", OFFSET(mime_type), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "etag", "export the entity tag of the resource", OFFSET(etag), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "last_modified", "export the modification date of the resource", OFFSET(last_modified), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     { "http_version", "export the http response version", OFFSET(http_version), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     { "cookies", "set cookies to be sent in applicable future requests, use newline delimited Set-Cookie HTTP field value syntax", OFFSET(cookies), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, D },
     { "icy", "request ICY metadata", OFFSET(icy), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, D },
@@ -370,20 +379,47 @@ fail:
         return location_changed;
     return ff_http_averror(s->http_code, AVERROR(EIO));
 }
+/* Parse the status line of a POST reply read after the request body. */
+static void parse_post_reply(HTTPContext *s, const char *buf, int size)
+{
+    int len = FFMIN(size, sizeof(s->post_reply_status) - 1 - s->post_reply_status_len);
+    const char *p;
+
+    memcpy(s->post_reply_status + s->post_reply_status_len, buf, len);
+    s->post_reply_status_len += len;
+    s->post_reply_status[s->post_reply_status_len] = 0;
+
+    /* "HTTP/1.1 200" */
+    p = strchr(s->post_reply_status, ' ');
+    if (!s->post_reply_code && p && strlen(p) >= 4)
+        s->post_reply_code = strtol(p + 1, NULL, 10);
+    if (!s->post_reply_code && s->post_reply_status_len == sizeof(s->post_reply_status) - 1)
+        s->post_reply_code = -1;
+}
+
 int ff_http_get_shutdown_status(URLContext *h)
 {
-    int ret = 0;
     HTTPContext *s = h->priv_data;
 
     /* flush the receive buffer when it is write only mode */
     char buf[1024];
     int read_ret;
-    read_ret = ffurl_read(s->hd, buf, sizeof(buf));
-    if (read_ret < 0) {
-        ret = read_ret;
-    }
 
-    return ret;
+    /* the reply may have been read by http_shutdown() already */
+    while (!s->post_reply_code) {
+        read_ret = ffurl_read(s->hd, buf, sizeof(buf));
+        if (read_ret < 0)
+            return read_ret;
+        if (!read_ret)
+            return AVERROR(EIO);
+        parse_post_reply(s, buf, read_ret);
+    }
+    if (s->post_reply_code < 200 || s->post_reply_code >= 300) {
+        av_log(h, AV_LOG_WARNING, "HTTP error %d in reply to the request body\n",
+               s->post_reply_code);
+        return ff_http_averror(s->post_reply_code, AVERROR(EIO));
+    }
+    return 0;
 }
 
 int ff_http_do_new_request(URLContext *h, const char *uri) {
@@ -1092,6 +1128,12 @@ static int process_line(URLContext *h, char *line, int line_count,
         } else if (!av_strcasecmp(tag, "Content-Type")) {
             av_free(s->mime_type);
             s->mime_type = av_strdup(p);
+        } else if (!av_strcasecmp(tag, "ETag")) {
+            av_free(s->etag);
+            s->etag = av_strdup(p);
+        } else if (!av_strcasecmp(tag, "Last-Modified")) {
+            av_free(s->last_modified);
+            s->last_modified = av_strdup(p);
         } else if (!av_strcasecmp(tag, "Set-Cookie")) {
             if (parse_cookie(s, p, &s->cookie_dict))
                 av_log(h, AV_LOG_WARNING, "Unable to parse '%s'\n", p);
@@ -1409,6 +1451,8 @@ static int http_connect(URLContext *h, const char *path, const char *local_path,
     s->filesize         = UINT64_MAX;
     s->willclose        = 0;
     s->end_chunked_post = 0;
+    s->post_reply_status_len = 0;
+    s->post_reply_code  = 0;
     s->end_header       = 0;
 #if CONFIG_ZLIB
     s->compressed       = 0;
@@ -1745,6 +1789,8 @@ static int http_shutdown(URLContext *h, int flags)
                 av_log(h, AV_LOG_ERROR, "URL read error: %s\n", av_err2str(read_ret));
                 ret = read_ret;
             }
+            if (read_ret > 0)
+                parse_post_reply(s, buf, read_ret);
         }
         s->end_chunked_post = 1;
     }
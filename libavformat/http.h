@@ -41,8 +41,8 @@ void ff_http_init_auth_state(URLContext *dest, const URLContext *src);
  * Get the HTTP shutdown response status, be used after http_shutdown.
  *
  * @param h pointer to the resource
- * @return a negative value if an error condition occurred, 0
- * otherwise
+ * @return a negative value if an error condition occurred or if the status
+ * code of the response is not 2xx, 0 otherwise
  */
 int ff_http_get_shutdown_status(URLContext *h);
 
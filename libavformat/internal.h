@@ -228,6 +228,12 @@ struct AVStreamInternal {
         int64_t fps_last_dts;
         int     fps_last_dts_idx;
 
+        /**
+         * Packet waiting to be decoded, used to decode the streams in
+         * parallel with AVFMT_FLAG_FAST_PROBE.
+         */
+        AVPacket *pending_pkt;
+
     } *info;
 
     AVIndexEntry *index_entries; /**< Only used if the format does not
@@ -541,6 +547,23 @@ int ff_add_index_entry(AVIndexEntry **index_entries,
                        unsigned int *index_entries_allocated_size,
                        int64_t pos, int64_t timestamp, int size, int distance, int flags);
 
+/**
+ * @return 1 if reading s can benefit from larger buffers, that is if it is
+ *         not read from a local file
+ */
+int ff_configure_buffers_needed(AVFormatContext *s);
+
+/**
+ * Enlarge the buffer of s to twice pos_delta, the largest distance between
+ * the data of different streams with close timestamps, and let it seek
+ * forward over skip bytes, the size of the largest packet, by reading.
+ */
+void ff_configure_buffers(AVFormatContext *s, int64_t pos_delta, int64_t skip);
+
+/**
+ * Configure the buffers of s from the distances between the index entries
+ * of its streams, see ff_configure_buffers().
+ */
 void ff_configure_buffers_for_index(AVFormatContext *s, int64_t time_tolerance);
 
 /**
@@ -640,6 +663,13 @@ int ff_framehash_write_header(AVFormatContext *s);
  */
 int ff_read_packet(AVFormatContext *s, AVPacket *pkt);
 
+/**
+ * Like av_get_packet(), but if the data is memory mapped by the protocol,
+ * reference it instead of copying it. The packet is then read-only, so
+ * it must not be used by demuxers modifying the data in place.
+ */
+int ff_get_packet_mapped(AVIOContext *s, AVPacket *pkt, int size);
+
 /**
  * Interleave an AVPacket per dts so it can be muxed.
  *
@@ -803,6 +833,12 @@ int ff_format_output_open(AVFormatContext *s, const char *url, AVDictionary **op
  */
 void ff_format_io_close(AVFormatContext *s, AVIOContext **pb);
 
+/**
+ * @return 1 if the io_open and io_close callbacks of s are the default ones,
+ *         i.e. if opening a URL with ffio_open_whitelist() is equivalent
+ */
+int ff_format_io_is_default(const AVFormatContext *s);
+
 /**
  * Utility function to check if the file uses http or https protocol
  *
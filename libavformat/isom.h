@@ -155,6 +155,44 @@ typedef struct MOVIndexRange {
     int64_t end;
 } MOVIndexRange;
 
+/**
+ * Position in the sample tables of a track, from which the samples are
+ * resolved one after the other.
+ */
+typedef struct MOVSampleCursor {
+    unsigned int sample;        ///< number of the next sample
+    unsigned int chunk;
+    unsigned int chunk_sample;  ///< samples of the chunk already read
+    unsigned int stsc_index;
+    unsigned int stts_index;
+    unsigned int stts_sample;
+    unsigned int stss_index;
+    unsigned int stps_index;
+    unsigned int rap_group_index;
+    unsigned int rap_group_sample;
+    unsigned int distance;
+    int64_t offset;
+    int64_t dts;
+} MOVSampleCursor;
+
+#define MOV_CHECKPOINT_INTERVAL 1024
+
+/**
+ * Sample index of a track built from the sample tables on demand, used
+ * instead of AVStream index entries with the compact_index option.
+ */
+typedef struct MOVCompactIndex {
+    unsigned int nb_samples;
+    int chunk_mode;             ///< raw audio read in groups of samples
+    int is_audio;
+    int64_t first_dts;
+    int max_sample_size;
+    MOVSampleCursor start;      ///< position of the first sample
+    MOVSampleCursor cur;        ///< position after the sample in entry
+    AVIndexEntry entry;         ///< entry of the sample cur.sample - 1
+    MOVSampleCursor *checkpoints; ///< one every MOV_CHECKPOINT_INTERVAL samples, built on the first seek
+} MOVCompactIndex;
+
 typedef struct MOVStreamContext {
     AVIOContext *pb;
     int pb_is_copied;
@@ -193,6 +231,7 @@ typedef struct MOVStreamContext {
     int64_t current_index;
     MOVIndexRange* index_ranges;
     MOVIndexRange* current_index_range;
+    MOVCompactIndex *compact_index;
     unsigned int bytes_per_frame;
     unsigned int samples_per_frame;
     int dv_audio_container;
@@ -267,6 +306,7 @@ typedef struct MOVContext {
     int use_absolute_path;
     int ignore_editlist;
     int advanced_editlist;
+    int compact_index;
     int ignore_chapters;
     int seek_individually;
     int64_t next_root_atom; ///< offset of the next root atom
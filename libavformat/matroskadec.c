@@ -1037,8 +1037,19 @@ static int ebml_read_ascii(AVIOContext *pb, int size,
 static int ebml_read_binary(AVIOContext *pb, int length,
                             int64_t pos, EbmlBin *bin)
 {
+    AVBufferRef *mapped;
     int ret;
 
+    /* reference the data directly when the input is memory mapped */
+    if (ffio_read_mapped(pb, &mapped, length, AV_INPUT_BUFFER_PADDING_SIZE) > 0) {
+        av_buffer_unref(&bin->buf);
+        bin->buf  = mapped;
+        bin->data = bin->buf->data;
+        bin->size = length;
+        bin->pos  = pos;
+        return 0;
+    }
+
     ret = av_buffer_realloc(&bin->buf, length + AV_INPUT_BUFFER_PADDING_SIZE);
     if (ret < 0)
         return ret;
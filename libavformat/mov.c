@@ -3373,10 +3373,315 @@ static int64_t add_ctts_entry(MOVStts** ctts_data, unsigned int* ctts_count, uns
 }
 
 #define MAX_REORDER_DELAY 16
+
+/**
+ * Number of samples and size of the next entry of an uncompressed audio
+ * track read in groups of samples, with chunk_samples samples left in the
+ * chunk. This follows mov_build_index().
+ */
+static void mov_chunk_mode_entry(MOVStreamContext *sc, unsigned int chunk_samples,
+                                 unsigned int *samples, unsigned int *size)
+{
+    if (sc->samples_per_frame >= 160) { // gsm
+        *samples = sc->samples_per_frame;
+        *size = sc->bytes_per_frame;
+    } else if (sc->samples_per_frame > 1) {
+        *samples = FFMIN((1024 / sc->samples_per_frame)*
+                         sc->samples_per_frame, chunk_samples);
+        *size = (*samples / sc->samples_per_frame) * sc->bytes_per_frame;
+    } else {
+        *samples = FFMIN(1024, chunk_samples);
+        *size = *samples * sc->sample_size;
+    }
+}
+
+/**
+ * Read the sample at the cursor c of a track with a compact index into e, and
+ * move the cursor to the next sample. This follows mov_build_index().
+ *
+ * @return 0 on success, AVERROR_EOF after the last sample
+ */
+static int mov_cursor_read(MOVStreamContext *sc, MOVSampleCursor *c, AVIndexEntry *e)
+{
+    MOVCompactIndex *ci = sc->compact_index;
+
+    for (;;) {
+        if (c->chunk >= sc->chunk_count)
+            return AVERROR_EOF;
+        if (!c->chunk_sample) {
+            c->offset = sc->chunk_offsets[c->chunk];
+            if (ci->chunk_mode) {
+                if (mov_stsc_index_valid(c->stsc_index, sc->stsc_count) &&
+                    c->chunk + 1 == sc->stsc_data[c->stsc_index + 1].first)
+                    c->stsc_index++;
+            } else {
+                while (mov_stsc_index_valid(c->stsc_index, sc->stsc_count) &&
+                       c->chunk + 1 == sc->stsc_data[c->stsc_index + 1].first)
+                    c->stsc_index++;
+            }
+        }
+        if (c->chunk_sample < sc->stsc_data[c->stsc_index].count)
+            break;
+        c->chunk++;
+        c->chunk_sample = 0;
+    }
+
+    if (ci->chunk_mode) {
+        unsigned size, samples;
+
+        mov_chunk_mode_entry(sc, sc->stsc_data[c->stsc_index].count - c->chunk_sample,
+                             &samples, &size);
+        if (size > 0x3FFFFFFF)
+            return AVERROR_INVALIDDATA;
+
+        e->pos = c->offset;
+        e->timestamp = c->dts;
+        e->size = size;
+        e->min_distance = 0;
+        e->flags = AVINDEX_KEYFRAME;
+
+        c->offset += size;
+        c->dts += samples;
+        c->chunk_sample += samples;
+    } else {
+        int key_off = (sc->keyframe_count && sc->keyframes[0] > 0) || (sc->stps_count && sc->stps_data[0] > 0);
+        int rap_group_present = sc->rap_group_count && sc->rap_group;
+        int keyframe = 0;
+        unsigned int sample_size;
+
+        if (c->sample >= sc->sample_count)
+            return AVERROR_EOF;
+
+        if (!sc->keyframe_absent && (!sc->keyframe_count || c->sample + key_off == sc->keyframes[c->stss_index])) {
+            keyframe = 1;
+            if (c->stss_index + 1 < sc->keyframe_count)
+                c->stss_index++;
+        } else if (sc->stps_count && c->sample + key_off == sc->stps_data[c->stps_index]) {
+            keyframe = 1;
+            if (c->stps_index + 1 < sc->stps_count)
+                c->stps_index++;
+        }
+        if (rap_group_present && c->rap_group_index < sc->rap_group_count) {
+            if (sc->rap_group[c->rap_group_index].index > 0)
+                keyframe = 1;
+            if (++c->rap_group_sample == sc->rap_group[c->rap_group_index].count) {
+                c->rap_group_sample = 0;
+                c->rap_group_index++;
+            }
+        }
+        if (sc->keyframe_absent
+            && !sc->stps_count
+            && !rap_group_present
+            && (ci->is_audio || (c->chunk == 0 && c->chunk_sample == 0)))
+             keyframe = 1;
+        if (keyframe)
+            c->distance = 0;
+        sample_size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[c->sample];
+        if (sample_size > 0x3FFFFFFF)
+            return AVERROR_INVALIDDATA;
+
+        e->pos = c->offset;
+        e->timestamp = c->dts;
+        e->size = sample_size;
+        e->min_distance = c->distance;
+        e->flags = keyframe ? AVINDEX_KEYFRAME : 0;
+
+        c->offset += sample_size;
+        c->dts += sc->stts_data[c->stts_index].duration;
+        c->distance++;
+        c->chunk_sample++;
+        c->stts_sample++;
+        if (c->stts_index + 1 < sc->stts_count && c->stts_sample == sc->stts_data[c->stts_index].count) {
+            c->stts_sample = 0;
+            c->stts_index++;
+        }
+    }
+    c->sample++;
+
+    return 0;
+}
+
+/**
+ * Save the cursor of every MOV_CHECKPOINT_INTERVAL-th sample of the track,
+ * if not done yet. The checkpoints are only needed to seek, so they are
+ * built by the first access to the samples which is not sequential.
+ */
+static int mov_compact_index_checkpoints(MOVStreamContext *sc)
+{
+    MOVCompactIndex *ci = sc->compact_index;
+    unsigned int nb_checkpoints = (ci->nb_samples + MOV_CHECKPOINT_INTERVAL - 1) / MOV_CHECKPOINT_INTERVAL;
+    MOVSampleCursor c = ci->start;
+    AVIndexEntry e;
+    unsigned int i;
+    int ret;
+
+    if (ci->checkpoints)
+        return 0;
+    ci->checkpoints = av_malloc_array(nb_checkpoints, sizeof(*ci->checkpoints));
+    if (!ci->checkpoints)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < nb_checkpoints; i++) {
+        ci->checkpoints[i] = c;
+        while (i + 1 < nb_checkpoints && c.sample < (i + 1) * MOV_CHECKPOINT_INTERVAL) {
+            if ((ret = mov_cursor_read(sc, &c, &e)) < 0) {
+                av_freep(&ci->checkpoints);
+                return ret;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Read the sample number sample into e, moving the cursor c from where it
+ * is if the sample is close enough ahead, or from the closest checkpoint.
+ */
+static int mov_compact_index_get(MOVStreamContext *sc, unsigned int sample,
+                                 MOVSampleCursor *c, AVIndexEntry *e)
+{
+    MOVCompactIndex *ci = sc->compact_index;
+    int ret;
+
+    if (sample >= ci->nb_samples)
+        return AVERROR(EINVAL);
+    if (c->sample > sample || sample - c->sample >= MOV_CHECKPOINT_INTERVAL) {
+        if ((ret = mov_compact_index_checkpoints(sc)) < 0)
+            return ret;
+        *c = ci->checkpoints[sample / MOV_CHECKPOINT_INTERVAL];
+    }
+    do {
+        if ((ret = mov_cursor_read(sc, c, e)) < 0)
+            return ret;
+    } while (c->sample <= sample);
+
+    return 0;
+}
+
+/* make the sample number sample the current entry of the compact index */
+static void mov_compact_index_set(MOVStreamContext *sc, int sample)
+{
+    MOVCompactIndex *ci = sc->compact_index;
+
+    if (sample < 0 || sample >= ci->nb_samples || sample + 1 == ci->cur.sample)
+        return;
+    if (mov_compact_index_get(sc, sample, &ci->cur, &ci->entry) < 0)
+        ci->cur.sample = 0;
+}
+
+/**
+ * Search the compact index like av_index_search_timestamp() searches the
+ * index entries: a binary search over the checkpoints, followed by a scan
+ * of the samples after the checkpoint found.
+ */
+static int mov_compact_index_search(MOVStreamContext *sc, int64_t wanted_timestamp, int flags)
+{
+    MOVCompactIndex *ci = sc->compact_index;
+    int nb_checkpoints = (ci->nb_samples + MOV_CHECKPOINT_INTERVAL - 1) / MOV_CHECKPOINT_INTERVAL;
+    int lo = 0, hi = nb_checkpoints - 1, k;
+    int a = -1, b = ci->nb_samples, key = -1;
+    MOVSampleCursor c;
+    AVIndexEntry e;
+
+    if (mov_compact_index_checkpoints(sc) < 0)
+        return -1;
+    while (lo < hi) {
+        int m = (lo + hi + 1) >> 1;
+        if (ci->checkpoints[m].dts < wanted_timestamp)
+            lo = m;
+        else
+            hi = m - 1;
+    }
+
+    c = ci->checkpoints[lo];
+    while (c.sample < ci->nb_samples) {
+        int n = c.sample;
+        if (mov_cursor_read(sc, &c, &e) < 0)
+            return -1;
+        if (e.timestamp <= wanted_timestamp) {
+            a = n;
+            if (e.flags & AVINDEX_KEYFRAME)
+                key = n;
+        }
+        if (e.timestamp >= wanted_timestamp && b == ci->nb_samples)
+            b = n;
+        if (e.timestamp > wanted_timestamp)
+            break;
+    }
+
+    if (flags & AVSEEK_FLAG_BACKWARD) {
+        if (flags & AVSEEK_FLAG_ANY || a < 0)
+            return a;
+        /* look for the previous keyframe in the intervals before */
+        for (k = lo - 1; key < 0 && k >= 0; k--) {
+            c = ci->checkpoints[k];
+            while (c.sample < ci->checkpoints[k + 1].sample) {
+                int n = c.sample;
+                if (mov_cursor_read(sc, &c, &e) < 0)
+                    return -1;
+                if (e.flags & AVINDEX_KEYFRAME)
+                    key = n;
+            }
+        }
+        return key;
+    }
+
+    if (b == ci->nb_samples)
+        return -1;
+    if (flags & AVSEEK_FLAG_ANY)
+        return b;
+    c = ci->checkpoints[b / MOV_CHECKPOINT_INTERVAL];
+    if (mov_compact_index_get(sc, b, &c, &e) < 0)
+        return -1;
+    while (!(e.flags & AVINDEX_KEYFRAME)) {
+        if (c.sample >= ci->nb_samples || mov_cursor_read(sc, &c, &e) < 0)
+            return -1;
+    }
+    return c.sample - 1;
+}
+
+static void mov_free_compact_index(MOVStreamContext *sc)
+{
+    if (sc->compact_index)
+        av_freep(&sc->compact_index->checkpoints);
+    av_freep(&sc->compact_index);
+}
+
+static AVIndexEntry *mov_get_current_sample(AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    if (sc->compact_index)
+        return sc->current_sample < sc->compact_index->nb_samples ?
+               &sc->compact_index->entry : NULL;
+    return sc->current_sample < st->internal->nb_index_entries ?
+           &st->internal->index_entries[sc->current_sample] : NULL;
+}
+
+static int64_t mov_get_sample_timestamp(AVStream *st, int sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVCompactIndex *ci = sc->compact_index;
+
+    if (ci) {
+        MOVSampleCursor c = ci->cur;
+        AVIndexEntry e;
+
+        if (sample + 1 == ci->cur.sample)
+            return ci->entry.timestamp;
+        if (mov_compact_index_get(sc, sample, &c, &e) < 0)
+            return AV_NOPTS_VALUE;
+        return e.timestamp;
+    }
+    return st->internal->index_entries[sample].timestamp;
+}
+
 static void mov_estimate_video_delay(MOVContext *c, AVStream* st)
 {
     MOVStreamContext *msc = st->priv_data;
-    int ind;
+    MOVCompactIndex *ci = msc->compact_index;
+    MOVSampleCursor cursor;
+    AVIndexEntry e;
+    int ind, nb_samples;
     int ctts_ind = 0;
     int ctts_sample = 0;
     int64_t pts_buf[MAX_REORDER_DELAY + 1]; // Circular buffer to sort pts.
@@ -3389,14 +3694,24 @@ static void mov_estimate_video_delay(MOVContext *c, AVStream* st)
     if (st->codecpar->video_delay <= 0 && msc->ctts_data &&
         st->codecpar->codec_id == AV_CODEC_ID_H264) {
         st->codecpar->video_delay = 0;
-        for (ind = 0; ind < st->internal->nb_index_entries && ctts_ind < msc->ctts_count; ++ind) {
+        nb_samples = ci ? ci->nb_samples : st->internal->nb_index_entries;
+        if (ci)
+            cursor = ci->start;
+        for (ind = 0; ind < nb_samples && ctts_ind < msc->ctts_count; ++ind) {
+            if (ci) {
+                if (mov_cursor_read(msc, &cursor, &e) < 0)
+                    break;
+            } else {
+                e = st->internal->index_entries[ind];
+            }
+
             // Point j to the last elem of the buffer and insert the current pts there.
             j = buf_start;
             buf_start = (buf_start + 1);
             if (buf_start == MAX_REORDER_DELAY + 1)
                 buf_start = 0;
 
-            pts_buf[j] = st->internal->index_entries[ind].timestamp + msc->ctts_data[ctts_ind].duration;
+            pts_buf[j] = e.timestamp + msc->ctts_data[ctts_ind].duration;
 
             // The timestamps that are already in the sorted buffer, and are greater than the
             // current pts, are exactly the timestamps that need to be buffered to output PTS
@@ -3439,6 +3754,8 @@ static void mov_current_sample_inc(MOVStreamContext *sc)
         sc->current_index_range++;
         sc->current_index = sc->current_index_range->start;
     }
+    if (sc->compact_index)
+        mov_compact_index_set(sc, sc->current_sample);
 }
 
 static void mov_current_sample_dec(MOVStreamContext *sc)
@@ -3451,6 +3768,8 @@ static void mov_current_sample_dec(MOVStreamContext *sc)
         sc->current_index_range--;
         sc->current_index = sc->current_index_range->end - 1;
     }
+    if (sc->compact_index)
+        mov_compact_index_set(sc, sc->current_sample);
 }
 
 static void mov_current_sample_set(MOVStreamContext *sc, int current_sample)
@@ -3459,6 +3778,8 @@ static void mov_current_sample_set(MOVStreamContext *sc, int current_sample)
 
     sc->current_sample = current_sample;
     sc->current_index = current_sample;
+    if (sc->compact_index)
+        mov_compact_index_set(sc, current_sample);
     if (!sc->index_ranges) {
         return;
     }
@@ -3785,6 +4106,258 @@ static void mov_fix_index(MOVContext *mov, AVStream *st)
     msc->current_index = msc->index_ranges[0].start;
 }
 
+/* Expand ctts entries such that we have a 1-1 mapping with samples */
+static int mov_expand_ctts(MOVStreamContext *sc)
+{
+    MOVStts *ctts_data_old = sc->ctts_data;
+    unsigned int ctts_count_old = sc->ctts_count;
+    unsigned int i, j;
+
+    if (sc->sample_count >= UINT_MAX / sizeof(*sc->ctts_data))
+        return AVERROR(EINVAL);
+    sc->ctts_count = 0;
+    sc->ctts_allocated_size = 0;
+    sc->ctts_data = av_fast_realloc(NULL, &sc->ctts_allocated_size,
+                            sc->sample_count * sizeof(*sc->ctts_data));
+    if (!sc->ctts_data) {
+        av_free(ctts_data_old);
+        return AVERROR(ENOMEM);
+    }
+
+    memset((uint8_t*)(sc->ctts_data), 0, sc->ctts_allocated_size);
+
+    for (i = 0; i < ctts_count_old &&
+                sc->ctts_count < sc->sample_count; i++)
+        for (j = 0; j < ctts_data_old[i].count &&
+                    sc->ctts_count < sc->sample_count; j++)
+            add_ctts_entry(&sc->ctts_data, &sc->ctts_count,
+                           &sc->ctts_allocated_size, 1,
+                           ctts_data_old[i].duration);
+    av_free(ctts_data_old);
+    return 0;
+}
+
+/**
+ * Count the samples of a track with a compact index from its sample tables,
+ * without resolving them one by one, and check their sizes.
+ *
+ * @param size     set to the total size of the samples
+ * @param duration set to the total duration of the samples
+ */
+static int mov_compact_index_scan(MOVStreamContext *sc, uint64_t *size, int64_t *duration)
+{
+    MOVCompactIndex *ci = sc->compact_index;
+    uint64_t nb_samples = 0, remaining;
+    unsigned int chunk, stsc_index = 0, i;
+
+    *size     = 0;
+    *duration = 0;
+    for (chunk = 0; chunk < sc->chunk_count; chunk++) {
+        unsigned int count, done, samples, entry_size;
+
+        if (ci->chunk_mode) {
+            if (mov_stsc_index_valid(stsc_index, sc->stsc_count) &&
+                chunk + 1 == sc->stsc_data[stsc_index + 1].first)
+                stsc_index++;
+        } else {
+            while (mov_stsc_index_valid(stsc_index, sc->stsc_count) &&
+                   chunk + 1 == sc->stsc_data[stsc_index + 1].first)
+                stsc_index++;
+        }
+        count = sc->stsc_data[stsc_index].count;
+        if (!ci->chunk_mode) {
+            nb_samples += count;
+            continue;
+        }
+        for (done = 0; done < count; done += samples) {
+            mov_chunk_mode_entry(sc, count - done, &samples, &entry_size);
+            if (entry_size > 0x3FFFFFFF)
+                return AVERROR_INVALIDDATA;
+            ci->max_sample_size = FFMAX(ci->max_sample_size, entry_size);
+            *size     += entry_size;
+            *duration += samples;
+            nb_samples++;
+        }
+    }
+
+    if (!ci->chunk_mode) {
+        nb_samples = FFMIN(nb_samples, sc->sample_count);
+        for (i = 0; i < nb_samples; i++) {
+            unsigned int sample_size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[i];
+            if (sample_size > 0x3FFFFFFF)
+                return AVERROR_INVALIDDATA;
+            ci->max_sample_size = FFMAX(ci->max_sample_size, sample_size);
+            *size += sample_size;
+        }
+        remaining = nb_samples;
+        for (i = 0; i < sc->stts_count && remaining; i++) {
+            uint64_t n = remaining;
+            /* like mov_cursor_read(), stay on the last or an empty entry */
+            if (i + 1 < sc->stts_count && sc->stts_data[i].count)
+                n = FFMIN(n, sc->stts_data[i].count);
+            *duration += n * sc->stts_data[i].duration;
+            remaining -= n;
+        }
+    }
+
+    if (nb_samples > UINT_MAX)
+        return AVERROR_INVALIDDATA;
+    ci->nb_samples = nb_samples;
+    return 0;
+}
+
+/**
+ * Resolve the samples of the track from the sample tables when they are
+ * read instead of building the index entries. The samples are only counted
+ * when the file is opened; the position of every MOV_CHECKPOINT_INTERVAL-th
+ * sample in the tables is kept once the track is first seeked.
+ *
+ * The tracks for which the index would need to be fixed, because of their
+ * edit list, invalid tables or fragments, are not supported.
+ *
+ * @param current_dts dts of the first sample
+ * @return 0 if the compact index is used, a negative value if the index
+ *         entries must be built
+ */
+static int mov_build_compact_index(MOVContext *mov, AVStream *st, int64_t current_dts)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVCompactIndex *ci;
+    unsigned int i;
+    uint64_t stream_size;
+    int64_t duration;
+    int ret;
+
+    if ((st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO &&
+         st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO) ||
+        !sc->chunk_count || !sc->stsc_count || !sc->stts_count ||
+        st->internal->nb_index_entries)
+        return AVERROR(ENOSYS);
+    /* all the samples must belong to the track */
+    for (i = 0; i < sc->stsc_count && sc->pseudo_stream_id != -1; i++)
+        if (sc->stsc_data[i].id - 1 != sc->pseudo_stream_id)
+            return AVERROR(ENOSYS);
+    /* only an edit list which keeps all the samples as they are */
+    if (sc->elst_count && !mov->ignore_editlist && mov->advanced_editlist &&
+        (sc->elst_count > 1 || sc->elst_data[0].time || sc->ctts_data || mov->time_scale <= 0))
+        return AVERROR(ENOSYS);
+
+    ci = av_mallocz(sizeof(*ci));
+    if (!ci)
+        return AVERROR(ENOMEM);
+    ci->is_audio   = st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO;
+    ci->chunk_mode = ci->is_audio && sc->stts_count == 1 && sc->stts_data[0].duration == 1;
+    sc->compact_index = ci;
+
+    ret = AVERROR(ENOSYS);
+    if (ci->chunk_mode) {
+        if (sc->samples_per_frame > 1 && !sc->bytes_per_frame)
+            goto fail;
+        for (i = 0; i + 1 < sc->stsc_count; i++)
+            if (sc->samples_per_frame && sc->stsc_data[i].count % sc->samples_per_frame)
+                goto fail;
+    } else {
+        if (!sc->sample_count ||
+            (sc->sample_size > 0 && sc->sample_size < sc->stsz_sample_size) ||
+            (sc->stsz_sample_size > 0 && sc->stsz_sample_size < sc->sample_size))
+            goto fail;
+        for (i = 0; i < sc->stts_count; i++)
+            if (sc->stts_data[i].duration < 0)
+                goto fail;
+        current_dts -= sc->dts_shift;
+    }
+
+    if (mov_compact_index_scan(sc, &stream_size, &duration) < 0 ||
+        !ci->nb_samples || ci->nb_samples >= INT_MAX) {
+        ret = AVERROR(ENOSYS);
+        goto fail;
+    }
+
+    if (sc->elst_count && !mov->ignore_editlist && mov->advanced_editlist) {
+        int64_t edit_duration = av_rescale(sc->elst_data[0].duration, sc->time_scale,
+                                           mov->time_scale);
+        if (edit_duration < duration) {
+            ret = AVERROR(ENOSYS);
+            goto fail;
+        }
+        /* what mov_fix_index() does for such an edit list */
+        sc->min_corrected_pts = 0;
+        st->start_time = 0;
+        st->duration = FFMIN(st->duration, edit_duration);
+        st->internal->skip_samples = sc->start_pad = 0;
+    }
+
+    if (!ci->chunk_mode && st->duration > 0)
+        st->codecpar->bit_rate = stream_size*8*sc->time_scale/st->duration;
+
+    ci->start.dts = current_dts;
+    if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+        MOVSampleCursor c = ci->start;
+        AVIndexEntry e;
+
+        while (c.sample < FFMIN(ci->nb_samples, 100) && mov_cursor_read(sc, &c, &e) >= 0)
+            ff_rfps_add_frame(mov->fc, st, e.timestamp);
+    }
+
+    ci->cur = ci->start;
+    if ((ret = mov_cursor_read(sc, &ci->cur, &ci->entry)) < 0)
+        goto fail;
+    ci->first_dts = ci->entry.timestamp;
+
+    if (st->start_time == AV_NOPTS_VALUE && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+        st->start_time = ci->first_dts + sc->dts_shift;
+        if (sc->ctts_data)
+            st->start_time += sc->ctts_data[0].duration;
+    }
+
+    mov_estimate_video_delay(mov, st);
+
+    av_log(mov->fc, AV_LOG_DEBUG, "stream %d: compact index of %u samples\n",
+           st->index, ci->nb_samples);
+    return 0;
+
+fail:
+    mov_free_compact_index(sc);
+    return ret;
+}
+
+/* replace the compact index of the track by index entries */
+static int mov_expand_compact_index(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVCompactIndex *ci = sc->compact_index;
+    MOVSampleCursor c;
+    unsigned int i;
+    int chunk_mode, ret;
+
+    if (!ci)
+        return 0;
+    av_log(mov->fc, AV_LOG_DEBUG, "stream %d: expanding the compact index\n", st->index);
+
+    if (ci->nb_samples >= UINT_MAX / sizeof(*st->internal->index_entries) ||
+        (ret = av_reallocp_array(&st->internal->index_entries, ci->nb_samples,
+                                 sizeof(*st->internal->index_entries))) < 0) {
+        mov_free_compact_index(sc);
+        return AVERROR(ENOMEM);
+    }
+    st->internal->index_entries_allocated_size = ci->nb_samples * sizeof(*st->internal->index_entries);
+    c = ci->start;
+    for (i = 0; i < ci->nb_samples; i++)
+        if (mov_cursor_read(sc, &c, &st->internal->index_entries[i]) < 0)
+            break;
+    st->internal->nb_index_entries = i;
+    chunk_mode = ci->chunk_mode;
+    mov_free_compact_index(sc);
+
+    if (sc->ctts_data && !chunk_mode) {
+        if ((ret = mov_expand_ctts(sc)) < 0)
+            return ret;
+        sc->ctts_index  = sc->current_sample;
+        sc->ctts_sample = 0;
+    }
+    return 0;
+}
+
 static void mov_build_index(MOVContext *mov, AVStream *st)
 {
     MOVStreamContext *sc = st->priv_data;
@@ -3796,8 +4369,6 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     unsigned int stps_index = 0;
     unsigned int i, j;
     uint64_t stream_size = 0;
-    MOVStts *ctts_data_old = sc->ctts_data;
-    unsigned int ctts_count_old = sc->ctts_count;
 
     if (sc->elst_count) {
         int i, edit_start_index = 0, multiple_edits = 0;
@@ -3838,6 +4409,9 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
             sc->start_pad = start_time;
     }
 
+    if (mov->compact_index && mov_build_compact_index(mov, st, current_dts) >= 0)
+        return;
+
     /* only use old uncompressed audio chunk demuxing when stts specifies it */
     if (!(st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
           sc->stts_count == 1 && sc->stts_data[0].duration == 1)) {
@@ -3867,30 +4441,8 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
         }
         st->internal->index_entries_allocated_size = (st->internal->nb_index_entries + sc->sample_count) * sizeof(*st->internal->index_entries);
 
-        if (ctts_data_old) {
-            // Expand ctts entries such that we have a 1-1 mapping with samples
-            if (sc->sample_count >= UINT_MAX / sizeof(*sc->ctts_data))
-                return;
-            sc->ctts_count = 0;
-            sc->ctts_allocated_size = 0;
-            sc->ctts_data = av_fast_realloc(NULL, &sc->ctts_allocated_size,
-                                    sc->sample_count * sizeof(*sc->ctts_data));
-            if (!sc->ctts_data) {
-                av_free(ctts_data_old);
-                return;
-            }
-
-            memset((uint8_t*)(sc->ctts_data), 0, sc->ctts_allocated_size);
-
-            for (i = 0; i < ctts_count_old &&
-                        sc->ctts_count < sc->sample_count; i++)
-                for (j = 0; j < ctts_data_old[i].count &&
-                            sc->ctts_count < sc->sample_count; j++)
-                    add_ctts_entry(&sc->ctts_data, &sc->ctts_count,
-                                   &sc->ctts_allocated_size, 1,
-                                   ctts_data_old[i].duration);
-            av_free(ctts_data_old);
-        }
+        if (sc->ctts_data && mov_expand_ctts(sc) < 0)
+            return;
 
         for (i = 0; i < sc->chunk_count; i++) {
             int64_t next_offset = i+1 < sc->chunk_count ? sc->chunk_offsets[i+1] : INT64_MAX;
@@ -4341,14 +4893,16 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         && sc->time_scale == st->codecpar->sample_rate) {
             st->need_parsing = AVSTREAM_PARSE_FULL;
     }
-    /* Do not need those anymore. */
-    av_freep(&sc->chunk_offsets);
-    av_freep(&sc->sample_sizes);
-    av_freep(&sc->keyframes);
-    av_freep(&sc->stts_data);
-    av_freep(&sc->stps_data);
-    av_freep(&sc->elst_data);
-    av_freep(&sc->rap_group);
+    /* Do not need those anymore, unless the samples are read from them. */
+    if (!sc->compact_index) {
+        av_freep(&sc->chunk_offsets);
+        av_freep(&sc->sample_sizes);
+        av_freep(&sc->keyframes);
+        av_freep(&sc->stts_data);
+        av_freep(&sc->stps_data);
+        av_freep(&sc->elst_data);
+        av_freep(&sc->rap_group);
+    }
 
     return 0;
 }
@@ -4771,7 +5325,7 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     unsigned entries, first_sample_flags = frag->flags;
     int flags, distance, i;
     int64_t prev_dts = AV_NOPTS_VALUE;
-    int next_frag_index = -1, index_entry_pos;
+    int next_frag_index = -1, index_entry_pos, ret;
     size_t requested_size;
     size_t old_ctts_allocated_size;
     AVIndexEntry *new_entries;
@@ -4795,6 +5349,8 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     sc = st->priv_data;
     if (sc->pseudo_stream_id+1 != frag->stsd_id && sc->pseudo_stream_id != -1)
         return 0;
+    if ((ret = mov_expand_compact_index(c, st)) < 0)
+        return ret;
 
     // Find the next frag_index index that has a valid index_entry for
     // the current track_id.
@@ -7206,6 +7762,7 @@ static void mov_read_chapters(AVFormatContext *s)
 
         sc = st->priv_data;
         cur_pos = avio_tell(sc->pb);
+        mov_expand_compact_index(mov, st);
 
         if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
             st->disposition |= AV_DISPOSITION_ATTACHED_PIC | AV_DISPOSITION_TIMED_THUMBNAILS;
@@ -7373,6 +7930,7 @@ static int mov_read_close(AVFormatContext *s)
             continue;
 
         av_freep(&sc->ctts_data);
+        mov_free_compact_index(sc);
         for (j = 0; j < sc->drefs_count; j++) {
             av_freep(&sc->drefs[j].path);
             av_freep(&sc->drefs[j].dir);
@@ -7577,6 +8135,98 @@ fail:
     return ret;
 }
 
+/**
+ * Find the position of the first sample of st at or after timestamp, in
+ * AV_TIME_BASE units.
+ */
+static int mov_find_sample_pos(AVStream *st, int64_t timestamp, int64_t *pos)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int64_t wanted = av_rescale_q_rnd(timestamp, AV_TIME_BASE_Q, st->time_base,
+                                      AV_ROUND_UP | AV_ROUND_PASS_MINMAX);
+    int index;
+
+    if (sc->compact_index) {
+        MOVSampleCursor c;
+        AVIndexEntry e;
+
+        index = mov_compact_index_search(sc, wanted, AVSEEK_FLAG_ANY);
+        if (index < 0)
+            return -1;
+        c = sc->compact_index->checkpoints[index / MOV_CHECKPOINT_INTERVAL];
+        if (mov_compact_index_get(sc, index, &c, &e) < 0)
+            return -1;
+        *pos = e.pos;
+    } else {
+        index = ff_index_search_timestamp(st->internal->index_entries,
+                                          st->internal->nb_index_entries,
+                                          wanted, AVSEEK_FLAG_ANY);
+        if (index < 0)
+            return -1;
+        *pos = st->internal->index_entries[index].pos;
+    }
+    return 0;
+}
+
+/**
+ * ff_configure_buffers_for_index() for the files with tracks with a compact
+ * index, which have no index entries: the samples of these tracks are
+ * compared to the other tracks at their checkpoints only, which are built
+ * for this.
+ */
+static void mov_configure_buffers(AVFormatContext *s, int64_t time_tolerance)
+{
+    int64_t pos_delta = 0, skip = 0;
+    int i, j, k;
+
+    for (i = 0; i < s->nb_streams; i++) {
+        MOVStreamContext *sc = s->streams[i]->priv_data;
+        if (sc->compact_index)
+            break;
+    }
+    if (i == s->nb_streams) {
+        ff_configure_buffers_for_index(s, time_tolerance);
+        return;
+    }
+    if (!ff_configure_buffers_needed(s))
+        return;
+
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        MOVStreamContext *sc = st->priv_data;
+        MOVCompactIndex *ci = sc->compact_index;
+        int nb_points = ci ? (ci->nb_samples + MOV_CHECKPOINT_INTERVAL - 1) / MOV_CHECKPOINT_INTERVAL
+                           : st->internal->nb_index_entries;
+
+        if (ci) {
+            skip = FFMAX(skip, ci->max_sample_size);
+            if (mov_compact_index_checkpoints(sc) < 0)
+                nb_points = 0;
+        }
+        for (k = 0; k < nb_points; k++) {
+            int64_t pos, timestamp;
+
+            if (ci) {
+                pos       = ci->checkpoints[k].offset;
+                timestamp = ci->checkpoints[k].dts;
+            } else {
+                pos       = st->internal->index_entries[k].pos;
+                timestamp = st->internal->index_entries[k].timestamp;
+                skip = FFMAX(skip, st->internal->index_entries[k].size);
+            }
+            timestamp = av_rescale_q(timestamp, st->time_base, AV_TIME_BASE_Q);
+            for (j = 0; j < s->nb_streams; j++) {
+                int64_t pos2;
+
+                if (j != i && mov_find_sample_pos(s->streams[j], timestamp + time_tolerance, &pos2) >= 0)
+                    pos_delta = FFMAX(pos_delta, pos - pos2);
+            }
+        }
+    }
+
+    ff_configure_buffers(s, pos_delta, skip);
+}
+
 static int mov_read_header(AVFormatContext *s)
 {
     MOVContext *mov = s->priv_data;
@@ -7775,7 +8425,7 @@ static int mov_read_header(AVFormatContext *s)
             break;
         }
     }
-    ff_configure_buffers_for_index(s, AV_TIME_BASE);
+    mov_configure_buffers(s, AV_TIME_BASE);
 
     for (i = 0; i < mov->frag_index.nb_items; i++)
         if (mov->frag_index.item[i].moof_offset <= mov->fragment.moof_offset)
@@ -7795,8 +8445,8 @@ static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *avst = s->streams[i];
         MOVStreamContext *msc = avst->priv_data;
-        if (msc->pb && msc->current_sample < avst->internal->nb_index_entries) {
-            AVIndexEntry *current_sample = &avst->internal->index_entries[msc->current_sample];
+        AVIndexEntry *current_sample = mov_get_current_sample(avst);
+        if (msc->pb && current_sample) {
             int64_t dts = av_rescale(current_sample->timestamp, AV_TIME_BASE, msc->time_scale);
             av_log(s, AV_LOG_TRACE, "stream %d, sample %d, dts %"PRId64"\n", i, msc->current_sample, dts);
             if (!sample || (!(s->pb->seekable & AVIO_SEEKABLE_NORMAL) && current_sample->pos < sample->pos) ||
@@ -7904,7 +8554,7 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
 {
     MOVContext *mov = s->priv_data;
     MOVStreamContext *sc;
-    AVIndexEntry *sample;
+    AVIndexEntry *sample, compact_sample;
     AVStream *st = NULL;
     int64_t current_index;
     int ret;
@@ -7919,6 +8569,11 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
         goto retry;
     }
     sc = st->priv_data;
+    if (sc->compact_index) {
+        /* the entry is replaced by the next sample */
+        compact_sample = *sample;
+        sample = &compact_sample;
+    }
     /* must be done just before reading, to avoid infinite loop on sample */
     current_index = sc->current_index;
     mov_current_sample_inc(sc);
@@ -7946,7 +8601,9 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
 
         if (st->codecpar->codec_id == AV_CODEC_ID_EIA_608 && sample->size > 8)
             ret = get_eia608_packet(sc->pb, pkt, sample->size);
-        else
+        else if (!mov->aax_mode && !mov->decryption_key)
+            ret = ff_get_packet_mapped(sc->pb, pkt, sample->size);
+        else /* decrypted in place */
             ret = av_get_packet(sc->pb, pkt, sample->size);
         if (ret < 0) {
             if (should_retry(sc->pb, ret)) {
@@ -7999,8 +8656,8 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
             sc->ctts_sample = 0;
         }
     } else {
-        int64_t next_dts = (sc->current_sample < st->internal->nb_index_entries) ?
-            st->internal->index_entries[sc->current_sample].timestamp : st->duration;
+        AVIndexEntry *next_sample = mov_get_current_sample(st);
+        int64_t next_dts = next_sample ? next_sample->timestamp : st->duration;
 
         if (next_dts >= pkt->dts)
             pkt->duration = next_dts - pkt->dts;
@@ -8079,10 +8736,16 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
     if (ret < 0)
         return ret;
 
-    sample = av_index_search_timestamp(st, timestamp, flags);
+    if (sc->compact_index) {
+        sample = mov_compact_index_search(sc, timestamp, flags);
+        if (sample < 0 && timestamp < sc->compact_index->first_dts)
+            sample = 0;
+    } else {
+        sample = av_index_search_timestamp(st, timestamp, flags);
+        if (sample < 0 && st->internal->nb_index_entries && timestamp < st->internal->index_entries[0].timestamp)
+            sample = 0;
+    }
     av_log(s, AV_LOG_TRACE, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
-    if (sample < 0 && st->internal->nb_index_entries && timestamp < st->internal->index_entries[0].timestamp)
-        sample = 0;
     if (sample < 0) /* not sure what to do */
         return AVERROR_INVALIDDATA;
     mov_current_sample_set(sc, sample);
@@ -8122,8 +8785,9 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
 static int64_t mov_get_skip_samples(AVStream *st, int sample)
 {
     MOVStreamContext *sc = st->priv_data;
-    int64_t first_ts = st->internal->index_entries[0].timestamp;
-    int64_t ts = st->internal->index_entries[sample].timestamp;
+    int64_t first_ts = sc->compact_index ? sc->compact_index->first_dts :
+                                           st->internal->index_entries[0].timestamp;
+    int64_t ts = mov_get_sample_timestamp(st, sample);
     int64_t off;
 
     if (st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
@@ -8152,7 +8816,7 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
 
     if (mc->seek_individually) {
         /* adjust seek timestamp to found sample timestamp */
-        int64_t seek_timestamp = st->internal->index_entries[sample].timestamp;
+        int64_t seek_timestamp = mov_get_sample_timestamp(st, sample);
         st->internal->skip_samples = mov_get_skip_samples(st, sample);
 
         for (i = 0; i < s->nb_streams; i++) {
@@ -8205,6 +8869,10 @@ static const AVOption mov_options[] = {
         "Modify the AVIndex according to the editlists. Use this option to decode in the order specified by the edits.",
         OFFSET(advanced_editlist), AV_OPT_TYPE_BOOL, {.i64 = 1},
         0, 1, FLAGS},
+    {"compact_index",
+        "Resolve the samples from the sample tables when they are read instead of building the index.",
+        OFFSET(compact_index), AV_OPT_TYPE_BOOL, {.i64 = 0},
+        0, 1, FLAGS},
     {"ignore_chapters", "", OFFSET(ignore_chapters), AV_OPT_TYPE_BOOL, {.i64 = 0},
         0, 1, FLAGS},
     {"use_mfra_for",
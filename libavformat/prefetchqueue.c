@@ -0,0 +1,574 @@
+/*
+ * Background download queue for the segmented demuxers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "config.h"
+
+#include "libavutil/avstring.h"
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/mathematics.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "prefetchqueue.h"
+#include "url.h"
+
+#define MAX_THREADS     16
+#define CHUNK_SIZE      16384
+#define POLLING_TIME    100000  ///< period of the interrupt checks while waiting, in microseconds
+
+#if HAVE_THREADS
+
+typedef struct PrefetchWorker {
+    struct FFPrefetchQueue *q;
+    pthread_t thread;
+    FFPrefetch *cur;            ///< download in progress, protected by the queue lock
+    AVIOInterruptCB int_cb;     ///< used by the connections of the worker
+} PrefetchWorker;
+
+struct FFPrefetchQueue {
+    void *logctx;
+    int64_t max_size;
+    AVIOInterruptCB int_cb;
+    ff_prefetch_open_fn open;
+    ff_prefetch_close_fn close;
+    void *opaque;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    PrefetchWorker workers[MAX_THREADS];
+    int nb_threads;
+    int abort;
+
+    FFPrefetch **prefetches;
+    int nb_prefetches;
+    int64_t used;               ///< memory allocated by the downloads
+    int64_t downloaded;
+    int64_t time;               ///< time spent downloading by the workers
+};
+
+/* must be called with lock held */
+static void prefetch_free(FFPrefetchQueue *q, FFPrefetch *p)
+{
+    q->used -= p->data_alloc;
+    av_freep(&p->url);
+    av_dict_free(&p->avio_opts);
+    av_freep(&p->data);
+    av_freep(&p->location);
+    av_free(p);
+}
+
+/* must be called with lock held */
+static void prefetch_release(FFPrefetchQueue *q, FFPrefetch *p)
+{
+    int i;
+
+    for (i = 0; i < q->nb_prefetches; i++) {
+        if (q->prefetches[i] == p) {
+            memmove(&q->prefetches[i], &q->prefetches[i + 1],
+                    (q->nb_prefetches - i - 1) * sizeof(*q->prefetches));
+            q->nb_prefetches--;
+            break;
+        }
+    }
+    if (p->running)
+        p->abort = 1;
+    else
+        prefetch_free(q, p);
+}
+
+/* must be called with lock held */
+static FFPrefetch *prefetch_find(FFPrefetchQueue *q, void *owner, int64_t seq_no)
+{
+    int i;
+
+    for (i = 0; i < q->nb_prefetches; i++)
+        if (q->prefetches[i]->owner == owner && q->prefetches[i]->seq_no == seq_no)
+            return q->prefetches[i];
+    return NULL;
+}
+
+/*
+ * Wait for a change in the queue, or for at most POLLING_TIME. Must be
+ * called with lock held.
+ * Return AVERROR_EXIT if the demuxer was interrupted, 0 otherwise.
+ */
+static int prefetch_wait(FFPrefetchQueue *q)
+{
+    /* FIXME: using the monotonic clock would be better,
+       but it does not exist on all supported platforms. */
+    int64_t t = av_gettime() + POLLING_TIME;
+    struct timespec tv = { .tv_sec  =  t / 1000000,
+                           .tv_nsec = (t % 1000000) * 1000 };
+
+    if (ff_check_interrupt(&q->int_cb))
+        return AVERROR_EXIT;
+    pthread_cond_timedwait(&q->cond, &q->lock, &tv);
+    return 0;
+}
+
+/* Interrupt the connection of a worker when its download is released, the
+ * queue is freed, or the demuxer is interrupted. */
+static int prefetch_check_interrupt(void *opaque)
+{
+    PrefetchWorker *w = opaque;
+    FFPrefetchQueue *q = w->q;
+    int abort;
+
+    pthread_mutex_lock(&q->lock);
+    abort = q->abort || (w->cur && w->cur->abort);
+    pthread_mutex_unlock(&q->lock);
+
+    return abort || ff_check_interrupt(&q->int_cb);
+}
+
+/* Download p into memory, keeping the connection in *pb if it can be
+ * reused for the next download. */
+static int prefetch_download(PrefetchWorker *w, FFPrefetch *p, AVIOContext **pb)
+{
+    FFPrefetchQueue *q = w->q;
+    AVIOContext *own_pb = NULL;
+    AVIOContext **in = p->seq_no < 0 ? &own_pb : pb;
+    uint8_t buf[CHUNK_SIZE];
+    int64_t total = 0;
+    int ret, keep_alive;
+
+    ret = keep_alive = q->open(q->opaque, p, in, &w->int_cb);
+    if (ret < 0)
+        return ret;
+
+    while (1) {
+        int size = sizeof(buf);
+
+        if (p->size >= 0)
+            size = FFMIN(size, p->size - total);
+        if (size <= 0)
+            break;
+        ret = avio_read(*in, buf, size);
+        if (ret == AVERROR_EOF || !ret)
+            break;
+        if (ret < 0)
+            goto fail;
+
+        pthread_mutex_lock(&q->lock);
+        if (p->abort || q->abort) {
+            pthread_mutex_unlock(&q->lock);
+            ret = AVERROR_EXIT;
+            goto fail;
+        }
+        if (p->data_size + ret > p->data_alloc) {
+            unsigned int old_alloc = p->data_alloc;
+            uint8_t *data = av_fast_realloc(p->data, &p->data_alloc,
+                                            p->data_size + ret);
+            if (!data) {
+                p->data_alloc = old_alloc;
+                pthread_mutex_unlock(&q->lock);
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
+            p->data = data;
+            q->used += p->data_alloc - old_alloc;
+        }
+        memcpy(p->data + p->data_size, buf, ret);
+        p->data_size  += ret;
+        q->downloaded += ret;
+        pthread_cond_broadcast(&q->cond);
+        pthread_mutex_unlock(&q->lock);
+        total += ret;
+    }
+    ret = 0;
+
+fail:
+    if (ret < 0 || !keep_alive)
+        q->close(q->opaque, in, ret >= 0);
+    return ret;
+}
+
+static void *prefetch_worker(void *arg)
+{
+    PrefetchWorker *w = arg;
+    FFPrefetchQueue *q = w->q;
+    AVIOContext *pb = NULL;
+
+    pthread_mutex_lock(&q->lock);
+    while (!q->abort) {
+        FFPrefetch *p = NULL;
+        int64_t start;
+        int i, ret;
+
+        for (i = 0; i < q->nb_prefetches && !p; i++)
+            if (q->prefetches[i]->urgent && !q->prefetches[i]->running &&
+                !q->prefetches[i]->done)
+                p = q->prefetches[i];
+        for (i = 0; i < q->nb_prefetches && !p && q->used < q->max_size; i++)
+            if (!q->prefetches[i]->running && !q->prefetches[i]->done)
+                p = q->prefetches[i];
+        if (!p) {
+            pthread_cond_wait(&q->cond, &q->lock);
+            continue;
+        }
+        p->running = 1;
+        w->cur     = p;
+        pthread_mutex_unlock(&q->lock);
+
+        start = av_gettime_relative();
+        ret = prefetch_download(w, p, &pb);
+
+        pthread_mutex_lock(&q->lock);
+        q->time   += av_gettime_relative() - start;
+        w->cur     = NULL;
+        p->running = 0;
+        p->done    = 1;
+        p->error   = FFMIN(ret, 0);
+        if (p->abort)
+            prefetch_free(q, p);
+        pthread_cond_broadcast(&q->cond);
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    if (pb)
+        q->close(q->opaque, &pb, 0);
+    return NULL;
+}
+
+int ff_prefetch_queue_alloc(FFPrefetchQueue **pq, void *logctx, int64_t max_size,
+                            const AVIOInterruptCB *int_cb,
+                            ff_prefetch_open_fn open, ff_prefetch_close_fn close,
+                            void *opaque)
+{
+    FFPrefetchQueue *q;
+    int ret;
+
+    *pq = NULL;
+    q = av_mallocz(sizeof(*q));
+    if (!q)
+        return AVERROR(ENOMEM);
+    q->logctx   = logctx;
+    q->max_size = max_size;
+    if (int_cb)
+        q->int_cb = *int_cb;
+    q->open     = open;
+    q->close    = close;
+    q->opaque   = opaque;
+
+    if ((ret = pthread_mutex_init(&q->lock, NULL))) {
+        av_log(logctx, AV_LOG_ERROR, "pthread_mutex_init failed : %s\n", av_err2str(AVERROR(ret)));
+        av_free(q);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&q->cond, NULL))) {
+        av_log(logctx, AV_LOG_ERROR, "pthread_cond_init failed : %s\n", av_err2str(AVERROR(ret)));
+        pthread_mutex_destroy(&q->lock);
+        av_free(q);
+        return AVERROR(ret);
+    }
+    *pq = q;
+    return 0;
+}
+
+void ff_prefetch_queue_free(FFPrefetchQueue **pq)
+{
+    FFPrefetchQueue *q = *pq;
+    int i;
+
+    if (!q)
+        return;
+
+    pthread_mutex_lock(&q->lock);
+    q->abort = 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+
+    for (i = 0; i < q->nb_threads; i++)
+        pthread_join(q->workers[i].thread, NULL);
+
+    for (i = 0; i < q->nb_prefetches; i++)
+        prefetch_free(q, q->prefetches[i]);
+    av_freep(&q->prefetches);
+
+    pthread_cond_destroy(&q->cond);
+    pthread_mutex_destroy(&q->lock);
+    av_freep(pq);
+}
+
+void ff_prefetch_queue_start(FFPrefetchQueue *q, int nb_threads)
+{
+    if (!q)
+        return;
+
+    nb_threads = av_clip(nb_threads, 1, MAX_THREADS);
+    pthread_mutex_lock(&q->lock);
+    while (q->nb_threads < nb_threads) {
+        PrefetchWorker *w = &q->workers[q->nb_threads];
+        int ret;
+
+        w->q      = q;
+        w->int_cb = (AVIOInterruptCB){ prefetch_check_interrupt, w };
+        ret = pthread_create(&w->thread, NULL, prefetch_worker, w);
+        if (ret) {
+            av_log(q->logctx, AV_LOG_WARNING, "pthread_create failed : %s\n", av_err2str(AVERROR(ret)));
+            break;
+        }
+        q->nb_threads++;
+    }
+    pthread_mutex_unlock(&q->lock);
+}
+
+int ff_prefetch_queue_add(FFPrefetchQueue *q, void *owner, int64_t seq_no,
+                          const char *url, int64_t url_offset, int64_t size,
+                          AVDictionary *avio_opts)
+{
+    FFPrefetch *p;
+    int ret;
+
+    if (!q)
+        return AVERROR(ENOSYS);
+    p = av_mallocz(sizeof(*p));
+    if (!p)
+        return AVERROR(ENOMEM);
+    p->owner      = owner;
+    p->seq_no     = seq_no;
+    p->url_offset = url_offset;
+    p->size       = size;
+    p->url        = av_strdup(url);
+    ret = p->url ? av_dict_copy(&p->avio_opts, avio_opts, 0) : AVERROR(ENOMEM);
+
+    pthread_mutex_lock(&q->lock);
+    if (ret >= 0)
+        ret = av_dynarray_add_nofree(&q->prefetches, &q->nb_prefetches, p);
+    if (ret < 0)
+        prefetch_free(q, p);
+    else
+        pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+
+    return ret;
+}
+
+int ff_prefetch_queue_has(FFPrefetchQueue *q, void *owner, int64_t seq_no)
+{
+    int ret;
+
+    if (!q)
+        return 0;
+    pthread_mutex_lock(&q->lock);
+    ret = !!prefetch_find(q, owner, seq_no);
+    pthread_mutex_unlock(&q->lock);
+    return ret;
+}
+
+int ff_prefetch_queue_full(FFPrefetchQueue *q)
+{
+    int ret;
+
+    if (!q)
+        return 1;
+    pthread_mutex_lock(&q->lock);
+    ret = q->used >= q->max_size;
+    pthread_mutex_unlock(&q->lock);
+    return ret;
+}
+
+FFPrefetch *ff_prefetch_queue_take(FFPrefetchQueue *q, void *owner,
+                                   int64_t seq_no, int64_t *stall_time)
+{
+    FFPrefetch *p;
+
+    *stall_time = -1;
+    if (!q)
+        return NULL;
+
+    pthread_mutex_lock(&q->lock);
+    p = prefetch_find(q, owner, seq_no);
+    if (p && !p->done && (seq_no < 0 || !p->data_size)) {
+        int64_t start = av_gettime_relative();
+
+        p->urgent = 1;
+        pthread_cond_broadcast(&q->cond);
+        while (!p->done && (seq_no < 0 || !p->data_size)) {
+            if (prefetch_wait(q) < 0) {
+                p = NULL;
+                break;
+            }
+        }
+        if (seq_no >= 0)
+            *stall_time = av_gettime_relative() - start;
+    }
+    if (p && p->error && !p->data_size) {
+        prefetch_release(q, p);
+        p = NULL;
+    }
+    if (p)
+        p->urgent = 1;
+    pthread_mutex_unlock(&q->lock);
+
+    return p;
+}
+
+int ff_prefetch_queue_read(FFPrefetchQueue *q, FFPrefetch *p,
+                           uint8_t *buf, int buf_size)
+{
+    int ret;
+
+    if (buf_size <= 0)
+        return 0;
+
+    pthread_mutex_lock(&q->lock);
+    while (p->read_pos == p->data_size && !p->done) {
+        if ((ret = prefetch_wait(q)) < 0) {
+            pthread_mutex_unlock(&q->lock);
+            return ret;
+        }
+    }
+    if (p->read_pos < p->data_size) {
+        ret = FFMIN(buf_size, p->data_size - p->read_pos);
+        memcpy(buf, p->data + p->read_pos, ret);
+        p->read_pos += ret;
+    } else {
+        ret = p->error ? p->error : AVERROR_EOF;
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return ret;
+}
+
+void ff_prefetch_queue_release(FFPrefetchQueue *q, FFPrefetch **p)
+{
+    if (!q || !*p)
+        return;
+    pthread_mutex_lock(&q->lock);
+    prefetch_release(q, *p);
+    pthread_mutex_unlock(&q->lock);
+    *p = NULL;
+}
+
+void ff_prefetch_queue_release_before(FFPrefetchQueue *q, void *owner,
+                                      int64_t seq_no, FFPrefetch *keep)
+{
+    int i;
+
+    if (!q)
+        return;
+    pthread_mutex_lock(&q->lock);
+    for (i = q->nb_prefetches - 1; i >= 0; i--) {
+        FFPrefetch *p = q->prefetches[i];
+        if (p->owner == owner && p->seq_no >= 0 && p->seq_no < seq_no && p != keep)
+            prefetch_release(q, p);
+    }
+    pthread_mutex_unlock(&q->lock);
+}
+
+void ff_prefetch_queue_cancel(FFPrefetchQueue *q, void *owner)
+{
+    int i;
+
+    if (!q)
+        return;
+    pthread_mutex_lock(&q->lock);
+    for (i = q->nb_prefetches - 1; i >= 0; i--)
+        if (q->prefetches[i]->owner == owner)
+            prefetch_release(q, q->prefetches[i]);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void ff_prefetch_queue_get_stats(FFPrefetchQueue *q, FFPrefetchStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!q)
+        return;
+    pthread_mutex_lock(&q->lock);
+    stats->downloaded = q->downloaded;
+    stats->throughput = q->time > 0 ?
+        av_rescale(q->downloaded, AV_TIME_BASE, q->time) : 0;
+    pthread_mutex_unlock(&q->lock);
+}
+
+#else
+
+int ff_prefetch_queue_alloc(FFPrefetchQueue **q, void *logctx, int64_t max_size,
+                            const AVIOInterruptCB *int_cb,
+                            ff_prefetch_open_fn open, ff_prefetch_close_fn close,
+                            void *opaque)
+{
+    *q = NULL;
+    return AVERROR(ENOSYS);
+}
+
+void ff_prefetch_queue_free(FFPrefetchQueue **q)
+{
+}
+
+void ff_prefetch_queue_start(FFPrefetchQueue *q, int nb_threads)
+{
+}
+
+int ff_prefetch_queue_add(FFPrefetchQueue *q, void *owner, int64_t seq_no,
+                          const char *url, int64_t url_offset, int64_t size,
+                          AVDictionary *avio_opts)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_prefetch_queue_has(FFPrefetchQueue *q, void *owner, int64_t seq_no)
+{
+    return 0;
+}
+
+int ff_prefetch_queue_full(FFPrefetchQueue *q)
+{
+    return 1;
+}
+
+FFPrefetch *ff_prefetch_queue_take(FFPrefetchQueue *q, void *owner,
+                                   int64_t seq_no, int64_t *stall_time)
+{
+    *stall_time = -1;
+    return NULL;
+}
+
+int ff_prefetch_queue_read(FFPrefetchQueue *q, FFPrefetch *p,
+                           uint8_t *buf, int buf_size)
+{
+    return AVERROR_BUG;
+}
+
+void ff_prefetch_queue_release(FFPrefetchQueue *q, FFPrefetch **p)
+{
+}
+
+void ff_prefetch_queue_release_before(FFPrefetchQueue *q, void *owner,
+                                      int64_t seq_no, FFPrefetch *keep)
+{
+}
+
+void ff_prefetch_queue_cancel(FFPrefetchQueue *q, void *owner)
+{
+}
+
+void ff_prefetch_queue_get_stats(FFPrefetchQueue *q, FFPrefetchStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif /* HAVE_THREADS */
@@ -0,0 +1,186 @@
+/*
+ * Background download queue for the segmented demuxers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_PREFETCHQUEUE_H
+#define AVFORMAT_PREFETCHQUEUE_H
+
+#include <stdint.h>
+
+#include "libavutil/dict.h"
+#include "avio.h"
+
+/**
+ * A prefetch queue downloads the next segments of the streams of a demuxer
+ * into memory with a pool of threads, while the demuxer reads the segments
+ * from there.
+ *
+ * Each download belongs to an owner, the demuxer's per-stream context, and
+ * is identified by its sequence number in that stream. Sequence numbers
+ * below 0 are whole resources which are not segments, such as playlist
+ * reloads: they are opened on a connection of their own, and
+ * ff_prefetch_queue_take() waits for their completion.
+ *
+ * The downloads are picked in the order they were added, the ones the
+ * demuxer is waiting for first. Downloads are only started while the memory
+ * used stays under the size given to ff_prefetch_queue_alloc(). Downloads
+ * stay in the queue until they are released, even while the demuxer reads
+ * from them.
+ *
+ * All the functions except the callbacks are called from the demuxer
+ * thread only. The waits of the demuxer thread are interrupted by the
+ * interrupt callback of the demuxer, the downloads also by the release of
+ * the download or the queue.
+ */
+typedef struct FFPrefetchQueue FFPrefetchQueue;
+
+typedef struct FFPrefetch {
+    void *owner;
+    int64_t seq_no;
+    char *url;
+    int64_t url_offset;
+    int64_t size;               ///< -1 to read the URL until its end
+    AVDictionary *avio_opts;
+    char *location;             ///< final URL, may be set by the open callback
+
+    /* set by the workers, valid once ff_prefetch_queue_take() returned */
+    int error;
+    uint8_t *data;
+    unsigned int data_size;
+
+    /* private to the queue */
+    int urgent;                 ///< the demuxer is waiting for it
+    int running;
+    int done;
+    int abort;                  ///< released while running, freed by the worker
+    unsigned int data_alloc;
+    unsigned int read_pos;
+} FFPrefetch;
+
+typedef struct FFPrefetchStats {
+    int64_t downloaded;         ///< bytes downloaded
+    int64_t throughput;         ///< mean download rate of the workers, in bytes per second
+} FFPrefetchStats;
+
+/**
+ * Open a download, called from the worker threads.
+ *
+ * @param pb the connection kept by the worker from its previous download
+ *           if any, which can be reused or closed, and which is replaced by
+ *           the connection to read p from
+ * @param int_cb interrupt callback of the worker, to be used by the
+ *               connection
+ * @return <0 on error, >0 if the connection can be kept by the worker for
+ *         its next download once p is read, 0 otherwise
+ */
+typedef int (*ff_prefetch_open_fn)(void *opaque, FFPrefetch *p, AVIOContext **pb,
+                                   const AVIOInterruptCB *int_cb);
+
+/**
+ * Close a connection opened by the open callback, called from the worker
+ * threads.
+ *
+ * @param reusable 1 if the download was read entirely
+ */
+typedef void (*ff_prefetch_close_fn)(void *opaque, AVIOContext **pb, int reusable);
+
+/**
+ * Allocate a prefetch queue. The threads are started by
+ * ff_prefetch_queue_start().
+ *
+ * @param max_size maximum memory used by the downloads
+ * @param int_cb   interrupt callback of the demuxer, copied
+ * @return 0 on success, AVERROR(ENOSYS) without threads, or another
+ *         negative AVERROR code
+ */
+int ff_prefetch_queue_alloc(FFPrefetchQueue **q, void *logctx, int64_t max_size,
+                            const AVIOInterruptCB *int_cb,
+                            ff_prefetch_open_fn open, ff_prefetch_close_fn close,
+                            void *opaque);
+
+/**
+ * Stop the threads and free the queue with all its downloads.
+ */
+void ff_prefetch_queue_free(FFPrefetchQueue **q);
+
+/**
+ * Start worker threads until there are nb_threads of them.
+ */
+void ff_prefetch_queue_start(FFPrefetchQueue *q, int nb_threads);
+
+/**
+ * Queue a download.
+ *
+ * @param avio_opts options used to open the URL, copied
+ */
+int ff_prefetch_queue_add(FFPrefetchQueue *q, void *owner, int64_t seq_no,
+                          const char *url, int64_t url_offset, int64_t size,
+                          AVDictionary *avio_opts);
+
+/**
+ * @return 1 if a download of seq_no of owner is queued
+ */
+int ff_prefetch_queue_has(FFPrefetchQueue *q, void *owner, int64_t seq_no);
+
+/**
+ * @return 1 if the memory used by the downloads reached the maximum
+ */
+int ff_prefetch_queue_full(FFPrefetchQueue *q);
+
+/**
+ * Get a download, waiting for its first data, or for its completion if
+ * seq_no is below 0. The download stays in the queue until released.
+ *
+ * @param stall_time set to the time spent waiting for a segment, in
+ *                   microseconds, or to -1 if there was no wait
+ * @return NULL if there is no such download, if it failed without data, or
+ *         if the wait was interrupted
+ */
+FFPrefetch *ff_prefetch_queue_take(FFPrefetchQueue *q, void *owner,
+                                   int64_t seq_no, int64_t *stall_time);
+
+/**
+ * Read the next bytes of a download returned by ff_prefetch_queue_take(),
+ * waiting for them if needed.
+ *
+ * @return the number of bytes read, AVERROR_EXIT if the wait was
+ *         interrupted, or another negative AVERROR code
+ */
+int ff_prefetch_queue_read(FFPrefetchQueue *q, FFPrefetch *p,
+                           uint8_t *buf, int buf_size);
+
+/**
+ * Drop a download, *p is set to NULL.
+ */
+void ff_prefetch_queue_release(FFPrefetchQueue *q, FFPrefetch **p);
+
+/**
+ * Drop the segment downloads of owner before seq_no, except keep.
+ */
+void ff_prefetch_queue_release_before(FFPrefetchQueue *q, void *owner,
+                                      int64_t seq_no, FFPrefetch *keep);
+
+/**
+ * Drop all the downloads of owner.
+ */
+void ff_prefetch_queue_cancel(FFPrefetchQueue *q, void *owner);
+
+void ff_prefetch_queue_get_stats(FFPrefetchQueue *q, FFPrefetchStats *stats);
+
+#endif /* AVFORMAT_PREFETCHQUEUE_H */
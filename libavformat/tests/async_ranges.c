@@ -0,0 +1,222 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Serve a file from a local HTTP server which limits the throughput of
+ * every connection, and read it through the async protocol with one and
+ * with several connections, sequentially and with the seeks of a demuxer
+ * reading an index at the end of the file. The data must be the same, and
+ * several connections must request ranges over persistent connections.
+ * Then the server closes some connections in the middle of a range, and the
+ * rest of those ranges must be requested again.
+ *
+ * Usage: async_ranges [connections]
+ * When an argument is given, the throughput is printed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavformat/avformat.h"
+#include "libavutil/avstring.h"
+#include "libavutil/time.h"
+
+#include "httpserver.h"
+
+#define FILE_SIZE        (4 * 1024 * 1024 + 123)
+#define CHUNK_SIZE       (256 * 1024)
+#define SEND_SIZE        (64 * 1024)
+#define SEND_DELAY       4000   /* 16 MB/s per connection */
+#define DROP_INTERVAL    3      /* close every third range response early */
+static uint8_t data[FILE_SIZE];
+static atomic_int drop_ranges, nb_ranges;
+
+static int handle_request(HTTPConnection *conn, const HTTPRequest *req)
+{
+    const char *range = av_stristr(req->headers, "Range: bytes=");
+    int64_t start = 0, end = FILE_SIZE - 1, stop;
+    char header[256];
+
+    if (strcmp(req->method, "GET") || strcmp(req->path, "/file"))
+        return http_server_respond(conn, "404 Not Found", NULL, NULL, 0);
+
+    if (range) {
+        char *p;
+        start = strtoll(range + 13, &p, 10);
+        if (*p == '-' && p[1] >= '0' && p[1] <= '9')
+            end = FFMIN(strtoll(p + 1, NULL, 10), FILE_SIZE - 1);
+        if (start > end)
+            return -1;
+        snprintf(header, sizeof(header),
+                 "HTTP/1.1 206 Partial Content\r\nContent-Length: %"PRId64"\r\n"
+                 "Content-Range: bytes %"PRId64"-%"PRId64"/%d\r\n\r\n",
+                 end - start + 1, start, end, FILE_SIZE);
+    } else {
+        snprintf(header, sizeof(header),
+                 "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n", FILE_SIZE);
+    }
+    if (http_server_send(conn, header, strlen(header)) < 0)
+        return -1;
+
+    stop = end;
+    if (range && atomic_load(&drop_ranges) &&
+        atomic_fetch_add(&nb_ranges, 1) % DROP_INTERVAL == DROP_INTERVAL - 1)
+        stop = start + (end - start) / 2;
+    while (start <= stop && !atomic_load(&conn->server->stop)) {
+        int size = FFMIN(SEND_SIZE, stop + 1 - start);
+        if (http_server_send(conn, data + start, size) < 0)
+            return -1;
+        start += size;
+        av_usleep(SEND_DELAY);
+    }
+    if (stop < end)
+        return -1;
+    return av_stristr(req->headers, "Connection: close") ? -1 : 0;
+}
+
+static int check(AVIOContext *pb, int64_t pos, int size)
+{
+    static uint8_t buf[CHUNK_SIZE];
+    int expected = FFMIN(size, FILE_SIZE - pos);
+    int ret;
+
+    if (avio_seek(pb, pos, SEEK_SET) != pos) {
+        fprintf(stderr, "Seeking to %"PRId64" failed\n", pos);
+        return AVERROR(EIO);
+    }
+    ret = avio_read(pb, buf, size);
+    if (ret != expected || memcmp(buf, data + pos, expected)) {
+        fprintf(stderr, "Wrong data at %"PRId64": %d\n", pos, ret);
+        return AVERROR_INVALIDDATA;
+    }
+    return 0;
+}
+
+static int play(const char *url, int connections, int64_t *elapsed)
+{
+    AVIOContext *pb = NULL;
+    AVDictionary *opts = NULL;
+    int64_t pos, start;
+    uint8_t byte;
+    int ret;
+
+    av_dict_set_int(&opts, "connections", connections, 0);
+    av_dict_set_int(&opts, "chunk_size", CHUNK_SIZE, 0);
+    av_dict_set_int(&opts, "buffer_size", 4 * CHUNK_SIZE, 0);
+    ret = avio_open2(&pb, url, AVIO_FLAG_READ, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+
+    /* sequential read */
+    start = av_gettime_relative();
+    for (pos = 0; pos < FILE_SIZE && ret >= 0; pos += CHUNK_SIZE)
+        ret = check(pb, pos, CHUNK_SIZE);
+    *elapsed = av_gettime_relative() - start;
+
+    /* index at the end, then short seeks forwards and backwards */
+    if (ret >= 0)
+        ret = check(pb, FILE_SIZE - 5000, 5000);
+    if (ret >= 0)
+        ret = check(pb, 32, 1000);
+    for (pos = 100000; pos < FILE_SIZE / 2 && ret >= 0; pos += 150000) {
+        ret = check(pb, pos, 20000);
+        if (ret >= 0)
+            ret = check(pb, pos - 50000, 20000);
+    }
+    if (ret >= 0)
+        ret = check(pb, FILE_SIZE - 1, 1);
+    if (ret >= 0 && avio_read(pb, &byte, 1) != AVERROR_EOF) {
+        fprintf(stderr, "No EOF\n");
+        ret = AVERROR_INVALIDDATA;
+    }
+    avio_closep(&pb);
+
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    HTTPServer server = { 0 };
+    int connections = argc > 1 ? av_clip(atoi(argv[1]), 2, 16) : 4;
+    int requests[2], nb_connections[2];
+    int64_t elapsed[2];
+    char url[64];
+    int i, ret = 0;
+
+    for (i = 0; i < FILE_SIZE; i++)
+        data[i] = i * 31 + (i >> 12);
+
+    avformat_network_init();
+    if (http_server_start(&server, handle_request, NULL) < 0) {
+        fprintf(stderr, "Cannot start the HTTP server\n");
+        return 1;
+    }
+    snprintf(url, sizeof(url), "async:http://127.0.0.1:%d/file", server.port);
+
+    for (i = 0; i < 2 && ret >= 0; i++) {
+        pthread_mutex_lock(&server.lock);
+        requests[i]       = server.nb_requests;
+        nb_connections[i] = server.nb_connections;
+        pthread_mutex_unlock(&server.lock);
+
+        ret = play(url, i ? connections : 1, &elapsed[i]);
+        if (ret < 0)
+            fprintf(stderr, "Reading %s failed: %s\n", url, av_err2str(ret));
+
+        http_server_wait_idle(&server);
+        pthread_mutex_lock(&server.lock);
+        requests[i]       = server.nb_requests    - requests[i];
+        nb_connections[i] = server.nb_connections - nb_connections[i];
+        pthread_mutex_unlock(&server.lock);
+    }
+
+    if (ret >= 0) {
+        int64_t unused;
+
+        atomic_store(&drop_ranges, 1);
+        ret = play(url, connections, &unused);
+        if (ret < 0)
+            fprintf(stderr, "Reading %s with connections closed early failed: %s\n",
+                    url, av_err2str(ret));
+        http_server_wait_idle(&server);
+    }
+
+    http_server_stop(&server);
+    avformat_network_deinit();
+
+    if (ret < 0)
+        return 1;
+    if (atomic_load(&nb_ranges) < DROP_INTERVAL) {
+        fprintf(stderr, "No connection was closed early\n");
+        return 1;
+    }
+    if (argc > 1)
+        printf("1 connection: %.1f MB/s, %d connections: %.1f MB/s, "
+               "%d requests over %d connections\n",
+               FILE_SIZE / (double)elapsed[0], connections,
+               FILE_SIZE / (double)elapsed[1], requests[1], nb_connections[1]);
+    if (requests[1] < FILE_SIZE / CHUNK_SIZE ||
+        nb_connections[1] >= requests[1] / 2) {
+        fprintf(stderr, "%d requests over %d connections\n",
+                requests[1], nb_connections[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,252 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Read a file through the cache protocol with a persistent cache directory,
+ * first from several threads at once, then again, which must not touch the
+ * source, then after changing the file, which must not use the old blocks,
+ * and finally with a size limit, which must evict blocks.
+ *
+ * Usage: cache <directory>
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+
+#include "libavformat/avio.h"
+#include "libavformat/os_support.h"
+#include "libavutil/avstring.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/random_seed.h"
+#include "libavutil/thread.h"
+
+#define BLOCK_SIZE  16384
+#define FILE_SIZE   (16 * BLOCK_SIZE + 1234)
+#define MAX_READ    10000
+#define NB_SEEKS    200
+#define NB_THREADS  4
+
+typedef struct Reader {
+    pthread_t thread;
+    const char *url;
+    const char *cache_dir;
+    int64_t max_size;
+    unsigned seed;
+    int64_t hit_bytes;
+    int64_t miss_bytes;
+    int ret;
+} Reader;
+
+static uint8_t data[FILE_SIZE];
+static int file_size = FILE_SIZE;
+
+static int check(AVIOContext *pb, int64_t pos, int size)
+{
+    uint8_t buf[MAX_READ];
+    int expected = FFMAX(FFMIN(size, file_size - pos), 0);
+    int ret;
+
+    if (avio_seek(pb, pos, SEEK_SET) != pos) {
+        fprintf(stderr, "Seeking to %"PRId64" failed\n", pos);
+        return AVERROR(EIO);
+    }
+    ret = avio_read(pb, buf, size);
+    if (!expected && ret == AVERROR_EOF)
+        return 0;
+    if (ret != expected || memcmp(buf, data + pos, expected)) {
+        fprintf(stderr, "Wrong data at %"PRId64"\n", pos);
+        return AVERROR_INVALIDDATA;
+    }
+    return 0;
+}
+
+static void *reader(void *arg)
+{
+    Reader *r = arg;
+    AVIOContext *pb = NULL;
+    AVDictionary *opts = NULL;
+    AVLFG lfg;
+    int64_t pos;
+    int i, ret;
+
+    av_dict_set(&opts, "cache_dir", r->cache_dir, 0);
+    av_dict_set_int(&opts, "cache_block_size", BLOCK_SIZE, 0);
+    av_dict_set_int(&opts, "cache_max_size", r->max_size, 0);
+    ret = avio_open2(&pb, r->url, AVIO_FLAG_READ, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", r->url, av_err2str(ret));
+        goto end;
+    }
+
+    av_lfg_init(&lfg, r->seed);
+    for (pos = 0; pos <= file_size && ret >= 0; pos += MAX_READ)
+        ret = check(pb, pos, MAX_READ);
+    for (i = 0; i < NB_SEEKS && ret >= 0; i++)
+        ret = check(pb, av_lfg_get(&lfg) % file_size, av_lfg_get(&lfg) % MAX_READ + 1);
+
+    if (ret >= 0)
+        ret = av_opt_get_int(pb, "cache_hit_bytes", AV_OPT_SEARCH_CHILDREN, &r->hit_bytes);
+    if (ret >= 0)
+        ret = av_opt_get_int(pb, "cache_miss_bytes", AV_OPT_SEARCH_CHILDREN, &r->miss_bytes);
+    avio_closep(&pb);
+end:
+    r->ret = ret;
+    return NULL;
+}
+
+static int write_source(const char *source, AVLFG *lfg, int size)
+{
+    FILE *f = fopen(source, "wb");
+    int i;
+
+    for (i = 0; i < size; i++)
+        data[i] = av_lfg_get(lfg);
+    file_size = size;
+    if (!f || fwrite(data, 1, size, f) != size) {
+        fprintf(stderr, "Cannot write %s\n", source);
+        if (f)
+            fclose(f);
+        return AVERROR(EIO);
+    }
+    return fclose(f) ? AVERROR(EIO) : 0;
+}
+
+static int run(Reader *readers, int nb_readers)
+{
+    int i, ret = 0;
+
+    for (i = 0; i < nb_readers; i++) {
+        if (pthread_create(&readers[i].thread, NULL, reader, &readers[i])) {
+            nb_readers = i;
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+    }
+    for (i = 0; i < nb_readers; i++) {
+        pthread_join(readers[i].thread, NULL);
+        if (readers[i].ret < 0)
+            ret = readers[i].ret;
+    }
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    Reader readers[NB_THREADS] = { { 0 } };
+    char *source = NULL, *cache_dir = NULL, *url = NULL;
+    int64_t miss_bytes = 0;
+    AVIOContext *pb = NULL;
+    AVDictionary *opts = NULL;
+    AVLFG lfg;
+    int i, ret = 1;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <directory>\n", argv[0]);
+        return 1;
+    }
+    av_log_set_level(AV_LOG_WARNING);
+
+    /* a new name for every run, as the cache is keyed by URL */
+    mkdir(argv[1], 0777);
+    source    = av_asprintf("%s/source-%08x", argv[1], av_get_random_seed());
+    cache_dir = av_asprintf("%s/cache", argv[1]);
+    url       = source ? av_asprintf("cache:file:%s", source) : NULL;
+    if (!source || !cache_dir || !url)
+        goto end;
+
+    av_lfg_init(&lfg, 0xcac4e);
+    if (write_source(source, &lfg, FILE_SIZE) < 0)
+        goto end;
+
+    /* cold cache, the readers race to store the same blocks */
+    for (i = 0; i < NB_THREADS; i++) {
+        readers[i].url       = url;
+        readers[i].cache_dir = cache_dir;
+        readers[i].seed      = i;
+    }
+    if (run(readers, NB_THREADS) < 0)
+        goto end;
+    for (i = 0; i < NB_THREADS; i++)
+        miss_bytes += readers[i].miss_bytes;
+    if (miss_bytes < FILE_SIZE) {
+        fprintf(stderr, "Only %"PRId64" bytes read from the source\n", miss_bytes);
+        goto end;
+    }
+
+    /* warm cache */
+    readers[0].seed = NB_THREADS;
+    if (run(readers, 1) < 0)
+        goto end;
+    if (readers[0].miss_bytes || readers[0].hit_bytes < FILE_SIZE) {
+        fprintf(stderr, "Warm read: %"PRId64" bytes from the cache, %"PRId64" from the source\n",
+                readers[0].hit_bytes, readers[0].miss_bytes);
+        goto end;
+    }
+
+    /* a changed file is read again from the source */
+    if (write_source(source, &lfg, FILE_SIZE - BLOCK_SIZE / 2) < 0)
+        goto end;
+    readers[0].seed = NB_THREADS + 1;
+    if (run(readers, 1) < 0)
+        goto end;
+    if (readers[0].miss_bytes < file_size) {
+        fprintf(stderr, "Changed file: only %"PRId64" bytes read from the source\n",
+                readers[0].miss_bytes);
+        goto end;
+    }
+
+    /* least recently used blocks are evicted above the size limit */
+    readers[0].max_size = 4 * BLOCK_SIZE;
+    if (run(readers, 1) < 0)
+        goto end;
+    readers[0].max_size = 0;
+    if (run(readers, 1) < 0)
+        goto end;
+    if (HAVE_DIRENT_H && !readers[0].miss_bytes) {
+        fprintf(stderr, "No block evicted\n");
+        goto end;
+    }
+
+    ret = 0;
+end:
+    /* evict everything */
+    av_dict_set(&opts, "cache_dir", cache_dir, 0);
+    av_dict_set_int(&opts, "cache_max_size", 1, 0);
+    if (url && avio_open2(&pb, url, AVIO_FLAG_READ, NULL, &opts) >= 0)
+        avio_closep(&pb);
+    av_dict_free(&opts);
+    if (cache_dir)
+        rmdir(cache_dir);
+    if (source)
+        unlink(source);
+    rmdir(argv[1]);
+
+    av_free(source);
+    av_free(cache_dir);
+    av_free(url);
+    return ret;
+}
@@ -0,0 +1,290 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Serve a DASH manifest with two audio representations of MPEG-TS fragments
+ * from a local HTTP server which delays every response, and read it without
+ * persistent connections and prefetching, with persistent connections only,
+ * and with both. The packets must be the same in every run, and persistent
+ * connections must be reused across fragments. Without prefetching, the
+ * demuxer requests one fragment at a time. With it, the server holds every
+ * fragment until the next one of the representation is requested, which
+ * only completes if the demuxer requests the fragments in advance.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavformat/avformat.h"
+#include "libavutil/crc.h"
+#include "libavutil/opt.h"
+#include "libavutil/time.h"
+
+#include "httpserver.h"
+
+#define NB_SEGMENTS      6
+#define NB_REPS          2
+#define FRAMES_PER_SEG   42   /* 1.008 seconds */
+#define FRAME_SIZE       192  /* MP2, 48 kHz, 64 kb/s, mono */
+#define FRAME_DURATION   2160 /* in 1/90000 */
+#define RESPONSE_DELAY   50000
+#define HOLD_TIMEOUT     10000000
+
+typedef struct State {
+    int hold;                   ///< hold the fragments until the next one is requested
+    int requested[NB_REPS][NB_SEGMENTS];
+    int nb_held;                ///< fragments answered after the next request
+    int nb_running;             ///< fragment requests being answered
+    int max_running;
+} State;
+
+static uint8_t *fragments[NB_REPS][NB_SEGMENTS];
+static int fragment_sizes[NB_REPS][NB_SEGMENTS];
+
+/* Mux the MP2 frames of a fragment into MPEG-TS, with timestamps following
+ * the ones of the previous fragment. */
+static int make_fragment(int rep, int seg)
+{
+    AVFormatContext *oc = NULL;
+    AVStream *st;
+    uint8_t frame[FRAME_SIZE] = { 0xFF, 0xFD, 0x44, 0xC0 };
+    int i, ret;
+
+    ret = avformat_alloc_output_context2(&oc, NULL, "mpegts", NULL);
+    if (ret < 0)
+        return ret;
+    if (!(st = avformat_new_stream(oc, NULL))) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    st->codecpar->codec_type     = AVMEDIA_TYPE_AUDIO;
+    st->codecpar->codec_id       = AV_CODEC_ID_MP2;
+    st->codecpar->sample_rate    = 48000;
+    st->codecpar->channels       = 1;
+    st->codecpar->channel_layout = AV_CH_LAYOUT_MONO;
+    st->time_base                = (AVRational){ 1, 90000 };
+    if ((ret = avio_open_dyn_buf(&oc->pb)) < 0 ||
+        (ret = avformat_write_header(oc, NULL)) < 0)
+        goto end;
+
+    for (i = 0; i < FRAMES_PER_SEG && ret >= 0; i++) {
+        AVPacket pkt = { 0 };
+
+        frame[4]     = rep * NB_SEGMENTS + seg;
+        pkt.data     = frame;
+        pkt.size     = sizeof(frame);
+        pkt.pts      = pkt.dts = (int64_t)(seg * FRAMES_PER_SEG + i) * FRAME_DURATION;
+        pkt.duration = FRAME_DURATION;
+        ret = av_write_frame(oc, &pkt);
+    }
+    if (ret >= 0)
+        ret = av_write_trailer(oc);
+
+end:
+    if (oc->pb)
+        fragment_sizes[rep][seg] = avio_close_dyn_buf(oc->pb, &fragments[rep][seg]);
+    avformat_free_context(oc);
+    return ret;
+}
+
+static int send_fragment(HTTPConnection *conn, int rep, int seg)
+{
+    HTTPServer *s = conn->server;
+    State *state = s->opaque;
+    int i, ret;
+
+    pthread_mutex_lock(&s->lock);
+    state->requested[rep][seg] = 1;
+    state->nb_running++;
+    state->max_running = FFMAX(state->max_running, state->nb_running);
+    if (state->hold && seg + 1 < NB_SEGMENTS) {
+        for (i = 0; i < HOLD_TIMEOUT / 1000 && !state->requested[rep][seg + 1]; i++) {
+            pthread_mutex_unlock(&s->lock);
+            av_usleep(1000);
+            pthread_mutex_lock(&s->lock);
+        }
+        state->nb_held += state->requested[rep][seg + 1];
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    ret = http_server_respond(conn, "200 OK",
+                              "Content-Type: application/octet-stream\r\n",
+                              fragments[rep][seg], fragment_sizes[rep][seg]);
+
+    pthread_mutex_lock(&s->lock);
+    state->nb_running--;
+    pthread_mutex_unlock(&s->lock);
+    return ret;
+}
+
+static int handle_request(HTTPConnection *conn, const HTTPRequest *req)
+{
+    char body[4096];
+    int rep, seg, i, size = 0;
+
+    av_usleep(RESPONSE_DELAY);
+
+    if (sscanf(req->path, "/%d/seg%d.ts", &rep, &seg) == 2 &&
+        rep >= 0 && rep < NB_REPS && seg >= 0 && seg < NB_SEGMENTS)
+        return send_fragment(conn, rep, seg);
+    if (strcmp(req->path, "/manifest.mpd"))
+        return http_server_respond(conn, "404 Not Found", NULL, NULL, 0);
+
+    size += snprintf(body, sizeof(body),
+                     "<?xml version=\"1.0\"?>\n"
+                     "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\" type=\"static\"\n"
+                     "     profiles=\"urn:mpeg:dash:profile:isoff-live:2011\"\n"
+                     "     mediaPresentationDuration=\"PT6S\" minBufferTime=\"PT1S\">\n"
+                     "  <Period start=\"PT0S\">\n");
+    for (i = 0; i < NB_REPS; i++)
+        size += snprintf(body + size, sizeof(body) - size,
+                         "    <AdaptationSet contentType=\"audio\" mimeType=\"video/mp2t\">\n"
+                         "      <SegmentTemplate media=\"$RepresentationID$/seg$Number$.ts\"\n"
+                         "                       startNumber=\"0\" duration=\"1008\" timescale=\"1000\"/>\n"
+                         "      <Representation id=\"%d\" bandwidth=\"64000\"/>\n"
+                         "    </AdaptationSet>\n", i);
+    size += snprintf(body + size, sizeof(body) - size, "  </Period>\n</MPD>\n");
+    return http_server_respond(conn, "200 OK",
+                               "Content-Type: application/octet-stream\r\n",
+                               body, size);
+}
+
+typedef struct Run {
+    int persistent;
+    int prefetch;
+    int nb_packets;
+    uint32_t crc;
+    int64_t stalls;
+    int nb_requests;
+    int nb_connections;
+    int nb_held;
+    int max_running;
+} Run;
+
+static int play(HTTPServer *server, const char *url, Run *run)
+{
+    const AVCRC *table = av_crc_get_table(AV_CRC_32_IEEE_LE);
+    State *state = server->opaque;
+    AVFormatContext *ctx = NULL;
+    AVDictionary *opts = NULL;
+    AVPacket pkt;
+    int nb_requests, nb_connections;
+    int ret;
+
+    pthread_mutex_lock(&server->lock);
+    memset(state, 0, sizeof(*state));
+    state->hold    = run->prefetch > 0;
+    nb_requests    = server->nb_requests;
+    nb_connections = server->nb_connections;
+    pthread_mutex_unlock(&server->lock);
+
+    av_dict_set_int(&opts, "http_persistent", run->persistent, 0);
+    av_dict_set_int(&opts, "prefetch_segments", run->prefetch, 0);
+    ret = avformat_open_input(&ctx, url, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+
+    run->nb_packets = 0;
+    run->crc        = 0;
+    while ((ret = av_read_frame(ctx, &pkt)) >= 0) {
+        run->crc = av_crc(table, run->crc, pkt.data, pkt.size);
+        run->nb_packets++;
+        av_packet_unref(&pkt);
+    }
+    if (ret == AVERROR_EOF)
+        ret = av_opt_get_int(ctx, "segment_stalls", AV_OPT_SEARCH_CHILDREN, &run->stalls);
+    avformat_close_input(&ctx);
+
+    http_server_wait_idle(server);
+    pthread_mutex_lock(&server->lock);
+    run->nb_requests    = server->nb_requests - nb_requests;
+    run->nb_connections = server->nb_connections - nb_connections;
+    run->nb_held        = state->nb_held;
+    run->max_running    = state->max_running;
+    pthread_mutex_unlock(&server->lock);
+
+    return ret;
+}
+
+int main(void)
+{
+    HTTPServer server = { 0 };
+    State state;
+    Run runs[3] = {
+        { .persistent = 0, .prefetch = 0 },
+        { .persistent = 1, .prefetch = 0 },
+        { .persistent = 1, .prefetch = 3 },
+    };
+    char url[64];
+    int i, j, ret = 0;
+
+    for (i = 0; i < NB_REPS && ret >= 0; i++)
+        for (j = 0; j < NB_SEGMENTS && ret >= 0; j++)
+            ret = make_fragment(i, j);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot create the fragments: %s\n", av_err2str(ret));
+        return 1;
+    }
+
+    avformat_network_init();
+    if (http_server_start(&server, handle_request, &state) < 0) {
+        fprintf(stderr, "Cannot start the HTTP server\n");
+        return 1;
+    }
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/manifest.mpd", server.port);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(runs) && !ret; i++) {
+        ret = play(&server, url, &runs[i]);
+        if (ret < 0)
+            fprintf(stderr, "Reading %s failed: %s\n", url, av_err2str(ret));
+        else
+            fprintf(stderr, "persistent %d prefetch %d: %d packets, %"PRId64" stalls, "
+                    "%d requests on %d connections, %d parallel requests, "
+                    "%d fragments held\n", runs[i].persistent, runs[i].prefetch,
+                    runs[i].nb_packets, runs[i].stalls, runs[i].nb_requests,
+                    runs[i].nb_connections, runs[i].max_running, runs[i].nb_held);
+    }
+
+    http_server_stop(&server);
+    avformat_network_deinit();
+    for (i = 0; i < NB_REPS; i++)
+        for (j = 0; j < NB_SEGMENTS; j++)
+            av_freep(&fragments[i][j]);
+
+    if (ret < 0)
+        return 1;
+    for (i = 1; i < FF_ARRAY_ELEMS(runs); i++) {
+        if (!runs[0].nb_packets || runs[i].nb_packets != runs[0].nb_packets ||
+            runs[i].crc != runs[0].crc) {
+            fprintf(stderr, "The packets differ in run %d\n", i);
+            return 1;
+        }
+    }
+    if (runs[0].nb_connections != runs[0].nb_requests ||
+        runs[1].nb_connections > 1 + NB_REPS) {
+        fprintf(stderr, "The connections were not reused\n");
+        return 1;
+    }
+    if (runs[0].max_running != 1 || runs[1].max_running != 1 ||
+        runs[2].max_running < 2 || runs[2].nb_held != NB_REPS * (NB_SEGMENTS - 1)) {
+        fprintf(stderr, "The fragments were not prefetched\n");
+        return 1;
+    }
+    return 0;
+}
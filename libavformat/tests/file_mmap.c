@@ -0,0 +1,221 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Write large video packets to files in several formats, and demux them
+ * with and without the mmap option of the file protocol. The packets must
+ * be the same and zero padded; with mmap, they must reference the read-only
+ * mapping, except at the end of the file, and stay valid after the input is
+ * closed.
+ *
+ * Usage: file_mmap <directory>
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+
+#include "libavformat/avformat.h"
+#include "libavformat/os_support.h"
+#include "libavutil/avstring.h"
+
+#define NB_PACKETS  8
+#define WIDTH       320
+#define HEIGHT      240
+#define FRAME_SIZE  (WIDTH * HEIGHT * 3 / 2)
+
+static void fill(uint8_t *buf, int size, int seed)
+{
+    int i;
+
+    for (i = 0; i < size; i++)
+        buf[i] = seed * 13 + i * 7 + (i >> 10);
+}
+
+static int packet_size(const char *format, int i)
+{
+    return strcmp(format, "mov") ? FRAME_SIZE : 100000 + i * 1000;
+}
+
+static int write_file(const char *filename, const char *format)
+{
+    AVFormatContext *oc = NULL;
+    AVStream *st;
+    AVPacket pkt;
+    uint8_t *buf;
+    int i, ret;
+
+    ret = avformat_alloc_output_context2(&oc, NULL, format, filename);
+    if (ret < 0)
+        return ret;
+    buf = av_malloc(packet_size(format, NB_PACKETS));
+    st  = avformat_new_stream(oc, NULL);
+    if (!buf || !st) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    st->time_base            = (AVRational){ 1, 25 };
+    st->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    if (!strcmp(format, "mov")) {
+        st->codecpar->codec_id  = AV_CODEC_ID_PRORES;
+        st->codecpar->codec_tag = MKTAG('a', 'p', 'c', 'h');
+    } else {
+        /* ProRes in Matroska is copied to restore its frame header */
+        st->codecpar->codec_id  = AV_CODEC_ID_RAWVIDEO;
+        st->codecpar->codec_tag = MKTAG('I', '4', '2', '0');
+        st->codecpar->format    = AV_PIX_FMT_YUV420P;
+    }
+    st->codecpar->width      = WIDTH;
+    st->codecpar->height     = HEIGHT;
+
+    ret = avio_open(&oc->pb, filename, AVIO_FLAG_WRITE);
+    if (ret < 0)
+        goto end;
+    ret = avformat_write_header(oc, NULL);
+    for (i = 0; i < NB_PACKETS && ret >= 0; i++) {
+        av_init_packet(&pkt);
+        pkt.data  = buf;
+        pkt.size  = packet_size(format, i);
+        pkt.pts   = pkt.dts = i;
+        pkt.flags = AV_PKT_FLAG_KEY;
+        fill(buf, pkt.size, i);
+        ret = av_write_frame(oc, &pkt);
+    }
+    if (ret >= 0)
+        ret = av_write_trailer(oc);
+    avio_closep(&oc->pb);
+
+end:
+    av_free(buf);
+    avformat_free_context(oc);
+    return ret;
+}
+
+static int read_file(const char *filename, const char *format, int mmap,
+                     AVPacket *last)
+{
+    AVFormatContext *ic = NULL;
+    AVDictionary *opts = NULL;
+    AVPacket pkt;
+    uint8_t *ref = av_malloc(packet_size(format, NB_PACKETS));
+    int nb_packets = 0, nb_mapped = 0, i, ret;
+
+    if (!ref)
+        return AVERROR(ENOMEM);
+    av_dict_set_int(&opts, "mmap", mmap, 0);
+    av_dict_set(&opts, "video_size", "320x240", 0);
+    ret = avformat_open_input(&ic, filename, av_find_input_format(format), &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        goto end;
+
+    while ((ret = av_read_frame(ic, &pkt)) >= 0) {
+        fill(ref, packet_size(format, nb_packets), nb_packets);
+        if (nb_packets >= NB_PACKETS || pkt.size != packet_size(format, nb_packets) ||
+            memcmp(pkt.data, ref, pkt.size)) {
+            fprintf(stderr, "%s: wrong packet %d with mmap=%d\n", format, nb_packets, mmap);
+            av_packet_unref(&pkt);
+            ret = AVERROR_INVALIDDATA;
+            break;
+        }
+        for (i = 0; i < AV_INPUT_BUFFER_PADDING_SIZE; i++)
+            if (pkt.data[pkt.size + i])
+                break;
+        if (i < AV_INPUT_BUFFER_PADDING_SIZE) {
+            fprintf(stderr, "%s: packet %d padding not zeroed with mmap=%d\n", format, nb_packets, mmap);
+            av_packet_unref(&pkt);
+            ret = AVERROR_INVALIDDATA;
+            break;
+        }
+        nb_mapped += pkt.buf && !av_buffer_is_writable(pkt.buf);
+        nb_packets++;
+        av_packet_unref(last);
+        av_packet_move_ref(last, &pkt);
+    }
+    if (ret == AVERROR_EOF)
+        ret = 0;
+    if (!ret && nb_packets != NB_PACKETS) {
+        fprintf(stderr, "%s: %d packets with mmap=%d\n", format, nb_packets, mmap);
+        ret = AVERROR_INVALIDDATA;
+    }
+    /* a packet at the end of the file is copied, as it has no padding */
+    if (!ret && (mmap && HAVE_MMAP) != (nb_mapped >= NB_PACKETS - 1)) {
+        fprintf(stderr, "%s: %d mapped packets with mmap=%d\n", format, nb_mapped, mmap);
+        ret = AVERROR_INVALIDDATA;
+    }
+
+end:
+    avformat_close_input(&ic);
+    av_free(ref);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    static const char *const formats[][2] = {
+        { "rawvideo", "yuv" },
+        { "mov",      "mov" },
+        { "matroska", "mkv" },
+    };
+    AVPacket last;
+    int i, mmap, ret = 0;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <directory>\n", argv[0]);
+        return 1;
+    }
+    mkdir(argv[1], 0777);
+    av_init_packet(&last);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(formats) && ret >= 0; i++) {
+        char *filename;
+
+        if (!av_guess_format(formats[i][0], NULL, NULL) ||
+            !av_find_input_format(formats[i][0]))
+            continue;
+        filename = av_asprintf("%s/test.%s", argv[1], formats[i][1]);
+        if (!filename)
+            return 1;
+
+        ret = write_file(filename, formats[i][0]);
+        for (mmap = 0; mmap < 2 && ret >= 0; mmap++) {
+            uint8_t ref[1024];
+
+            ret = read_file(filename, formats[i][0], mmap, &last);
+            /* the last packet outlives the input */
+            fill(ref, sizeof(ref), NB_PACKETS - 1);
+            if (ret >= 0 && memcmp(last.data, ref, sizeof(ref))) {
+                fprintf(stderr, "%s: last packet changed after closing\n", formats[i][0]);
+                ret = AVERROR_INVALIDDATA;
+            }
+            av_packet_unref(&last);
+        }
+        if (ret < 0)
+            fprintf(stderr, "%s: %s\n", filename, av_err2str(ret));
+        unlink(filename);
+        av_free(filename);
+    }
+    rmdir(argv[1]);
+
+    return ret < 0;
+}
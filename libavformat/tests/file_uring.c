@@ -0,0 +1,196 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Write a file like a muxer does, patching a header after the data, and
+ * read it back sequentially and at random positions, with and without the
+ * io_uring option of the file protocol. The contents must be the same in
+ * every case; without io_uring support, the option falls back to blocking
+ * I/O and the test still passes.
+ *
+ * Usage: file_uring <directory>
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+
+#include "libavformat/avio.h"
+#include "libavformat/os_support.h"
+#include "libavutil/avstring.h"
+#include "libavutil/mem.h"
+
+#define FILE_SIZE   (3 * 1024 * 1024 + 12345)
+#define HEADER_SIZE 4096
+#define NB_SEEKS    200
+
+static uint8_t ref[FILE_SIZE];
+
+static unsigned lcg(unsigned *state)
+{
+    *state = *state * 1664525 + 1013904223;
+    return *state >> 8;
+}
+
+static AVIOContext *open_file(const char *filename, int flags, int io_uring,
+                              int queue_depth)
+{
+    AVIOContext *pb = NULL;
+    AVDictionary *opts = NULL;
+    int ret;
+
+    av_dict_set_int(&opts, "io_uring", io_uring, 0);
+    av_dict_set_int(&opts, "queue_depth", queue_depth, 0);
+    ret = avio_open2(&pb, filename, flags, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        fprintf(stderr, "cannot open %s: %s\n", filename, av_err2str(ret));
+    return pb;
+}
+
+static int write_file(const char *filename, int io_uring, int queue_depth)
+{
+    AVIOContext *pb = open_file(filename, AVIO_FLAG_WRITE, io_uring, queue_depth);
+    int64_t size;
+    int pos, len, ret;
+
+    if (!pb)
+        return AVERROR(EIO);
+
+    /* placeholder header, rewritten once the data is written */
+    for (pos = 0; pos < HEADER_SIZE; pos++)
+        avio_w8(pb, 0);
+    for (len = 1; pos < FILE_SIZE; pos += len, len = len * 3 % 100003) {
+        len = FFMIN(len, FILE_SIZE - pos);
+        avio_write(pb, ref + pos, len);
+        if (pos > FILE_SIZE / 2 && pos - len <= FILE_SIZE / 2) {
+            avio_flush(pb);
+            size = avio_size(pb);
+            if (size != pos + len) {
+                fprintf(stderr, "size %"PRId64" while writing, expected %d\n",
+                        size, pos + len);
+                avio_closep(&pb);
+                return AVERROR_INVALIDDATA;
+            }
+        }
+    }
+    avio_seek(pb, 0, SEEK_SET);
+    avio_write(pb, ref, HEADER_SIZE);
+    avio_seek(pb, FILE_SIZE, SEEK_SET);
+    ret = pb->error;
+    if (ret >= 0)
+        ret = avio_closep(&pb);
+    else
+        avio_closep(&pb);
+    return ret;
+}
+
+static int read_file(const char *filename, int io_uring, int queue_depth)
+{
+    AVIOContext *pb = open_file(filename, AVIO_FLAG_READ, io_uring, queue_depth);
+    uint8_t *buf = av_malloc(FILE_SIZE + 1);
+    unsigned state = 1;
+    int64_t size;
+    int i, pos, len, ret = 0;
+
+    if (!pb || !buf) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    size = avio_size(pb);
+    if (size != FILE_SIZE) {
+        fprintf(stderr, "size %"PRId64", expected %d\n", size, FILE_SIZE);
+        ret = AVERROR_INVALIDDATA;
+        goto end;
+    }
+
+    for (pos = 0, len = 1; pos <= FILE_SIZE; pos += ret, len = len * 5 % 70001) {
+        ret = avio_read(pb, buf + pos, len);
+        if (ret <= 0)
+            break;
+    }
+    if (pos != FILE_SIZE || !avio_feof(pb) || memcmp(buf, ref, FILE_SIZE)) {
+        fprintf(stderr, "sequential read with io_uring=%d failed at %d\n",
+                io_uring, pos);
+        ret = AVERROR_INVALIDDATA;
+        goto end;
+    }
+
+    for (i = 0; i < NB_SEEKS; i++) {
+        pos = lcg(&state) % (FILE_SIZE + 1000);
+        len = lcg(&state) % 300000;
+        if (avio_seek(pb, pos, SEEK_SET) != pos) {
+            fprintf(stderr, "seek to %d failed\n", pos);
+            ret = AVERROR_INVALIDDATA;
+            goto end;
+        }
+        ret = avio_read(pb, buf, len);
+        len = av_clip(FILE_SIZE - pos, 0, len);
+        if (len ? ret != len || memcmp(buf, ref + pos, len) : ret > 0) {
+            fprintf(stderr, "read of %d bytes at %d with io_uring=%d returned %d\n",
+                    len, pos, io_uring, ret);
+            ret = AVERROR_INVALIDDATA;
+            goto end;
+        }
+    }
+    ret = 0;
+
+end:
+    avio_closep(&pb);
+    av_free(buf);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    static const int configs[][2] = {
+        { 0,  8 }, { 1,  8 }, { 1,  1 }, { 1, 64 },
+    };
+    char *filename;
+    int i, j, ret = 0;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <directory>\n", argv[0]);
+        return 1;
+    }
+    mkdir(argv[1], 0777);
+    filename = av_asprintf("%s/test.bin", argv[1]);
+    if (!filename)
+        return 1;
+    for (i = 0; i < FILE_SIZE; i++)
+        ref[i] = i * 7 + (i >> 8) * 13 + (i >> 16);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(configs) && ret >= 0; i++) {
+        ret = write_file(filename, configs[i][0], configs[i][1]);
+        for (j = 0; j < FF_ARRAY_ELEMS(configs) && ret >= 0; j++)
+            ret = read_file(filename, configs[j][0], configs[j][1]);
+        if (ret < 0)
+            fprintf(stderr, "io_uring=%d queue_depth=%d: %s\n",
+                    configs[i][0], configs[i][1], av_err2str(ret));
+        unlink(filename);
+    }
+    av_free(filename);
+    rmdir(argv[1]);
+
+    return ret < 0;
+}
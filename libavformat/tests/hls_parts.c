@@ -0,0 +1,149 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Mux a live low-latency HLS stream of MP2 frames into fragmented MP4
+ * segments and parts, and print the media and delta playlists while a
+ * segment is being written, then again once the stream ended. The playlists
+ * are compared to the reference, which checks the parts, the preload hint,
+ * the server control and the skipped segments of the delta playlist.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include <sys/stat.h>
+
+#include "libavformat/avformat.h"
+#include "libavformat/os_support.h"
+#include "libavutil/avstring.h"
+#include "libavutil/channel_layout.h"
+
+#define NB_FRAMES        690  /* 18 seconds */
+#define SNAPSHOT_FRAME   590  /* 15.4 seconds, in the middle of a segment */
+#define FRAME_SIZE       208  /* MP2, 44.1 kHz, 64 kb/s, mono */
+#define FRAME_SAMPLES    1152
+
+static int print_file(const char *filename)
+{
+    char line[1024];
+    FILE *f = fopen(filename, "r");
+
+    if (!f) {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        return AVERROR(ENOENT);
+    }
+    printf("%s\n", av_basename(filename));
+    while (fgets(line, sizeof(line), f))
+        fputs(line, stdout);
+    fclose(f);
+    return 0;
+}
+
+static int print_playlists(const char *dir)
+{
+    char filename[1024];
+    int ret;
+
+    snprintf(filename, sizeof(filename), "%s/test.m3u8", dir);
+    if ((ret = print_file(filename)) < 0)
+        return ret;
+    snprintf(filename, sizeof(filename), "%s/test_delta.m3u8", dir);
+    return print_file(filename);
+}
+
+static int mux(const char *dir)
+{
+    AVFormatContext *ctx = NULL;
+    AVDictionary *opts = NULL;
+    AVStream *st;
+    AVPacket pkt;
+    uint8_t frame[FRAME_SIZE] = { 0xFF, 0xFD, 0x40, 0xC0 };
+    char url[1024], segments[1024];
+    int i, ret;
+
+    snprintf(url, sizeof(url), "%s/test.m3u8", dir);
+    snprintf(segments, sizeof(segments), "%s/test_%%d.m4s", dir);
+    ret = avformat_alloc_output_context2(&ctx, NULL, "hls", url);
+    if (ret < 0)
+        return ret;
+    if (!(st = avformat_new_stream(ctx, NULL))) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    ctx->flags                  |= AVFMT_FLAG_BITEXACT;
+    st->time_base                = (AVRational){ 1, 44100 };
+    st->codecpar->codec_type     = AVMEDIA_TYPE_AUDIO;
+    st->codecpar->codec_id       = AV_CODEC_ID_MP2;
+    st->codecpar->sample_rate    = 44100;
+    st->codecpar->channels       = 1;
+    st->codecpar->channel_layout = AV_CH_LAYOUT_MONO;
+    st->codecpar->bit_rate       = 64000;
+
+    av_dict_set(&opts, "hls_segment_type", "fmp4", 0);
+    av_dict_set(&opts, "hls_fmp4_init_filename", "test_init.mp4", 0);
+    av_dict_set(&opts, "hls_segment_filename", segments, 0);
+    av_dict_set(&opts, "hls_list_size", "0", 0);
+    av_dict_set(&opts, "hls_time", "2", 0);
+    av_dict_set(&opts, "hls_part_time", "0.5", 0);
+    av_dict_set(&opts, "hls_skip_until", "12", 0);
+    ret = avformat_write_header(ctx, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        goto end;
+
+    for (i = 0; i < NB_FRAMES && ret >= 0; i++) {
+        if (i == SNAPSHOT_FRAME && (ret = print_playlists(dir)) < 0)
+            break;
+        av_init_packet(&pkt);
+        pkt.data         = frame;
+        pkt.size         = sizeof(frame);
+        pkt.stream_index = 0;
+        pkt.pts = pkt.dts = (int64_t)i * FRAME_SAMPLES;
+        pkt.duration     = FRAME_SAMPLES;
+        pkt.flags        = AV_PKT_FLAG_KEY;
+        ret = av_write_frame(ctx, &pkt);
+    }
+    if (ret >= 0)
+        ret = av_write_trailer(ctx);
+    if (ret >= 0)
+        ret = print_playlists(dir);
+
+end:
+    avformat_free_context(ctx);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <directory>\n", argv[0]);
+        return 1;
+    }
+    mkdir(argv[1], 0777);
+
+    ret = mux(argv[1]);
+    if (ret < 0) {
+        fprintf(stderr, "Muxing failed: %s\n", av_err2str(ret));
+        return 1;
+    }
+    return 0;
+}
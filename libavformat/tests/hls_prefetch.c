@@ -0,0 +1,287 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Serve an HLS playlist of MP2 segments from a local HTTP server which
+ * delays every response, and read it without and with segment prefetching.
+ * The packets must be the same. Without prefetching, the demuxer requests
+ * one segment at a time. With it, the server holds every segment until the
+ * next one is requested, which only completes if the demuxer requests the
+ * segments in advance. The cookie set with the first segment must be sent
+ * with the requests of the segments queued after it was received.
+ * Then the server stops answering in the middle of the playlist, and the
+ * interrupt callback must stop the prefetching demuxer.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavformat/avformat.h"
+#include "libavutil/crc.h"
+#include "libavutil/opt.h"
+#include "libavutil/time.h"
+
+#include "httpserver.h"
+
+#define NB_SEGMENTS      6
+#define FRAMES_PER_SEG   42   /* 1.008 seconds */
+#define FRAME_SIZE       192  /* MP2, 48 kHz, 64 kb/s, mono */
+#define RESPONSE_DELAY   50000
+#define HOLD_TIMEOUT     10000000
+#define STALL_SEGMENT    2
+#define INTERRUPT_DELAY  1000000
+#define COOKIE_SEGMENT   3    /* first segment queued after the cookie was set */
+
+typedef struct State {
+    int hold;                   ///< hold the segments until the next one is requested
+    int stall;                  ///< do not answer STALL_SEGMENT until released
+    int released;
+    int requested[NB_SEGMENTS];
+    int nb_held;                ///< segments answered after the next request
+    int nb_running;             ///< segment requests being answered
+    int max_running;
+    int nb_no_cookie;           ///< requests from COOKIE_SEGMENT on without the cookie
+} State;
+
+static int send_segment(HTTPConnection *conn, const HTTPRequest *req, int seg)
+{
+    HTTPServer *s = conn->server;
+    State *state = s->opaque;
+    char body[FRAMES_PER_SEG * FRAME_SIZE] = { 0 };
+    int i, ret;
+
+    pthread_mutex_lock(&s->lock);
+    state->requested[seg] = 1;
+    if (seg >= COOKIE_SEGMENT && !strstr(req->headers, "token=42"))
+        state->nb_no_cookie++;
+    state->nb_running++;
+    state->max_running = FFMAX(state->max_running, state->nb_running);
+    if (state->hold && seg + 1 < NB_SEGMENTS) {
+        for (i = 0; i < HOLD_TIMEOUT / 1000 && !state->requested[seg + 1]; i++) {
+            pthread_mutex_unlock(&s->lock);
+            av_usleep(1000);
+            pthread_mutex_lock(&s->lock);
+        }
+        state->nb_held += state->requested[seg + 1];
+    }
+    if (state->stall && seg == STALL_SEGMENT) {
+        for (i = 0; i < HOLD_TIMEOUT / 1000 && !state->released; i++) {
+            pthread_mutex_unlock(&s->lock);
+            av_usleep(1000);
+            pthread_mutex_lock(&s->lock);
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    for (i = 0; i < FRAMES_PER_SEG; i++) {
+        uint8_t *frame = (uint8_t *)body + i * FRAME_SIZE;
+        frame[0] = 0xFF;
+        frame[1] = 0xFD;
+        frame[2] = 0x44;
+        frame[3] = 0xC0;
+    }
+    ret = http_server_respond(conn, "200 OK",
+                              seg ? "Content-Type: application/octet-stream\r\n" :
+                                    "Content-Type: application/octet-stream\r\n"
+                                    "Set-Cookie: token=42; path=/\r\n",
+                              body, sizeof(body));
+
+    pthread_mutex_lock(&s->lock);
+    state->nb_running--;
+    pthread_mutex_unlock(&s->lock);
+    return ret;
+}
+
+static int handle_request(HTTPConnection *conn, const HTTPRequest *req)
+{
+    char body[1024];
+    int seg, i, size = 0;
+
+    av_usleep(RESPONSE_DELAY);
+
+    if (sscanf(req->path, "/seg%d.mp2", &seg) == 1 && seg >= 0 && seg < NB_SEGMENTS)
+        return send_segment(conn, req, seg);
+    if (strcmp(req->path, "/index.m3u8"))
+        return http_server_respond(conn, "404 Not Found", NULL, NULL, 0);
+
+    size += snprintf(body, sizeof(body),
+                     "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:2\n"
+                     "#EXT-X-MEDIA-SEQUENCE:0\n");
+    for (i = 0; i < NB_SEGMENTS; i++)
+        size += snprintf(body + size, sizeof(body) - size,
+                         "#EXTINF:1.008,\nseg%d.mp2\n", i);
+    size += snprintf(body + size, sizeof(body) - size, "#EXT-X-ENDLIST\n");
+    return http_server_respond(conn, "200 OK",
+                               "Content-Type: application/octet-stream\r\n",
+                               body, size);
+}
+
+static int play(const char *url, int prefetch, int64_t *stalls,
+                int *nb_packets, uint32_t *crc)
+{
+    const AVCRC *table = av_crc_get_table(AV_CRC_32_IEEE_LE);
+    AVFormatContext *ctx = NULL;
+    AVDictionary *opts = NULL;
+    AVPacket pkt;
+    int ret;
+
+    av_dict_set_int(&opts, "prefetch_segments", prefetch, 0);
+    ret = avformat_open_input(&ctx, url, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+
+    *nb_packets = 0;
+    *crc        = 0;
+    while ((ret = av_read_frame(ctx, &pkt)) >= 0) {
+        *crc = av_crc(table, *crc, pkt.data, pkt.size);
+        (*nb_packets)++;
+        av_packet_unref(&pkt);
+    }
+    if (ret == AVERROR_EOF)
+        ret = av_opt_get_int(ctx, "segment_stalls", AV_OPT_SEARCH_CHILDREN, stalls);
+    avformat_close_input(&ctx);
+
+    return ret;
+}
+
+static int interrupt_cb(void *opaque)
+{
+    return av_gettime_relative() > *(int64_t *)opaque;
+}
+
+/* Read until the interrupt callback stops the demuxer, return the time it
+ * took once the callback fired, or a negative error code. The interruption
+ * may end the playlist like an error, as EOF. */
+static int64_t play_interrupted(const char *url)
+{
+    AVFormatContext *ctx = avformat_alloc_context();
+    AVDictionary *opts = NULL;
+    AVPacket pkt;
+    int64_t deadline = INT64_MAX, late;
+    int ret;
+
+    if (!ctx)
+        return AVERROR(ENOMEM);
+    ctx->interrupt_callback = (AVIOInterruptCB){ interrupt_cb, &deadline };
+    av_dict_set_int(&opts, "prefetch_segments", 3, 0);
+    ret = avformat_open_input(&ctx, url, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+
+    deadline = av_gettime_relative() + INTERRUPT_DELAY;
+    while ((ret = av_read_frame(ctx, &pkt)) >= 0)
+        av_packet_unref(&pkt);
+    avformat_close_input(&ctx);
+    late = av_gettime_relative() - deadline;
+    if (ret != AVERROR_EXIT && ret != AVERROR_EOF)
+        return ret;
+
+    /* the stalled segment cannot be read before the interruption */
+    return late >= 0 ? late : AVERROR_BUG;
+}
+
+int main(void)
+{
+    HTTPServer server = { 0 };
+    State state;
+    char url[64];
+    int64_t stalls[2];
+    int nb_packets[2], nb_held[2], max_running[2], nb_no_cookie[2];
+    uint32_t crc[2];
+    int64_t late = 0;
+    int i, ret = 0;
+
+    avformat_network_init();
+    if (http_server_start(&server, handle_request, &state) < 0) {
+        fprintf(stderr, "Cannot start the HTTP server\n");
+        return 1;
+    }
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/index.m3u8", server.port);
+
+    for (i = 0; i < 2 && !ret; i++) {
+        pthread_mutex_lock(&server.lock);
+        memset(&state, 0, sizeof(state));
+        state.hold = i;
+        pthread_mutex_unlock(&server.lock);
+
+        ret = play(url, i ? 3 : 0, &stalls[i], &nb_packets[i], &crc[i]);
+        if (ret < 0) {
+            fprintf(stderr, "Reading %s failed: %s\n", url, av_err2str(ret));
+            break;
+        }
+        http_server_wait_idle(&server);
+        pthread_mutex_lock(&server.lock);
+        nb_held[i]      = state.nb_held;
+        max_running[i]  = state.max_running;
+        nb_no_cookie[i] = state.nb_no_cookie;
+        pthread_mutex_unlock(&server.lock);
+        fprintf(stderr, "prefetch %d: %d packets, %"PRId64" stalls, "
+                "%d parallel requests, %d segments held, %d requests without cookie\n",
+                i ? 3 : 0, nb_packets[i], stalls[i], max_running[i], nb_held[i],
+                nb_no_cookie[i]);
+    }
+
+    if (!ret) {
+        pthread_mutex_lock(&server.lock);
+        memset(&state, 0, sizeof(state));
+        state.stall = 1;
+        pthread_mutex_unlock(&server.lock);
+
+        late = play_interrupted(url);
+        pthread_mutex_lock(&server.lock);
+        state.released = 1;
+        pthread_mutex_unlock(&server.lock);
+        http_server_wait_idle(&server);
+        if (late < 0)
+            fprintf(stderr, "Reading %s with a stalled segment failed: %s\n",
+                    url, av_err2str(late));
+        else
+            fprintf(stderr, "interrupted %"PRId64" us after the interrupt\n", late);
+    }
+
+    http_server_stop(&server);
+    avformat_network_deinit();
+
+    if (ret < 0 || late < 0)
+        return 1;
+    if (late > HOLD_TIMEOUT / 2) {
+        fprintf(stderr, "The interrupt callback did not stop the demuxer\n");
+        return 1;
+    }
+    if (!nb_packets[0] || nb_packets[0] != nb_packets[1] || crc[0] != crc[1]) {
+        fprintf(stderr, "The packets differ with prefetching\n");
+        return 1;
+    }
+    if (max_running[0] != 1 || max_running[1] < 2 || nb_held[1] != NB_SEGMENTS - 1) {
+        fprintf(stderr, "The segments were not prefetched\n");
+        return 1;
+    }
+    if (nb_no_cookie[0] || nb_no_cookie[1]) {
+        fprintf(stderr, "The cookie was not sent back\n");
+        return 1;
+    }
+    /* only the waits for prefetched segments are stalls, the first
+     * segment is always waited for */
+    if (stalls[0] || stalls[1] < 1 || stalls[1] > NB_SEGMENTS) {
+        fprintf(stderr, "Wrong number of stalls\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,328 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Mux a live HLS stream of MP2 segments to a local HTTP server which delays
+ * every upload, and drops or answers with a 503 error the first attempt of
+ * some of them, with the background upload queue, over new and persistent
+ * connections. The server checks that every playlist only lists segments it
+ * already received, that the playlists arrive in order and that segments
+ * are only deleted once no playlist lists them anymore, which also means
+ * that every dropped or rejected upload was retried.
+ * Then every upload of one segment is rejected, and the muxer must report
+ * the error.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavformat/avformat.h"
+#include "libavutil/avstring.h"
+#include "libavutil/channel_layout.h"
+#include "libavutil/opt.h"
+#include "libavutil/time.h"
+
+#include "httpserver.h"
+
+#define NB_FRAMES        250  /* 6 seconds */
+#define FRAME_SIZE       192  /* MP2, 48 kHz, 64 kb/s, mono */
+#define FRAME_SAMPLES    1152
+#define UPLOAD_DELAY     30000
+#define MAX_FILES        64
+#define REJECTED_SEGMENT "index2.ts"
+
+/* protected by the server lock */
+typedef struct State {
+    char files[MAX_FILES][32];  ///< segments received and not deleted
+    int nb_files;
+    char attempts[MAX_FILES][32];
+    int nb_attempts[MAX_FILES];
+    int nb_paths;
+    char playlist[4096];        ///< last playlist received
+    int last_sequence;
+    int nb_playlists;
+    int nb_dropped;
+    int nb_rejected;
+    int nb_errors;
+    int reject_all;             ///< reject every upload of REJECTED_SEGMENT
+    int active, max_active;
+} State;
+
+static int find_file(State *s, const char *name)
+{
+    int i;
+
+    for (i = 0; i < s->nb_files; i++)
+        if (!strcmp(s->files[i], name))
+            return i;
+    return -1;
+}
+
+static int is_listed(const char *playlist, const char *name)
+{
+    const char *p = playlist;
+    int len = strlen(name);
+
+    while ((p = strstr(p, name))) {
+        if ((p == playlist || p[-1] == '\n') && p[len] == '\n')
+            return 1;
+        p += len;
+    }
+    return 0;
+}
+
+static void check_playlist(State *s, const char *body)
+{
+    const char *p = body;
+    int sequence = -1;
+
+    while (*p) {
+        int len = strcspn(p, "\n");
+        char name[32];
+
+        if (sscanf(p, "#EXT-X-MEDIA-SEQUENCE:%d", &sequence) != 1 && *p != '#' &&
+            len && len < sizeof(name)) {
+            av_strlcpy(name, p, len + 1);
+            if (find_file(s, name) < 0) {
+                fprintf(stderr, "The playlist lists %s before its upload\n", name);
+                s->nb_errors++;
+            }
+        }
+        p += len + !!p[len];
+    }
+    if (sequence < s->last_sequence) {
+        fprintf(stderr, "Playlist with sequence %d after %d\n", sequence, s->last_sequence);
+        s->nb_errors++;
+    }
+    s->last_sequence = sequence;
+    av_strlcpy(s->playlist, body, sizeof(s->playlist));
+    s->nb_playlists++;
+}
+
+enum Failure {
+    ACCEPT,
+    DROP,
+    REJECT,
+};
+
+/* The first upload of every third segment and of the second playlist is
+ * dropped, the first upload of the segments following them is answered
+ * with an error. */
+static enum Failure fail_upload(State *s, const char *name)
+{
+    int i, seg;
+
+    if (s->reject_all)
+        return strcmp(name, REJECTED_SEGMENT) ? ACCEPT : REJECT;
+    for (i = 0; i < s->nb_paths; i++)
+        if (!strcmp(s->attempts[i], name))
+            break;
+    if (i == s->nb_paths) {
+        if (i == MAX_FILES)
+            return ACCEPT;
+        av_strlcpy(s->attempts[s->nb_paths++], name, sizeof(s->attempts[i]));
+    }
+    if (strstr(name, ".m3u8"))
+        return ++s->nb_attempts[i] == 2 ? DROP : ACCEPT;
+    if (s->nb_attempts[i]++ || sscanf(name, "index%d.ts", &seg) != 1)
+        return ACCEPT;
+    return seg % 3 == 1 ? DROP : seg % 3 == 2 ? REJECT : ACCEPT;
+}
+
+static int handle_request(HTTPConnection *conn, const HTTPRequest *req)
+{
+    HTTPServer *server = conn->server;
+    State *s = server->opaque;
+    const char *method = req->method, *name = req->path + 1;
+    char body[4096] = "";
+    int keep_alive = !!av_stristr(req->headers, "Connection: keep-alive");
+    int size = 0, ret;
+    enum Failure failure;
+
+    if (av_stristr(req->headers, "Transfer-Encoding: chunked") &&
+        (size = http_server_read_chunked_body(conn, body, sizeof(body))) < 0)
+        return -1;
+
+    pthread_mutex_lock(&server->lock);
+    failure = strcmp(method, "PUT") ? ACCEPT : fail_upload(s, name);
+    s->nb_dropped  += failure == DROP;
+    s->nb_rejected += failure == REJECT;
+    s->active++;
+    s->max_active = FFMAX(s->max_active, s->active);
+    pthread_mutex_unlock(&server->lock);
+
+    if (failure == DROP) {
+        /* reset the connection, with the request unanswered */
+        struct linger l = { 1, 0 };
+        setsockopt(conn->fd, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+        pthread_mutex_lock(&server->lock);
+        s->active--;
+        pthread_mutex_unlock(&server->lock);
+        return -1;
+    }
+    av_usleep(UPLOAD_DELAY);
+
+    pthread_mutex_lock(&server->lock);
+    s->active--;
+    if (failure == REJECT) {
+        pthread_mutex_unlock(&server->lock);
+        ret = http_server_respond(conn, "503 Service Unavailable", NULL, NULL, 0);
+        return ret < 0 || !keep_alive ? -1 : 0;
+    }
+    if (!strcmp(method, "DELETE")) {
+        int i = find_file(s, name);
+        if (i < 0 || is_listed(s->playlist, name)) {
+            fprintf(stderr, "Deleting %s while it is listed or missing\n", name);
+            s->nb_errors++;
+        } else {
+            memcpy(s->files[i], s->files[--s->nb_files], sizeof(s->files[i]));
+        }
+    } else if (strstr(name, ".m3u8")) {
+        check_playlist(s, body);
+    } else if (find_file(s, name) < 0 && s->nb_files < MAX_FILES && size > 0) {
+        av_strlcpy(s->files[s->nb_files++], name, sizeof(s->files[0]));
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    ret = http_server_respond(conn, "201 Created", NULL, NULL, 0);
+    return ret < 0 || !keep_alive ? -1 : 0;
+}
+
+static int mux(const char *url, int persistent, int64_t *retries, int64_t *failures)
+{
+    AVFormatContext *ctx = NULL;
+    AVDictionary *opts = NULL;
+    AVStream *st;
+    AVPacket pkt;
+    uint8_t frame[FRAME_SIZE] = { 0xFF, 0xFD, 0x44, 0xC0 };
+    int i, ret;
+
+    ret = avformat_alloc_output_context2(&ctx, NULL, "hls", url);
+    if (ret < 0)
+        return ret;
+    if (!(st = avformat_new_stream(ctx, NULL))) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    st->time_base                = (AVRational){ 1, 48000 };
+    st->codecpar->codec_type     = AVMEDIA_TYPE_AUDIO;
+    st->codecpar->codec_id       = AV_CODEC_ID_MP2;
+    st->codecpar->sample_rate    = 48000;
+    st->codecpar->channels       = 1;
+    st->codecpar->channel_layout = AV_CH_LAYOUT_MONO;
+    st->codecpar->bit_rate       = 64000;
+
+    av_dict_set(&opts, "method", "PUT", 0);
+    av_dict_set(&opts, "hls_time", "0.5", 0);
+    av_dict_set(&opts, "hls_list_size", "3", 0);
+    av_dict_set(&opts, "hls_flags", "delete_segments", 0);
+    av_dict_set_int(&opts, "http_persistent", persistent, 0);
+    av_dict_set_int(&opts, "upload_connections", 3, 0);
+    av_dict_set_int(&opts, "upload_retries", 3, 0);
+    ret = avformat_write_header(ctx, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        goto end;
+
+    for (i = 0; i < NB_FRAMES && ret >= 0; i++) {
+        av_init_packet(&pkt);
+        pkt.data         = frame;
+        pkt.size         = sizeof(frame);
+        pkt.stream_index = 0;
+        pkt.pts = pkt.dts = av_rescale_q((int64_t)i * FRAME_SAMPLES,
+                                         (AVRational){ 1, 48000 }, st->time_base);
+        pkt.duration     = av_rescale_q(FRAME_SAMPLES, (AVRational){ 1, 48000 },
+                                        st->time_base);
+        pkt.flags        = AV_PKT_FLAG_KEY;
+        ret = av_write_frame(ctx, &pkt);
+    }
+    /* the muxer context is freed by the trailer */
+    if (ret >= 0)
+        ret = av_opt_get_int(ctx, "upload_retry_count", AV_OPT_SEARCH_CHILDREN, retries);
+    if (ret >= 0)
+        ret = av_opt_get_int(ctx, "upload_failures", AV_OPT_SEARCH_CHILDREN, failures);
+    if (ret >= 0)
+        ret = av_write_trailer(ctx);
+
+end:
+    avformat_free_context(ctx);
+    return ret;
+}
+
+int main(void)
+{
+    HTTPServer server = { 0 };
+    State state = { 0 };
+    char url[64];
+    int64_t retries = 0, failures = 0;
+    int persistent, ret = 0;
+
+    avformat_network_init();
+    if (http_server_start(&server, handle_request, &state) < 0) {
+        fprintf(stderr, "Cannot start the HTTP server\n");
+        return 1;
+    }
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/index.m3u8", server.port);
+
+    for (persistent = 0; persistent < 2 && !ret; persistent++) {
+        pthread_mutex_lock(&server.lock);
+        state.nb_files = state.nb_paths = state.nb_playlists = 0;
+        state.nb_dropped = state.nb_rejected = 0;
+        state.max_active = state.last_sequence = 0;
+        memset(state.nb_attempts, 0, sizeof(state.nb_attempts));
+        state.playlist[0] = 0;
+        pthread_mutex_unlock(&server.lock);
+
+        ret = mux(url, persistent, &retries, &failures);
+        if (ret < 0) {
+            fprintf(stderr, "Muxing to %s failed: %s\n", url, av_err2str(ret));
+            break;
+        }
+
+        http_server_wait_idle(&server);
+        pthread_mutex_lock(&server.lock);
+        fprintf(stderr, "persistent %d: %d playlists, %d dropped, %d rejected, "
+                "%"PRId64" retries, %d parallel uploads\n", persistent,
+                state.nb_playlists, state.nb_dropped, state.nb_rejected,
+                retries, state.max_active);
+        if (state.nb_errors || failures || state.nb_playlists < 10 ||
+            !retries ||
+            state.nb_dropped < 3 || state.nb_rejected < 3 ||
+            state.max_active < 2 || !is_listed(state.playlist, "#EXT-X-ENDLIST"))
+            ret = 1;
+        pthread_mutex_unlock(&server.lock);
+    }
+
+    if (!ret) {
+        pthread_mutex_lock(&server.lock);
+        state.reject_all = 1;
+        pthread_mutex_unlock(&server.lock);
+
+        ret = mux(url, 1, &retries, &failures);
+        http_server_wait_idle(&server);
+        fprintf(stderr, "rejected %s: %s\n", REJECTED_SEGMENT, av_err2str(ret));
+        ret = ret >= 0;
+        if (ret)
+            fprintf(stderr, "The failed upload was not reported\n");
+    }
+
+    http_server_stop(&server);
+    avformat_network_deinit();
+
+    return !!ret;
+}
@@ -0,0 +1,334 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Minimal HTTP/1.1 server on the loopback interface for the network tests,
+ * with one thread per connection. The requests are passed to a callback of
+ * the test, which answers them with the helpers below. The counters of the
+ * server, like the test's own state, are protected by its lock.
+ */
+
+#ifndef AVFORMAT_TESTS_HTTPSERVER_H
+#define AVFORMAT_TESTS_HTTPSERVER_H
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavformat/network.h"
+#include "libavutil/attributes.h"
+#include "libavutil/avstring.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define HTTP_SERVER_MAX_CONNECTIONS 256
+
+typedef struct HTTPServer HTTPServer;
+
+typedef struct HTTPConnection {
+    HTTPServer *server;
+    int fd;
+    char buf[65536];
+    int len;
+} HTTPConnection;
+
+typedef struct HTTPRequest {
+    char method[16];
+    char path[256];
+    char headers[4096];         ///< header lines, each ending with CRLF
+} HTTPRequest;
+
+/**
+ * Answer a request, called from the connection threads.
+ *
+ * @return 0 to wait for the next request on the connection, <0 to close it
+ */
+typedef int (*http_server_handler)(HTTPConnection *conn, const HTTPRequest *req);
+
+struct HTTPServer {
+    int fd;
+    int port;
+    http_server_handler handler;
+    void *opaque;
+    atomic_int stop;
+    pthread_t thread;
+    pthread_t connections[HTTP_SERVER_MAX_CONNECTIONS];
+
+    pthread_mutex_t lock;
+    int nb_connections;         ///< connections accepted
+    int nb_requests;            ///< requests received
+    int active;                 ///< connections not closed yet
+};
+
+static av_unused int http_server_send(HTTPConnection *conn, const void *data, int size)
+{
+    const uint8_t *buf = data;
+
+    while (size > 0) {
+        int ret = send(conn->fd, buf, size, MSG_NOSIGNAL);
+        if (ret <= 0)
+            return -1;
+        buf  += ret;
+        size -= ret;
+    }
+    return 0;
+}
+
+/**
+ * Send a response with a body, extra_headers may be NULL.
+ */
+static av_unused int http_server_respond(HTTPConnection *conn, const char *status,
+                                         const char *extra_headers,
+                                         const void *body, int size)
+{
+    char header[512];
+
+    snprintf(header, sizeof(header), "HTTP/1.1 %s\r\n%sContent-Length: %d\r\n\r\n",
+             status, extra_headers ? extra_headers : "", size);
+    if (http_server_send(conn, header, strlen(header)) < 0)
+        return -1;
+    return http_server_send(conn, body, size);
+}
+
+/* wait for more data, giving up when the server stops */
+static int http_server_fill(HTTPConnection *conn)
+{
+    while (!atomic_load(&conn->server->stop)) {
+        struct pollfd p = { conn->fd, POLLIN, 0 };
+        int ret = poll(&p, 1, 100);
+
+        if (!ret)
+            continue;
+        if (ret < 0 || conn->len == sizeof(conn->buf) - 1)
+            return -1;
+        ret = recv(conn->fd, conn->buf + conn->len, sizeof(conn->buf) - 1 - conn->len, 0);
+        if (ret <= 0)
+            return -1;
+        conn->len += ret;
+        conn->buf[conn->len] = 0;
+        return 0;
+    }
+    return -1;
+}
+
+static void http_server_consume(HTTPConnection *conn, int size)
+{
+    conn->len -= size;
+    memmove(conn->buf, conn->buf + size, conn->len + 1);
+}
+
+/* read a line without its CRLF, it must be shorter than size */
+static int http_server_read_line(HTTPConnection *conn, char *line, int size)
+{
+    char *end;
+
+    while (!(end = strstr(conn->buf, "\r\n")))
+        if (http_server_fill(conn) < 0)
+            return -1;
+    if (end - conn->buf >= size)
+        return -1;
+    av_strlcpy(line, conn->buf, end - conn->buf + 1);
+    http_server_consume(conn, end + 2 - conn->buf);
+    return 0;
+}
+
+/**
+ * Read a chunked request body. Only the start of the bodies larger than
+ * size is kept.
+ *
+ * @return the size of the whole body, or <0 on error
+ */
+static av_unused int http_server_read_chunked_body(HTTPConnection *conn,
+                                                   char *body, int size)
+{
+    char line[64];
+    int len = 0, chunk;
+
+    for (;;) {
+        if (http_server_read_line(conn, line, sizeof(line)) < 0 ||
+            sscanf(line, "%x", &chunk) != 1 || chunk < 0)
+            return -1;
+        if (!chunk)
+            return http_server_read_line(conn, line, sizeof(line)) < 0 ? -1 : len;
+        while (conn->len < chunk + 2)
+            if (http_server_fill(conn) < 0)
+                return -1;
+        if (len + chunk < size) {
+            memcpy(body + len, conn->buf, chunk);
+            body[len + chunk] = 0;
+        }
+        len += chunk;
+        http_server_consume(conn, chunk + 2);
+    }
+}
+
+static int http_server_read_request(HTTPConnection *conn, HTTPRequest *req)
+{
+    char line[1024];
+    int len = 0;
+
+    if (http_server_read_line(conn, line, sizeof(line)) < 0 ||
+        sscanf(line, "%15s %255s", req->method, req->path) != 2)
+        return -1;
+    req->headers[0] = 0;
+    while (http_server_read_line(conn, line, sizeof(line)) >= 0) {
+        if (!*line)
+            return 0;
+        len += snprintf(req->headers + len, sizeof(req->headers) - len, "%s\r\n", line);
+        if (len >= sizeof(req->headers))
+            return -1;
+    }
+    return -1;
+}
+
+static void *http_server_connection_thread(void *arg)
+{
+    HTTPConnection *conn = arg;
+    HTTPServer *s = conn->server;
+    HTTPRequest req;
+
+    while (http_server_read_request(conn, &req) >= 0) {
+        pthread_mutex_lock(&s->lock);
+        s->nb_requests++;
+        pthread_mutex_unlock(&s->lock);
+        if (s->handler(conn, &req) < 0)
+            break;
+    }
+    closesocket(conn->fd);
+    av_free(conn);
+
+    pthread_mutex_lock(&s->lock);
+    s->active--;
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+static void *http_server_thread(void *arg)
+{
+    HTTPServer *s = arg;
+
+    while (!atomic_load(&s->stop)) {
+        struct pollfd p = { s->fd, POLLIN, 0 };
+        HTTPConnection *conn;
+        int fd;
+
+        if (poll(&p, 1, 100) <= 0)
+            continue;
+        /* accepting and counting a connection is atomic for
+         * http_server_wait_idle() */
+        pthread_mutex_lock(&s->lock);
+        if (s->nb_connections == HTTP_SERVER_MAX_CONNECTIONS) {
+            pthread_mutex_unlock(&s->lock);
+            break;
+        }
+        fd = accept(s->fd, NULL, NULL);
+        if (fd < 0) {
+            pthread_mutex_unlock(&s->lock);
+            continue;
+        }
+        conn = av_mallocz(sizeof(*conn));
+        if (!conn) {
+            pthread_mutex_unlock(&s->lock);
+            closesocket(fd);
+            continue;
+        }
+        conn->server = s;
+        conn->fd     = fd;
+        if (pthread_create(&s->connections[s->nb_connections], NULL,
+                           http_server_connection_thread, conn)) {
+            pthread_mutex_unlock(&s->lock);
+            av_free(conn);
+            closesocket(fd);
+            continue;
+        }
+        s->nb_connections++;
+        s->active++;
+        pthread_mutex_unlock(&s->lock);
+    }
+    return NULL;
+}
+
+static int http_server_start(HTTPServer *s, http_server_handler handler, void *opaque)
+{
+    struct sockaddr_in addr = { 0 };
+    socklen_t addrlen = sizeof(addr);
+
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = 0;
+
+    s->handler = handler;
+    s->opaque  = opaque;
+    s->fd = ff_socket(AF_INET, SOCK_STREAM, 0);
+    if (s->fd < 0)
+        return -1;
+    if (bind(s->fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        listen(s->fd, 16) ||
+        getsockname(s->fd, (struct sockaddr *)&addr, &addrlen)) {
+        closesocket(s->fd);
+        return -1;
+    }
+    s->port = ntohs(addr.sin_port);
+    atomic_init(&s->stop, 0);
+    pthread_mutex_init(&s->lock, NULL);
+    if (pthread_create(&s->thread, NULL, http_server_thread, s)) {
+        pthread_mutex_destroy(&s->lock);
+        closesocket(s->fd);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Wait until every connection opened to the server so far was accepted and
+ * closed, which makes the counters of the server and of the test final once
+ * the client closed its connections.
+ */
+static av_unused void http_server_wait_idle(HTTPServer *s)
+{
+    for (;;) {
+        struct pollfd p = { s->fd, POLLIN, 0 };
+        int idle;
+
+        pthread_mutex_lock(&s->lock);
+        idle = !s->active && !poll(&p, 1, 0);
+        pthread_mutex_unlock(&s->lock);
+        if (idle)
+            return;
+        av_usleep(10000);
+    }
+}
+
+static void http_server_stop(HTTPServer *s)
+{
+    int i;
+
+    atomic_store(&s->stop, 1);
+    pthread_join(s->thread, NULL);
+    for (i = 0; i < s->nb_connections; i++)
+        pthread_join(s->connections[i], NULL);
+    pthread_mutex_destroy(&s->lock);
+    closesocket(s->fd);
+}
+
+#endif /* AVFORMAT_TESTS_HTTPSERVER_H */
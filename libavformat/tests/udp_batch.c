@@ -0,0 +1,187 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Send MPEG-TS sized datagrams over the loopback interface through the
+ * paced sender thread, or directly without pacing, and receive them through
+ * the receiver thread, all batching several datagrams per system call. The
+ * datagrams must arrive in order and intact, and the paced stream must not
+ * be faster than its bitrate, also when the sender catches up in bursts.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavformat/avformat.h"
+#include "libavformat/url.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#define NB_PACKETS   2000
+#define PACKET_SIZE  1316
+
+typedef struct Receiver {
+    URLContext *uc;
+    pthread_t thread;
+    int nb_packets;
+    int64_t first, last;
+    int ret;
+} Receiver;
+
+static void fill(uint8_t *buf, int seq)
+{
+    int i;
+
+    AV_WB32(buf, seq);
+    for (i = 4; i < PACKET_SIZE; i++)
+        buf[i] = seq * 7 + i;
+}
+
+static void *receiver(void *arg)
+{
+    Receiver *r = arg;
+    uint8_t buf[PACKET_SIZE + 1], ref[PACKET_SIZE];
+    int prev = -1;
+
+    for (;;) {
+        int ret = ffurl_read(r->uc, buf, sizeof(buf));
+        int seq;
+
+        /* the timeout ends the stream if the last datagrams were lost */
+        if (ret == AVERROR(EIO))
+            break;
+        if (ret < 0) {
+            r->ret = ret;
+            break;
+        }
+        seq = AV_RB32(buf);
+        fill(ref, seq);
+        if (ret != PACKET_SIZE || seq <= prev || seq >= NB_PACKETS ||
+            memcmp(buf, ref, PACKET_SIZE)) {
+            fprintf(stderr, "Wrong datagram %d after %d, %d bytes\n", seq, prev, ret);
+            r->ret = AVERROR_INVALIDDATA;
+            break;
+        }
+        r->last = av_gettime_relative();
+        if (!r->nb_packets++)
+            r->first = r->last;
+        prev = seq;
+        if (seq == NB_PACKETS - 1)
+            break;
+    }
+    return NULL;
+}
+
+static int run(int64_t bitrate, int burst_bits, Receiver *r)
+{
+    URLContext *out = NULL;
+    AVDictionary *opts = NULL;
+    uint8_t buf[PACKET_SIZE];
+    char url[128];
+    int i, ret, err;
+
+    memset(r, 0, sizeof(*r));
+    av_dict_set_int(&opts, "fifo_size", NB_PACKETS * 8, 0);
+    av_dict_set_int(&opts, "buffer_size", 1 << 22, 0);
+    av_dict_set_int(&opts, "timeout", 1000000, 0);
+    av_dict_set_int(&opts, "batch", 32, 0);
+    ret = ffurl_open_whitelist(&r->uc, "udp://127.0.0.1:0", AVIO_FLAG_READ,
+                               NULL, &opts, NULL, NULL, NULL);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+
+    snprintf(url, sizeof(url), "udp://127.0.0.1:%d?pkt_size=%d",
+             ff_udp_get_local_port(r->uc), PACKET_SIZE);
+    if (bitrate) {
+        av_dict_set_int(&opts, "bitrate", bitrate, 0);
+        av_dict_set_int(&opts, "burst_bits", burst_bits, 0);
+    }
+    av_dict_set_int(&opts, "fifo_size", NB_PACKETS * 8, 0);
+    av_dict_set_int(&opts, "batch", 32, 0);
+    ret = ffurl_open_whitelist(&out, url, AVIO_FLAG_WRITE,
+                               NULL, &opts, NULL, NULL, NULL);
+    av_dict_free(&opts);
+    if (ret < 0)
+        goto end;
+
+    if (pthread_create(&r->thread, NULL, receiver, r)) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    for (i = 0; i < NB_PACKETS && ret >= 0; i++) {
+        fill(buf, i);
+        ret = ffurl_write(out, buf, PACKET_SIZE);
+    }
+    /* sends the queued datagrams, with the sender thread */
+    err = ffurl_closep(&out);
+    pthread_join(r->thread, NULL);
+    if (ret >= 0)
+        ret = err;
+    if (ret >= 0)
+        ret = r->ret;
+
+end:
+    ffurl_closep(&out);
+    ffurl_closep(&r->uc);
+    return ret;
+}
+
+int main(void)
+{
+    static const struct {
+        int64_t bitrate;
+        int burst_bits;
+    } tests[] = {
+        { 100000000, 0 },
+        { 200000000, PACKET_SIZE * 8 * 16 },
+        { 0 },
+    };
+    Receiver r;
+    int i;
+
+    avformat_network_init();
+    for (i = 0; i < FF_ARRAY_ELEMS(tests); i++) {
+        int64_t duration;
+        int ret = run(tests[i].bitrate, tests[i].burst_bits, &r);
+
+        if (ret < 0) {
+            fprintf(stderr, "%"PRId64" b/s: %s\n", tests[i].bitrate, av_err2str(ret));
+            return 1;
+        }
+        /* loopback may drop a few datagrams on a loaded machine */
+        if (r.nb_packets < NB_PACKETS * 95 / 100) {
+            fprintf(stderr, "%"PRId64" b/s: only %d datagrams received\n",
+                    tests[i].bitrate, r.nb_packets);
+            return 1;
+        }
+        if (!tests[i].bitrate)
+            continue;
+        duration = (int64_t)NB_PACKETS * PACKET_SIZE * 8 * 1000000 / tests[i].bitrate;
+        /* the first datagrams may be sent as one burst */
+        if (r.last - r.first < duration * 9 / 10 - (int64_t)tests[i].burst_bits * 1000000 / tests[i].bitrate) {
+            fprintf(stderr, "%"PRId64" b/s: received in %"PRId64" us instead of %"PRId64"\n",
+                    tests[i].bitrate, r.last - r.first, duration);
+            return 1;
+        }
+    }
+    avformat_network_deinit();
+
+    return 0;
+}
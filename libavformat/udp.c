@@ -26,6 +26,7 @@
 
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE     /* Needed for using struct ip_mreq with recent glibc */
+#define _GNU_SOURCE     /* Needed for recvmmsg() and sendmmsg() */
 
 #include "avformat.h"
 #include "avio_internal.h"
@@ -80,6 +81,19 @@
 #define UDP_MAX_PKT_SIZE 65536
 #define UDP_HEADER_SIZE 8
 
+#if HAVE_SENDMMSG && defined(__linux__)
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#define UDP_MAX_SEGMENTS 64
+#define UDP_MAX_GSO_SIZE (UDP_MAX_PKT_SIZE - 64)
+
+typedef union UDPSegmentControl {
+    char buf[CMSG_SPACE(sizeof(uint16_t))];
+    struct cmsghdr align;
+} UDPSegmentControl;
+#endif
+
 typedef struct UDPContext {
     const AVClass *class;
     int udp_fd;
@@ -117,6 +131,21 @@ typedef struct UDPContext {
     char *sources;
     char *block;
     IPSourceFilters filters;
+
+    /* datagrams received or sent per system call */
+    int batch;
+    int gso;
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+    struct sockaddr_storage *msg_addrs;
+    uint8_t *msg_buf;
+    int nb_msgs;
+    int nb_queued;              ///< datagrams written without the sending thread, not sent yet
+#endif
+#ifdef UDP_MAX_SEGMENTS
+    UDPSegmentControl *cmsgs;
+#endif
 } UDPContext;
 
 #define OFFSET(x) offsetof(UDPContext, x)
@@ -141,6 +170,8 @@ static const AVOption options[] = {
     { "timeout",        "set raise error timeout, in microseconds (only in read mode)",OFFSET(timeout),         AV_OPT_TYPE_INT,  {.i64 = 0}, 0, INT_MAX, D },
     { "sources",        "Source list",                                     OFFSET(sources),        AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
     { "block",          "Block list",                                      OFFSET(block),          AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
+    { "batch",          "Maximum number of datagrams per system call (-1 for 16 in the circular buffer threads, none otherwise)", OFFSET(batch), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 1024, D|E },
+    { "gso",            "Let the kernel split the datagrams sent in a batch, if supported", OFFSET(gso), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, E },
     { NULL }
 };
 
@@ -459,6 +490,176 @@ static int udp_get_file_handle(URLContext *h)
     return s->udp_fd;
 }
 
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+static void udp_batch_free(UDPContext *s)
+{
+    av_freep(&s->msgs);
+    av_freep(&s->iovs);
+    av_freep(&s->msg_addrs);
+    av_freep(&s->msg_buf);
+#ifdef UDP_MAX_SEGMENTS
+    av_freep(&s->cmsgs);
+#endif
+    s->nb_msgs = 0;
+}
+
+static int udp_batch_init(UDPContext *s, int is_output, int default_batch)
+{
+    int i;
+
+    if (s->batch < 0)
+        s->batch = default_batch;
+    if (s->batch <= 1 || (is_output ? !HAVE_SENDMMSG : !HAVE_RECVMMSG))
+        return 0;
+
+    s->msgs    = av_mallocz_array(s->batch, sizeof(*s->msgs));
+    s->iovs    = av_mallocz_array(s->batch, sizeof(*s->iovs));
+    s->msg_buf = av_malloc_array(s->batch, UDP_MAX_PKT_SIZE);
+    if (!is_output)
+        s->msg_addrs = av_mallocz_array(s->batch, sizeof(*s->msg_addrs));
+#ifdef UDP_MAX_SEGMENTS
+    else
+        s->cmsgs = av_mallocz_array(s->batch, sizeof(*s->cmsgs));
+#endif
+    if (!s->msgs || !s->iovs || !s->msg_buf || (!is_output && !s->msg_addrs)
+#ifdef UDP_MAX_SEGMENTS
+        || (is_output && !s->cmsgs)
+#endif
+        ) {
+        udp_batch_free(s);
+        return AVERROR(ENOMEM);
+    }
+
+    if (!is_output) {
+        for (i = 0; i < s->batch; i++) {
+            s->iovs[i].iov_base = s->msg_buf + i * UDP_MAX_PKT_SIZE;
+            s->iovs[i].iov_len  = UDP_MAX_PKT_SIZE;
+            s->msgs[i].msg_hdr.msg_iov    = &s->iovs[i];
+            s->msgs[i].msg_hdr.msg_iovlen = 1;
+            s->msgs[i].msg_hdr.msg_name   = &s->msg_addrs[i];
+        }
+    }
+    s->nb_msgs = s->batch;
+    return 0;
+}
+#endif
+
+#if HAVE_PTHREAD_CANCEL || HAVE_SENDMMSG
+static int udp_send_packet(UDPContext *s, const uint8_t *p, int len)
+{
+    while (len) {
+        int ret;
+        av_assert0(len > 0);
+        if (!s->is_connected) {
+            ret = sendto (s->udp_fd, p, len, 0,
+                        (struct sockaddr *) &s->dest_addr,
+                        s->dest_addr_len);
+        } else
+            ret = send(s->udp_fd, p, len, 0);
+        if (ret >= 0) {
+            len -= ret;
+            p   += ret;
+        } else {
+            ret = ff_neterrno();
+            if (ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR))
+                return ret;
+        }
+    }
+    return 0;
+}
+
+#if HAVE_SENDMMSG
+/**
+ * Send the nb datagrams described by s->iovs with as few system calls as
+ * possible. With GSO, runs of datagrams of the same size, the last one
+ * possibly shorter, are passed as a single message split by the kernel.
+ */
+static int udp_send_batch(URLContext *h, int nb)
+{
+    UDPContext *s = h->priv_data;
+    int first = 0;
+
+    while (first < nb) {
+        int i = first, nb_msgs = 0, segmented = 0, ret;
+
+        while (i < nb) {
+            struct msghdr *m = &s->msgs[nb_msgs].msg_hdr;
+            int n = 1;
+#ifdef UDP_MAX_SEGMENTS
+            int size = s->iovs[i].iov_len, total = size;
+
+            while (s->gso && i + n < nb && n < UDP_MAX_SEGMENTS &&
+                   s->iovs[i + n - 1].iov_len == size &&
+                   s->iovs[i + n].iov_len <= size &&
+                   total + s->iovs[i + n].iov_len <= UDP_MAX_GSO_SIZE)
+                total += s->iovs[i + n++].iov_len;
+#endif
+
+            memset(m, 0, sizeof(*m));
+            m->msg_iov    = &s->iovs[i];
+            m->msg_iovlen = n;
+            if (!s->is_connected) {
+                m->msg_name    = &s->dest_addr;
+                m->msg_namelen = s->dest_addr_len;
+            }
+#ifdef UDP_MAX_SEGMENTS
+            if (n > 1) {
+                struct cmsghdr *cm;
+                uint16_t segment_size = size;
+
+                m->msg_control    = s->cmsgs[nb_msgs].buf;
+                m->msg_controllen = sizeof(s->cmsgs[nb_msgs].buf);
+                cm = CMSG_FIRSTHDR(m);
+                cm->cmsg_level = IPPROTO_UDP;
+                cm->cmsg_type  = UDP_SEGMENT;
+                cm->cmsg_len   = CMSG_LEN(sizeof(segment_size));
+                memcpy(CMSG_DATA(cm), &segment_size, sizeof(segment_size));
+                segmented = 1;
+            }
+#endif
+            nb_msgs++;
+            i += n;
+        }
+
+        ret = sendmmsg(s->udp_fd, s->msgs, nb_msgs, 0);
+        if (ret < 0) {
+            ret = ff_neterrno();
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR(EINTR))
+                continue;
+            if (segmented && (ret == AVERROR(EIO) || ret == AVERROR(EINVAL) ||
+                              ret == AVERROR(ENOPROTOOPT))) {
+                av_log(h, AV_LOG_VERBOSE, "UDP segmentation offload unavailable\n");
+                s->gso = 0;
+                continue;
+            }
+            if (ret == AVERROR(ENOSYS)) {
+                for (; first < nb; first++) {
+                    ret = udp_send_packet(s, s->iovs[first].iov_base, s->iovs[first].iov_len);
+                    if (ret < 0)
+                        return ret;
+                }
+                return 0;
+            }
+            return ret;
+        }
+        for (i = 0; i < ret; i++)
+            first += s->msgs[i].msg_hdr.msg_iovlen;
+    }
+    return 0;
+}
+
+/* send the datagrams queued by udp_write() */
+static int udp_send_queue(URLContext *h)
+{
+    UDPContext *s = h->priv_data;
+    int nb = s->nb_queued;
+
+    s->nb_queued = 0;
+    return nb ? udp_send_batch(h, nb) : 0;
+}
+#endif
+#endif
+
 #if HAVE_PTHREAD_CANCEL
 static void *circular_buffer_task_rx( void *_URLContext)
 {
@@ -474,7 +675,7 @@ static void *circular_buffer_task_rx( void *_URLContext)
         goto end;
     }
     while(1) {
-        int len;
+        int len, i, nb = 1;
         struct sockaddr_storage addr;
         socklen_t addr_len = sizeof(addr);
 
@@ -483,35 +684,61 @@ static void *circular_buffer_task_rx( void *_URLContext)
            see "General Information" / "Thread Cancelation Overview"
            in Single Unix. */
         pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_cancelstate);
+#if HAVE_RECVMMSG
+        if (s->nb_msgs) {
+            for (i = 0; i < s->nb_msgs; i++)
+                s->msgs[i].msg_hdr.msg_namelen = sizeof(*s->msg_addrs);
+            len = nb = recvmmsg(s->udp_fd, s->msgs, s->nb_msgs, MSG_WAITFORONE, NULL);
+        } else
+#endif
         len = recvfrom(s->udp_fd, s->tmp+4, sizeof(s->tmp)-4, 0, (struct sockaddr *)&addr, &addr_len);
         pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancelstate);
         pthread_mutex_lock(&s->mutex);
         if (len < 0) {
+#if HAVE_RECVMMSG
+            if (s->nb_msgs && ff_neterrno() == AVERROR(ENOSYS)) {
+                s->nb_msgs = 0;
+                continue;
+            }
+#endif
             if (ff_neterrno() != AVERROR(EAGAIN) && ff_neterrno() != AVERROR(EINTR)) {
                 s->circular_buffer_error = ff_neterrno();
                 goto end;
             }
             continue;
         }
-        if (ff_ip_check_source_lists(&addr, &s->filters))
-            continue;
-        AV_WL32(s->tmp, len);
 
-        if(av_fifo_space(s->fifo) < len + 4) {
-            /* No Space left */
-            if (s->overrun_nonfatal) {
-                av_log(h, AV_LOG_WARNING, "Circular buffer overrun. "
-                        "Surviving due to overrun_nonfatal option\n");
+        for (i = 0; i < nb; i++) {
+            struct sockaddr_storage *from = &addr;
+            uint8_t *buf = s->tmp + 4, size[4];
+#if HAVE_RECVMMSG
+            if (s->nb_msgs) {
+                from = &s->msg_addrs[i];
+                buf  = s->iovs[i].iov_base;
+                len  = s->msgs[i].msg_len;
+            }
+#endif
+            if (ff_ip_check_source_lists(from, &s->filters))
                 continue;
-            } else {
-                av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
-                        "To avoid, increase fifo_size URL option. "
-                        "To survive in such case, use overrun_nonfatal option\n");
-                s->circular_buffer_error = AVERROR(EIO);
-                goto end;
+
+            if(av_fifo_space(s->fifo) < len + 4) {
+                /* No Space left */
+                if (s->overrun_nonfatal) {
+                    av_log(h, AV_LOG_WARNING, "Circular buffer overrun. "
+                            "Surviving due to overrun_nonfatal option\n");
+                    continue;
+                } else {
+                    av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
+                            "To avoid, increase fifo_size URL option. "
+                            "To survive in such case, use overrun_nonfatal option\n");
+                    s->circular_buffer_error = AVERROR(EIO);
+                    goto end;
+                }
             }
+            AV_WL32(size, len);
+            av_fifo_generic_write(s->fifo, size, 4, NULL);
+            av_fifo_generic_write(s->fifo, buf, len, NULL);
         }
-        av_fifo_generic_write(s->fifo, s->tmp, len+4, NULL);
         pthread_cond_signal(&s->cond);
     }
 
@@ -540,8 +767,7 @@ static void *circular_buffer_task_tx( void *_URLContext)
     }
 
     for(;;) {
-        int len;
-        const uint8_t *p;
+        int len, ret;
         uint8_t tmp[4];
         int64_t timestamp;
 
@@ -586,28 +812,49 @@ static void *circular_buffer_task_tx( void *_URLContext)
             target_timestamp = start_timestamp + sent_bits * 1000000 / s->bitrate;
         }
 
-        p = s->tmp;
-        while (len) {
-            int ret;
-            av_assert0(len > 0);
-            if (!s->is_connected) {
-                ret = sendto (s->udp_fd, p, len, 0,
-                            (struct sockaddr *) &s->dest_addr,
-                            s->dest_addr_len);
-            } else
-                ret = send(s->udp_fd, p, len, 0);
-            if (ret >= 0) {
-                len -= ret;
-                p   += ret;
-            } else {
-                ret = ff_neterrno();
-                if (ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR)) {
-                    pthread_mutex_lock(&s->mutex);
-                    s->circular_buffer_error = ret;
-                    pthread_mutex_unlock(&s->mutex);
-                    return NULL;
+#if HAVE_SENDMMSG
+        if (s->nb_msgs) {
+            int nb = 1;
+
+            s->iovs[0].iov_base = s->tmp;
+            s->iovs[0].iov_len  = len;
+
+            /* append the following packets which are already due */
+            pthread_mutex_lock(&s->mutex);
+            while (nb < s->nb_msgs && av_fifo_size(s->fifo) >= 4) {
+                uint8_t *buf = s->msg_buf + nb * UDP_MAX_PKT_SIZE;
+
+                timestamp = av_gettime_relative();
+                if (timestamp < target_timestamp)
+                    break;
+                if (timestamp - burst_interval > target_timestamp) {
+                    start_timestamp = timestamp - burst_interval;
+                    sent_bits = 0;
                 }
+
+                av_fifo_generic_read(s->fifo, tmp, 4, NULL);
+                len = AV_RL32(tmp);
+                av_assert0(len >= 0 && len <= UDP_MAX_PKT_SIZE);
+                av_fifo_generic_read(s->fifo, buf, len, NULL);
+
+                sent_bits += len * 8;
+                target_timestamp = start_timestamp + sent_bits * 1000000 / s->bitrate;
+
+                s->iovs[nb].iov_base = buf;
+                s->iovs[nb].iov_len  = len;
+                nb++;
             }
+            pthread_mutex_unlock(&s->mutex);
+
+            ret = udp_send_batch(h, nb);
+        } else
+#endif
+        ret = udp_send_packet(s, s->tmp, len);
+        if (ret < 0) {
+            pthread_mutex_lock(&s->mutex);
+            s->circular_buffer_error = ret;
+            pthread_mutex_unlock(&s->mutex);
+            return NULL;
         }
 
         pthread_mutex_lock(&s->mutex);
@@ -907,6 +1154,11 @@ static int udp_open(URLContext *h, const char *uri, int flags)
             ret = AVERROR(ENOMEM);
             goto fail;
         }
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+        ret = udp_batch_init(s, is_output, 16);
+        if (ret < 0)
+            goto fail;
+#endif
         ret = pthread_mutex_init(&s->mutex, NULL);
         if (ret != 0) {
             av_log(h, AV_LOG_ERROR, "pthread_mutex_init failed : %s\n", strerror(ret));
@@ -928,6 +1180,15 @@ static int udp_open(URLContext *h, const char *uri, int flags)
         s->thread_started = 1;
     }
 #endif
+#if HAVE_SENDMMSG
+    /* without the sending thread, the datagrams are only batched on request,
+     * as they are held until enough of them are written */
+    if (is_output && !s->fifo && !(flags & AVIO_FLAG_NONBLOCK)) {
+        ret = udp_batch_init(s, is_output, 1);
+        if (ret < 0)
+            goto fail;
+    }
+#endif
 
     return 0;
 #if HAVE_PTHREAD_CANCEL
@@ -940,6 +1201,9 @@ static int udp_open(URLContext *h, const char *uri, int flags)
     if (udp_fd >= 0)
         closesocket(udp_fd);
     av_fifo_freep(&s->fifo);
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+    udp_batch_free(s);
+#endif
     ff_ip_reset_filters(&s->filters);
     return ret;
 }
@@ -1051,6 +1315,23 @@ static int udp_write(URLContext *h, const uint8_t *buf, int size)
         pthread_mutex_unlock(&s->mutex);
         return size;
     }
+#endif
+#if HAVE_SENDMMSG
+    if (s->nb_msgs && size <= UDP_MAX_PKT_SIZE) {
+        uint8_t *dst = s->msg_buf + s->nb_queued * UDP_MAX_PKT_SIZE;
+
+        memcpy(dst, buf, size);
+        s->iovs[s->nb_queued].iov_base = dst;
+        s->iovs[s->nb_queued].iov_len  = size;
+        /* a datagram shorter than the packet size ends a flush of the
+         * AVIOContext, which must not wait for more data */
+        if (++s->nb_queued == s->nb_msgs || size < h->max_packet_size) {
+            ret = udp_send_queue(h);
+            if (ret < 0)
+                return ret;
+        }
+        return size;
+    }
 #endif
     if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
         ret = ff_network_wait_fd(s->udp_fd, 1);
@@ -1071,6 +1352,12 @@ static int udp_write(URLContext *h, const uint8_t *buf, int size)
 static int udp_close(URLContext *h)
 {
     UDPContext *s = h->priv_data;
+    int err = 0;
+
+#if HAVE_SENDMMSG
+    if (s->nb_queued)
+        err = udp_send_queue(h);
+#endif
 
 #if HAVE_PTHREAD_CANCEL
     // Request close once writing is finished
@@ -1108,8 +1395,11 @@ static int udp_close(URLContext *h)
 #endif
     closesocket(s->udp_fd);
     av_fifo_freep(&s->fifo);
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+    udp_batch_free(s);
+#endif
     ff_ip_reset_filters(&s->filters);
-    return 0;
+    return err;
 }
 
 const URLProtocol ff_udp_protocol = {
@@ -0,0 +1,517 @@
+/*
+ * Background upload queue for the segmenting muxers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "config.h"
+
+#include "libavutil/avstring.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "avio_internal.h"
+#include "internal.h"
+#if CONFIG_HTTP_PROTOCOL
+#include "http.h"
+#endif
+#include "uploadqueue.h"
+#include "url.h"
+
+#define MAX_CONNECTIONS     16
+#define RETRY_DELAY         100000
+#define MAX_RETRY_DELAY     5000000
+
+#if HAVE_THREADS
+
+struct upload {
+    char *url;
+    uint8_t *data;
+    int size;
+    int flags;
+    int delete;
+    int active;             ///< taken by a thread
+    int64_t submitted;
+};
+
+struct buffer {
+    AVIOContext *pb;
+    char *url;
+    int flags;
+};
+
+struct FFUploadQueue {
+    AVFormatContext *s;
+    AVDictionary *opts;
+    int max_queued;
+    int max_retries;
+    int persistent;
+
+    /* buffers opened by the muxer, only used by the muxer thread */
+    struct buffer *buffers;
+    int nb_buffers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t threads[MAX_CONNECTIONS];
+    int nb_threads;
+    int abort;
+
+    /* uploads queued or in progress, in submission order */
+    struct upload **uploads;
+    int nb_uploads;
+    int error;
+    FFUploadStats stats;
+    int64_t total_latency;
+};
+
+static void upload_free(struct upload **u)
+{
+    if (!*u)
+        return;
+    av_freep(&(*u)->url);
+    av_freep(&(*u)->data);
+    av_freep(u);
+}
+
+/* must be called with lock held */
+static struct upload *next_upload(FFUploadQueue *q)
+{
+    int i, j;
+
+    for (i = 0; i < q->nb_uploads; i++) {
+        struct upload *u = q->uploads[i];
+
+        if (u->active)
+            continue;
+        /* the earlier uploads are the ones not finished yet */
+        if (u->flags & FF_UPLOAD_ORDERED && i > 0)
+            continue;
+        for (j = 0; j < i; j++)
+            if (!strcmp(q->uploads[j]->url, u->url))
+                break;
+        if (j == i)
+            return u;
+    }
+    return NULL;
+}
+
+static int upload_once(FFUploadQueue *q, struct upload *u, AVIOContext **conn)
+{
+    AVFormatContext *s = q->s;
+    AVIOContext *out = NULL;
+    AVIOContext **pb = q->persistent && !u->delete ? conn : &out;
+    int ret = 0;
+
+#if CONFIG_HTTP_PROTOCOL
+    if (*pb) {
+        ret = ff_http_do_new_request(ffio_geturlcontext(*pb), u->url);
+    } else
+#endif
+    {
+        AVDictionary *opts = NULL;
+
+        av_dict_copy(&opts, q->opts, 0);
+        if (u->delete)
+            av_dict_set(&opts, "method", "DELETE", 0);
+        ret = ffio_open_whitelist(pb, u->url, AVIO_FLAG_WRITE, &s->interrupt_callback,
+                                  &opts, s->protocol_whitelist, s->protocol_blacklist);
+        av_dict_free(&opts);
+    }
+    if (ret >= 0 && u->size > 0) {
+        avio_write(*pb, u->data, u->size);
+        avio_flush(*pb);
+        ret = (*pb)->error;
+    }
+
+#if CONFIG_HTTP_PROTOCOL
+    /* wait for the response, the upload is only complete once it arrived */
+    if (ret >= 0 && ff_is_http_proto(u->url)) {
+        URLContext *h = ffio_geturlcontext(*pb);
+        ret = ffurl_shutdown(h, AVIO_FLAG_WRITE);
+        if (ret >= 0)
+            ret = ff_http_get_shutdown_status(h);
+    }
+#endif
+    /* a connection which failed is not reused */
+    if (ret < 0 || pb != conn) {
+        int err = avio_closep(pb);
+        if (ret >= 0)
+            ret = err;
+    }
+    return ret;
+}
+
+/* Connection errors and server errors may be temporary, client errors
+ * are not. */
+static int is_retryable(int err)
+{
+    switch (err) {
+    case AVERROR_HTTP_BAD_REQUEST:
+    case AVERROR_HTTP_UNAUTHORIZED:
+    case AVERROR_HTTP_FORBIDDEN:
+    case AVERROR_HTTP_NOT_FOUND:
+    case AVERROR_HTTP_OTHER_4XX:
+    case AVERROR_EXIT:
+        return 0;
+    }
+    return 1;
+}
+
+static int upload_run(FFUploadQueue *q, struct upload *u, AVIOContext **conn)
+{
+    int64_t delay = RETRY_DELAY;
+    int i, ret;
+
+    for (i = 0; ; i++) {
+        ret = upload_once(q, u, conn);
+        if (ret >= 0 || i >= q->max_retries || !is_retryable(ret) ||
+            ff_check_interrupt(&q->s->interrupt_callback))
+            return ret;
+
+        av_log(q->s, AV_LOG_WARNING, "Upload of '%s' failed: %s, retrying in %"PRId64" ms\n",
+               u->url, av_err2str(ret), delay / 1000);
+        pthread_mutex_lock(&q->lock);
+        q->stats.retries++;
+        pthread_mutex_unlock(&q->lock);
+        av_usleep(delay);
+        delay = FFMIN(2 * delay, MAX_RETRY_DELAY);
+    }
+}
+
+static void *upload_worker(void *arg)
+{
+    FFUploadQueue *q = arg;
+    AVIOContext *conn = NULL;
+
+    pthread_mutex_lock(&q->lock);
+    for (;;) {
+        struct upload *u;
+        int64_t latency;
+        int i, ret;
+
+        while (!(u = next_upload(q)) && !q->abort)
+            pthread_cond_wait(&q->cond, &q->lock);
+        if (!u)
+            break;
+        u->active = 1;
+        pthread_mutex_unlock(&q->lock);
+
+        ret = upload_run(q, u, &conn);
+        if (ret < 0)
+            av_log(q->s, AV_LOG_ERROR, "Failed to upload '%s': %s\n",
+                   u->url, av_err2str(ret));
+
+        pthread_mutex_lock(&q->lock);
+        latency = av_gettime_relative() - u->submitted;
+        q->stats.uploads++;
+        q->stats.failures   += ret < 0;
+        q->total_latency    += latency;
+        q->stats.latency     = q->total_latency / q->stats.uploads;
+        q->stats.max_latency = FFMAX(q->stats.max_latency, latency);
+        if (ret < 0 && !q->error)
+            q->error = ret;
+        for (i = 0; q->uploads[i] != u; i++)
+            ;
+        memmove(q->uploads + i, q->uploads + i + 1,
+                (q->nb_uploads - i - 1) * sizeof(*q->uploads));
+        q->nb_uploads--;
+        q->stats.queue_depth = q->nb_uploads;
+        upload_free(&u);
+        pthread_cond_broadcast(&q->cond);
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    avio_closep(&conn);
+    return NULL;
+}
+
+static int queue_add(FFUploadQueue *q, const char *url, uint8_t *data,
+                     int size, int flags, int delete)
+{
+    struct upload *u = av_mallocz(sizeof(*u));
+    int ret;
+
+    if (!u) {
+        av_free(data);
+        return AVERROR(ENOMEM);
+    }
+    u->data   = data;
+    u->size   = size;
+    u->flags  = flags | (delete ? FF_UPLOAD_ORDERED : 0);
+    u->delete = delete;
+    u->url    = av_strdup(url);
+    if (!u->url) {
+        upload_free(&u);
+        return AVERROR(ENOMEM);
+    }
+
+    pthread_mutex_lock(&q->lock);
+    while (q->nb_uploads >= q->max_queued)
+        pthread_cond_wait(&q->cond, &q->lock);
+    u->submitted = av_gettime_relative();
+    ret = av_dynarray_add_nofree(&q->uploads, &q->nb_uploads, u);
+    if (ret >= 0) {
+        q->stats.queue_depth     = q->nb_uploads;
+        q->stats.max_queue_depth = FFMAX(q->stats.max_queue_depth, q->nb_uploads);
+        pthread_cond_broadcast(&q->cond);
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    if (ret < 0)
+        upload_free(&u);
+    return ret;
+}
+
+int ff_upload_queue_alloc(FFUploadQueue **pq, AVFormatContext *s,
+                          int nb_connections, int max_queued, int max_retries,
+                          int persistent, AVDictionary *opts)
+{
+    FFUploadQueue *q = av_mallocz(sizeof(*q));
+    int i, ret;
+
+    if (!q)
+        return AVERROR(ENOMEM);
+    q->s           = s;
+    q->max_queued  = FFMAX(max_queued, 1);
+    q->max_retries = max_retries;
+    q->persistent  = persistent && CONFIG_HTTP_PROTOCOL;
+    if ((ret = av_dict_copy(&q->opts, opts, 0)) < 0) {
+        av_free(q);
+        return ret;
+    }
+    if ((ret = pthread_mutex_init(&q->lock, NULL))) {
+        av_dict_free(&q->opts);
+        av_free(q);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&q->cond, NULL))) {
+        pthread_mutex_destroy(&q->lock);
+        av_dict_free(&q->opts);
+        av_free(q);
+        return AVERROR(ret);
+    }
+
+    nb_connections = av_clip(nb_connections, 1, MAX_CONNECTIONS);
+    for (i = 0; i < nb_connections; i++) {
+        if ((ret = pthread_create(&q->threads[i], NULL, upload_worker, q))) {
+            ret = AVERROR(ret);
+            break;
+        }
+        q->nb_threads++;
+    }
+    *pq = q;
+    if (!q->nb_threads) {
+        ff_upload_queue_free(pq);
+        return ret;
+    }
+    return 0;
+}
+
+void ff_upload_queue_free(FFUploadQueue **pq)
+{
+    FFUploadQueue *q = *pq;
+    int i;
+
+    if (!q)
+        return;
+    ff_upload_queue_flush(q);
+
+    pthread_mutex_lock(&q->lock);
+    q->abort = 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+    for (i = 0; i < q->nb_threads; i++)
+        pthread_join(q->threads[i], NULL);
+
+    for (i = 0; i < q->nb_buffers; i++) {
+        ffio_free_dyn_buf(&q->buffers[i].pb);
+        av_freep(&q->buffers[i].url);
+    }
+    av_freep(&q->buffers);
+    av_freep(&q->uploads);
+    pthread_cond_destroy(&q->cond);
+    pthread_mutex_destroy(&q->lock);
+    av_dict_free(&q->opts);
+    av_freep(pq);
+}
+
+int ff_upload_queue_open(FFUploadQueue *q, AVIOContext **pb, const char *url,
+                         int flags)
+{
+    struct buffer buf = { .flags = flags };
+    int ret;
+
+    buf.url = av_strdup(url);
+    if (!buf.url)
+        return AVERROR(ENOMEM);
+    if ((ret = avio_open_dyn_buf(&buf.pb)) < 0) {
+        av_free(buf.url);
+        return ret;
+    }
+    if (!av_dynarray2_add((void **)&q->buffers, &q->nb_buffers,
+                          sizeof(buf), (uint8_t *)&buf)) {
+        ffio_free_dyn_buf(&buf.pb);
+        av_free(buf.url);
+        return AVERROR(ENOMEM);
+    }
+    *pb = buf.pb;
+    return 0;
+}
+
+static int find_buffer(FFUploadQueue *q, AVIOContext *pb)
+{
+    int i;
+
+    for (i = 0; pb && i < q->nb_buffers; i++)
+        if (q->buffers[i].pb == pb)
+            return i;
+    return -1;
+}
+
+static struct buffer remove_buffer(FFUploadQueue *q, int i)
+{
+    struct buffer buf = q->buffers[i];
+
+    q->buffers[i] = q->buffers[--q->nb_buffers];
+    return buf;
+}
+
+int ff_upload_queue_owns(FFUploadQueue *q, AVIOContext *pb)
+{
+    return find_buffer(q, pb) >= 0;
+}
+
+int ff_upload_queue_submit(FFUploadQueue *q, AVIOContext **pb)
+{
+    int i = find_buffer(q, *pb);
+    struct buffer buf;
+    uint8_t *data;
+    int size, ret;
+
+    if (i < 0)
+        return AVERROR(EINVAL);
+    buf  = remove_buffer(q, i);
+    size = avio_close_dyn_buf(buf.pb, &data);
+    *pb  = NULL;
+    ret  = queue_add(q, buf.url, data, size, buf.flags, 0);
+    av_free(buf.url);
+    return ret;
+}
+
+void ff_upload_queue_discard(FFUploadQueue *q, AVIOContext **pb)
+{
+    int i = find_buffer(q, *pb);
+    struct buffer buf;
+
+    if (i < 0)
+        return;
+    buf = remove_buffer(q, i);
+    ffio_free_dyn_buf(&buf.pb);
+    av_free(buf.url);
+    *pb = NULL;
+}
+
+int ff_upload_queue_delete(FFUploadQueue *q, const char *url)
+{
+    return queue_add(q, url, NULL, 0, 0, 1);
+}
+
+int ff_upload_queue_get_error(FFUploadQueue *q)
+{
+    int ret;
+
+    pthread_mutex_lock(&q->lock);
+    ret = q->error;
+    q->error = 0;
+    pthread_mutex_unlock(&q->lock);
+    return ret;
+}
+
+int ff_upload_queue_flush(FFUploadQueue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->nb_uploads)
+        pthread_cond_wait(&q->cond, &q->lock);
+    pthread_mutex_unlock(&q->lock);
+    return ff_upload_queue_get_error(q);
+}
+
+void ff_upload_queue_get_stats(FFUploadQueue *q, FFUploadStats *stats)
+{
+    pthread_mutex_lock(&q->lock);
+    *stats = q->stats;
+    pthread_mutex_unlock(&q->lock);
+}
+
+#else
+
+int ff_upload_queue_alloc(FFUploadQueue **q, AVFormatContext *s,
+                          int nb_connections, int max_queued, int max_retries,
+                          int persistent, AVDictionary *opts)
+{
+    return AVERROR(ENOSYS);
+}
+
+void ff_upload_queue_free(FFUploadQueue **q)
+{
+}
+
+int ff_upload_queue_open(FFUploadQueue *q, AVIOContext **pb, const char *url,
+                         int flags)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_upload_queue_owns(FFUploadQueue *q, AVIOContext *pb)
+{
+    return 0;
+}
+
+int ff_upload_queue_submit(FFUploadQueue *q, AVIOContext **pb)
+{
+    return AVERROR(ENOSYS);
+}
+
+void ff_upload_queue_discard(FFUploadQueue *q, AVIOContext **pb)
+{
+}
+
+int ff_upload_queue_delete(FFUploadQueue *q, const char *url)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_upload_queue_get_error(FFUploadQueue *q)
+{
+    return 0;
+}
+
+int ff_upload_queue_flush(FFUploadQueue *q)
+{
+    return 0;
+}
+
+void ff_upload_queue_get_stats(FFUploadQueue *q, FFUploadStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif /* HAVE_THREADS */
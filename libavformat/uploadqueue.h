@@ -0,0 +1,124 @@
+/*
+ * Background upload queue for the segmenting muxers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_UPLOADQUEUE_H
+#define AVFORMAT_UPLOADQUEUE_H
+
+#include <stdint.h>
+
+#include "libavutil/dict.h"
+#include "avformat.h"
+#include "avio.h"
+
+/**
+ * An upload queue lets a muxer write files to memory buffers, which are
+ * then uploaded by a pool of threads, each with its own connection, while
+ * the muxer goes on. Failed uploads are retried with an exponential backoff.
+ *
+ * Uploads submitted with FF_UPLOAD_ORDERED, such as playlists, only start
+ * once every upload submitted before them has finished, so that a playlist
+ * is never published before the segments it lists. Two uploads to the same
+ * URL never run at the same time and finish in submission order.
+ */
+typedef struct FFUploadQueue FFUploadQueue;
+
+#define FF_UPLOAD_ORDERED (1 << 0)
+
+typedef struct FFUploadStats {
+    int64_t uploads;            ///< finished uploads
+    int64_t retries;
+    int64_t failures;           ///< uploads given up after all the retries
+    int64_t queue_depth;        ///< uploads queued or in progress
+    int64_t max_queue_depth;
+    int64_t latency;            ///< mean time from submission to completion, in microseconds
+    int64_t max_latency;
+} FFUploadStats;
+
+/**
+ * Start an upload queue.
+ *
+ * @param s              the muxer, its interrupt callback and protocol
+ *                       whitelists are used for the uploads, but not its
+ *                       io_open and io_close callbacks
+ * @param nb_connections number of uploads running at the same time
+ * @param max_queued     maximum number of uploads queued or in progress,
+ *                       submitting more blocks until one has finished
+ * @param max_retries    number of times a failed upload is retried
+ * @param persistent     keep the HTTP connections open between uploads
+ * @param opts           options used to open the URLs, copied
+ * @return 0 on success, AVERROR(ENOSYS) without threads, or another
+ *         negative AVERROR code
+ */
+int ff_upload_queue_alloc(FFUploadQueue **q, AVFormatContext *s,
+                          int nb_connections, int max_queued, int max_retries,
+                          int persistent, AVDictionary *opts);
+
+/**
+ * Wait for the queued uploads, stop the threads and free the queue.
+ */
+void ff_upload_queue_free(FFUploadQueue **q);
+
+/**
+ * Open a memory buffer for a file, uploaded to url by
+ * ff_upload_queue_submit().
+ *
+ * @param flags FF_UPLOAD_* flags of the upload
+ */
+int ff_upload_queue_open(FFUploadQueue *q, AVIOContext **pb, const char *url,
+                         int flags);
+
+/**
+ * @return 1 if pb was opened by ff_upload_queue_open() and not submitted yet
+ */
+int ff_upload_queue_owns(FFUploadQueue *q, AVIOContext *pb);
+
+/**
+ * Close a buffer opened by ff_upload_queue_open() and queue its upload.
+ * *pb is set to NULL.
+ */
+int ff_upload_queue_submit(FFUploadQueue *q, AVIOContext **pb);
+
+/**
+ * Free a buffer opened by ff_upload_queue_open() without uploading it.
+ * Does nothing if *pb was not opened by the queue.
+ */
+void ff_upload_queue_discard(FFUploadQueue *q, AVIOContext **pb);
+
+/**
+ * Queue an HTTP DELETE of url, ordered after the previous uploads.
+ */
+int ff_upload_queue_delete(FFUploadQueue *q, const char *url);
+
+/**
+ * @return the first error of the uploads which failed since the last call,
+ *         or 0
+ */
+int ff_upload_queue_get_error(FFUploadQueue *q);
+
+/**
+ * Wait until every queued upload has finished.
+ *
+ * @return the same as ff_upload_queue_get_error()
+ */
+int ff_upload_queue_flush(FFUploadQueue *q);
+
+void ff_upload_queue_get_stats(FFUploadQueue *q, FFUploadStats *stats);
+
+#endif /* AVFORMAT_UPLOADQUEUE_H */
@@ -0,0 +1,163 @@
+/*
+ * Minimal io_uring wrapper
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* needed for syscall() and MAP_POPULATE */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "uring.h"
+
+/* the rings are shared with the kernel, which updates the other ends */
+static unsigned load_acquire(const unsigned *p)
+{
+    return atomic_load_explicit((const _Atomic unsigned *)p, memory_order_acquire);
+}
+
+static void store_release(unsigned *p, unsigned v)
+{
+    atomic_store_explicit((_Atomic unsigned *)p, v, memory_order_release);
+}
+
+static int uring_enter(FFURing *r, unsigned to_submit, unsigned min_complete)
+{
+    int ret;
+
+    do {
+        ret = syscall(__NR_io_uring_enter, r->fd, to_submit, min_complete,
+                      min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret < 0 ? AVERROR(errno) : ret;
+}
+
+int ff_uring_init(FFURing *r, unsigned entries)
+{
+    struct io_uring_params p = { 0 };
+    uint8_t *ring;
+    int ret;
+
+    memset(r, 0, sizeof(*r));
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0)
+        return AVERROR(errno);
+    /* older kernels map both rings separately, they are not supported */
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        ret = AVERROR(ENOSYS);
+        goto fail;
+    }
+
+    r->ring_size = FFMAX(p.sq_off.array + p.sq_entries * sizeof(unsigned),
+                         p.cq_off.cqes  + p.cq_entries * sizeof(struct io_uring_cqe));
+    r->ring = mmap(NULL, r->ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->ring == MAP_FAILED) {
+        ret = AVERROR(errno);
+        r->ring = NULL;
+        goto fail;
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        ret = AVERROR(errno);
+        r->sqes = NULL;
+        goto fail;
+    }
+
+    ring = r->ring;
+    r->features   = p.features;
+    r->sq_entries = p.sq_entries;
+    r->sq_khead   = (unsigned *)(ring + p.sq_off.head);
+    r->sq_ktail   = (unsigned *)(ring + p.sq_off.tail);
+    r->sq_kmask   = (unsigned *)(ring + p.sq_off.ring_mask);
+    r->sq_array   = (unsigned *)(ring + p.sq_off.array);
+    r->cq_khead   = (unsigned *)(ring + p.cq_off.head);
+    r->cq_ktail   = (unsigned *)(ring + p.cq_off.tail);
+    r->cq_kmask   = (unsigned *)(ring + p.cq_off.ring_mask);
+    r->cqes       = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+    r->sq_tail    = r->sq_submitted = *r->sq_ktail;
+    return 0;
+
+fail:
+    ff_uring_free(r);
+    return ret;
+}
+
+void ff_uring_free(FFURing *r)
+{
+    if (r->sqes)
+        munmap(r->sqes, r->sqes_size);
+    if (r->ring)
+        munmap(r->ring, r->ring_size);
+    if (r->fd >= 0)
+        close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+struct io_uring_sqe *ff_uring_get_sqe(FFURing *r)
+{
+    unsigned index;
+
+    if (r->sq_tail - load_acquire(r->sq_khead) >= r->sq_entries)
+        return NULL;
+    index = r->sq_tail++ & *r->sq_kmask;
+    r->sq_array[index] = index;
+    memset(&r->sqes[index], 0, sizeof(r->sqes[index]));
+    return &r->sqes[index];
+}
+
+int ff_uring_submit(FFURing *r)
+{
+    unsigned to_submit = r->sq_tail - r->sq_submitted;
+    int ret;
+
+    if (!to_submit)
+        return 0;
+    store_release(r->sq_ktail, r->sq_tail);
+    ret = uring_enter(r, to_submit, 0);
+    if (ret > 0)
+        r->sq_submitted += ret;
+    return ret;
+}
+
+int ff_uring_get_cqe(FFURing *r, struct io_uring_cqe *cqe, int wait)
+{
+    unsigned head = *r->cq_khead;
+
+    while (head == load_acquire(r->cq_ktail)) {
+        int ret;
+        if (!wait)
+            return AVERROR(EAGAIN);
+        ret = uring_enter(r, 0, 1);
+        if (ret < 0)
+            return ret;
+    }
+    *cqe = r->cqes[head & *r->cq_kmask];
+    store_release(r->cq_khead, head + 1);
+    return 0;
+}
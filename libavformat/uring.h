@@ -0,0 +1,85 @@
+/*
+ * Minimal io_uring wrapper
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_URING_H
+#define AVFORMAT_URING_H
+
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+/**
+ * An io_uring instance used from a single thread, driven through the raw
+ * system calls so that no external library is needed.
+ */
+typedef struct FFURing {
+    int fd;
+    unsigned features;      ///< IORING_FEAT_* flags of the kernel
+    unsigned sq_entries;
+    unsigned sq_tail;       ///< local tail, published by ff_uring_submit()
+    unsigned sq_submitted;
+
+    unsigned *sq_khead;
+    unsigned *sq_ktail;
+    unsigned *sq_kmask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+
+    unsigned *cq_khead;
+    unsigned *cq_ktail;
+    unsigned *cq_kmask;
+    struct io_uring_cqe *cqes;
+
+    void  *ring;
+    size_t ring_size;
+    size_t sqes_size;
+} FFURing;
+
+/**
+ * Set up a ring with at least entries submission queue entries.
+ *
+ * @return 0 on success, a negative AVERROR code if io_uring is not
+ *         available, in which case nothing needs to be freed
+ */
+int ff_uring_init(FFURing *r, unsigned entries);
+
+void ff_uring_free(FFURing *r);
+
+/**
+ * Return a cleared submission queue entry, or NULL if the queue is full.
+ */
+struct io_uring_sqe *ff_uring_get_sqe(FFURing *r);
+
+/**
+ * Submit the entries returned by ff_uring_get_sqe() since the last call.
+ *
+ * @return the number of entries submitted or a negative AVERROR code
+ */
+int ff_uring_submit(FFURing *r);
+
+/**
+ * Copy the oldest completion queue entry to cqe and remove it.
+ *
+ * @param wait if nonzero, wait for a completion if there is none
+ * @return 0 on success, AVERROR(EAGAIN) if there is no completion and
+ *         wait is 0, another negative AVERROR code on failure
+ */
+int ff_uring_get_cqe(FFURing *r, struct io_uring_cqe *cqe, int wait);
+
+#endif /* AVFORMAT_URING_H */
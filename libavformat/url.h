@@ -27,6 +27,7 @@
 #include "avio.h"
 #include "libavformat/version.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/dict.h"
 #include "libavutil/log.h"
 
@@ -86,6 +87,8 @@ typedef struct URLProtocol {
     int (*url_get_multi_file_handle)(URLContext *h, int **handles,
                                      int *numhandles);
     int (*url_get_short_seek)(URLContext *h);
+    int (*url_get_mapping)(URLContext *h, AVBufferRef **buf, int64_t pos,
+                           int size, int padding);
     int (*url_shutdown)(URLContext *h, int flags);
     const AVClass *priv_data_class;
     int priv_data_size;
@@ -254,6 +257,19 @@ int ffurl_get_multi_file_handle(URLContext *h, int **handles, int *numhandles);
  */
 int ffurl_get_short_seek(URLContext *h);
 
+/**
+ * Return a reference to a part of a memory mapping of the resource, so that
+ * it can be used without being read.
+ *
+ * @param buf set to a new read-only reference to the size bytes at
+ *            position pos of the resource, followed by padding zero bytes
+ * @return 0 on success, AVERROR(ENOSYS) if the resource is not mapped or
+ *         the bytes are not all mapped, another negative error code on
+ *         failure
+ */
+int ffurl_get_mapping(URLContext *h, AVBufferRef **buf, int64_t pos,
+                      int size, int padding);
+
 /**
  * Signal the URLContext that we are done reading or writing the stream.
  *
@@ -25,12 +25,14 @@
 
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
+#include "libavutil/cpu.h"
 #include "libavutil/dict.h"
 #include "libavutil/internal.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
 #include "libavutil/parseutils.h"
 #include "libavutil/pixfmt.h"
+#include "libavutil/slicethread.h"
 #include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "libavutil/timestamp.h"
@@ -317,6 +319,21 @@ int av_get_packet(AVIOContext *s, AVPacket *pkt, int size)
     return append_packet_chunked(s, pkt, size);
 }
 
+int ff_get_packet_mapped(AVIOContext *s, AVPacket *pkt, int size)
+{
+    av_init_packet(pkt);
+    pkt->data = NULL;
+    pkt->size = 0;
+    pkt->pos  = avio_tell(s);
+
+    if (ffio_read_mapped(s, &pkt->buf, size, AV_INPUT_BUFFER_PADDING_SIZE) > 0) {
+        pkt->data = pkt->buf->data;
+        pkt->size = size;
+        return size;
+    }
+    return append_packet_chunked(s, pkt, size);
+}
+
 int av_append_packet(AVIOContext *s, AVPacket *pkt, int size)
 {
     if (!pkt->size)
@@ -2040,16 +2057,11 @@ int ff_index_search_timestamp(const AVIndexEntry *entries, int nb_entries,
     return m;
 }
 
-void ff_configure_buffers_for_index(AVFormatContext *s, int64_t time_tolerance)
+int ff_configure_buffers_needed(AVFormatContext *s)
 {
-    int ist1, ist2;
-    int64_t pos_delta = 0;
-    int64_t skip = 0;
     //We could use URLProtocol flags here but as many user applications do not use URLProtocols this would be unreliable
     const char *proto = avio_find_protocol_name(s->url);
 
-    av_assert0(time_tolerance >= 0);
-
     if (!proto) {
         av_log(s, AV_LOG_INFO,
                "Protocol name not provided, cannot determine if input is local or "
@@ -2057,7 +2069,39 @@ void ff_configure_buffers_for_index(AVFormatContext *s, int64_t time_tolerance)
                "optimally without knowing the protocol\n");
     }
 
-    if (proto && !(strcmp(proto, "file") && strcmp(proto, "pipe") && strcmp(proto, "cache")))
+    return !proto || (strcmp(proto, "file") && strcmp(proto, "pipe") && strcmp(proto, "cache"));
+}
+
+void ff_configure_buffers(AVFormatContext *s, int64_t pos_delta, int64_t skip)
+{
+    pos_delta *= 2;
+    /* XXX This could be adjusted depending on protocol*/
+    if (s->pb->buffer_size < pos_delta && pos_delta < (1<<24)) {
+        av_log(s, AV_LOG_VERBOSE, "Reconfiguring buffers to size %"PRId64"\n", pos_delta);
+
+        /* realloc the buffer and the original data will be retained */
+        if (ffio_realloc_buf(s->pb, pos_delta)) {
+            av_log(s, AV_LOG_ERROR, "Realloc buffer fail.\n");
+            return;
+        }
+
+        s->pb->short_seek_threshold = FFMAX(s->pb->short_seek_threshold, pos_delta/2);
+    }
+
+    if (skip < (1<<23)) {
+        s->pb->short_seek_threshold = FFMAX(s->pb->short_seek_threshold, skip);
+    }
+}
+
+void ff_configure_buffers_for_index(AVFormatContext *s, int64_t time_tolerance)
+{
+    int ist1, ist2;
+    int64_t pos_delta = 0;
+    int64_t skip = 0;
+
+    av_assert0(time_tolerance >= 0);
+
+    if (!ff_configure_buffers_needed(s))
         return;
 
     for (ist1 = 0; ist1 < s->nb_streams; ist1++) {
@@ -2086,23 +2130,7 @@ void ff_configure_buffers_for_index(AVFormatContext *s, int64_t time_tolerance)
         }
     }
 
-    pos_delta *= 2;
-    /* XXX This could be adjusted depending on protocol*/
-    if (s->pb->buffer_size < pos_delta && pos_delta < (1<<24)) {
-        av_log(s, AV_LOG_VERBOSE, "Reconfiguring buffers to size %"PRId64"\n", pos_delta);
-
-        /* realloc the buffer and the original data will be retained */
-        if (ffio_realloc_buf(s->pb, pos_delta)) {
-            av_log(s, AV_LOG_ERROR, "Realloc buffer fail.\n");
-            return;
-        }
-
-        s->pb->short_seek_threshold = FFMAX(s->pb->short_seek_threshold, pos_delta/2);
-    }
-
-    if (skip < (1<<23)) {
-        s->pb->short_seek_threshold = FFMAX(s->pb->short_seek_threshold, skip);
-    }
+    ff_configure_buffers(s, pos_delta, skip);
 }
 
 int av_index_search_timestamp(AVStream *st, int64_t wanted_timestamp, int flags)
@@ -2990,6 +3018,22 @@ static int has_codec_parameters(AVStream *st, const char **errmsg_ptr)
     return 1;
 }
 
+/* In fast probe mode, decode only until the codec parameters are complete,
+ * and one frame for the decoders which do not trust the container channel
+ * configuration. */
+static int fast_probe_needs_decoding(AVFormatContext *s, AVStream *st)
+{
+    AVCodecContext *avctx = st->internal->avctx;
+    const AVCodec *codec;
+
+    if (!has_codec_parameters(st, NULL))
+        return 1;
+    if (st->internal->nb_decoded_frames || st->internal->info->found_decoder < 0)
+        return 0;
+    codec = avctx->codec ? avctx->codec : find_probe_decoder(s, st, st->codecpar->codec_id);
+    return codec && (codec->capabilities & AV_CODEC_CAP_CHANNEL_CONF);
+}
+
 /* returns 1 or 0 if or if not decoded data was returned, or a negative error */
 static int try_decode_frame(AVFormatContext *s, AVStream *st,
                             const AVPacket *avpkt, AVDictionary **options)
@@ -3001,6 +3045,7 @@ static int try_decode_frame(AVFormatContext *s, AVStream *st,
     AVSubtitle subtitle;
     AVPacket pkt = *avpkt;
     int do_skip_frame = 0;
+    int fast_probe = s->flags & AVFMT_FLAG_FAST_PROBE;
     enum AVDiscard skip_frame;
 
     if (!frame)
@@ -3050,11 +3095,13 @@ static int try_decode_frame(AVFormatContext *s, AVStream *st,
         avctx->skip_frame = AVDISCARD_ALL;
     }
 
+    /* In fast probe mode, the decoder delay is not guessed. */
     while ((pkt.size > 0 || (!pkt.data && got_picture)) &&
            ret >= 0 &&
-           (!has_codec_parameters(st, NULL) || !has_decode_delay_been_guessed(st) ||
-            (!st->codec_info_nb_frames &&
-             (avctx->codec->capabilities & AV_CODEC_CAP_CHANNEL_CONF)))) {
+           (fast_probe ? fast_probe_needs_decoding(s, st) :
+            (!has_codec_parameters(st, NULL) || !has_decode_delay_been_guessed(st) ||
+             (!st->codec_info_nb_frames &&
+              (avctx->codec->capabilities & AV_CODEC_CAP_CHANNEL_CONF))))) {
         got_picture = 0;
         if (avctx->codec_type == AVMEDIA_TYPE_VIDEO ||
             avctx->codec_type == AVMEDIA_TYPE_AUDIO) {
@@ -3575,6 +3622,79 @@ static int add_coded_side_data(AVStream *st, AVCodecContext *avctx)
     return 0;
 }
 
+typedef struct ProbeDecodeContext {
+    AVFormatContext *ic;
+    AVDictionary   **options;
+    int              orig_nb_streams;
+    AVSliceThread   *slicethread;
+    int              slicethread_failed;
+    int             *jobs;
+    unsigned int     jobs_size;
+} ProbeDecodeContext;
+
+static void probe_decode_worker(void *priv, int jobnr, int threadnr,
+                                int nb_jobs, int nb_threads)
+{
+    ProbeDecodeContext *pd = priv;
+    int i = pd->jobs[jobnr];
+    AVStream *st = pd->ic->streams[i];
+
+    try_decode_frame(pd->ic, st, st->internal->info->pending_pkt,
+                     (pd->options && i < pd->orig_nb_streams) ? &pd->options[i] : NULL);
+    av_packet_unref(st->internal->info->pending_pkt);
+}
+
+/* Decode the pending packets of all streams, each stream in its own job. */
+static int probe_decode_flush(ProbeDecodeContext *pd)
+{
+    AVFormatContext *ic = pd->ic;
+    int i, nb_jobs = 0;
+
+    av_fast_malloc(&pd->jobs, &pd->jobs_size, ic->nb_streams * sizeof(*pd->jobs));
+    if (!pd->jobs)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < ic->nb_streams; i++) {
+        const AVPacket *pkt = ic->streams[i]->internal->info->pending_pkt;
+        /* a referenced packet always has a buffer */
+        if (pkt && pkt->buf)
+            pd->jobs[nb_jobs++] = i;
+    }
+
+    /* no more threads than streams being decoded, the caller thread
+     * decodes one of them */
+    if (nb_jobs > 1 && !pd->slicethread && !pd->slicethread_failed)
+        pd->slicethread_failed = avpriv_slicethread_create(&pd->slicethread, pd,
+                                                           probe_decode_worker, NULL,
+                                                           FFMIN(nb_jobs, av_cpu_count())) < 0;
+
+    if (nb_jobs > 1 && pd->slicethread) {
+        avpriv_slicethread_execute(pd->slicethread, nb_jobs, 0);
+    } else {
+        for (i = 0; i < nb_jobs; i++)
+            probe_decode_worker(pd, i, 0, nb_jobs, 1);
+    }
+    return 0;
+}
+
+/* Queue a packet for decoding, flushing the queue if the stream already
+ * has a pending packet. */
+static int probe_decode_queue(ProbeDecodeContext *pd, AVStream *st,
+                              const AVPacket *pkt)
+{
+    AVPacket **pending = &st->internal->info->pending_pkt;
+    int ret;
+
+    if (!*pending && !(*pending = av_packet_alloc()))
+        return AVERROR(ENOMEM);
+    if ((*pending)->buf) {
+        ret = probe_decode_flush(pd);
+        if (ret < 0)
+            return ret;
+    }
+    return av_packet_ref(*pending, pkt);
+}
+
 int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
 {
     int i, count = 0, ret = 0, j;
@@ -3592,6 +3712,12 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
     int64_t probesize = ic->probesize;
     int eof_reached = 0;
     int *missing_streams = av_opt_ptr(ic->iformat->priv_class, ic->priv_data, "missing_streams");
+    int fast_probe = ic->flags & AVFMT_FLAG_FAST_PROBE;
+    ProbeDecodeContext pd = {
+        .ic              = ic,
+        .options         = options,
+        .orig_nb_streams = orig_nb_streams,
+    };
 
     flush_codecs = probesize > 0;
 
@@ -3735,6 +3861,9 @@ FF_ENABLE_DEPRECATION_WARNINGS
             count = (ic->iformat->flags & AVFMT_NOTIMESTAMPS) ?
                        st->internal->info->codec_info_duration_fields/2 :
                        st->internal->info->duration_count;
+            /* In fast probe mode, trust any frame rate from the header. */
+            if (fast_probe && (st->r_frame_rate.num || st->avg_frame_rate.num))
+                fps_analyze_framecount = 0;
             if (!(st->r_frame_rate.num && st->avg_frame_rate.num) &&
                 st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
                 if (count < fps_analyze_framecount)
@@ -3742,7 +3871,8 @@ FF_ENABLE_DEPRECATION_WARNINGS
             }
             // Look at the first 3 frames if there is evidence of frame delay
             // but the decoder delay is not set.
-            if (st->internal->info->frame_delay_evidence && count < 2 && st->internal->avctx->has_b_frames == 0)
+            if (!fast_probe &&
+                st->internal->info->frame_delay_evidence && count < 2 && st->internal->avctx->has_b_frames == 0)
                 break;
             if (!st->internal->avctx->extradata &&
                 (!st->internal->extract_extradata.inited ||
@@ -3919,9 +4049,18 @@ FF_ENABLE_DEPRECATION_WARNINGS
          * If AV_CODEC_CAP_CHANNEL_CONF is set this will force decoding of at
          * least one frame of codec data, this makes sure the codec initializes
          * the channel configuration and does not only trust the values from
-         * the container. */
-        try_decode_frame(ic, st, pkt,
-                         (options && i < orig_nb_streams) ? &options[i] : NULL);
+         * the container.
+         *
+         * In fast probe mode, only the streams which still need decoding
+         * are decoded, one packet of each stream at a time in parallel. */
+        if (!fast_probe) {
+            try_decode_frame(ic, st, pkt,
+                             (options && i < orig_nb_streams) ? &options[i] : NULL);
+        } else if (fast_probe_needs_decoding(ic, st)) {
+            ret = probe_decode_queue(&pd, st, pkt);
+            if (ret < 0)
+                goto unref_then_goto_end;
+        }
 
         if (ic->flags & AVFMT_FLAG_NOBUFFER)
             av_packet_unref(&pkt1);
@@ -3930,6 +4069,14 @@ FF_ENABLE_DEPRECATION_WARNINGS
         count++;
     }
 
+    if (fast_probe) {
+        int err = probe_decode_flush(&pd);
+        if (err < 0) {
+            ret = err;
+            goto find_stream_info_err;
+        }
+    }
+
     if (eof_reached) {
         int stream_index;
         for (stream_index = 0; stream_index < ic->nb_streams; stream_index++) {
@@ -4035,6 +4182,11 @@ FF_ENABLE_DEPRECATION_WARNINGS
                               best_fps, 12 * 1001, INT_MAX);
             }
 
+            /* In fast probe mode, the frames are not analyzed when the
+             * header gives a frame rate, which is then also the average. */
+            if (fast_probe && !st->avg_frame_rate.num && st->r_frame_rate.num)
+                st->avg_frame_rate = st->r_frame_rate;
+
             if (!st->r_frame_rate.num) {
                 if (    avctx->time_base.den * (int64_t) st->time_base.num
                     <= avctx->time_base.num * avctx->ticks_per_frame * (uint64_t) st->time_base.den) {
@@ -4167,13 +4319,17 @@ FF_ENABLE_DEPRECATION_WARNINGS
 find_stream_info_err:
     for (i = 0; i < ic->nb_streams; i++) {
         st = ic->streams[i];
-        if (st->internal->info)
+        if (st->internal->info) {
             av_freep(&st->internal->info->duration_error);
+            av_packet_free(&st->internal->info->pending_pkt);
+        }
         avcodec_close(ic->streams[i]->internal->avctx);
         av_freep(&ic->streams[i]->internal->info);
         av_bsf_free(&ic->streams[i]->internal->extract_extradata.bsf);
         av_packet_free(&ic->streams[i]->internal->extract_extradata.pkt);
     }
+    avpriv_slicethread_free(&pd.slicethread);
+    av_freep(&pd.jobs);
     if (ic->pb)
         av_log(ic, AV_LOG_DEBUG, "After avformat_find_stream_info() pos: %"PRId64" bytes read:%"PRId64" seeks:%d frames:%d\n",
                avio_tell(ic->pb), ic->pb->bytes_read, ic->pb->seek_count, count);
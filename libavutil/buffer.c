@@ -26,6 +26,7 @@
 #include "buffer_internal.h"
 #include "common.h"
 #include "mem.h"
+#include "recycle_internal.h"
 #include "thread.h"
 
 
@@ -36,7 +37,7 @@ AVBufferRef *av_buffer_create(uint8_t *data, int size,
     AVBufferRef *ref = NULL;
     AVBuffer    *buf = NULL;
 
-    buf = av_mallocz(sizeof(*buf));
+    buf = avpriv_recycle_alloc(AV_RECYCLE_BUFFER, sizeof(*buf));
     if (!buf)
         return NULL;
 
@@ -49,9 +50,9 @@ AVBufferRef *av_buffer_create(uint8_t *data, int size,
 
     buf->flags = flags;
 
-    ref = av_mallocz(sizeof(*ref));
+    ref = avpriv_recycle_alloc(AV_RECYCLE_BUFFER_REF, sizeof(*ref));
     if (!ref) {
-        av_freep(&buf);
+        avpriv_recycle_freep(AV_RECYCLE_BUFFER, &buf);
         return NULL;
     }
 
@@ -95,7 +96,7 @@ AVBufferRef *av_buffer_allocz(int size)
 
 AVBufferRef *av_buffer_ref(AVBufferRef *buf)
 {
-    AVBufferRef *ret = av_mallocz(sizeof(*ret));
+    AVBufferRef *ret = avpriv_recycle_alloc(AV_RECYCLE_BUFFER_REF, sizeof(*ret));
 
     if (!ret)
         return NULL;
@@ -107,21 +108,41 @@ AVBufferRef *av_buffer_ref(AVBufferRef *buf)
     return ret;
 }
 
+/* the first reference to a pool buffer is part of its pool entry */
+static int buffer_ref_is_embedded(const AVBufferRef *ref)
+{
+    const AVBuffer *b = ref->buffer;
+
+    return (b->flags_internal & BUFFER_FLAG_NO_FREE) &&
+           ref == &((const BufferPoolEntry *)b->opaque)->ref;
+}
+
 static void buffer_replace(AVBufferRef **dst, AVBufferRef **src)
 {
     AVBuffer *b;
 
     b = (*dst)->buffer;
 
-    if (src) {
+    if (src && !buffer_ref_is_embedded(*dst) && !buffer_ref_is_embedded(*src)) {
         **dst = **src;
-        av_freep(src);
-    } else
-        av_freep(dst);
+        avpriv_recycle_freep(AV_RECYCLE_BUFFER_REF, src);
+    } else {
+        if (buffer_ref_is_embedded(*dst))
+            *dst = NULL;
+        else
+            avpriv_recycle_freep(AV_RECYCLE_BUFFER_REF, dst);
+        if (src) {
+            *dst = *src;
+            *src = NULL;
+        }
+    }
 
     if (atomic_fetch_sub_explicit(&b->refcount, 1, memory_order_acq_rel) == 1) {
+        /* b->free may hand an embedded AVBuffer over to another thread */
+        int free_avbuf = !(b->flags_internal & BUFFER_FLAG_NO_FREE);
         b->free(b->opaque, b->data);
-        av_freep(&b);
+        if (free_avbuf)
+            avpriv_recycle_freep(AV_RECYCLE_BUFFER, &b);
     }
 }
 
@@ -282,14 +303,55 @@ AVBufferPool *av_buffer_pool_init(int size, AVBufferRef* (*alloc)(int size))
     return pool;
 }
 
+static BufferPoolEntry *pool_entry(AVBufferPool *pool, unsigned index)
+{
+    int chunk = av_log2(index / POOL_CHUNK_SIZE + 1);
+
+    return &pool->chunks[chunk][index - POOL_CHUNK_SIZE * ((1U << chunk) - 1)];
+}
+
+static void pool_push(AVBufferPool *pool, BufferPoolEntry *buf)
+{
+    uint64_t head = atomic_load_explicit(&pool->free_list, memory_order_relaxed);
+    uint64_t new_head;
+
+    do {
+        atomic_store_explicit(&buf->next, (uint32_t)head, memory_order_relaxed);
+        new_head = ((head >> 32) + 1) << 32 | (buf->index + 1);
+    } while (!atomic_compare_exchange_weak_explicit(&pool->free_list, &head, new_head,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+}
+
+static BufferPoolEntry *pool_pop(AVBufferPool *pool)
+{
+    uint64_t head = atomic_load_explicit(&pool->free_list, memory_order_acquire);
+    uint64_t new_head;
+    BufferPoolEntry *buf;
+
+    do {
+        if (!(uint32_t)head)
+            return NULL;
+        buf      = pool_entry(pool, (uint32_t)head - 1);
+        new_head = ((head >> 32) + 1) << 32 |
+                   atomic_load_explicit(&buf->next, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&pool->free_list, &head, new_head,
+                                                    memory_order_acquire,
+                                                    memory_order_acquire));
+
+    return buf;
+}
+
 static void buffer_pool_flush(AVBufferPool *pool)
 {
-    while (pool->pool) {
-        BufferPoolEntry *buf = pool->pool;
-        pool->pool = buf->next;
+    BufferPoolEntry *buf;
 
-        buf->free(buf->opaque, buf->data);
-        av_freep(&buf);
+    while ((buf = pool_pop(pool))) {
+        if (buf->alloc_ref)
+            av_buffer_unref(&buf->alloc_ref);
+        else
+            buf->free(buf->opaque, buf->data);
+        buf->data = NULL;
     }
 }
 
@@ -299,12 +361,16 @@ static void buffer_pool_flush(AVBufferPool *pool)
  */
 static void buffer_pool_free(AVBufferPool *pool)
 {
+    int i;
+
     buffer_pool_flush(pool);
     ff_mutex_destroy(&pool->mutex);
 
     if (pool->pool_free)
         pool->pool_free(pool->opaque);
 
+    for (i = 0; i < POOL_MAX_CHUNKS; i++)
+        av_freep(&pool->chunks[i]);
     av_freep(&pool);
 }
 
@@ -317,9 +383,7 @@ void av_buffer_pool_uninit(AVBufferPool **ppool)
     pool   = *ppool;
     *ppool = NULL;
 
-    ff_mutex_lock(&pool->mutex);
     buffer_pool_flush(pool);
-    ff_mutex_unlock(&pool->mutex);
 
     if (atomic_fetch_sub_explicit(&pool->refcount, 1, memory_order_acq_rel) == 1)
         buffer_pool_free(pool);
@@ -333,10 +397,7 @@ static void pool_release_buffer(void *opaque, uint8_t *data)
     if(CONFIG_MEMORY_POISONING)
         memset(buf->data, FF_MEMORY_POISON, pool->size);
 
-    ff_mutex_lock(&pool->mutex);
-    buf->next = pool->pool;
-    pool->pool = buf;
-    ff_mutex_unlock(&pool->mutex);
+    pool_push(pool, buf);
 
     if (atomic_fetch_sub_explicit(&pool->refcount, 1, memory_order_acq_rel) == 1)
         buffer_pool_free(pool);
@@ -360,72 +421,65 @@ static void pool_release_buffer_vpe(void *opaque, uint8_t *data)
     }
     ff_mutex_unlock(&vpi_frame->frame_mutex);
 
-    ff_mutex_lock(&pool->mutex);
-    buf->next = pool->pool;
-    pool->pool = buf;
-    ff_mutex_unlock(&pool->mutex);
+    pool_push(pool, buf);
 
     if (atomic_fetch_sub_explicit(&pool->refcount, 1, memory_order_acq_rel) == 1)
         buffer_pool_free(pool);
 }
 
-/* allocate a new buffer and override its free() callback so that
- * it is returned to the pool on free */
-static AVBufferRef *pool_alloc_buffer(AVBufferPool *pool)
+/* set up the embedded AVBuffer and reference of an available entry */
+static AVBufferRef *pool_entry_ref(AVBufferPool *pool, BufferPoolEntry *buf,
+                                   void (*release)(void *opaque, uint8_t *data))
 {
-    BufferPoolEntry *buf;
-    AVBufferRef     *ret;
-
-    av_assert0(pool->alloc || pool->alloc2);
-
-    ret = pool->alloc2 ? pool->alloc2(pool->opaque, pool->size) :
-                         pool->alloc(pool->size);
-    if (!ret)
-        return NULL;
+    AVBuffer    *b   = &buf->buffer;
+    AVBufferRef *ref = &buf->ref;
 
-    buf = av_mallocz(sizeof(*buf));
-    if (!buf) {
-        av_buffer_unref(&ret);
-        return NULL;
-    }
-
-    buf->data   = ret->buffer->data;
-    buf->opaque = ret->buffer->opaque;
-    buf->free   = ret->buffer->free;
-    buf->pool   = pool;
+    memset(b, 0, sizeof(*b));
+    b->data           = buf->data;
+    b->size           = pool->size;
+    b->free           = release;
+    b->opaque         = buf;
+    b->flags_internal = BUFFER_FLAG_NO_FREE;
+    atomic_init(&b->refcount, 1);
 
-    ret->buffer->opaque = buf;
-    ret->buffer->free   = pool_release_buffer;
+    ref->buffer = b;
+    ref->data   = buf->data;
+    ref->size   = pool->size;
 
-    return ret;
+    return ref;
 }
 
-AVBufferRef *av_buffer_pool_get(AVBufferPool *pool)
+static BufferPoolEntry *pool_new_entry(AVBufferPool *pool)
 {
-    AVBufferRef *ret;
-    BufferPoolEntry *buf;
+    BufferPoolEntry *buf = NULL;
+    unsigned index;
+    int chunk;
 
     ff_mutex_lock(&pool->mutex);
-    buf = pool->pool;
-    if (buf) {
-        ret = av_buffer_create(buf->data, pool->size, pool_release_buffer,
-                               buf, 0);
-        if (ret) {
-            pool->pool = buf->next;
-            buf->next = NULL;
-        }
-    } else {
-        ret = pool_alloc_buffer(pool);
+    index = pool->nb_entries;
+    chunk = av_log2(index / POOL_CHUNK_SIZE + 1);
+    if (chunk >= POOL_MAX_CHUNKS)
+        goto end;
+    if (!pool->chunks[chunk]) {
+        pool->chunks[chunk] = av_calloc(POOL_CHUNK_SIZE << chunk,
+                                        sizeof(*pool->chunks[chunk]));
+        if (!pool->chunks[chunk])
+            goto end;
     }
-    ff_mutex_unlock(&pool->mutex);
+    pool->nb_entries++;
 
-    if (ret)
-        atomic_fetch_add_explicit(&pool->refcount, 1, memory_order_relaxed);
-
-    return ret;
+    buf        = pool_entry(pool, index);
+    buf->index = index;
+    buf->pool  = pool;
+end:
+    ff_mutex_unlock(&pool->mutex);
+    return buf;
 }
 
-static AVBufferRef *pool_alloc_buffer_vpe(AVBufferPool *pool)
+/* allocate a new buffer and take it over, so that
+ * it is returned to the pool on free */
+static AVBufferRef *pool_alloc_buffer(AVBufferPool *pool,
+                                      void (*release)(void *opaque, uint8_t *data))
 {
     BufferPoolEntry *buf;
     AVBufferRef     *ret;
@@ -437,41 +491,43 @@ static AVBufferRef *pool_alloc_buffer_vpe(AVBufferPool *pool)
     if (!ret)
         return NULL;
 
-    buf = av_mallocz(sizeof(*buf));
+    buf = pool_new_entry(pool);
     if (!buf) {
         av_buffer_unref(&ret);
         return NULL;
     }
 
-    buf->data   = ret->buffer->data;
+    /* Only the buffers of the default allocators are known to be plain
+     * av_buffer_create() results, whose AVBuffer and reference can be
+     * replaced by the embedded ones. A custom allocator may return a wrapped,
+     * offset or shared reference, which is kept until the pool is freed. */
     buf->opaque = ret->buffer->opaque;
-    buf->free   = ret->buffer->free;
-    buf->pool   = pool;
+    if (!pool->alloc2 &&
+        (pool->alloc == av_buffer_alloc || pool->alloc == av_buffer_allocz)) {
+        buf->data = ret->buffer->data;
+        buf->free = ret->buffer->free;
 
-    ret->buffer->opaque = buf;
-    ret->buffer->free   = pool_release_buffer_vpe;
+        avpriv_recycle_freep(AV_RECYCLE_BUFFER, &ret->buffer);
+        avpriv_recycle_freep(AV_RECYCLE_BUFFER_REF, &ret);
+    } else {
+        buf->data      = ret->data;
+        buf->alloc_ref = ret;
+    }
 
-    return ret;
+    return pool_entry_ref(pool, buf, release);
 }
 
-AVBufferRef *av_buffer_pool_get_vpe(AVBufferPool *pool)
+static AVBufferRef *pool_get(AVBufferPool *pool,
+                             void (*release)(void *opaque, uint8_t *data))
 {
     AVBufferRef *ret;
     BufferPoolEntry *buf;
 
-    ff_mutex_lock(&pool->mutex);
-    buf = pool->pool;
-    if (buf) {
-        ret = av_buffer_create(buf->data, pool->size, pool_release_buffer_vpe,
-                               buf, 0);
-        if (ret) {
-            pool->pool = buf->next;
-            buf->next = NULL;
-        }
-    } else {
-        ret = pool_alloc_buffer_vpe(pool);
-    }
-    ff_mutex_unlock(&pool->mutex);
+    buf = pool_pop(pool);
+    if (buf)
+        ret = pool_entry_ref(pool, buf, release);
+    else
+        ret = pool_alloc_buffer(pool, release);
 
     if (ret)
         atomic_fetch_add_explicit(&pool->refcount, 1, memory_order_relaxed);
@@ -479,6 +535,16 @@ AVBufferRef *av_buffer_pool_get_vpe(AVBufferPool *pool)
     return ret;
 }
 
+AVBufferRef *av_buffer_pool_get(AVBufferPool *pool)
+{
+    return pool_get(pool, pool_release_buffer);
+}
+
+AVBufferRef *av_buffer_pool_get_vpe(AVBufferPool *pool)
+{
+    return pool_get(pool, pool_release_buffer_vpe);
+}
+
 void *av_buffer_pool_buffer_get_opaque(AVBufferRef *ref)
 {
     BufferPoolEntry *buf = ref->buffer->opaque;
@@ -244,6 +244,10 @@ int av_buffer_replace(AVBufferRef **dst, AVBufferRef *src);
  * Allocating and releasing buffers with this API is thread-safe as long as
  * either the default alloc callback is used, or the user-supplied one is
  * thread-safe.
+ *
+ * Once a buffer has been returned to the pool, getting it again takes no lock
+ * and allocates no memory, the alloc callback is only called when all the
+ * buffers of the pool are in use.
  */
 
 /**
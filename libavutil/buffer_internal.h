@@ -30,6 +30,12 @@
  */
 #define BUFFER_FLAG_REALLOCATABLE (1 << 0)
 
+/**
+ * The AVBuffer structure is part of a larger structure
+ * and should not be freed.
+ */
+#define BUFFER_FLAG_NO_FREE       (1 << 1)
+
 struct AVBuffer {
     uint8_t *data; /**< data described by this buffer */
     int      size; /**< size of data in bytes */
@@ -70,13 +76,45 @@ typedef struct BufferPoolEntry {
     void *opaque;
     void (*free)(void *opaque, uint8_t *data);
 
+    /*
+     * The reference returned by a custom allocator, whose AVBuffer the pool
+     * does not own. It is unreferenced instead of calling free when the pool
+     * is freed.
+     */
+    AVBufferRef *alloc_ref;
+
     AVBufferPool *pool;
-    struct BufferPoolEntry *next;
+
+    /* position of this entry in the pool */
+    unsigned index;
+
+    /* index + 1 of the next available entry, 0 for the end of the list */
+    atomic_uint next;
+
+    /*
+     * The AVBuffer and the first reference to it handed out by
+     * av_buffer_pool_get(), so that reusing an entry allocates nothing.
+     */
+    AVBuffer    buffer;
+    AVBufferRef ref;
 } BufferPoolEntry;
 
+/* entries are allocated in chunks of POOL_CHUNK_SIZE << chunk index */
+#define POOL_CHUNK_SIZE 16
+#define POOL_MAX_CHUNKS 26
+
 struct AVBufferPool {
+    /* protects the allocation of new entries */
     AVMutex mutex;
-    BufferPoolEntry *pool;
+    BufferPoolEntry *chunks[POOL_MAX_CHUNKS];
+    unsigned nb_entries;
+
+    /*
+     * Lock-free stack of the available entries: index + 1 of the top entry
+     * in the low 32 bits, a counter incremented on every change in the high
+     * 32 bits to avoid the ABA problem.
+     */
+    atomic_uint_least64_t free_list;
 
     /*
      * This is used to track when the pool is to be freed.
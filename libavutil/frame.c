@@ -24,6 +24,7 @@
 #include "frame.h"
 #include "imgutils.h"
 #include "mem.h"
+#include "recycle_internal.h"
 #include "samplefmt.h"
 #include "hwcontext.h"
 
@@ -172,7 +173,7 @@ static void free_side_data(AVFrameSideData **ptr_sd)
 
     av_buffer_unref(&sd->buf);
     av_dict_free(&sd->metadata);
-    av_freep(ptr_sd);
+    avpriv_recycle_freep(AV_RECYCLE_FRAME_SIDE_DATA, ptr_sd);
 }
 
 static void wipe_side_data(AVFrame *frame)
@@ -189,7 +190,7 @@ static void wipe_side_data(AVFrame *frame)
 
 AVFrame *av_frame_alloc(void)
 {
-    AVFrame *frame = av_mallocz(sizeof(*frame));
+    AVFrame *frame = avpriv_recycle_alloc(AV_RECYCLE_FRAME, sizeof(*frame));
 
     if (!frame)
         return NULL;
@@ -206,7 +207,7 @@ void av_frame_free(AVFrame **frame)
         return;
 
     av_frame_unref(*frame);
-    av_freep(frame);
+    avpriv_recycle_freep(AV_RECYCLE_FRAME, frame);
 }
 
 static int get_video_buffer(AVFrame *frame, int align)
@@ -709,7 +710,7 @@ AVFrameSideData *av_frame_new_side_data_from_buf(AVFrame *frame,
         return NULL;
     frame->side_data = tmp;
 
-    ret = av_mallocz(sizeof(*ret));
+    ret = avpriv_recycle_alloc(AV_RECYCLE_FRAME_SIDE_DATA, sizeof(*ret));
     if (!ret)
         return NULL;
 
@@ -0,0 +1,243 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+#include "error.h"
+#include "internal.h"
+#include "mem.h"
+#include "recycle_internal.h"
+#include "thread.h"
+
+/*
+ * The free lists work like the ones of AVBufferPool: the entries are
+ * allocated in chunks which are never freed, and the available entries form
+ * a lock-free stack indexed by entry position, with a change counter to
+ * avoid the ABA problem.
+ *
+ * Only the entries of the free lists have a header. Structures allocated
+ * while recycling is disabled are plain av_mallocz() allocations, so they
+ * can still be freed by code unaware of recycling. When freeing, a structure
+ * is recognized as an entry by its address being inside one of the chunks.
+ */
+
+typedef struct RecycleBin RecycleBin;
+
+typedef struct RecycleEntry {
+    /* position of this entry in the free list */
+    unsigned index;
+
+    /* index + 1 of the next available entry, 0 for the end of the list */
+    atomic_uint next;
+} RecycleEntry;
+
+#define ENTRY_HEADER_SIZE FFALIGN(sizeof(RecycleEntry), 16)
+
+/* entries are allocated in chunks of BIN_CHUNK_SIZE << chunk index */
+#define BIN_CHUNK_SIZE 64
+#define BIN_MAX_CHUNKS 20
+
+struct RecycleBin {
+    /* protects the allocation of new entries */
+    AVMutex mutex;
+    uint8_t *chunks[BIN_MAX_CHUNKS];
+    unsigned nb_entries;
+
+    /* number of allocated chunks, published once the chunk and entry_size
+     * are set so that they can be read without the mutex */
+    atomic_int nb_chunks;
+
+    /* size of the structures, set by the first allocation */
+    size_t size;
+    size_t entry_size;
+
+    /* index + 1 of the top entry in the low 32 bits, change counter above */
+    atomic_uint_least64_t free_list;
+
+    atomic_uint_least64_t hits;
+    atomic_uint_least64_t misses;
+};
+
+#define BIN_INIT { .mutex = AV_MUTEX_INITIALIZER }
+
+static RecycleBin bins[AV_RECYCLE_NB] = {
+    BIN_INIT, BIN_INIT, BIN_INIT, BIN_INIT, BIN_INIT,
+};
+
+static atomic_int recycle_enabled;
+
+static RecycleEntry *bin_entry(RecycleBin *bin, unsigned index)
+{
+    int chunk = av_log2(index / BIN_CHUNK_SIZE + 1);
+
+    index -= BIN_CHUNK_SIZE * ((1U << chunk) - 1);
+    return (RecycleEntry *)(bin->chunks[chunk] + index * bin->entry_size);
+}
+
+static void bin_push(RecycleBin *bin, RecycleEntry *e)
+{
+    uint64_t head = atomic_load_explicit(&bin->free_list, memory_order_relaxed);
+    uint64_t new_head;
+
+    do {
+        atomic_store_explicit(&e->next, (uint32_t)head, memory_order_relaxed);
+        new_head = ((head >> 32) + 1) << 32 | (e->index + 1);
+    } while (!atomic_compare_exchange_weak_explicit(&bin->free_list, &head, new_head,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+}
+
+static RecycleEntry *bin_pop(RecycleBin *bin)
+{
+    uint64_t head = atomic_load_explicit(&bin->free_list, memory_order_acquire);
+    uint64_t new_head;
+    RecycleEntry *e;
+
+    do {
+        if (!(uint32_t)head)
+            return NULL;
+        e        = bin_entry(bin, (uint32_t)head - 1);
+        new_head = ((head >> 32) + 1) << 32 |
+                   atomic_load_explicit(&e->next, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&bin->free_list, &head, new_head,
+                                                    memory_order_acquire,
+                                                    memory_order_acquire));
+
+    return e;
+}
+
+static RecycleEntry *bin_new_entry(RecycleBin *bin, size_t size)
+{
+    RecycleEntry *e = NULL;
+    unsigned index;
+    int chunk;
+
+    ff_mutex_lock(&bin->mutex);
+    if (!bin->size) {
+        bin->size       = size;
+        bin->entry_size = ENTRY_HEADER_SIZE + FFALIGN(size, 16);
+    } else if (size != bin->size) {
+        goto end;
+    }
+
+    index = bin->nb_entries;
+    chunk = av_log2(index / BIN_CHUNK_SIZE + 1);
+    if (chunk >= BIN_MAX_CHUNKS)
+        goto end;
+    if (!bin->chunks[chunk]) {
+        bin->chunks[chunk] = av_malloc_array(BIN_CHUNK_SIZE << chunk, bin->entry_size);
+        if (!bin->chunks[chunk])
+            goto end;
+        atomic_store_explicit(&bin->nb_chunks, chunk + 1, memory_order_release);
+    }
+    bin->nb_entries++;
+
+    e        = bin_entry(bin, index);
+    e->index = index;
+    atomic_init(&e->next, 0);
+end:
+    ff_mutex_unlock(&bin->mutex);
+    return e;
+}
+
+/**
+ * @return the entry of the structure at ptr, NULL if it does not come from
+ *         the free list
+ */
+static RecycleEntry *bin_find_entry(RecycleBin *bin, const void *ptr)
+{
+    int nb_chunks = atomic_load_explicit(&bin->nb_chunks, memory_order_acquire);
+    uintptr_t addr = (uintptr_t)ptr - ENTRY_HEADER_SIZE;
+    int i;
+
+    for (i = 0; i < nb_chunks; i++) {
+        uintptr_t start = (uintptr_t)bin->chunks[i];
+        if (addr >= start && addr - start < (BIN_CHUNK_SIZE << i) * bin->entry_size &&
+            !((addr - start) % bin->entry_size))
+            return (RecycleEntry *)addr;
+    }
+    return NULL;
+}
+
+void *avpriv_recycle_alloc(enum AVRecycleType type, size_t size)
+{
+    RecycleBin *bin = &bins[type];
+    RecycleEntry *e;
+    uint8_t *ptr;
+
+    if (!atomic_load_explicit(&recycle_enabled, memory_order_relaxed))
+        return av_mallocz(size);
+
+    if ((e = bin_pop(bin)))
+        atomic_fetch_add_explicit(&bin->hits, 1, memory_order_relaxed);
+    else if ((e = bin_new_entry(bin, size)))
+        atomic_fetch_add_explicit(&bin->misses, 1, memory_order_relaxed);
+    else
+        return av_mallocz(size);
+
+    ptr = (uint8_t *)e + ENTRY_HEADER_SIZE;
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+void avpriv_recycle_freep(enum AVRecycleType type, void *arg)
+{
+    RecycleBin *bin = &bins[type];
+    RecycleEntry *e;
+    void *ptr;
+
+    memcpy(&ptr, arg, sizeof(ptr));
+    memcpy(arg, &(void *){ NULL }, sizeof(ptr));
+    if (!ptr)
+        return;
+
+    if (!(e = bin_find_entry(bin, ptr))) {
+        av_free(ptr);
+        return;
+    }
+
+    if (CONFIG_MEMORY_POISONING)
+        memset(ptr, FF_MEMORY_POISON, bin->size);
+    bin_push(bin, e);
+}
+
+void av_recycle_enable(int enable)
+{
+    atomic_store_explicit(&recycle_enabled, !!enable, memory_order_relaxed);
+}
+
+int av_recycle_get_stats(enum AVRecycleType type, AVRecycleStats *stats)
+{
+    RecycleBin *bin;
+
+    if ((unsigned)type >= AV_RECYCLE_NB)
+        return AVERROR(EINVAL);
+    bin = &bins[type];
+
+    memset(stats, 0, sizeof(*stats));
+    stats->hits   = atomic_load_explicit(&bin->hits,   memory_order_relaxed);
+    stats->misses = atomic_load_explicit(&bin->misses, memory_order_relaxed);
+    ff_mutex_lock(&bin->mutex);
+    stats->nb_entries = bin->nb_entries;
+    ff_mutex_unlock(&bin->mutex);
+
+    return 0;
+}
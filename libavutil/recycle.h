@@ -0,0 +1,107 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * @ingroup lavu_recycle
+ * Recycling of the small structures allocated for every frame and packet.
+ */
+
+#ifndef AVUTIL_RECYCLE_H
+#define AVUTIL_RECYCLE_H
+
+#include <stdint.h>
+
+/**
+ * @defgroup lavu_recycle Structure recycling
+ * @ingroup lavu_mem
+ *
+ * Every decoding, filtering and encoding step allocates and frees a few
+ * small structures: the AVFrame or AVPacket itself, the AVBuffer and
+ * AVBufferRef of every buffer reference and the AVFrameSideData of every
+ * piece of side data. When recycling is enabled, the freed structures are
+ * kept in process-wide lock-free free lists and handed out again by the
+ * next allocations instead of going through malloc() and free().
+ *
+ * The memory of the recycled structures is kept until the process exits,
+ * so recycling is only worth it for long-running processes which allocate
+ * many of these structures per second.
+ *
+ * @{
+ */
+
+/**
+ * The kinds of recycled structures.
+ */
+enum AVRecycleType {
+    AV_RECYCLE_FRAME,           ///< AVFrame, from av_frame_alloc()
+    AV_RECYCLE_PACKET,          ///< AVPacket, from av_packet_alloc()
+    AV_RECYCLE_BUFFER,          ///< AVBuffer, from av_buffer_create()
+    AV_RECYCLE_BUFFER_REF,      ///< AVBufferRef, from av_buffer_create() and av_buffer_ref()
+    AV_RECYCLE_FRAME_SIDE_DATA, ///< AVFrameSideData, from av_frame_new_side_data()
+    AV_RECYCLE_NB,              ///< Number of types, not part of the ABI
+};
+
+/**
+ * Statistics of the recycling of one kind of structure.
+ *
+ * New fields can be added to the end with minor version bumps.
+ */
+typedef struct AVRecycleStats {
+    /**
+     * Number of allocations served from the free list.
+     */
+    uint64_t hits;
+
+    /**
+     * Number of allocations made while recycling was enabled which found
+     * the free list empty and had to allocate a new structure.
+     */
+    uint64_t misses;
+
+    /**
+     * Number of structures owned by the free list, either in use or
+     * available.
+     */
+    unsigned nb_entries;
+} AVRecycleStats;
+
+/**
+ * Enable or disable the recycling of the structures listed in
+ * enum AVRecycleType. It is disabled by default.
+ *
+ * This can be called at any time: the structures allocated before are
+ * freed as usual, the structures allocated from the free lists are
+ * returned to them even once recycling has been disabled again.
+ *
+ * @param enable 1 to enable recycling, 0 to disable it
+ */
+void av_recycle_enable(int enable);
+
+/**
+ * Get the recycling statistics of one kind of structure.
+ *
+ * @return 0 on success, AVERROR(EINVAL) if type is invalid
+ */
+int av_recycle_get_stats(enum AVRecycleType type, AVRecycleStats *stats);
+
+/**
+ * @}
+ */
+
+#endif /* AVUTIL_RECYCLE_H */
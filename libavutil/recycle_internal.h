@@ -0,0 +1,47 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVUTIL_RECYCLE_INTERNAL_H
+#define AVUTIL_RECYCLE_INTERNAL_H
+
+#include <stddef.h>
+
+#include "recycle.h"
+
+/**
+ * Allocate a zeroed structure of the given type, from its free list if
+ * recycling is enabled.
+ *
+ * @param size size of the structure, must be the same for all the
+ *             allocations of a type
+ * @return the structure, NULL on failure. It must be freed with
+ *         avpriv_recycle_freep(). If recycling is disabled, or the free
+ *         list cannot provide it, this is a plain av_mallocz() allocation.
+ */
+void *avpriv_recycle_alloc(enum AVRecycleType type, size_t size);
+
+/**
+ * Free a structure allocated with avpriv_recycle_alloc() or av_mallocz() and
+ * set the pointer pointing to it to NULL.
+ *
+ * @param type type the structure was allocated with
+ * @param ptr  pointer to the pointer to the structure, which may be NULL
+ */
+void avpriv_recycle_freep(enum AVRecycleType type, void *ptr);
+
+#endif /* AVUTIL_RECYCLE_INTERNAL_H */
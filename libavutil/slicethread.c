@@ -20,6 +20,7 @@
 #include "slicethread.h"
 #include "mem.h"
 #include "thread.h"
+#include "threadpool_internal.h"
 #include "avassert.h"
 
 #if HAVE_PTHREADS || HAVE_W32THREADS || HAVE_OS2THREADS
@@ -34,6 +35,7 @@ typedef struct WorkerContext {
 
 struct AVSliceThread {
     WorkerContext   *workers;
+    FFThreadPool    *pool;
     int             nb_threads;
     int             nb_active_threads;
     int             nb_jobs;
@@ -116,6 +118,11 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
     if (!ctx)
         return AVERROR(ENOMEM);
 
+    /* The main function may wait for the jobs to make progress, which is only
+     * guaranteed with private threads. */
+    if (!main_func && nb_threads > 1 && (ctx->pool = ff_thread_pool_ref_shared()))
+        nb_workers = 0;
+
     if (nb_workers && !(ctx->workers = av_calloc(nb_workers, sizeof(*ctx->workers)))) {
         av_freep(pctx);
         return AVERROR(ENOMEM);
@@ -166,6 +173,12 @@ void avpriv_slicethread_execute(AVSliceThread *ctx, int nb_jobs, int execute_mai
     int nb_workers, i, is_last = 0;
 
     av_assert0(nb_jobs > 0);
+    if (ctx->pool) {
+        ff_thread_pool_execute(ctx->pool, ctx->priv, ctx->worker_func, NULL,
+                               nb_jobs, FFMIN(nb_jobs, ctx->nb_threads));
+        return;
+    }
+
     ctx->nb_jobs           = nb_jobs;
     ctx->nb_active_threads = FFMIN(nb_jobs, ctx->nb_threads);
     atomic_store_explicit(&ctx->first_job, 0, memory_order_relaxed);
@@ -208,6 +221,10 @@ void avpriv_slicethread_free(AVSliceThread **pctx)
     nb_workers = ctx->nb_threads;
     if (!ctx->main_func)
         nb_workers--;
+    if (ctx->pool) {
+        ff_thread_pool_unref(&ctx->pool);
+        nb_workers = 0;
+    }
 
     ctx->finished = 1;
     for (i = 0; i < nb_workers; i++) {
@@ -0,0 +1,210 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Get and release buffers from one AVBufferPool in several threads, checking
+ * that no buffer is handed out twice. This is done once with the default
+ * allocator and once with a custom one returning offset references to
+ * buffers it keeps references to itself.
+ *
+ * Usage: bufferpool [threads [iterations]]
+ * When arguments are given, the get/release throughput is printed.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/buffer.h"
+#include "libavutil/common.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#define MAX_THREADS 64
+#define BUFFER_SIZE 64
+#define NB_HELD     4
+#define MAX_SHARED  (MAX_THREADS * (NB_HELD + 1))
+#define OFFSET      16
+
+typedef struct SharedAlloc {
+    pthread_mutex_t lock;
+    AVBufferRef    *bufs[MAX_SHARED];
+    int             nb_bufs;
+    int             freed;
+} SharedAlloc;
+
+typedef struct Worker {
+    AVBufferPool *pool;
+    pthread_t     thread;
+    int           id;
+    int           nb_iterations;
+    int           failed;
+} Worker;
+
+static void *worker(void *arg)
+{
+    Worker *w = arg;
+    AVBufferRef *held[NB_HELD] = { NULL };
+    int i, j;
+
+    for (i = 0; i < w->nb_iterations; i++) {
+        int slot = i % NB_HELD;
+        AVBufferRef *buf = av_buffer_pool_get(w->pool);
+
+        if (!buf) {
+            w->failed = 1;
+            break;
+        }
+        if (!av_buffer_is_writable(buf) || buf->size != BUFFER_SIZE) {
+            fprintf(stderr, "buffer not writable or wrong size\n");
+            w->failed = 1;
+        }
+        memset(buf->data, w->id, BUFFER_SIZE);
+
+        /* exercise both additional references and moving the buffer */
+        if (i & 1) {
+            AVBufferRef *ref = av_buffer_ref(buf);
+            av_buffer_unref(&buf);
+            buf = ref;
+        }
+
+        av_buffer_unref(&held[slot]);
+        held[slot] = buf;
+
+        for (j = 0; j < NB_HELD; j++) {
+            if (held[j] && (held[j]->data[0] != w->id ||
+                            held[j]->data[BUFFER_SIZE - 1] != w->id)) {
+                fprintf(stderr, "buffer shared between threads\n");
+                w->failed = 1;
+            }
+        }
+        if (w->failed)
+            break;
+    }
+
+    for (j = 0; j < NB_HELD; j++)
+        av_buffer_unref(&held[j]);
+
+    return NULL;
+}
+
+static AVBufferRef *shared_alloc(void *opaque, int size)
+{
+    SharedAlloc *s = opaque;
+    AVBufferRef *buf, *ref;
+
+    buf = av_buffer_alloc(size + OFFSET);
+    if (!buf)
+        return NULL;
+    ref = av_buffer_ref(buf);
+    if (!ref) {
+        av_buffer_unref(&buf);
+        return NULL;
+    }
+    ref->data += OFFSET;
+    ref->size  = size;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->nb_bufs < MAX_SHARED)
+        s->bufs[s->nb_bufs++] = buf;
+    else
+        av_buffer_unref(&buf);
+    pthread_mutex_unlock(&s->lock);
+
+    return ref;
+}
+
+static void shared_pool_free(void *opaque)
+{
+    SharedAlloc *s = opaque;
+    s->freed = 1;
+}
+
+static int run_pool(AVBufferPool *pool, int nb_threads, int nb_iterations,
+                    const char *name, int print)
+{
+    Worker workers[MAX_THREADS] = { { 0 } };
+    int64_t start, elapsed;
+    int i, ret = 0;
+
+    start = av_gettime_relative();
+    for (i = 0; i < nb_threads; i++) {
+        workers[i].pool          = pool;
+        workers[i].id            = i + 1;
+        workers[i].nb_iterations = nb_iterations;
+        if (pthread_create(&workers[i].thread, NULL, worker, &workers[i])) {
+            nb_threads = i;
+            ret = 1;
+            break;
+        }
+    }
+    for (i = 0; i < nb_threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        ret |= workers[i].failed;
+    }
+    elapsed = av_gettime_relative() - start;
+
+    av_buffer_pool_uninit(&pool);
+
+    if (print && !ret)
+        printf("%s, %d threads: %"PRId64" get/release per second\n", name,
+               nb_threads,
+               (int64_t)nb_threads * nb_iterations * 1000000 / FFMAX(elapsed, 1));
+
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    static SharedAlloc shared = { .lock = PTHREAD_MUTEX_INITIALIZER };
+    AVBufferPool *pool;
+    int nb_threads    = 4;
+    int nb_iterations = 100000;
+    int i, ret;
+
+    if (argc > 1)
+        nb_threads = av_clip(atoi(argv[1]), 1, MAX_THREADS);
+    if (argc > 2)
+        nb_iterations = FFMAX(atoi(argv[2]), 1);
+
+    pool = av_buffer_pool_init(BUFFER_SIZE, NULL);
+    if (!pool)
+        return 1;
+    ret = run_pool(pool, nb_threads, nb_iterations, "default", argc > 1);
+
+    pool = av_buffer_pool_init2(BUFFER_SIZE, &shared, shared_alloc,
+                                shared_pool_free);
+    if (!pool)
+        return 1;
+    ret |= run_pool(pool, nb_threads, nb_iterations, "shared", argc > 1);
+    if (!shared.freed) {
+        fprintf(stderr, "pool not freed\n");
+        ret = 1;
+    }
+    /* the pool must have dropped its references to the shared buffers */
+    for (i = 0; i < shared.nb_bufs; i++) {
+        if (!av_buffer_is_writable(shared.bufs[i])) {
+            fprintf(stderr, "buffer still referenced by the pool\n");
+            ret = 1;
+        }
+        av_buffer_unref(&shared.bufs[i]);
+    }
+
+    return ret;
+}
@@ -0,0 +1,195 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Allocate and free frames with side data in several threads with
+ * recycling enabled, checking that no structure is handed out twice and
+ * that the free lists are hit.
+ *
+ * Usage: recycle [threads [iterations]]
+ * When arguments are given, the alloc/free throughput is printed.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libavutil/buffer.h"
+#include "libavutil/common.h"
+#include "libavutil/frame.h"
+#include "libavutil/mem.h"
+#include "libavutil/recycle.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#define MAX_THREADS 64
+#define NB_HELD     4
+
+typedef struct Worker {
+    pthread_t thread;
+    int       id;
+    int       nb_iterations;
+    int       failed;
+} Worker;
+
+static AVFrame *alloc_frame(int id)
+{
+    AVFrame *frame = av_frame_alloc();
+    AVFrameSideData *sd;
+
+    if (!frame)
+        return NULL;
+    frame->pts = id;
+    frame->buf[0] = av_buffer_alloc(16);
+    sd = av_frame_new_side_data(frame, AV_FRAME_DATA_A53_CC, 4);
+    if (!frame->buf[0] || !sd) {
+        av_frame_free(&frame);
+        return NULL;
+    }
+    frame->buf[0]->data[0] = id;
+    sd->data[0]            = id;
+    return frame;
+}
+
+static int frame_is_intact(const AVFrame *frame, int id)
+{
+    return frame->pts == id && frame->buf[0]->data[0] == id &&
+           frame->nb_side_data == 1 && frame->side_data[0]->data[0] == id;
+}
+
+static void *worker(void *arg)
+{
+    Worker *w = arg;
+    AVFrame *held[NB_HELD] = { NULL };
+    int i, j;
+
+    for (i = 0; i < w->nb_iterations; i++) {
+        int slot = i % NB_HELD;
+
+        av_frame_free(&held[slot]);
+        held[slot] = alloc_frame(w->id);
+        if (!held[slot]) {
+            w->failed = 1;
+            break;
+        }
+
+        /* exercise additional references */
+        if (i & 1) {
+            AVFrame *ref = av_frame_clone(held[slot]);
+            if (!ref) {
+                w->failed = 1;
+                break;
+            }
+            av_frame_free(&held[slot]);
+            held[slot] = ref;
+        }
+
+        for (j = 0; j < NB_HELD; j++) {
+            if (held[j] && !frame_is_intact(held[j], w->id)) {
+                fprintf(stderr, "structure shared between threads\n");
+                w->failed = 1;
+            }
+        }
+        if (w->failed)
+            break;
+    }
+
+    for (j = 0; j < NB_HELD; j++)
+        av_frame_free(&held[j]);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    static const enum AVRecycleType types[] = {
+        AV_RECYCLE_FRAME, AV_RECYCLE_BUFFER, AV_RECYCLE_BUFFER_REF,
+        AV_RECYCLE_FRAME_SIDE_DATA,
+    };
+    Worker workers[MAX_THREADS] = { { 0 } };
+    AVRecycleStats stats;
+    AVFrame *before;
+    int nb_threads    = 4;
+    int nb_iterations = 100000;
+    int64_t start, elapsed;
+    int i, ret = 0;
+
+    if (argc > 1)
+        nb_threads = av_clip(atoi(argv[1]), 1, MAX_THREADS);
+    if (argc > 2)
+        nb_iterations = FFMAX(atoi(argv[2]), 1);
+
+    /* structures allocated before recycling is enabled are freed normally */
+    before = alloc_frame(1);
+    if (!before)
+        return 1;
+
+    av_recycle_enable(1);
+
+    start = av_gettime_relative();
+    for (i = 0; i < nb_threads; i++) {
+        workers[i].id            = i + 1;
+        workers[i].nb_iterations = nb_iterations;
+        if (pthread_create(&workers[i].thread, NULL, worker, &workers[i])) {
+            nb_threads = i;
+            ret = 1;
+            break;
+        }
+    }
+    for (i = 0; i < nb_threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        ret |= workers[i].failed;
+    }
+    elapsed = av_gettime_relative() - start;
+
+    av_frame_free(&before);
+
+    /* only the structures taken from the free lists are special, so frames
+     * allocated by other means are still accepted by av_frame_free() */
+    before = av_mallocz(sizeof(*before));
+    if (!before)
+        return 1;
+    av_frame_free(&before);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(types); i++) {
+        if (av_recycle_get_stats(types[i], &stats) < 0 ||
+            !stats.hits || !stats.misses || stats.misses != stats.nb_entries) {
+            fprintf(stderr, "type %d: %"PRIu64" hits, %"PRIu64" misses, %u entries\n",
+                    types[i], stats.hits, stats.misses, stats.nb_entries);
+            ret = 1;
+        } else if (argc > 1) {
+            printf("type %d: %.2f%% hits, %u entries\n", types[i],
+                   100.0 * stats.hits / (stats.hits + stats.misses), stats.nb_entries);
+        }
+    }
+    if (av_recycle_get_stats(AV_RECYCLE_NB, &stats) != AVERROR(EINVAL))
+        ret = 1;
+
+    /* recycled structures still in use can be freed after disabling */
+    before = alloc_frame(2);
+    av_recycle_enable(0);
+    if (!before || !frame_is_intact(before, 2))
+        ret = 1;
+    av_frame_free(&before);
+
+    if (argc > 1 && !ret)
+        printf("%d threads: %"PRId64" frame alloc/free per second\n", nb_threads,
+               (int64_t)nb_threads * nb_iterations * 1000000 / FFMAX(elapsed, 1));
+
+    return ret;
+}
@@ -0,0 +1,179 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * This test program runs slice threading contexts from several threads on
+ * the shared thread pool and checks that every job runs exactly once.
+ */
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/error.h"
+#include "libavutil/slicethread.h"
+#include "libavutil/thread.h"
+#include "libavutil/threadpool.h"
+
+#define NB_CLIENTS    3
+#define NB_ITERATIONS 200
+#define MAX_JOBS      37
+#define NB_THREADS    4
+
+typedef struct Client {
+    AVSliceThread *slicethread;
+    atomic_int     runs[MAX_JOBS];
+    atomic_int     bad_threadnr;
+    int            has_main;
+    int            main_runs;
+    uint64_t       nb_jobs;
+    int            failed;
+} Client;
+
+static void worker(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
+{
+    Client *c = priv;
+
+    if (threadnr < 0 || threadnr >= nb_threads || nb_threads > NB_THREADS)
+        atomic_fetch_add(&c->bad_threadnr, 1);
+    atomic_fetch_add(&c->runs[jobnr], 1);
+}
+
+static void main_func(void *priv)
+{
+    Client *c = priv;
+    c->main_runs++;
+}
+
+static void *client_main(void *arg)
+{
+    Client *c = arg;
+    int i, j;
+
+    for (i = 0; i < NB_ITERATIONS; i++) {
+        int nb_jobs = 1 + i % MAX_JOBS;
+        int execute_main = c->has_main && (i & 1);
+
+        for (j = 0; j < MAX_JOBS; j++)
+            atomic_store(&c->runs[j], 0);
+        c->main_runs = 0;
+
+        avpriv_slicethread_execute(c->slicethread, nb_jobs, execute_main);
+        c->nb_jobs += nb_jobs;
+
+        for (j = 0; j < MAX_JOBS; j++)
+            if (atomic_load(&c->runs[j]) != (j < nb_jobs)) {
+                fprintf(stderr, "job %d of %d ran %d times\n", j, nb_jobs,
+                        atomic_load(&c->runs[j]));
+                c->failed = 1;
+            }
+        if (c->main_runs != execute_main) {
+            fprintf(stderr, "main function ran %d times\n", c->main_runs);
+            c->failed = 1;
+        }
+    }
+    if (atomic_load(&c->bad_threadnr)) {
+        fprintf(stderr, "invalid threadnr\n");
+        c->failed = 1;
+    }
+
+    return NULL;
+}
+
+static int check_stats(uint64_t nb_batches, uint64_t nb_jobs)
+{
+    AVThreadPoolStats stats;
+
+    if (av_thread_pool_get_stats(&stats) < 0) {
+        fprintf(stderr, "av_thread_pool_get_stats failed\n");
+        return 1;
+    }
+    if (stats.nb_threads != 2 || stats.nb_batches != nb_batches ||
+        stats.nb_jobs != nb_jobs || stats.queue_depth ||
+        stats.max_queue_depth > NB_CLIENTS - 1) {
+        fprintf(stderr, "unexpected stats: threads %d batches %"PRIu64"/%"PRIu64" "
+                "jobs %"PRIu64"/%"PRIu64" queue depth %d max %d\n",
+                stats.nb_threads, stats.nb_batches, nb_batches,
+                stats.nb_jobs, nb_jobs, stats.queue_depth, stats.max_queue_depth);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    Client clients[NB_CLIENTS] = { 0 };
+    pthread_t threads[NB_CLIENTS];
+    AVThreadPoolStats stats;
+    uint64_t nb_jobs = 0;
+    int i, ret;
+
+    if ((ret = av_thread_pool_init(2)) != 2) {
+        fprintf(stderr, "av_thread_pool_init failed: %d\n", ret);
+        return 1;
+    }
+    if (av_thread_pool_init(2) != AVERROR(EEXIST)) {
+        fprintf(stderr, "second av_thread_pool_init did not fail\n");
+        return 1;
+    }
+
+    /* the first client has a main function and thus private threads */
+    for (i = 0; i < NB_CLIENTS; i++) {
+        clients[i].has_main = !i;
+        ret = avpriv_slicethread_create(&clients[i].slicethread, &clients[i],
+                                        worker, clients[i].has_main ? main_func : NULL,
+                                        NB_THREADS);
+        if (ret != NB_THREADS) {
+            fprintf(stderr, "avpriv_slicethread_create failed: %d\n", ret);
+            return 1;
+        }
+    }
+
+    for (i = 0; i < NB_CLIENTS; i++) {
+        if ((ret = pthread_create(&threads[i], NULL, client_main, &clients[i]))) {
+            fprintf(stderr, "pthread_create failed: %s.\n", strerror(ret));
+            return 1;
+        }
+    }
+    for (i = 0; i < NB_CLIENTS; i++) {
+        pthread_join(threads[i], NULL);
+        if (clients[i].failed)
+            return 2;
+        if (i)
+            nb_jobs += clients[i].nb_jobs;
+    }
+
+    if (check_stats((NB_CLIENTS - 1) * NB_ITERATIONS, nb_jobs))
+        return 3;
+
+    /* the contexts keep the pool alive */
+    av_thread_pool_uninit();
+    if (av_thread_pool_get_stats(&stats) != AVERROR(EINVAL)) {
+        fprintf(stderr, "the pool is still shared after uninit\n");
+        return 3;
+    }
+    client_main(&clients[1]);
+    if (clients[1].failed)
+        return 2;
+
+    for (i = 0; i < NB_CLIENTS; i++)
+        avpriv_slicethread_free(&clients[i].slicethread);
+
+    return 0;
+}
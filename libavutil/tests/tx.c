@@ -0,0 +1,187 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Check the float transforms against the double ones.
+ *
+ * Usage: tx [-b [iterations]]
+ * With -b, the time per float transform is printed for each size instead.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+#include "libavutil/tx.h"
+
+#define MAX_LEN 131072
+
+static const int lengths[] = {
+    2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384,
+    32768, 65536, 131072,
+    3 * 64, 3 * 1024, 5 * 32, 5 * 512, 15 * 16, 15 * 128, 15 * 8192,
+};
+
+typedef struct TXTest {
+    AVTXContext *f, *d;
+    av_tx_fn     f_fn, d_fn;
+    int          mdct, inv, len;
+    int          in_len, out_len;   ///< number of real values
+} TXTest;
+
+static void tx_test_uninit(TXTest *t)
+{
+    av_tx_uninit(&t->f);
+    av_tx_uninit(&t->d);
+}
+
+static int tx_test_init(TXTest *t, int mdct, int inv, int len)
+{
+    const float  scale_f = mdct ? 1.0f / len : 1.0f;
+    const double scale_d = scale_f;
+    int ret;
+
+    memset(t, 0, sizeof(*t));
+    t->mdct = mdct;
+    t->inv  = inv;
+    t->len  = len;
+
+    if (mdct) {
+        /* len is the frame size, the window is twice as long */
+        t->in_len  = inv ? len : 2 * len;
+        t->out_len = len;
+    } else {
+        t->in_len = t->out_len = 2 * len;
+    }
+
+    ret = av_tx_init(&t->f, &t->f_fn, mdct ? AV_TX_FLOAT_MDCT : AV_TX_FLOAT_FFT,
+                     inv, len, &scale_f, 0);
+    if (ret < 0)
+        return ret;
+    ret = av_tx_init(&t->d, &t->d_fn, mdct ? AV_TX_DOUBLE_MDCT : AV_TX_DOUBLE_FFT,
+                     inv, len, &scale_d, 0);
+    if (ret < 0)
+        tx_test_uninit(t);
+    return ret;
+}
+
+static int check(AVLFG *lfg, TXTest *t, float *in_f, float *out_f,
+                 double *in_d, double *out_d)
+{
+    double err = 0.0, ref = 0.0;
+    int i;
+
+    for (i = 0; i < t->in_len; i++) {
+        in_f[i] = av_lfg_get(lfg) / (double)UINT32_MAX - 0.5;
+        in_d[i] = in_f[i];
+    }
+
+    t->f_fn(t->f, out_f, in_f, sizeof(float));
+    t->d_fn(t->d, out_d, in_d, sizeof(double));
+
+    for (i = 0; i < t->out_len; i++) {
+        err += (out_f[i] - out_d[i]) * (out_f[i] - out_d[i]);
+        ref += out_d[i] * out_d[i];
+    }
+    err = sqrt(err / t->out_len);
+    ref = sqrt(ref / t->out_len);
+
+    if (!(err <= ref * 1e-5)) {
+        fprintf(stderr, "%s%s %d: rms error %g for rms %g\n", t->inv ? "i" : "",
+                t->mdct ? "mdct" : "fft", t->len, err, ref);
+        return 1;
+    }
+    return 0;
+}
+
+static void bench(TXTest *t, float *in, float *out, int iterations)
+{
+    int64_t start;
+    int i;
+
+    for (i = 0; i < t->in_len; i++)
+        in[i] = i & 1 ? 0.25f : -0.5f;
+
+    /* scale the iteration count so that every size takes about as long */
+    iterations = FFMAX(iterations / t->len, 16);
+    t->f_fn(t->f, out, in, sizeof(float));
+
+    start = av_gettime_relative();
+    for (i = 0; i < iterations; i++)
+        t->f_fn(t->f, out, in, sizeof(float));
+
+    printf("%s%-4s %6d: %10.1f ns\n", t->inv ? "i" : "", t->mdct ? "mdct" : "fft",
+           t->len, (av_gettime_relative() - start) * 1000.0 / iterations);
+}
+
+int main(int argc, char **argv)
+{
+    float  *in_f  = av_malloc_array(2 * MAX_LEN, sizeof(*in_f));
+    float  *out_f = av_malloc_array(2 * MAX_LEN, sizeof(*out_f));
+    double *in_d  = av_malloc_array(2 * MAX_LEN, sizeof(*in_d));
+    double *out_d = av_malloc_array(2 * MAX_LEN, sizeof(*out_d));
+    int do_bench  = argc > 1 && !strcmp(argv[1], "-b");
+    int iterations = argc > 2 ? atoi(argv[2]) : 100000000;
+    AVLFG lfg;
+    int i, mdct, inv, ret = 0;
+
+    if (!in_f || !out_f || !in_d || !out_d) {
+        ret = 1;
+        goto end;
+    }
+    av_lfg_init(&lfg, 0xdeadbeef);
+
+    for (mdct = 0; mdct < 2; mdct++) {
+        for (inv = 0; inv < 2; inv++) {
+            for (i = 0; i < FF_ARRAY_ELEMS(lengths); i++) {
+                TXTest t;
+                int err;
+
+                /* an MDCT of 2 needs an FFT of 1, which is not supported */
+                if (mdct && lengths[i] < 4)
+                    continue;
+
+                err = tx_test_init(&t, mdct, inv, lengths[i]);
+                if (err < 0) {
+                    fprintf(stderr, "%s%s %d: init failed: %s\n", inv ? "i" : "",
+                            mdct ? "mdct" : "fft", lengths[i], av_err2str(err));
+                    ret = 1;
+                    continue;
+                }
+                if (do_bench)
+                    bench(&t, in_f, out_f, iterations);
+                else
+                    ret |= check(&lfg, &t, in_f, out_f, in_d, out_d);
+                tx_test_uninit(&t);
+            }
+        }
+    }
+
+end:
+    av_free(in_f);
+    av_free(out_f);
+    av_free(in_d);
+    av_free(out_d);
+    return ret;
+}
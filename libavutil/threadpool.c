@@ -0,0 +1,448 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdatomic.h>
+#include "threadpool.h"
+#include "threadpool_internal.h"
+#include "cpu.h"
+#include "error.h"
+#include "mem.h"
+#include "thread.h"
+#include "avassert.h"
+
+#if HAVE_PTHREADS || HAVE_W32THREADS || HAVE_OS2THREADS
+
+/*
+ * The pool has one queue of batches per worker. A batch is the set of jobs
+ * of one execute call, its jobs are handed out through an atomic counter so
+ * that any number of threads can work on it. Batches are queued round robin,
+ * a worker with an empty queue joins the batches queued for the others.
+ * A batch leaves its queue once all its jobs have been started or the
+ * maximum number of threads are working on it.
+ *
+ * Each queue has its own lock, so submitters and workers only contend on the
+ * queue they use. The pool mutex is only taken by idle workers going to sleep
+ * and by submitters waking them up.
+ */
+
+struct WorkQueue;
+
+typedef struct Batch {
+    void            *priv;
+    void            (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads);
+    int             nb_jobs;
+    int             nb_threads;
+    atomic_uint     next_job;
+    struct WorkQueue *q;            ///< queue the batch is assigned to
+
+    /* protected by the lock of q */
+    int             nb_slots;       ///< number of threadnr handed out
+    int             nb_running;     ///< pool threads currently running jobs
+    int             queued;         ///< the batch is in q
+    struct Batch    *next;
+} Batch;
+
+typedef struct WorkQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t  done_cond;      ///< a batch of the queue has no pool thread left
+    Batch           *first;
+} WorkQueue;
+
+struct FFThreadPool {
+    pthread_t       *threads;
+    int             nb_threads;
+    int             nb_created;
+    atomic_int      refcount;
+
+    WorkQueue       *queues;
+    atomic_uint     next_queue;
+    atomic_int      nb_started;
+
+    /* idle pool threads wait on work_cond until a batch is queued */
+    pthread_mutex_t mutex;
+    pthread_cond_t  work_cond;
+    atomic_int      nb_idle;
+    int             finished;
+
+    atomic_uint_least64_t nb_batches;
+    atomic_uint_least64_t nb_jobs;
+    atomic_uint_least64_t nb_steals;
+    atomic_int      queue_depth;
+    atomic_int      max_queue_depth;
+};
+
+static AVMutex shared_pool_lock = AV_MUTEX_INITIALIZER;
+static FFThreadPool *shared_pool;
+
+/* must be called with the lock of b->q held */
+static void queue_batch(FFThreadPool *pool, Batch *b)
+{
+    Batch **p;
+    int depth, max_depth;
+
+    b->next = NULL;
+    for (p = &b->q->first; *p; p = &(*p)->next)
+        ;
+    *p = b;
+    b->queued = 1;
+
+    depth     = atomic_fetch_add(&pool->queue_depth, 1) + 1;
+    max_depth = atomic_load_explicit(&pool->max_queue_depth, memory_order_relaxed);
+    while (depth > max_depth &&
+           !atomic_compare_exchange_weak_explicit(&pool->max_queue_depth, &max_depth, depth,
+                                                  memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+/* must be called with the lock of b->q held */
+static void dequeue_batch(FFThreadPool *pool, Batch *b)
+{
+    Batch **p;
+
+    if (!b->queued)
+        return;
+
+    for (p = &b->q->first; *p != b; p = &(*p)->next)
+        av_assert1(*p);
+    *p = b->next;
+    b->queued = 0;
+    atomic_fetch_sub(&pool->queue_depth, 1);
+}
+
+/**
+ * Reserve a threadnr in the batch, must be called with the lock of b->q held.
+ * @return the threadnr, or -1 if enough threads already work on the batch
+ */
+static int take_slot(FFThreadPool *pool, Batch *b)
+{
+    int slot;
+
+    if (b->nb_slots >= b->nb_threads)
+        return -1;
+    slot = b->nb_slots++;
+    if (b->nb_slots >= b->nb_threads)
+        dequeue_batch(pool, b);
+    return slot;
+}
+
+static int run_batch(Batch *b, int threadnr)
+{
+    unsigned nb_jobs = b->nb_jobs;
+    unsigned jobnr;
+    int done = 0;
+
+    while ((jobnr = atomic_fetch_add_explicit(&b->next_job, 1, memory_order_acq_rel)) < nb_jobs) {
+        b->worker_func(b->priv, jobnr, threadnr, nb_jobs, b->nb_threads);
+        done++;
+    }
+    return done;
+}
+
+/**
+ * Wait until a batch is queued or the pool is freed.
+ * @return 1 if the pool is being freed
+ */
+static int wait_for_work(FFThreadPool *pool)
+{
+    int finished;
+
+    pthread_mutex_lock(&pool->mutex);
+    /* paired with the queue_depth increment and nb_idle check in
+     * ff_thread_pool_execute(), one of the two sees the other */
+    atomic_fetch_add(&pool->nb_idle, 1);
+    while (!atomic_load(&pool->queue_depth) && !pool->finished)
+        pthread_cond_wait(&pool->work_cond, &pool->mutex);
+    atomic_fetch_sub(&pool->nb_idle, 1);
+    finished = pool->finished;
+    pthread_mutex_unlock(&pool->mutex);
+
+    return finished;
+}
+
+static void *attribute_align_arg thread_worker(void *v)
+{
+    FFThreadPool *pool = v;
+    int self = atomic_fetch_add(&pool->nb_started, 1);
+
+    while (1) {
+        WorkQueue *q = NULL;
+        Batch *b = NULL;
+        int i, slot = -1, done;
+
+        for (i = 0; i < pool->nb_threads && !b; i++) {
+            q = &pool->queues[(self + i) % pool->nb_threads];
+
+            pthread_mutex_lock(&q->lock);
+            b = q->first;
+            if (b) {
+                slot = take_slot(pool, b);
+                av_assert1(slot >= 0);
+                b->nb_running++;
+            }
+            pthread_mutex_unlock(&q->lock);
+        }
+        if (!b) {
+            if (wait_for_work(pool))
+                break;
+            continue;
+        }
+        if (q != &pool->queues[self])
+            atomic_fetch_add_explicit(&pool->nb_steals, 1, memory_order_relaxed);
+
+        done = run_batch(b, slot);
+        atomic_fetch_add_explicit(&pool->nb_jobs, done, memory_order_relaxed);
+
+        pthread_mutex_lock(&q->lock);
+        /* all the jobs have been started, no point in joining anymore */
+        dequeue_batch(pool, b);
+        if (!--b->nb_running)
+            pthread_cond_broadcast(&q->done_cond);
+        pthread_mutex_unlock(&q->lock);
+    }
+
+    return NULL;
+}
+
+void ff_thread_pool_execute(FFThreadPool *pool, void *priv,
+                            void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
+                            void (*main_func)(void *priv),
+                            int nb_jobs, int nb_threads)
+{
+    WorkQueue *q = &pool->queues[atomic_fetch_add_explicit(&pool->next_queue, 1,
+                                                           memory_order_relaxed) % pool->nb_threads];
+    Batch b = {
+        .priv        = priv,
+        .worker_func = worker_func,
+        .nb_jobs     = nb_jobs,
+        .nb_threads  = nb_threads,
+        .q           = q,
+    };
+    int slot = -1, done = 0, queued;
+
+    av_assert0(nb_jobs > 0 && nb_threads > 0);
+    atomic_init(&b.next_job, 0);
+    atomic_fetch_add_explicit(&pool->nb_batches, 1, memory_order_relaxed);
+
+    pthread_mutex_lock(&q->lock);
+    if (!main_func)
+        slot = take_slot(pool, &b);
+    queued = b.nb_slots < b.nb_threads;
+    if (queued)
+        queue_batch(pool, &b);
+    pthread_mutex_unlock(&q->lock);
+
+    if (queued && atomic_load(&pool->nb_idle)) {
+        pthread_mutex_lock(&pool->mutex);
+        pthread_cond_broadcast(&pool->work_cond);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    if (main_func) {
+        main_func(priv);
+
+        pthread_mutex_lock(&q->lock);
+        slot = take_slot(pool, &b);
+        pthread_mutex_unlock(&q->lock);
+    }
+
+    if (slot >= 0)
+        done = run_batch(&b, slot);
+    atomic_fetch_add_explicit(&pool->nb_jobs, done, memory_order_relaxed);
+
+    pthread_mutex_lock(&q->lock);
+    dequeue_batch(pool, &b);
+    while (b.nb_running)
+        pthread_cond_wait(&q->done_cond, &q->lock);
+    pthread_mutex_unlock(&q->lock);
+
+    /* either this thread or a pool thread holding a slot ran until the end */
+    av_assert1(atomic_load(&b.next_job) >= nb_jobs);
+}
+
+static void pool_free(FFThreadPool *pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->finished = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (i = 0; i < pool->nb_created; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    for (i = 0; i < pool->nb_threads; i++) {
+        pthread_cond_destroy(&pool->queues[i].done_cond);
+        pthread_mutex_destroy(&pool->queues[i].lock);
+    }
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->mutex);
+    av_freep(&pool->queues);
+    av_freep(&pool->threads);
+    av_free(pool);
+}
+
+FFThreadPool *ff_thread_pool_ref_shared(void)
+{
+    FFThreadPool *pool;
+
+    ff_mutex_lock(&shared_pool_lock);
+    pool = shared_pool;
+    if (pool)
+        atomic_fetch_add_explicit(&pool->refcount, 1, memory_order_relaxed);
+    ff_mutex_unlock(&shared_pool_lock);
+
+    return pool;
+}
+
+void ff_thread_pool_unref(FFThreadPool **ppool)
+{
+    FFThreadPool *pool = *ppool;
+
+    if (!pool)
+        return;
+    *ppool = NULL;
+
+    if (atomic_fetch_sub_explicit(&pool->refcount, 1, memory_order_acq_rel) == 1)
+        pool_free(pool);
+}
+
+int av_thread_pool_init(int nb_threads)
+{
+    FFThreadPool *pool;
+    int i, ret;
+
+    if (nb_threads < 0)
+        return AVERROR(EINVAL);
+    if (!nb_threads)
+        nb_threads = av_cpu_count();
+
+    pool = av_mallocz(sizeof(*pool));
+    if (!pool)
+        return AVERROR(ENOMEM);
+    pool->threads = av_calloc(nb_threads, sizeof(*pool->threads));
+    pool->queues  = av_calloc(nb_threads, sizeof(*pool->queues));
+    if (!pool->threads || !pool->queues) {
+        av_freep(&pool->threads);
+        av_freep(&pool->queues);
+        av_free(pool);
+        return AVERROR(ENOMEM);
+    }
+
+    atomic_init(&pool->refcount, 1);
+    atomic_init(&pool->next_queue, 0);
+    atomic_init(&pool->nb_started, 0);
+    atomic_init(&pool->nb_idle, 0);
+    atomic_init(&pool->nb_batches, 0);
+    atomic_init(&pool->nb_jobs, 0);
+    atomic_init(&pool->nb_steals, 0);
+    atomic_init(&pool->queue_depth, 0);
+    atomic_init(&pool->max_queue_depth, 0);
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+
+    pool->nb_threads = nb_threads;
+    for (i = 0; i < nb_threads; i++) {
+        pthread_mutex_init(&pool->queues[i].lock, NULL);
+        pthread_cond_init(&pool->queues[i].done_cond, NULL);
+    }
+    for (i = 0; i < nb_threads; i++) {
+        if ((ret = pthread_create(&pool->threads[i], NULL, thread_worker, pool))) {
+            pool_free(pool);
+            return AVERROR(ret);
+        }
+        pool->nb_created++;
+    }
+
+    ff_mutex_lock(&shared_pool_lock);
+    if (shared_pool) {
+        ff_mutex_unlock(&shared_pool_lock);
+        pool_free(pool);
+        return AVERROR(EEXIST);
+    }
+    shared_pool = pool;
+    ff_mutex_unlock(&shared_pool_lock);
+
+    return nb_threads;
+}
+
+void av_thread_pool_uninit(void)
+{
+    FFThreadPool *pool;
+
+    ff_mutex_lock(&shared_pool_lock);
+    pool = shared_pool;
+    shared_pool = NULL;
+    ff_mutex_unlock(&shared_pool_lock);
+
+    ff_thread_pool_unref(&pool);
+}
+
+int av_thread_pool_get_stats(AVThreadPoolStats *stats)
+{
+    FFThreadPool *pool = ff_thread_pool_ref_shared();
+
+    if (!pool)
+        return AVERROR(EINVAL);
+
+    stats->nb_threads      = pool->nb_threads;
+    stats->nb_batches      = atomic_load_explicit(&pool->nb_batches, memory_order_relaxed);
+    stats->nb_jobs         = atomic_load_explicit(&pool->nb_jobs, memory_order_relaxed);
+    stats->nb_steals       = atomic_load_explicit(&pool->nb_steals, memory_order_relaxed);
+    stats->queue_depth     = atomic_load_explicit(&pool->queue_depth, memory_order_relaxed);
+    stats->max_queue_depth = atomic_load_explicit(&pool->max_queue_depth, memory_order_relaxed);
+
+    ff_thread_pool_unref(&pool);
+    return 0;
+}
+
+#else /* HAVE_PTHREADS || HAVE_W32THREADS || HAVE_OS2THREADS */
+
+FFThreadPool *ff_thread_pool_ref_shared(void)
+{
+    return NULL;
+}
+
+void ff_thread_pool_unref(FFThreadPool **ppool)
+{
+    av_assert0(!ppool || !*ppool);
+}
+
+void ff_thread_pool_execute(FFThreadPool *pool, void *priv,
+                            void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
+                            void (*main_func)(void *priv),
+                            int nb_jobs, int nb_threads)
+{
+    av_assert0(0);
+}
+
+int av_thread_pool_init(int nb_threads)
+{
+    return AVERROR(ENOSYS);
+}
+
+void av_thread_pool_uninit(void)
+{
+}
+
+int av_thread_pool_get_stats(AVThreadPoolStats *stats)
+{
+    return AVERROR(EINVAL);
+}
+
+#endif /* HAVE_PTHREADS || HAVE_W32THREADS || HAVE_OS2THREADS */
@@ -0,0 +1,115 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * @ingroup lavu_threadpool
+ * Process-wide shared thread pool.
+ */
+
+#ifndef AVUTIL_THREADPOOL_H
+#define AVUTIL_THREADPOOL_H
+
+#include <stdint.h>
+
+/**
+ * @defgroup lavu_threadpool Shared thread pool
+ * @ingroup lavu_data
+ *
+ * By default every codec and filter graph using slice threading starts its
+ * own set of threads. When many of them run in the same process, this leads
+ * to far more threads than CPUs. Once the shared pool is initialized, the
+ * slice threading contexts created afterwards do not start any thread and
+ * run their jobs on the pool instead, except for the few whose main thread
+ * runs a separate function alongside the jobs. Idle pool threads take work queued for
+ * other threads, so the load is balanced across all the users of the pool.
+ *
+ * Frame threading is not affected.
+ *
+ * @{
+ */
+
+/**
+ * Statistics of the shared thread pool.
+ *
+ * New fields can be added to the end with minor version bumps.
+ */
+typedef struct AVThreadPoolStats {
+    /**
+     * Number of worker threads in the pool.
+     */
+    int nb_threads;
+
+    /**
+     * Number of job batches (one per slice threaded execute call) which
+     * were submitted to the pool.
+     */
+    uint64_t nb_batches;
+
+    /**
+     * Number of jobs run, both by the pool threads and by the threads which
+     * submitted them.
+     */
+    uint64_t nb_jobs;
+
+    /**
+     * Number of times a pool thread took part in a batch queued for another
+     * pool thread.
+     */
+    uint64_t nb_steals;
+
+    /**
+     * Number of batches currently waiting for pool threads.
+     */
+    int queue_depth;
+
+    /**
+     * Highest value of queue_depth so far.
+     */
+    int max_queue_depth;
+} AVThreadPoolStats;
+
+/**
+ * Create the shared thread pool. This must be called before the codec and
+ * filter graph contexts which should use it are created.
+ *
+ * @param nb_threads number of worker threads, 0 for one per CPU
+ * @return number of worker threads on success, a negative AVERROR code on
+ *         failure, AVERROR(EEXIST) if the pool already exists
+ */
+int av_thread_pool_init(int nb_threads);
+
+/**
+ * Release the shared thread pool. The contexts still using it keep it
+ * alive until they are freed, the contexts created afterwards use private
+ * threads again.
+ */
+void av_thread_pool_uninit(void);
+
+/**
+ * Get the statistics of the shared thread pool.
+ *
+ * @return 0 on success, AVERROR(EINVAL) if there is no shared pool
+ */
+int av_thread_pool_get_stats(AVThreadPoolStats *stats);
+
+/**
+ * @}
+ */
+
+#endif /* AVUTIL_THREADPOOL_H */
@@ -0,0 +1,51 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVUTIL_THREADPOOL_INTERNAL_H
+#define AVUTIL_THREADPOOL_INTERNAL_H
+
+typedef struct FFThreadPool FFThreadPool;
+
+/**
+ * Get a new reference to the shared thread pool.
+ * @return the pool, or NULL if av_thread_pool_init() was not called
+ */
+FFThreadPool *ff_thread_pool_ref_shared(void);
+
+/**
+ * Release a reference obtained with ff_thread_pool_ref_shared().
+ */
+void ff_thread_pool_unref(FFThreadPool **ppool);
+
+/**
+ * Run nb_jobs calls of worker_func on the pool and wait for them to finish.
+ *
+ * The calling thread takes part in the work. The threadnr passed to
+ * worker_func is unique among the threads running jobs of this call and
+ * lower than nb_threads.
+ *
+ * @param main_func if not NULL, called from the calling thread before it
+ *                  starts running jobs
+ * @param nb_threads maximum number of threads running jobs of this call
+ */
+void ff_thread_pool_execute(FFThreadPool *pool, void *priv,
+                            void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
+                            void (*main_func)(void *priv),
+                            int nb_jobs, int nb_threads);
+
+#endif /* AVUTIL_THREADPOOL_INTERNAL_H */
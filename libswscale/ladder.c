@@ -0,0 +1,250 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * scaling of one source to several destination sizes
+ */
+
+#include <string.h>
+
+#include "libavutil/error.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/mem.h"
+#include "libavutil/pixdesc.h"
+
+#include "swscale.h"
+
+typedef struct LadderStep {
+    struct SwsContext *sws;
+    int dst;            ///< index of the destination written by this step
+    int src;            ///< index of the destination read, -1 for the source
+    int srcH;
+} LadderStep;
+
+struct SwsLadder {
+    LadderStep *steps;
+    int nb_steps;
+
+    /* source unpacked once for all the steps reading it, see planar_format() */
+    struct SwsContext *unpack;
+    uint8_t *planes[4];
+    int strides[4];
+    int srcH;
+};
+
+/**
+ * Get the planar format holding the same samples as an 8-bit YUV format
+ * with interleaved components, like NV12 or YUYV422. Unpacking to it is
+ * exact, and the scalers read it without any conversion, so the outputs do
+ * not change when the source is unpacked once for several destinations.
+ *
+ * @return AV_PIX_FMT_NONE if the format does not need unpacking
+ */
+static enum AVPixelFormat planar_format(enum AVPixelFormat format)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format), *d = NULL;
+    int i, interleaved = 0;
+
+    if (!desc || desc->nb_components != 3 ||
+        desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BE |
+                       AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_HWACCEL |
+                       AV_PIX_FMT_FLAG_BAYER | AV_PIX_FMT_FLAG_FLOAT))
+        return AV_PIX_FMT_NONE;
+    for (i = 0; i < 3; i++) {
+        if (desc->comp[i].depth != 8 || desc->comp[i].shift)
+            return AV_PIX_FMT_NONE;
+        interleaved |= desc->comp[i].plane != i || desc->comp[i].step != 1;
+    }
+    if (!interleaved)
+        return AV_PIX_FMT_NONE;
+
+    while ((d = av_pix_fmt_desc_next(d))) {
+        if (d->nb_components != 3 || d->flags != AV_PIX_FMT_FLAG_PLANAR ||
+            d->log2_chroma_w != desc->log2_chroma_w ||
+            d->log2_chroma_h != desc->log2_chroma_h)
+            continue;
+        for (i = 0; i < 3; i++)
+            if (d->comp[i].depth != 8 || d->comp[i].plane != i ||
+                d->comp[i].step != 1 || d->comp[i].offset || d->comp[i].shift)
+                break;
+        /* the JPEG range formats are deprecated */
+        if (i == 3 && strncmp(d->name, "yuvj", 4))
+            return av_pix_fmt_desc_get_id(d);
+    }
+    return AV_PIX_FMT_NONE;
+}
+
+/**
+ * Intermediate images are stored in the destination format, so only
+ * cascade through formats which do not lose more precision than 8 bits
+ * per component.
+ */
+static int can_cascade(enum AVPixelFormat format)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+
+    if (!desc || !sws_isSupportedInput(format))
+        return 0;
+    if (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM |
+                       AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BAYER))
+        return 0;
+    return desc->comp[0].depth >= 8;
+}
+
+struct SwsLadder *sws_alloc_ladder(int srcW, int srcH, enum AVPixelFormat srcFormat,
+                                   int nb_dst, const int *dstW, const int *dstH,
+                                   enum AVPixelFormat dstFormat, int flags,
+                                   const double *param, double cascade_ratio)
+{
+    struct SwsLadder *l;
+    int cascade = cascade_ratio >= 1.0 && can_cascade(dstFormat);
+    enum AVPixelFormat planar;
+    int i, j, nb_from_src = 0;
+
+    if (nb_dst <= 0 || srcW <= 0 || srcH <= 0)
+        return NULL;
+    for (i = 0; i < nb_dst; i++)
+        if (dstW[i] <= 0 || dstH[i] <= 0)
+            return NULL;
+
+    l = av_mallocz(sizeof(*l));
+    if (!l)
+        return NULL;
+    l->steps = av_calloc(nb_dst, sizeof(*l->steps));
+    if (!l->steps)
+        goto fail;
+
+    /* produce the destinations from the largest to the smallest */
+    for (i = 0; i < nb_dst; i++) {
+        for (j = i; j > 0; j--) {
+            int prev = l->steps[j - 1].dst;
+            if ((int64_t)dstW[prev] * dstH[prev] >= (int64_t)dstW[i] * dstH[i])
+                break;
+            l->steps[j] = l->steps[j - 1];
+        }
+        l->steps[j].dst = i;
+    }
+
+    for (i = 0; i < nb_dst; i++) {
+        LadderStep *step = &l->steps[i];
+        int w = dstW[step->dst], h = dstH[step->dst];
+
+        /*
+         * Scale from the smallest destination produced so far that is
+         * downscaled from the source and large enough to keep the quality.
+         */
+        step->src  = -1;
+        step->srcH = srcH;
+        for (j = i - 1; cascade && j >= 0; j--) {
+            int prev = l->steps[j].dst;
+            if (dstW[prev] <= srcW && dstH[prev] <= srcH &&
+                dstW[prev] >= w * cascade_ratio && dstH[prev] >= h * cascade_ratio) {
+                step->src  = prev;
+                step->srcH = dstH[prev];
+                break;
+            }
+        }
+        nb_from_src += step->src < 0;
+    }
+
+    /* unpack an interleaved source once if several steps read it */
+    planar = planar_format(srcFormat);
+    if (nb_from_src > 1 && planar != AV_PIX_FMT_NONE) {
+        l->unpack = sws_getContext(srcW, srcH, srcFormat, srcW, srcH, planar,
+                                   SWS_POINT, NULL, NULL, NULL);
+        if (!l->unpack ||
+            av_image_alloc(l->planes, l->strides, srcW, srcH, planar, 32) < 0)
+            goto fail;
+        l->srcH   = srcH;
+        srcFormat = planar;
+    }
+
+    for (i = 0; i < nb_dst; i++) {
+        LadderStep *step = &l->steps[i];
+        int inW = step->src < 0 ? srcW : dstW[step->src];
+        enum AVPixelFormat inFormat = step->src < 0 ? srcFormat : dstFormat;
+
+        step->sws = sws_getContext(inW, step->srcH, inFormat,
+                                   dstW[step->dst], dstH[step->dst], dstFormat,
+                                   flags, NULL, NULL, param);
+        if (!step->sws)
+            goto fail;
+        l->nb_steps++;
+    }
+
+    return l;
+fail:
+    sws_free_ladder(&l);
+    return NULL;
+}
+
+int sws_scale_ladder(struct SwsLadder *l, const uint8_t *const src[],
+                     const int srcStride[], uint8_t *const dst[][4],
+                     const int dstStride[][4])
+{
+    int i, ret;
+
+    if (l->unpack) {
+        ret = sws_scale(l->unpack, src, srcStride, 0, l->srcH, l->planes, l->strides);
+        if (ret < 0)
+            return ret;
+        src       = (const uint8_t *const *)l->planes;
+        srcStride = l->strides;
+    }
+
+    for (i = 0; i < l->nb_steps; i++) {
+        const LadderStep *step = &l->steps[i];
+        const uint8_t *const *in = step->src < 0 ? src :
+                                   (const uint8_t *const *)dst[step->src];
+        const int *inStride = step->src < 0 ? srcStride : dstStride[step->src];
+
+        ret = sws_scale(step->sws, in, inStride, 0, step->srcH,
+                        dst[step->dst], dstStride[step->dst]);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+int sws_ladder_get_source(const struct SwsLadder *l, int index)
+{
+    int i;
+
+    for (i = 0; i < l->nb_steps; i++)
+        if (l->steps[i].dst == index)
+            return l->steps[i].src;
+    return AVERROR(EINVAL);
+}
+
+void sws_free_ladder(struct SwsLadder **pl)
+{
+    struct SwsLadder *l = *pl;
+    int i;
+
+    if (!l)
+        return;
+
+    for (i = 0; i < l->nb_steps; i++)
+        sws_freeContext(l->steps[i].sws);
+    av_freep(&l->steps);
+    sws_freeContext(l->unpack);
+    av_freep(&l->planes[0]);
+    av_freep(pl);
+}
@@ -243,6 +243,7 @@ static int swscale(SwsContext *c, const uint8_t *src[],
      * and faster */
     const int dstW                   = c->dstW;
     const int dstH                   = c->dstH;
+    const int dstEnd                 = c->dst_slice_end ? c->dst_slice_end : dstH;
 
     const enum AVPixelFormat dstFormat = c->dstFormat;
     const int flags                  = c->flags;
@@ -335,7 +336,7 @@ static int swscale(SwsContext *c, const uint8_t *src[],
      * will not get executed. This is not really intended but works
      * currently, so people might do it. */
     if (srcSliceY == 0) {
-        dstY         = 0;
+        dstY         = c->dst_slice_start;
         lastInLumBuf = -1;
         lastInChrBuf = -1;
     }
@@ -367,7 +368,7 @@ static int swscale(SwsContext *c, const uint8_t *src[],
         hout_slice->width = dstW;
     }
 
-    for (; dstY < dstH; dstY++) {
+    for (; dstY < dstEnd; dstY++) {
         const int chrDstY = dstY >> c->chrDstVSubSample;
         int use_mmx_vfilter= c->use_mmx_vfilter;
 
@@ -738,6 +739,81 @@ static void rgb48Toxyz12(struct SwsContext *c, uint16_t *dst,
     }
 }
 
+static void slice_band(const SwsContext *c, int jobnr, int nb_jobs,
+                       int *start, int *end)
+{
+    int units = (c->dstH + SWS_SLICE_ALIGN - 1) / SWS_SLICE_ALIGN;
+
+    *start = units *  jobnr      / nb_jobs * SWS_SLICE_ALIGN;
+    *end   = FFMIN(units * (jobnr + 1) / nb_jobs * SWS_SLICE_ALIGN, c->dstH);
+}
+
+void ff_sws_slice_worker(void *priv, int jobnr, int threadnr,
+                         int nb_jobs, int nb_threads)
+{
+    SwsContext *parent = priv;
+    SwsContext *c = parent->slice_ctx[jobnr];
+    const uint8_t *src[4];
+    uint8_t *dst[4];
+    int srcStride[4], dstStride[4];
+    int i, start, end;
+
+    memcpy(src,       parent->slice_src,        sizeof(src));
+    memcpy(srcStride, parent->slice_src_stride, sizeof(srcStride));
+    memcpy(dst,       parent->slice_dst,        sizeof(dst));
+    memcpy(dstStride, parent->slice_dst_stride, sizeof(dstStride));
+
+    slice_band(parent, jobnr, nb_jobs, &start, &end);
+
+    if (c->swscale == swscale) {
+        /* every band reads the source lines its vertical filter needs */
+        c->dst_slice_start = start;
+        c->dst_slice_end   = end;
+        parent->slice_err[jobnr] = c->swscale(c, src, srcStride, 0, c->srcH,
+                                              dst, dstStride);
+    } else {
+        /* unscaled conversions map source lines to destination lines */
+        for (i = 0; i < 4; i++) {
+            int vsub = i == 1 || i == 2 ? c->chrSrcVSubSample : 0;
+            if (src[i] && !(i == 1 && usePal(c->srcFormat)))
+                src[i] += (start >> vsub) * srcStride[i];
+        }
+        parent->slice_err[jobnr] = c->swscale(c, src, srcStride, start,
+                                              end - start, dst, dstStride);
+    }
+}
+
+static int scale_threaded(SwsContext *c, const uint8_t *src[4],
+                          const int srcStride[4], uint8_t *dst[4],
+                          const int dstStride[4])
+{
+    int units   = (c->dstH + SWS_SLICE_ALIGN - 1) / SWS_SLICE_ALIGN;
+    int nb_jobs = FFMIN(c->nb_slice_ctx, units);
+    int i;
+
+    memcpy(c->slice_src,        src,       sizeof(c->slice_src));
+    memcpy(c->slice_src_stride, srcStride, sizeof(c->slice_src_stride));
+    memcpy(c->slice_dst,        dst,       sizeof(c->slice_dst));
+    memcpy(c->slice_dst_stride, dstStride, sizeof(c->slice_dst_stride));
+
+    if (usePal(c->srcFormat)) {
+        for (i = 0; i < nb_jobs; i++) {
+            memcpy(c->slice_ctx[i]->pal_yuv, c->pal_yuv, sizeof(c->pal_yuv));
+            memcpy(c->slice_ctx[i]->pal_rgb, c->pal_rgb, sizeof(c->pal_rgb));
+        }
+    }
+
+    avpriv_slicethread_execute(c->slicethread, nb_jobs, 0);
+
+    for (i = 0; i < nb_jobs; i++)
+        if (c->slice_err[i] < 0)
+            return c->slice_err[i];
+
+    if (c->swscale == swscale)
+        c->dstY = c->dstH;
+    return c->dstH;
+}
+
 /**
  * swscale wrapper, so we don't need to export the SwsContext.
  * Assumes planar YUV to be in YUV order instead of YVU.
@@ -967,7 +1043,10 @@ int attribute_align_arg sws_scale(struct SwsContext *c,
     /* reset slice direction at end of frame */
     if (srcSliceY_internal + srcSliceH == c->srcH)
         c->sliceDir = 0;
-    ret = c->swscale(c, src2, srcStride2, srcSliceY_internal, srcSliceH, dst2, dstStride2);
+    if (c->nb_slice_ctx && srcSliceY_internal == 0 && srcSliceH == c->srcH)
+        ret = scale_threaded(c, src2, srcStride2, dst2, dstStride2);
+    else
+        ret = c->swscale(c, src2, srcStride2, srcSliceY_internal, srcSliceH, dst2, dstStride2);
 
     if (c->dstXYZ && !(c->srcXYZ && c->srcW==c->dstW && c->srcH==c->dstH)) {
         int dstY = c->dstY ? c->dstY : srcSliceY + srcSliceH;
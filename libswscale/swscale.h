@@ -218,6 +218,62 @@ int sws_scale(struct SwsContext *c, const uint8_t *const srcSlice[],
               const int srcStride[], int srcSliceY, int srcSliceH,
               uint8_t *const dst[], const int dstStride[]);
 
+struct SwsLadder;
+
+/**
+ * Allocate a context scaling one source image to several destination sizes
+ * in the same pixel format, e.g. the renditions of an adaptive streaming
+ * ladder.
+ *
+ * The destinations are produced from the largest to the smallest. When
+ * cascade_ratio is at least 1, a destination is scaled from the smallest
+ * destination produced before it which is downscaled from the source and at
+ * least cascade_ratio times larger in both dimensions, instead of from the
+ * source. Only the destinations for which no such intermediate exists read
+ * and convert the source then. Cascading is not done for destination formats
+ * with less than 8 bits per component or with a palette. A source with
+ * interleaved 8-bit YUV components, like NV12 or YUYV422, is unpacked once
+ * for all the destinations reading it. The horizontal filtering is still
+ * done for every destination, as their widths differ.
+ *
+ * @param nb_dst        the number of destinations
+ * @param dstW          the widths of the destinations
+ * @param dstH          the heights of the destinations
+ * @param flags         the same as for sws_getContext()
+ * @param param         the same as for sws_getContext()
+ * @param cascade_ratio minimum size ratio between a destination and the
+ *                      destination it is scaled from, 0 to scale all of them
+ *                      from the source
+ * @return a pointer to an allocated context, or NULL in case of error
+ */
+struct SwsLadder *sws_alloc_ladder(int srcW, int srcH, enum AVPixelFormat srcFormat,
+                                   int nb_dst, const int *dstW, const int *dstH,
+                                   enum AVPixelFormat dstFormat, int flags,
+                                   const double *param, double cascade_ratio);
+
+/**
+ * Scale a complete source image to all the destinations of a ladder.
+ *
+ * @param dst       the planes of each destination, in the order of the
+ *                  sizes given to sws_alloc_ladder()
+ * @param dstStride the strides of each destination
+ * @return 0 on success, a negative value on error
+ */
+int sws_scale_ladder(struct SwsLadder *ladder, const uint8_t *const src[],
+                     const int srcStride[], uint8_t *const dst[][4],
+                     const int dstStride[][4]);
+
+/**
+ * @return the index of the destination the destination index is scaled from,
+ *         -1 if it is scaled from the source, or a negative AVERROR code
+ */
+int sws_ladder_get_source(const struct SwsLadder *ladder, int index);
+
+/**
+ * Free a ladder context and set the pointer to NULL.
+ */
+void sws_free_ladder(struct SwsLadder **ladder);
+
 /**
  * @param dstRange flag indicating the while-black range of the output (1=jpeg / 0=mpeg)
  * @param srcRange flag indicating the while-black range of the input (1=jpeg / 0=mpeg)
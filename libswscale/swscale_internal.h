@@ -33,6 +33,7 @@
 #include "libavutil/pixfmt.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/ppc/util_altivec.h"
+#include "libavutil/slicethread.h"
 
 #define STR(s) AV_TOSTRING(s) // AV_STRINGIFY is too long
 
@@ -61,6 +62,10 @@
 
 #define RETCODE_USE_CASCADE -12345
 
+/* Alignment of the destination bands of slice threading, a multiple of the
+ * chroma subsampling and of the period of the ordered dither matrices. */
+#define SWS_SLICE_ALIGN 16
+
 struct SwsContext;
 
 typedef enum SwsDither {
@@ -324,6 +329,21 @@ typedef struct SwsContext {
     uint8_t *cascaded1_tmp[4];
     int cascaded_mainindex;
 
+    /* Slice threading: each slice context outputs one band of destination
+     * lines from the whole source image, so that the result is identical
+     * to the one of this context. */
+    int nb_threads;
+    struct SwsContext **slice_ctx;
+    int nb_slice_ctx;
+    int *slice_err;
+    AVSliceThread *slicethread;
+    const uint8_t *slice_src[4];
+    int slice_src_stride[4];
+    uint8_t *slice_dst[4];
+    int slice_dst_stride[4];
+    int dst_slice_start;          ///< first line output by swscale() from a whole source image
+    int dst_slice_end;            ///< line after the last one output by swscale(), 0 for dstH
+
     double gamma_value;
     int gamma_flag;
     int is_internal_gamma;
@@ -866,12 +886,21 @@ void ff_get_unscaled_swscale_ppc(SwsContext *c);
 void ff_get_unscaled_swscale_arm(SwsContext *c);
 void ff_get_unscaled_swscale_aarch64(SwsContext *c);
 
+/**
+ * Return whether the unscaled converter of c, if any, gives the same output
+ * for a band of lines as for the whole image.
+ */
+int ff_sws_unscaled_is_line_based(SwsContext *c);
+
 /**
  * Return function pointer to fastest main scaler path function depending
  * on architecture and available optimizations.
  */
 SwsFunc ff_getSwsFunc(SwsContext *c);
 
+void ff_sws_slice_worker(void *priv, int jobnr, int threadnr,
+                         int nb_jobs, int nb_threads);
+
 void ff_sws_init_input_funcs(SwsContext *c);
 void ff_sws_init_output_funcs(SwsContext *c,
                               yuv2planar1_fn *yuv2plane1,
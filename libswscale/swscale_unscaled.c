@@ -1972,6 +1972,14 @@ static int planarCopyWrapper(SwsContext *c, const uint8_t *src[],
      (src_fmt == pix_fmt ## LE && dst_fmt == pix_fmt ## BE))
 
 
+int ff_sws_unscaled_is_line_based(SwsContext *c)
+{
+    /* these treat the borders of the slices as the ones of the image */
+    return c->swscale != yvu9ToYv12Wrapper &&
+           c->swscale != ff_sws_alphablendaway &&
+           !isBayer(c->srcFormat);
+}
+
 void ff_get_unscaled_swscale(SwsContext *c)
 {
     const enum AVPixelFormat srcFormat = c->srcFormat;
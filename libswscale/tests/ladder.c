@@ -0,0 +1,178 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Check that the destinations of a ladder scaled from the source are
+ * identical to the output of sws_scale(), and that the cascaded ones are
+ * close to it.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/imgutils.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "libavutil/pixdesc.h"
+
+#include "libswscale/swscale.h"
+
+#define SRC_W 640
+#define SRC_H 360
+#define NB_DST 4
+
+static const int dst_w[NB_DST] = { 320, 480, 160, 400 };
+static const int dst_h[NB_DST] = { 180, 270,  90, 224 };
+/* sources with a cascade ratio of 1.5 */
+static const int cascade_src[NB_DST] = { 1, -1, 0, -1 };
+
+static const enum AVPixelFormat src_formats[] = {
+    AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, AV_PIX_FMT_YUYV422, AV_PIX_FMT_RGB24,
+    AV_PIX_FMT_YUV420P10,
+};
+
+/* over the yuv420p planes, ignoring the padding */
+static double psnr(uint8_t *const a[4], const int a_stride[4],
+                   uint8_t *const b[4], const int b_stride[4], int w, int h)
+{
+    double sse = 0;
+    int i, x, y;
+
+    for (i = 0; i < 3; i++) {
+        int pw = i ? AV_CEIL_RSHIFT(w, 1) : w, ph = i ? AV_CEIL_RSHIFT(h, 1) : h;
+        for (y = 0; y < ph; y++)
+            for (x = 0; x < pw; x++) {
+                int d = a[i][y * a_stride[i] + x] - b[i][y * b_stride[i] + x];
+                sse += d * d;
+            }
+    }
+    return sse ? 10 * log10(255.0 * 255.0 * w * h * 3 / 2 / sse) : INFINITY;
+}
+
+static int check_ladder(enum AVPixelFormat src_fmt, uint8_t *src[4], int src_stride[4],
+                        double cascade_ratio)
+{
+    const enum AVPixelFormat dst_fmt = AV_PIX_FMT_YUV420P;
+    uint8_t *dst[NB_DST][4] = { { NULL } }, *ref[4] = { NULL };
+    int dst_stride[NB_DST][4], ref_stride[4];
+    struct SwsLadder *ladder;
+    int i, ret = 1;
+
+    ladder = sws_alloc_ladder(SRC_W, SRC_H, src_fmt, NB_DST, dst_w, dst_h,
+                              dst_fmt, SWS_BICUBIC, NULL, cascade_ratio);
+    if (!ladder) {
+        fprintf(stderr, "sws_alloc_ladder failed\n");
+        return 1;
+    }
+    for (i = 0; i < NB_DST; i++)
+        if (av_image_alloc(dst[i], dst_stride[i], dst_w[i], dst_h[i], dst_fmt, 32) < 0)
+            goto end;
+
+    if (sws_scale_ladder(ladder, (const uint8_t * const *)src, src_stride,
+                         dst, dst_stride) < 0) {
+        fprintf(stderr, "sws_scale_ladder failed\n");
+        goto end;
+    }
+
+    for (i = 0; i < NB_DST; i++) {
+        int expected = cascade_ratio ? cascade_src[i] : -1;
+        int source   = sws_ladder_get_source(ladder, i);
+        struct SwsContext *sws;
+        double p;
+
+        if (source != expected) {
+            fprintf(stderr, "%s %dx%d: source %d instead of %d\n",
+                    av_get_pix_fmt_name(src_fmt), dst_w[i], dst_h[i], source, expected);
+            goto end;
+        }
+
+        if (av_image_alloc(ref, ref_stride, dst_w[i], dst_h[i], dst_fmt, 32) < 0)
+            goto end;
+        sws = sws_getContext(SRC_W, SRC_H, src_fmt, dst_w[i], dst_h[i], dst_fmt,
+                             SWS_BICUBIC, NULL, NULL, NULL);
+        if (!sws) {
+            av_freep(&ref[0]);
+            goto end;
+        }
+        sws_scale(sws, (const uint8_t * const *)src, src_stride, 0, SRC_H, ref, ref_stride);
+        sws_freeContext(sws);
+
+        p = psnr(ref, ref_stride, dst[i], dst_stride[i], dst_w[i], dst_h[i]);
+        av_freep(&ref[0]);
+        if (source < 0 ? p != INFINITY : p < 40) {
+            fprintf(stderr, "%s %dx%d from %d: psnr %f\n",
+                    av_get_pix_fmt_name(src_fmt), dst_w[i], dst_h[i], source, p);
+            goto end;
+        }
+    }
+    ret = 0;
+
+end:
+    for (i = 0; i < NB_DST; i++)
+        av_freep(&dst[i][0]);
+    sws_free_ladder(&ladder);
+    return ret;
+}
+
+int main(void)
+{
+    const enum AVPixelFormat gen_fmt = AV_PIX_FMT_YUV420P;
+    uint8_t *gen[4], *src[4];
+    int gen_stride[4], src_stride[4];
+    AVLFG lfg;
+    int i, x, y, ret = 0;
+
+    av_lfg_init(&lfg, 1);
+    if (av_image_alloc(gen, gen_stride, SRC_W, SRC_H, gen_fmt, 32) < 0)
+        return 1;
+
+    /* smooth gradients with some noise */
+    for (i = 0; i < 3; i++) {
+        int w = i ? SRC_W / 2 : SRC_W, h = i ? SRC_H / 2 : SRC_H;
+        for (y = 0; y < h; y++)
+            for (x = 0; x < w; x++)
+                gen[i][y * gen_stride[i] + x] = 64 + (x * (i + 1) + y * 2) % 128 +
+                                                 (av_lfg_get(&lfg) & 7);
+    }
+
+    for (i = 0; i < FF_ARRAY_ELEMS(src_formats) && !ret; i++) {
+        struct SwsContext *sws;
+
+        if (av_image_alloc(src, src_stride, SRC_W, SRC_H, src_formats[i], 32) < 0) {
+            ret = 1;
+            break;
+        }
+        sws = sws_getContext(SRC_W, SRC_H, gen_fmt, SRC_W, SRC_H, src_formats[i],
+                             SWS_POINT, NULL, NULL, NULL);
+        if (!sws) {
+            av_freep(&src[0]);
+            ret = 1;
+            break;
+        }
+        sws_scale(sws, (const uint8_t * const *)gen, gen_stride, 0, SRC_H, src, src_stride);
+        sws_freeContext(sws);
+
+        ret |= check_ladder(src_formats[i], src, src_stride, 0);
+        ret |= check_ladder(src_formats[i], src, src_stride, 1.5);
+        av_freep(&src[0]);
+    }
+
+    av_freep(&gen[0]);
+    return ret;
+}
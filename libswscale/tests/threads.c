@@ -0,0 +1,154 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Check that slice threaded scaling gives the same output as scaling on a
+ * single thread.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/imgutils.h"
+#include "libavutil/lfg.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+
+#include "libswscale/swscale.h"
+
+#define SRC_W 96
+#define SRC_H 72
+
+static const enum AVPixelFormat pix_fmts[] = {
+    AV_PIX_FMT_YUV420P,  AV_PIX_FMT_YUV422P,     AV_PIX_FMT_YUV444P,
+    AV_PIX_FMT_YUVA420P, AV_PIX_FMT_YUV410P,     AV_PIX_FMT_NV12,
+    AV_PIX_FMT_YUYV422,  AV_PIX_FMT_RGB24,       AV_PIX_FMT_BGRA,
+    AV_PIX_FMT_RGB565LE, AV_PIX_FMT_GRAY8,       AV_PIX_FMT_YUV420P10LE,
+    AV_PIX_FMT_P010LE,   AV_PIX_FMT_RGB48LE,     AV_PIX_FMT_GBRP,
+    AV_PIX_FMT_GBRP12LE, AV_PIX_FMT_PAL8,        AV_PIX_FMT_MONOBLACK,
+};
+
+static const int dst_sizes[][2] = {
+    { SRC_W, SRC_H }, { 160, 100 }, { 50, 36 }, { 96, 200 },
+};
+
+static const int flags[] = {
+    SWS_FAST_BILINEAR, SWS_BILINEAR, SWS_BICUBIC | SWS_ACCURATE_RND,
+    SWS_POINT | SWS_FULL_CHR_H_INT, SWS_LANCZOS | SWS_BITEXACT,
+};
+
+static struct SwsContext *alloc_context(enum AVPixelFormat src_fmt,
+                                        enum AVPixelFormat dst_fmt,
+                                        int dst_w, int dst_h, int flags,
+                                        int threads)
+{
+    struct SwsContext *c = sws_alloc_context();
+
+    if (!c)
+        return NULL;
+    av_opt_set_int(c, "srcw",       SRC_W,   0);
+    av_opt_set_int(c, "srch",       SRC_H,   0);
+    av_opt_set_int(c, "src_format", src_fmt, 0);
+    av_opt_set_int(c, "dstw",       dst_w,   0);
+    av_opt_set_int(c, "dsth",       dst_h,   0);
+    av_opt_set_int(c, "dst_format", dst_fmt, 0);
+    av_opt_set_int(c, "sws_flags",  flags,   0);
+    av_opt_set_int(c, "threads",    threads, 0);
+    if (sws_init_context(c, NULL, NULL) < 0) {
+        sws_freeContext(c);
+        return NULL;
+    }
+    return c;
+}
+
+static int scale(enum AVPixelFormat src_fmt, uint8_t *src[4], int src_stride[4],
+                 enum AVPixelFormat dst_fmt, int dst_w, int dst_h, int flags,
+                 int threads, uint8_t *dst[4], int dst_stride[4], int *size)
+{
+    struct SwsContext *c;
+
+    *size = av_image_alloc(dst, dst_stride, dst_w, dst_h, dst_fmt, 32);
+    if (*size < 0)
+        return *size;
+    memset(dst[0], 0, *size);
+
+    c = alloc_context(src_fmt, dst_fmt, dst_w, dst_h, flags, threads);
+    if (!c)
+        return AVERROR(EINVAL);
+    sws_scale(c, (const uint8_t * const *)src, src_stride, 0, SRC_H, dst, dst_stride);
+    sws_freeContext(c);
+    return 0;
+}
+
+int main(void)
+{
+    uint8_t *src[4];
+    int src_stride[4];
+    AVLFG lfg;
+    int i, j, k, l, n, ret = 0;
+
+    av_log_set_level(AV_LOG_ERROR);
+    av_lfg_init(&lfg, 1);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(pix_fmts); i++) {
+        enum AVPixelFormat src_fmt = pix_fmts[i];
+        int size = av_image_alloc(src, src_stride, SRC_W, SRC_H, src_fmt, 32);
+
+        if (size < 0)
+            return 1;
+        for (n = 0; n < size; n++)
+            src[0][n] = av_lfg_get(&lfg);
+
+        for (j = 0; j < FF_ARRAY_ELEMS(pix_fmts); j++) {
+            enum AVPixelFormat dst_fmt = pix_fmts[j];
+
+            if (!sws_isSupportedInput(src_fmt) || !sws_isSupportedOutput(dst_fmt))
+                continue;
+
+            for (k = 0; k < FF_ARRAY_ELEMS(dst_sizes); k++) {
+                for (l = 0; l < FF_ARRAY_ELEMS(flags); l++) {
+                    uint8_t *ref[4] = { NULL }, *out[4] = { NULL };
+                    int ref_stride[4], out_stride[4], ref_size, out_size;
+                    int w = dst_sizes[k][0], h = dst_sizes[k][1];
+
+                    if (scale(src_fmt, src, src_stride, dst_fmt, w, h, flags[l], 1,
+                              ref, ref_stride, &ref_size) < 0 ||
+                        scale(src_fmt, src, src_stride, dst_fmt, w, h, flags[l], 4,
+                              out, out_stride, &out_size) < 0) {
+                        fprintf(stderr, "%s -> %s %dx%d flags 0x%x: scaling failed\n",
+                                av_get_pix_fmt_name(src_fmt), av_get_pix_fmt_name(dst_fmt),
+                                w, h, flags[l]);
+                        ret = 1;
+                    } else if (memcmp(ref[0], out[0], ref_size)) {
+                        fprintf(stderr, "%s -> %s %dx%d flags 0x%x: output differs\n",
+                                av_get_pix_fmt_name(src_fmt), av_get_pix_fmt_name(dst_fmt),
+                                w, h, flags[l]);
+                        ret = 1;
+                    }
+                    av_freep(&ref[0]);
+                    av_freep(&out[0]);
+                }
+            }
+        }
+        av_freep(&src[0]);
+    }
+
+    return ret;
+}
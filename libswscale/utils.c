@@ -876,6 +876,7 @@ int sws_setColorspaceDetails(struct SwsContext *c, const int inv_table[4],
     const AVPixFmtDescriptor *desc_dst;
     const AVPixFmtDescriptor *desc_src;
     int need_reinit = 0;
+    int i;
 
     handle_formats(c);
     desc_dst = av_pix_fmt_desc_get(c->dstFormat);
@@ -915,6 +916,10 @@ int sws_setColorspaceDetails(struct SwsContext *c, const int inv_table[4],
     c->dstFormatBpp = av_get_bits_per_pixel(desc_dst);
     c->srcFormatBpp = av_get_bits_per_pixel(desc_src);
 
+    for (i = 0; i < c->nb_slice_ctx; i++)
+        sws_setColorspaceDetails(c->slice_ctx[i], inv_table, srcRange, table,
+                                 dstRange, brightness, contrast, saturation);
+
     if (c->cascaded_context[c->cascaded_mainindex])
         return sws_setColorspaceDetails(c->cascaded_context[c->cascaded_mainindex],inv_table, srcRange,table, dstRange, brightness,  contrast, saturation);
 
@@ -1176,8 +1181,8 @@ static enum AVPixelFormat alphaless_fmt(enum AVPixelFormat fmt)
     }
 }
 
-av_cold int sws_init_context(SwsContext *c, SwsFilter *srcFilter,
-                             SwsFilter *dstFilter)
+static av_cold int init_single_context(SwsContext *c, SwsFilter *srcFilter,
+                                      SwsFilter *dstFilter)
 {
     int i;
     int usesVFilter, usesHFilter;
@@ -1889,6 +1894,96 @@ fail: // FIXME replace things by appropriate error codes
     return ret;
 }
 
+static void free_slice_contexts(SwsContext *c)
+{
+    int i;
+
+    avpriv_slicethread_free(&c->slicethread);
+    for (i = 0; i < c->nb_slice_ctx; i++)
+        sws_freeContext(c->slice_ctx[i]);
+    av_freep(&c->slice_ctx);
+    av_freep(&c->slice_err);
+    c->nb_slice_ctx = 0;
+}
+
+/**
+ * Set up the slice contexts from tmpl, a copy of the options of c taken
+ * before c was initialized and possibly modified them. No more threads are
+ * started than there are bands of destination lines.
+ */
+static av_cold int init_slice_contexts(SwsContext *c, const SwsContext *tmpl,
+                                       SwsFilter *srcFilter, SwsFilter *dstFilter)
+{
+    int units      = (c->dstH + SWS_SLICE_ALIGN - 1) / SWS_SLICE_ALIGN;
+    int nb_threads = c->nb_threads ? c->nb_threads : av_cpu_count();
+    int i, ret;
+
+    nb_threads = FFMIN(nb_threads, units);
+    if (nb_threads <= 1)
+        return 0;
+
+    ret = avpriv_slicethread_create(&c->slicethread, c, ff_sws_slice_worker,
+                                    NULL, nb_threads);
+    if (ret == AVERROR(ENOSYS))
+        return 0;
+    if (ret < 0)
+        return ret;
+    if (ret == 1) {
+        avpriv_slicethread_free(&c->slicethread);
+        return 0;
+    }
+
+    c->slice_ctx = av_calloc(ret, sizeof(*c->slice_ctx));
+    c->slice_err = av_calloc(ret, sizeof(*c->slice_err));
+    if (!c->slice_ctx || !c->slice_err)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < ret; i++) {
+        SwsContext *slice = sws_alloc_context();
+        int err;
+
+        if (!slice)
+            return AVERROR(ENOMEM);
+        c->slice_ctx[c->nb_slice_ctx++] = slice;
+
+        if ((err = av_opt_copy(slice, tmpl)) < 0)
+            return err;
+        if ((err = sws_init_context(slice, srcFilter, dstFilter)) < 0)
+            return err;
+    }
+
+    return 0;
+}
+
+av_cold int sws_init_context(SwsContext *c, SwsFilter *srcFilter,
+                             SwsFilter *dstFilter)
+{
+    SwsContext *tmpl = NULL;
+    int ret;
+
+    if (c->nb_threads != 1) {
+        tmpl = sws_alloc_context();
+        if (!tmpl)
+            return AVERROR(ENOMEM);
+        if ((ret = av_opt_copy(tmpl, c)) < 0)
+            goto end;
+        tmpl->nb_threads = 1;
+    }
+
+    if ((ret = init_single_context(c, srcFilter, dstFilter)) < 0)
+        goto end;
+
+    /* the other cases process the image as a whole or carry state across
+     * lines, so no slice contexts are set up for them */
+    if (tmpl && !c->cascaded_context[0] && c->dither != SWS_DITHER_ED &&
+        ff_sws_unscaled_is_line_based(c) && c->dstH >= 2 * SWS_SLICE_ALIGN)
+        ret = init_slice_contexts(c, tmpl, srcFilter, dstFilter);
+
+end:
+    sws_freeContext(tmpl);
+    return ret;
+}
+
 SwsContext *sws_alloc_set_opts(int srcW, int srcH, enum AVPixelFormat srcFormat,
                                int dstW, int dstH, enum AVPixelFormat dstFormat,
                                int flags, const double *param)
@@ -2340,6 +2435,8 @@ void sws_freeContext(SwsContext *c)
     if (!c)
         return;
 
+    free_slice_contexts(c);
+
     for (i = 0; i < 4; i++)
         av_freep(&c->dither_error[i]);
 
@@ -379,6 +379,9 @@ av_cold void ff_sws_init_swscale_x86(SwsContext *c)
         if (EXTERNAL_AVX2_FAST(cpu_flags))
             c->yuv2planeX = yuv2yuvX_avx2;
 #endif
+        /* the C yuv2planeX() does not understand the MMX filter layout */
+        if (!EXTERNAL_MMX(cpu_flags) && !isPacked(c->dstFormat))
+            c->use_mmx_vfilter = 0;
     }
 
 #define ASSIGN_SCALE_FUNC2(hscalefn, filtersize, opt1, opt2) do { \
@@ -139,6 +139,13 @@ framecrc(){
     ffmpeg "$@" -bitexact -f framecrc -
 }
 
+# print the final -stats_json report with the measured times replaced by 0
+stats_json(){
+    ffmpeg "$@" -stats_json - -f null - | grep '"final":true' |
+        sed -e 's/"time":[0-9.]*/"time":0/' -e 's/"interval":[0-9.]*/"interval":0/' \
+            -e 's/"rate":[0-9.]*/"rate":0/g' -e 's/"\([a-z0-9]*_us\)":[0-9]*/"\1":0/g'
+}
+
 ffmetadata(){
     ffmpeg "$@" -bitexact -f ffmetadata -
 }
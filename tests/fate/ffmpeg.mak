@@ -41,6 +41,16 @@ fate-ffmpeg-filter_colorkey: CMD = framecrc -auto_conversion_filters -idct simpl
 FATE_FFMPEG-$(CONFIG_COLOR_FILTER) += fate-ffmpeg-lavfi
 fate-ffmpeg-lavfi: CMD = framecrc -lavfi color=d=1:r=5 -fflags +bitexact
 
+# the output with encoder threads must be identical to the serial one
+FFMPEG_OUTPUT_THREADS = -auto_conversion_filters -filter_complex "color=d=1:r=25:s=320x240,split[v0][v1];aevalsrc=sin(440*2*PI*t):d=1[a]" -map "[v0]" -map "[v1]" -map "[a]" -c:v mpeg4 -bf:v 2 -qscale:v 2 -s:v:1 160x120 -c:a pcm_s16le -sws_flags +accurate_rnd+bitexact -flags +bitexact -fflags +bitexact
+FATE_FFMPEG-$(call ALLYES, COLOR_FILTER SPLIT_FILTER SCALE_FILTER AEVALSRC_FILTER MPEG4_ENCODER PCM_S16LE_ENCODER) += fate-ffmpeg-output_threads fate-ffmpeg-output_threads-serial
+fate-ffmpeg-output_threads: CMD = framecrc -output_thread_queue_size 2 $(FFMPEG_OUTPUT_THREADS)
+fate-ffmpeg-output_threads-serial: CMD = framecrc $(FFMPEG_OUTPUT_THREADS)
+fate-ffmpeg-output_threads-serial: REF = $(SRC_PATH)/tests/ref/fate/ffmpeg-output_threads
+
+FATE_FFMPEG-$(call ALLYES, LAVFI_INDEV TESTSRC_FILTER HFLIP_FILTER RAWVIDEO_DECODER WRAPPED_AVFRAME_ENCODER NULL_MUXER) += fate-ffmpeg-stats_json
+fate-ffmpeg-stats_json: CMD = stats_json -f lavfi -i testsrc=d=1:r=10:s=64x64 -vf hflip -c:v wrapped_avframe
+
 FATE_SAMPLES_FFMPEG-$(CONFIG_RAWVIDEO_DEMUXER) += fate-force_key_frames
 fate-force_key_frames: tests/data/vsynth_lena.yuv
 fate-force_key_frames: CMD = enc_dec \
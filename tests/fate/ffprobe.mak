@@ -29,6 +29,18 @@ FATE_FFPROBE-$(CONFIG_AVDEVICE) += fate-ffprobe_xml
 fate-ffprobe_xml: $(FFPROBE_TEST_FILE)
 fate-ffprobe_xml: CMD = run $(FFPROBE_COMMAND) -of xml
 
+# -fflags fastprobe must give the same stream parameters as the full probe
+FFPROBE_STREAMS_COMMAND=ffprobe$(PROGSSUF)$(EXESUF) -show_streams -bitexact $(TARGET_PATH)/$(FFPROBE_TEST_FILE) -print_filename $(FFPROBE_TEST_FILE)
+
+FATE_FFPROBE-$(CONFIG_AVDEVICE) += fate-ffprobe_streams
+fate-ffprobe_streams: $(FFPROBE_TEST_FILE)
+fate-ffprobe_streams: CMD = run $(FFPROBE_STREAMS_COMMAND)
+
+FATE_FFPROBE-$(CONFIG_AVDEVICE) += fate-ffprobe_streams_fastprobe
+fate-ffprobe_streams_fastprobe: $(FFPROBE_TEST_FILE)
+fate-ffprobe_streams_fastprobe: CMD = run $(FFPROBE_STREAMS_COMMAND) -fflags fastprobe
+fate-ffprobe_streams_fastprobe: REF = $(SRC_PATH)/tests/ref/fate/ffprobe_streams
+
 FATE_FFPROBE += $(FATE_FFPROBE-yes)
 
 fate-ffprobe: $(FATE_FFPROBE)
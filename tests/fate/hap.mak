@@ -70,3 +70,52 @@ FATE_SAMPLES_FFMPEG-$(call ALLYES, MOV_DEMUXER HAPQA_EXTRACT_BSF MOV_MUXER) += $
 FATE_SAMPLES_FFPROBE += $(FATE_HAPQA_EXTRACT_BSF_FFPROBE)
 
 fate-hapqa-extract-bsf: $(FATE_HAPQA_EXTRACT_BSF) $(FATE_HAPQA_EXTRACT_BSF_FFPROBE)
+
+
+#Test encoding, the slice-threaded output must match the single-threaded reference
+fate-hapenc-%: CMD = framemd5 -f image2 -c:v pgmyuv -i $(TARGET_PATH)/tests/vsynth1/%02d.pgm -frames:v 5 -c:v hap -compressor none -sws_flags +accurate_rnd+bitexact ${OPTS} -pix_fmt rgba -vf scale
+
+FATE_HAPENC += fate-hapenc-hap-none
+fate-hapenc-hap-none: OPTS = -format hap
+
+FATE_HAPENC += fate-hapenc-hapa-none
+fate-hapenc-hapa-none: OPTS = -format hap_alpha
+
+FATE_HAPENC += fate-hapenc-hapq-none
+fate-hapenc-hapq-none: OPTS = -format hap_q
+
+FATE_HAPENC += fate-hapenc-hap-none-threads
+fate-hapenc-hap-none-threads: OPTS = -format hap -threads 4
+fate-hapenc-hap-none-threads: REF = $(SRC_PATH)/tests/ref/fate/hapenc-hap-none
+
+FATE_HAPENC += fate-hapenc-hapa-none-threads
+fate-hapenc-hapa-none-threads: OPTS = -format hap_alpha -threads 4
+fate-hapenc-hapa-none-threads: REF = $(SRC_PATH)/tests/ref/fate/hapenc-hapa-none
+
+FATE_HAPENC += fate-hapenc-hapq-none-threads
+fate-hapenc-hapq-none-threads: OPTS = -format hap_q -threads 4
+fate-hapenc-hapq-none-threads: REF = $(SRC_PATH)/tests/ref/fate/hapenc-hapq-none
+
+#The snappy chunks are compressed by slice threads, compare with the single-threaded output of the same build
+HAPENC_SNAPPY_ARGS = -f image2 -c:v pgmyuv -i $(TARGET_PATH)/tests/vsynth1/%02d.pgm -frames:v 5 -c:v hap -compressor snappy -chunks 4 -sws_flags +accurate_rnd+bitexact -pix_fmt rgba -vf scale
+
+define FATE_HAPENC_SNAPPY
+tests/data/hapenc-$(1)-snappy4.framemd5: TAG = GEN
+tests/data/hapenc-$(1)-snappy4.framemd5: ffmpeg$(PROGSSUF)$(EXESUF) $(VREF) | tests/data
+	$$(M)$$(TARGET_EXEC) $$(TARGET_PATH)/$$< -nostdin -noauto_conversion_filters \
+	$$(HAPENC_SNAPPY_ARGS) -format $(2) -threads 1 -bitexact -f framemd5 $$(TARGET_PATH)/$$@ -y 2>/dev/null
+
+FATE_HAPENC += fate-hapenc-$(1)-snappy4-threads
+fate-hapenc-$(1)-snappy4-threads: tests/data/hapenc-$(1)-snappy4.framemd5
+fate-hapenc-$(1)-snappy4-threads: CMD = framemd5 $$(HAPENC_SNAPPY_ARGS) -format $(2) -threads 4
+fate-hapenc-$(1)-snappy4-threads: REF = tests/data/hapenc-$(1)-snappy4.framemd5
+endef
+
+$(eval $(call FATE_HAPENC_SNAPPY,hap,hap))
+$(eval $(call FATE_HAPENC_SNAPPY,hapa,hap_alpha))
+$(eval $(call FATE_HAPENC_SNAPPY,hapq,hap_q))
+
+$(FATE_HAPENC): $(VREF)
+
+FATE_AVCONV-$(call ALLYES, IMAGE2_DEMUXER PGMYUV_DECODER HAP_ENCODER SCALE_FILTER FRAMEMD5_MUXER) += $(FATE_HAPENC)
+fate-hapenc: $(FATE_HAPENC)
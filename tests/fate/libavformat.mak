@@ -2,6 +2,49 @@
 #fate-async: libavformat/tests/async$(EXESUF)
 #fate-async: CMD = run libavformat/tests/async
 
+FATE_HLS_PREFETCH-$(HAVE_THREADS) += fate-hls-prefetch
+FATE_LIBAVFORMAT-$(call ALLYES, HLS_DEMUXER HTTP_PROTOCOL MP3_DEMUXER) += $(FATE_HLS_PREFETCH-yes)
+fate-hls-prefetch: libavformat/tests/hls_prefetch$(EXESUF)
+fate-hls-prefetch: CMD = run libavformat/tests/hls_prefetch$(EXESUF)
+fate-hls-prefetch: CMP = null
+
+FATE_DASH_PREFETCH-$(HAVE_THREADS) += fate-dash-prefetch
+FATE_LIBAVFORMAT-$(call ALLYES, DASH_DEMUXER HTTP_PROTOCOL MPEGTS_DEMUXER MPEGTS_MUXER MPEGAUDIO_PARSER) += $(FATE_DASH_PREFETCH-yes)
+fate-dash-prefetch: libavformat/tests/dash_prefetch$(EXESUF)
+fate-dash-prefetch: CMD = run libavformat/tests/dash_prefetch$(EXESUF)
+fate-dash-prefetch: CMP = null
+
+FATE_LIBAVFORMAT-$(call ALLYES, HLS_MUXER MP4_MUXER FILE_PROTOCOL) += fate-hls-parts-playlist
+fate-hls-parts-playlist: libavformat/tests/hls_parts$(EXESUF)
+fate-hls-parts-playlist: CMD = run libavformat/tests/hls_parts$(EXESUF) $(TARGET_PATH)/tests/data/fate/hls-parts-playlist.dir
+
+FATE_HLS_UPLOAD-$(HAVE_THREADS) += fate-hls-upload
+FATE_LIBAVFORMAT-$(call ALLYES, HLS_MUXER HTTP_PROTOCOL MPEGTS_MUXER) += $(FATE_HLS_UPLOAD-yes)
+fate-hls-upload: libavformat/tests/hls_upload$(EXESUF)
+fate-hls-upload: CMD = run libavformat/tests/hls_upload$(EXESUF)
+fate-hls-upload: CMP = null
+
+FATE_LIBAVFORMAT-$(call ALLYES, ASYNC_PROTOCOL HTTP_PROTOCOL) += fate-async-ranges
+fate-async-ranges: libavformat/tests/async_ranges$(EXESUF)
+fate-async-ranges: CMD = run libavformat/tests/async_ranges$(EXESUF)
+fate-async-ranges: CMP = null
+
+FATE_CACHE-$(HAVE_THREADS) += fate-cache
+FATE_LIBAVFORMAT-$(call ALLYES, CACHE_PROTOCOL FILE_PROTOCOL) += $(FATE_CACHE-yes)
+fate-cache: libavformat/tests/cache$(EXESUF)
+fate-cache: CMD = run libavformat/tests/cache$(EXESUF) $(TARGET_PATH)/tests/data/fate/cache.dir
+fate-cache: CMP = null
+
+FATE_LIBAVFORMAT-$(call ALLYES, FILE_PROTOCOL RAWVIDEO_DEMUXER RAWVIDEO_MUXER) += fate-file-mmap
+fate-file-mmap: libavformat/tests/file_mmap$(EXESUF)
+fate-file-mmap: CMD = run libavformat/tests/file_mmap$(EXESUF) $(TARGET_PATH)/tests/data/fate/file-mmap.dir
+fate-file-mmap: CMP = null
+
+FATE_LIBAVFORMAT-$(CONFIG_FILE_PROTOCOL) += fate-file-uring
+fate-file-uring: libavformat/tests/file_uring$(EXESUF)
+fate-file-uring: CMD = run libavformat/tests/file_uring$(EXESUF) $(TARGET_PATH)/tests/data/fate/file-uring.dir
+fate-file-uring: CMP = null
+
 FATE_LIBAVFORMAT-$(CONFIG_NETWORK) += fate-noproxy
 fate-noproxy: libavformat/tests/noproxy$(EXESUF)
 fate-noproxy: CMD = run libavformat/tests/noproxy$(EXESUF)
@@ -14,6 +57,12 @@ FATE_LIBAVFORMAT-$(CONFIG_SRTP) += fate-srtp
 fate-srtp: libavformat/tests/srtp$(EXESUF)
 fate-srtp: CMD = run libavformat/tests/srtp$(EXESUF)
 
+FATE_UDP_BATCH-$(HAVE_THREADS) += fate-udp-batch
+FATE_LIBAVFORMAT-$(CONFIG_UDP_PROTOCOL) += $(FATE_UDP_BATCH-yes)
+fate-udp-batch: libavformat/tests/udp_batch$(EXESUF)
+fate-udp-batch: CMD = run libavformat/tests/udp_batch$(EXESUF)
+fate-udp-batch: CMP = null
+
 FATE_LIBAVFORMAT-yes += fate-url
 fate-url: libavformat/tests/url$(EXESUF)
 fate-url: CMD = run libavformat/tests/url$(EXESUF)
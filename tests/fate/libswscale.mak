@@ -6,6 +6,16 @@ FATE_LIBSWSCALE += fate-sws-floatimg-cmp
 fate-sws-floatimg-cmp: libswscale/tests/floatimg_cmp$(EXESUF)
 fate-sws-floatimg-cmp: CMD = run libswscale/tests/floatimg_cmp$(EXESUF)
 
+FATE_LIBSWSCALE += fate-sws-ladder
+fate-sws-ladder: libswscale/tests/ladder$(EXESUF)
+fate-sws-ladder: CMD = run libswscale/tests/ladder$(EXESUF)
+fate-sws-ladder: CMP = null
+
+FATE_LIBSWSCALE += fate-sws-threads
+fate-sws-threads: libswscale/tests/threads$(EXESUF)
+fate-sws-threads: CMD = run libswscale/tests/threads$(EXESUF)
+fate-sws-threads: CMP = null
+
 FATE_LIBSWSCALE += $(FATE_LIBSWSCALE-yes)
 FATE-$(CONFIG_SWSCALE) += $(FATE_LIBSWSCALE)
 fate-libswscale: $(FATE_LIBSWSCALE)
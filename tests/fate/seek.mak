@@ -246,6 +246,35 @@ fate-seek-lavf-y4m:      SRC = lavf/lavf.y4m
 
 FATE_SEEK += $(FATE_SEEK_LAVF-yes:%=fate-seek-lavf-%)
 
+# mov demuxer compact index, must seek like the full index
+FATE_SEEK_COMPACT-$(call ENCDEC,  PCM_S16BE,             MOV)         += fate-seek-acodec-pcm-s16be-compact
+FATE_SEEK_COMPACT-$(call ENCDEC2, MPEG4,      PCM_ALAW,  MOV)         += fate-seek-lavf-mov-compact
+
+fate-seek-acodec-pcm-s16be-compact: fate-acodec-pcm-s16be
+fate-seek-acodec-pcm-s16be-compact: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/fate/acodec-pcm-s16be.mov -compact_index 1
+fate-seek-acodec-pcm-s16be-compact: REF = $(SRC_PATH)/tests/ref/seek/acodec-pcm-s16be
+fate-seek-lavf-mov-compact: fate-lavf-mov
+fate-seek-lavf-mov-compact: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/lavf/lavf.mov -compact_index 1
+fate-seek-lavf-mov-compact: REF = $(SRC_PATH)/tests/ref/seek/lavf-mov
+
+# a minute of video and audio, with several thousand samples per track so
+# that the compact index seeks across several checkpoints
+FATE_SEEK_COMPACT-$(call ALLYES, LAVFI_INDEV TESTSRC_FILTER SINE_FILTER MPEG4_ENCODER MP2FIXED_ENCODER MOV_MUXER MOV_DEMUXER) += fate-seek-mov-long fate-seek-mov-long-compact
+
+tests/data/mov-long.mov: TAG = GEN
+tests/data/mov-long.mov: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+	-f lavfi -i "testsrc=s=16x16:r=50:d=60" -f lavfi -i "sine=r=48000:d=60" \
+	-c:v mpeg4 -g 25 -c:a mp2fixed -b:a 32k -ac 1 \
+	-use_editlist 0 -flags +bitexact -fflags +bitexact -y $(TARGET_PATH)/$@ 2>/dev/null
+
+fate-seek-mov-long fate-seek-mov-long-compact: tests/data/mov-long.mov
+fate-seek-mov-long: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/mov-long.mov -duration 60
+fate-seek-mov-long-compact: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/mov-long.mov -duration 60 -compact_index 1
+fate-seek-mov-long-compact: REF = $(SRC_PATH)/tests/ref/seek/mov-long
+
+FATE_SEEK_COMPACT += $(FATE_SEEK_COMPACT-yes)
+
 # extra files
 
 FATE_SEEK_EXTRA-$(CONFIG_MP3_DEMUXER)   += fate-seek-extra-mp3
@@ -267,11 +296,11 @@ fate-seek-mkv-codec-delay:   CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_
 FATE_SEEK_EXTRA += $(FATE_SEEK_EXTRA-yes)
 
 
-$(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA): libavformat/tests/seek$(EXESUF)
+$(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA) $(FATE_SEEK_COMPACT): libavformat/tests/seek$(EXESUF)
 $(FATE_SEEK) $(FATE_SAMPLES_SEEK): CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/$(SRC)
 $(FATE_SEEK) $(FATE_SAMPLES_SEEK): fate-seek-%: fate-%
 fate-seek-%: REF = $(SRC_PATH)/tests/ref/seek/$(@:fate-seek-%=%)
 
-FATE_AVCONV += $(FATE_SEEK)
+FATE_AVCONV += $(FATE_SEEK) $(FATE_SEEK_COMPACT)
 FATE_SAMPLES_AVCONV += $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
-fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
+fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA) $(FATE_SEEK_COMPACT)
@@ -373,6 +373,23 @@ fate-xxan-wc4: CMD = framecrc -i $(TARGET_SAMPLES)/wc4-xan/wc4trailer-partial.av
 FATE_VIDEO-$(call DEMDEC, WAV, SMVJPEG) += fate-smvjpeg
 fate-smvjpeg: CMD = framecrc -idct simple -flags +bitexact -i $(TARGET_SAMPLES)/smv/clock.smv -an
 
+tests/data/mjpeg-rst.avi: TAG = GEN
+tests/data/mjpeg-rst.avi: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+	-f lavfi -i testsrc=size=352x288:rate=25:duration=0.2 -c:v mjpeg -qscale 5 \
+	-pix_fmt yuvj420p -threads 4 -thread_type slice -bitexact \
+	-y $(TARGET_PATH)/$(@) 2>/dev/null
+
+# the encoder writes a restart interval per slice, which the decoder decodes
+# in parallel with slice threads, with the same output as serially
+FATE_MJPEG_RST-$(call ALLYES, LAVFI_INDEV TESTSRC_FILTER MJPEG_ENCODER AVI_MUXER AVI_DEMUXER MJPEG_DECODER) += fate-mjpeg-rst fate-mjpeg-rst-slice-threads
+fate-mjpeg-rst fate-mjpeg-rst-slice-threads: tests/data/mjpeg-rst.avi
+fate-mjpeg-rst fate-mjpeg-rst-slice-threads: CMD = framecrc -idct simple -i $(TARGET_PATH)/tests/data/mjpeg-rst.avi
+fate-mjpeg-rst-slice-threads: THREADS = 4
+fate-mjpeg-rst-slice-threads: THREAD_TYPE = slice
+fate-mjpeg-rst-slice-threads: REF = $(SRC_PATH)/tests/ref/fate/mjpeg-rst
+FATE_FFMPEG += $(FATE_MJPEG_RST-yes)
+
 FATE_VIDEO += $(FATE_VIDEO-yes)
 
 FATE_SAMPLES_FFMPEG += $(FATE_VIDEO)
@@ -0,0 +1,160 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Measure the latency of avformat_open_input() + avformat_find_stream_info()
+ * over a corpus of files, with and without the fastprobe format flag, and
+ * report the streams whose parameters differ between both modes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "config.h"
+#if HAVE_UNISTD_H
+#include <unistd.h>             /* getopt */
+#endif
+
+#include "libavformat/avformat.h"
+#include "libavutil/time.h"
+
+#if !HAVE_GETOPT
+#include "compat/getopt.c"
+#endif
+
+static void usage(int ret)
+{
+    fprintf(ret ? stderr : stdout,
+            "Usage: probe_bench [-r runs] file ...\n"
+            "    -r runs  probe each file this many times in each mode and\n"
+            "             keep the fastest run (default 3)\n");
+    exit(ret);
+}
+
+static int probe(const char *filename, int fast, int64_t *elapsed,
+                 AVFormatContext **pavf)
+{
+    AVDictionary *opts = NULL;
+    int64_t start = av_gettime_relative();
+    int ret;
+
+    if (fast)
+        av_dict_set(&opts, "fflags", "+fastprobe", 0);
+    ret = avformat_open_input(pavf, filename, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+    ret = avformat_find_stream_info(*pavf, NULL);
+    *elapsed = av_gettime_relative() - start;
+    if (ret < 0)
+        avformat_close_input(pavf);
+    return ret;
+}
+
+static int same_parameters(const AVCodecParameters *a,
+                           const AVCodecParameters *b)
+{
+    return a->codec_type     == b->codec_type     &&
+           a->codec_id       == b->codec_id       &&
+           a->format         == b->format         &&
+           a->width          == b->width          &&
+           a->height         == b->height         &&
+           a->sample_rate    == b->sample_rate    &&
+           a->channels       == b->channels       &&
+           a->channel_layout == b->channel_layout &&
+           a->profile        == b->profile;
+}
+
+int main(int argc, char **argv)
+{
+    int opt, i, fast, run, nb_runs = 3, nb_files = 0, nb_diff = 0;
+    int64_t total[2] = { 0 };
+
+    while ((opt = getopt(argc, argv, "hr:")) != -1) {
+        switch (opt) {
+        case 'r':
+            nb_runs = atoi(optarg);
+            if (nb_runs < 1)
+                usage(1);
+            break;
+        case 'h':
+            usage(0);
+        default:
+            usage(1);
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (!argc)
+        usage(1);
+
+    av_log_set_level(AV_LOG_ERROR);
+
+    printf("%10s %10s  %s\n", "normal_us", "fast_us", "file");
+    for (i = 0; i < argc; i++) {
+        AVFormatContext *avf[2] = { NULL };
+        int64_t best[2] = { INT64_MAX, INT64_MAX };
+        int ret = 0, st;
+
+        for (run = 0; run < nb_runs && ret >= 0; run++) {
+            for (fast = 0; fast < 2 && ret >= 0; fast++) {
+                int64_t elapsed;
+
+                avformat_close_input(&avf[fast]);
+                ret = probe(argv[i], fast, &elapsed, &avf[fast]);
+                if (ret >= 0 && elapsed < best[fast])
+                    best[fast] = elapsed;
+            }
+        }
+        if (ret < 0) {
+            fprintf(stderr, "%s: %s\n", argv[i], av_err2str(ret));
+            avformat_close_input(&avf[0]);
+            avformat_close_input(&avf[1]);
+            continue;
+        }
+
+        printf("%10"PRId64" %10"PRId64"  %s\n", best[0], best[1], argv[i]);
+        total[0] += best[0];
+        total[1] += best[1];
+        nb_files++;
+
+        if (avf[0]->nb_streams != avf[1]->nb_streams) {
+            printf("  stream count differs: %u / %u\n",
+                   avf[0]->nb_streams, avf[1]->nb_streams);
+            nb_diff++;
+        } else {
+            for (st = 0; st < avf[0]->nb_streams; st++) {
+                if (!same_parameters(avf[0]->streams[st]->codecpar,
+                                     avf[1]->streams[st]->codecpar)) {
+                    printf("  stream %d parameters differ\n", st);
+                    nb_diff++;
+                }
+            }
+        }
+
+        avformat_close_input(&avf[0]);
+        avformat_close_input(&avf[1]);
+    }
+
+    if (nb_files)
+        printf("%d files, average %"PRId64" us normal, %"PRId64" us fast (%.1fx), "
+               "%d differences\n", nb_files, total[0] / nb_files,
+               total[1] / nb_files, (double)total[0] / FFMAX(total[1], 1), nb_diff);
+
+    return nb_files ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Measure the throughput of the udp protocol over the loopback interface,
+ * with one datagram per system call and with batches, and report the
+ * datagrams per second and the CPU time spent per Gbit in both modes.
+ *
+ * The sender thread and the receiver thread of the protocol run at the same
+ * time; the receiver keeps the datagrams in its circular buffer until the
+ * sender is done, then they are counted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "config.h"
+#if HAVE_UNISTD_H
+#include <unistd.h>             /* getopt */
+#endif
+#if HAVE_GETRUSAGE
+#include <sys/resource.h>
+#endif
+
+#include "libavformat/avformat.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/time.h"
+
+#if !HAVE_GETOPT
+#include "compat/getopt.c"
+#endif
+
+static void usage(int ret)
+{
+    fprintf(ret ? stderr : stdout,
+            "Usage: udp_bench [-n packets] [-s size] [-b bitrate] [-B batch] [-p port]\n"
+            "    -n packets  datagrams to send in each mode (default 100000)\n"
+            "    -s size     datagram size (default 1316)\n"
+            "    -b bitrate  pacing of the sender in bits/s (default 10000000000)\n"
+            "    -B batch    datagrams per system call in batched mode (default 16)\n"
+            "    -p port     loopback port (default 12345)\n");
+    exit(ret);
+}
+
+static int64_t cpu_time(void)
+{
+#if HAVE_GETRUSAGE
+    struct rusage rusage;
+
+    getrusage(RUSAGE_SELF, &rusage);
+    return (rusage.ru_utime.tv_sec + rusage.ru_stime.tv_sec) * 1000000LL +
+           rusage.ru_utime.tv_usec + rusage.ru_stime.tv_usec;
+#else
+    return 0;
+#endif
+}
+
+static int run(int port, int nb_packets, int size, int64_t bitrate, int batch,
+               int *received, int64_t *elapsed, int64_t *cpu)
+{
+    AVIOContext *in = NULL, *out = NULL;
+    AVDictionary *opts = NULL;
+    uint8_t *buf = av_mallocz(65536);
+    char url[128];
+    int64_t start, start_cpu;
+    int i, ret;
+
+    if (!buf)
+        return AVERROR(ENOMEM);
+    *received = 0;
+
+    /* the circular buffer of the receiver holds the whole stream */
+    snprintf(url, sizeof(url), "udp://127.0.0.1:%d", port);
+    av_dict_set_int(&opts, "fifo_size", (int64_t)nb_packets * (size + 4) / 188 + 1, 0);
+    av_dict_set_int(&opts, "buffer_size", 1 << 24, 0);
+    av_dict_set_int(&opts, "batch", batch, 0);
+    av_dict_set_int(&opts, "overrun_nonfatal", 1, 0);
+    av_dict_set_int(&opts, "timeout", 200000, 0);
+    ret = avio_open2(&in, url, AVIO_FLAG_READ, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        goto end;
+
+    snprintf(url, sizeof(url), "udp://127.0.0.1:%d?pkt_size=%d", port, size);
+    av_dict_set_int(&opts, "bitrate", bitrate, 0);
+    av_dict_set_int(&opts, "fifo_size", 65536, 0);
+    av_dict_set_int(&opts, "batch", batch, 0);
+    ret = avio_open2(&out, url, AVIO_FLAG_WRITE, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        goto end;
+
+    start     = av_gettime_relative();
+    start_cpu = cpu_time();
+    for (i = 0; i < nb_packets; i++) {
+        AV_WB32(buf, i);
+        avio_write(out, buf, size);
+        avio_flush(out);
+    }
+    /* waits for the sender thread to send the queued datagrams */
+    ret = avio_closep(&out);
+    *elapsed = av_gettime_relative() - start;
+    *cpu     = cpu_time() - start_cpu;
+    if (ret < 0)
+        goto end;
+
+    /* the timeout ends the stream with an I/O error */
+    while ((ret = avio_read_partial(in, buf, 65536)) > 0)
+        (*received)++;
+    if (ret == AVERROR(EIO) || ret == AVERROR_EOF)
+        ret = 0;
+
+end:
+    avio_closep(&out);
+    avio_closep(&in);
+    av_free(buf);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int opt, mode, nb_packets = 100000, size = 1316, batch = 16, port = 12345;
+    int64_t bitrate = 10000000000;
+
+    while ((opt = getopt(argc, argv, "hn:s:b:B:p:")) != -1) {
+        switch (opt) {
+        case 'n':
+            nb_packets = atoi(optarg);
+            if (nb_packets < 1)
+                usage(1);
+            break;
+        case 's':
+            size = atoi(optarg);
+            if (size < 4 || size > 65507)
+                usage(1);
+            break;
+        case 'b':
+            bitrate = strtoll(optarg, NULL, 10);
+            if (bitrate < 1)
+                usage(1);
+            break;
+        case 'B':
+            batch = atoi(optarg);
+            if (batch < 1 || batch > 1024)
+                usage(1);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'h':
+            usage(0);
+        default:
+            usage(1);
+        }
+    }
+
+    av_log_set_level(AV_LOG_ERROR);
+    avformat_network_init();
+
+    printf("%6s %10s %8s %10s %8s\n", "batch", "packets/s", "lost", "Mbit/s", "cpu_s/Gb");
+    for (mode = 0; mode < 2; mode++) {
+        int b = mode ? batch : 1, received;
+        int64_t elapsed, cpu;
+        double bits;
+        int ret = run(port, nb_packets, size, bitrate, b, &received, &elapsed, &cpu);
+
+        if (ret < 0) {
+            fprintf(stderr, "batch %d: %s\n", b, av_err2str(ret));
+            return 1;
+        }
+        bits = (double)received * size * 8;
+        printf("%6d %10.0f %8d %10.1f %8.3f\n", b,
+               received * 1000000.0 / FFMAX(elapsed, 1), nb_packets - received,
+               bits / FFMAX(elapsed, 1), bits ? cpu / 1000000.0 / (bits / 1e9) : 0);
+    }
+
+    avformat_network_deinit();
+    return 0;
+}